@@ -91,6 +91,17 @@ typedef struct gdriver_sim_descr
     gdriver_tgen_t tgen;
 
     uint32_t packets_processed;
+
+    char *stats_path;
+
+    // default L1 copy size of the execution contexts (--l1-copy-size)
+    uint32_t l1_copy_size;
+
+    // stateless execution contexts (--stateless)
+    uint32_t stateless;
+
+    // packets can be lost or duplicated: do not check the feedback count
+    int is_impaired;
 } gdriver_sim_descr_t;
 
 static gdriver_sim_descr_t sim_state;
@@ -264,6 +275,10 @@ static void ectx_set_mems(gdriver_ectx_t *gectx, uint32_t gectx_id) {
         gectx->ectx.scratchpad_size[i] = SCRATCHPAD_EC_CHUNK_SIZE;
         assert(gectx->ectx.scratchpad_addr[i] < (SCRATCHPAD_REL_ADDR + SCRATCHPAD_SIZE));
     }
+
+    // drivers can change it after gdriver_get_ectx_mems
+    gectx->ectx.l1_copy_size = sim_state.l1_copy_size;
+    gectx->ectx.stateless = sim_state.stateless;
 }
 
 static int gdriver_init_ectx(gdriver_ectx_t *gectx, uint32_t gectx_id,
@@ -374,9 +389,19 @@ int gdriver_run()
 
 int gdriver_fini()
 {
+    if (sim_state.stats_path != NULL) {
+        size_t len = strlen(sim_state.stats_path);
+        pspinsim_stats_format_t format = (len >= 4 && !strcmp(sim_state.stats_path + len - 4, ".csv")) ? PSPINSIM_STATS_CSV : PSPINSIM_STATS_JSON;
+        if (pspinsim_stats_dump(sim_state.stats_path, format) != SPIN_SUCCESS)
+            return GDRIVER_ERR;
+    }
+
     if (pspinsim_fini() != SPIN_SUCCESS)
         return GDRIVER_ERR;
 
+    if (sim_state.is_impaired)
+        return GDRIVER_OK;
+
     if (sim_state.is_trace && sim_state.ttrace.packets_parsed != sim_state.packets_processed)
         return GDRIVER_ERR;
 
@@ -402,6 +427,56 @@ int gdriver_init(int argc, char **argv, match_packet_fun_t matching_cb, int *ect
 
     pspinsim_default_conf(&conf);
     conf.slm_files_path = SLM_FILES;
+    conf.trace_conf.start_cycle = ai.waves_start_arg;
+    conf.trace_conf.stop_cycle = ai.waves_stop_arg;
+    conf.trace_conf.trigger_msgid = ai.waves_msgid_arg;
+    conf.trace_conf.trigger_feedback = ai.waves_feedback_arg;
+    conf.trace_conf.trigger_pc = ai.waves_pc_arg;
+    if (strcmp(ai.chrome_trace_arg, MAGIC_PATH))
+        conf.chrome_trace_file = ai.chrome_trace_arg;
+    if (strcmp(ai.msg_stats_arg, MAGIC_PATH))
+        conf.msg_stats_file = ai.msg_stats_arg;
+    conf.hpu_util_interval = ai.hpu_util_interval_arg;
+    if (strcmp(ai.hpu_util_arg, MAGIC_PATH))
+        conf.hpu_util_file = ai.hpu_util_arg;
+    if (strcmp(ai.perf_samples_arg, MAGIC_PATH))
+        conf.perf_samples_file = ai.perf_samples_arg;
+    conf.ni_conf.impair.seed = ai.impair_seed_arg;
+    conf.ni_conf.impair.drop_prob = ai.loss_arg;
+    conf.ni_conf.impair.dup_prob = ai.dup_arg;
+    conf.ni_conf.impair.reorder_prob = ai.reorder_arg;
+    conf.ni_conf.impair.reorder_window = ai.reorder_window_arg;
+    conf.ni_conf.impair.ge_p = ai.burst_loss_p_arg;
+    conf.ni_conf.impair.ge_r = ai.burst_loss_r_arg;
+    conf.ni_conf.impair.ge_loss_bad = ai.burst_loss_bad_arg;
+    conf.ni_conf.ingress.mode = (ni_ingress_mode_t) ai.ingress_mode_arg;
+    conf.ni_conf.ingress.buffer_size = ai.ingress_buffer_arg;
+    conf.ni_conf.ingress.xoff_threshold = ai.ingress_xoff_arg;
+    conf.ni_conf.ingress.xon_threshold = ai.ingress_xon_arg;
+    conf.ni_conf.ingress.num_priorities = ai.ingress_priorities_arg;
+    conf.ni_conf.ingress.prio_offset = ai.ingress_prio_offset_arg;
+    conf.ni_conf.ingress.prio_shift = ai.ingress_prio_shift_arg;
+    conf.no_conf.num_ports = ai.egress_ports_arg;
+    conf.no_conf.num_tcs = ai.egress_classes_arg;
+    conf.no_conf.sched_policy = (no_sched_policy_t) ai.egress_sched_arg;
+    conf.no_conf.pkt_format = (no_pkt_format_t) ai.pkt_format_arg;
+    conf.no_conf.icrc = ai.icrc_flag;
+    conf.pcie_slv_conf.model = (pcie_model_t) ai.pcie_model_arg;
+    conf.pcie_slv_conf.tlp.mps = ai.pcie_mps_arg;
+    conf.pcie_slv_conf.tlp.mrrs = ai.pcie_mrrs_arg;
+    conf.pcie_slv_conf.tlp.max_read_tags = ai.pcie_tags_arg;
+    conf.pcie_slv_conf.tlp.latency = ai.pcie_latency_arg;
+    conf.pcie_slv_conf.tlp.cpl_jitter = ai.pcie_cpl_jitter_arg;
+    if (strcmp(ai.handler_profile_arg, MAGIC_PATH))
+        conf.handler_profile_file = ai.handler_profile_arg;
+    conf.sched_model.enabled = ai.sched_model_flag;
+    conf.sched_model.policy = (sched_model_policy_t) ai.sched_policy_arg;
+    conf.sched_model.home_min_free = ai.sched_home_min_free_arg;
+    conf.sched_model.num_clusters = ai.sched_clusters_arg;
+    conf.sched_model.num_cores = ai.sched_cores_arg;
+    if (strcmp(ai.sched_profile_arg, MAGIC_PATH))
+        conf.sched_model.handler_profile = ai.sched_profile_arg;
+    conf.sched_model.cycles_per_ns = ai.sched_cycles_per_ns_arg;
 
     pspinsim_init(argc, argv, &conf);
 
@@ -410,6 +485,15 @@ int gdriver_init(int argc, char **argv, match_packet_fun_t matching_cb, int *ect
 
     memset(&sim_state, 0, sizeof(sim_state));
 
+    if (strcmp(ai.stats_arg, MAGIC_PATH))
+        sim_state.stats_path = ai.stats_arg;
+
+    sim_state.l1_copy_size = ai.l1_copy_size_arg;
+    sim_state.stateless = ai.stateless_flag;
+
+    sim_state.is_impaired = ai.loss_arg > 0 || ai.dup_arg > 0 || ai.burst_loss_p_arg > 0 ||
+        ai.ingress_mode_arg == ingress_mode_arg_taildrop || ai.ingress_mode_arg == ingress_mode_arg_red;
+
     if (ai.interactive_given) {
         sim_state.is_interactive = 1;
     } else {
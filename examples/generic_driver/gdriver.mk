@@ -8,20 +8,55 @@ all::
 
 SPIN_DRIVER_CC ?= gcc
 
+# the driver links the simulation library built with the same CLUSTERS and CORES
+include $(PSPIN_HW)/pspin_conf.mk
+
 driver: driver/driver.c ../generic_driver/gdriver_args.c ../generic_driver/gdriver.c
-	 $(SPIN_DRIVER_CC) -std=c99 -I../generic_driver/ -I$(PSPIN_RT)/runtime/include/ -I$(PSPIN_HW)/verilator_model/include $(SPIN_DRIVER_CFLAGS) driver/driver.c ../generic_driver/gdriver.c ../generic_driver/gdriver_args.c -L$(PSPIN_HW)/verilator_model/lib/ -lpspin $(SPIN_DRIVER_LDFLAGS) -o sim_${SPIN_APP_NAME}
+	 $(SPIN_DRIVER_CC) -std=c99 -I../generic_driver/ -I$(PSPIN_RT)/runtime/include/ -I$(PSPIN_HW)/verilator_model/include $(PSPIN_CONF_CFLAGS) $(SPIN_DRIVER_CFLAGS) driver/driver.c ../generic_driver/gdriver.c ../generic_driver/gdriver_args.c -L$(PSPIN_HW)/verilator_model/lib/ -lpspin$(PSPIN_CONF_SUFFIX) $(SPIN_DRIVER_LDFLAGS) -o sim_${SPIN_APP_NAME}
 
 driver_debug: driver/driver.c ../generic_driver/gdriver_args.c
-	 $(SPIN_DRIVER_CC) -g -std=c99 -I../generic_driver/ -I$(PSPIN_RT)/runtime/include/ -I$(PSPIN_HW)/verilator_model/include $(SPIN_DRIVER_CFLAGS) driver/driver.c ../generic_driver/gdriver.c ../generic_driver/gdriver_args.c -L$(PSPIN_HW)/verilator_model/lib/ -lpspin_debug $(SPIN_DRIVER_LDFLAGS) -o sim_${SPIN_APP_NAME}_debug
+	 $(SPIN_DRIVER_CC) -g -std=c99 -I../generic_driver/ -I$(PSPIN_RT)/runtime/include/ -I$(PSPIN_HW)/verilator_model/include $(PSPIN_CONF_CFLAGS) $(SPIN_DRIVER_CFLAGS) driver/driver.c ../generic_driver/gdriver.c ../generic_driver/gdriver_args.c -L$(PSPIN_HW)/verilator_model/lib/ -lpspin_debug$(PSPIN_CONF_SUFFIX) $(SPIN_DRIVER_LDFLAGS) -o sim_${SPIN_APP_NAME}_debug
+
+# handlers built for the host and run by libpspin_native.so (see handler_profiler.h)
+native: driver/driver.c ../generic_driver/gdriver_args.c ../generic_driver/gdriver.c
+	@mkdir -p build/
+	 $(SPIN_DRIVER_CC) -DHOST -fPIC -shared -O2 -g -I$(PSPIN_RT)/runtime/include/ $(PSPIN_CONF_RT_CFLAGS) $(filter -D%,$(SPIN_CFLAGS)) $(SPIN_APP_SRCS) -o build/$(SPIN_APP_NAME).so
+	 $(SPIN_DRIVER_CC) -std=c99 -I../generic_driver/ -I$(PSPIN_RT)/runtime/include/ -I$(PSPIN_HW)/verilator_model/include $(PSPIN_CONF_CFLAGS) $(SPIN_DRIVER_CFLAGS) driver/driver.c ../generic_driver/gdriver.c ../generic_driver/gdriver_args.c -L$(PSPIN_HW)/verilator_model/lib/ -lpspin_native$(PSPIN_CONF_SUFFIX) $(SPIN_DRIVER_LDFLAGS) -o native_${SPIN_APP_NAME}
+
+# Scheduler model check: the same run on the RTL library (sim_*) and on the
+# scheduler model of the native library (native_*), with the handler durations
+# of the RTL run. MODEL_CHECK_POLICY must match the SCHED_POLICY of the RTL
+# library (0: home, 1: space-aware, 2: two-choice). It fails if the error of
+# the model on the average packet latency or on the feedback throughput is
+# above MODEL_CHECK_TOLERANCE percent.
+MODEL_CHECK_ARGS ?=
+MODEL_CHECK_POLICY ?= home
+MODEL_CHECK_TOLERANCE ?= 10
+model-check::
+	@mkdir -p build/
+	./sim_${SPIN_APP_NAME} $(MODEL_CHECK_ARGS) --handler-profile=build/handler_profile.csv > model_check_rtl.log
+	./native_${SPIN_APP_NAME} $(MODEL_CHECK_ARGS) --sched-model --sched-clusters=$(CLUSTERS) --sched-cores=$(CORES) --sched-policy=$(MODEL_CHECK_POLICY) --sched-profile=build/handler_profile.csv > model_check_model.log
+	@echo "RTL:" && grep -E "Feedback throughput|Packet latency" model_check_rtl.log
+	@echo "Model:" && grep -E "Feedback throughput|Packet latency \(cycles\)" model_check_model.log
+	@awk -v tol=$(MODEL_CHECK_TOLERANCE) ' \
+		/Feedback throughput:/ { tput[FILENAME] = $$3 } \
+		/Packet latency/ { for (i = 1; i < NF; i++) if ($$i == "avg:") { lat[FILENAME] = $$(i + 1) + 0 } } \
+		function err(m, r) { return (r > 0) ? 100 * (m > r ? m - r : r - m) / r : 100 } \
+		END { \
+			r = "model_check_rtl.log"; m = "model_check_model.log"; \
+			et = err(tput[m], tput[r]); el = err(lat[m], lat[r]); \
+			printf "Model error: throughput %.1f%%; packet latency %.1f%% (tolerance: %s%%)\n", et, el, tol; \
+			exit (et > tol || el > tol) }' model_check_rtl.log model_check_model.log
 
 clean::
 	-@rm *.log 2>/dev/null || true
 	-@rm -r build/ 2>/dev/null || true
-	-@rm -r waves.vcd 2>/dev/null || true
+	-@rm -r waves.vcd waves.fst 2>/dev/null || true
 	-@rm sim_${SPIN_APP_NAME} 2>/dev/null || true
 	-@rm sim_${SPIN_APP_NAME}_debug 2>/dev/null || true
+	-@rm native_${SPIN_APP_NAME} 2>/dev/null || true
 
 run::
 	./sim_${SPIN_APP_NAME} | tee transcript
 
-.PHONY: driver driver_debug clean run
+.PHONY: driver driver_debug native clean run model-check
@@ -0,0 +1,90 @@
+// Copyright 2020 ETH Zurich
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <handler.h>
+
+// alloc/free rounds per packet
+#ifndef ROUNDS
+#define ROUNDS 16
+#endif
+
+// blocks live at the same time per HPU (16 B and 32 B)
+#ifndef BATCH
+#define BATCH 8
+#endif
+
+#define ALLOC_COUNTER 0
+#define FREE_COUNTER 1
+#define FAILED_COUNTER 2
+
+__handler__ void l1_alloc_bench_ph(handler_args_t *args) {
+  void *blocks[BATCH];
+  uint32_t alloc_cycles = 0, free_cycles = 0, failed = 0;
+
+  for (int r = 0; r < ROUNDS; ++r) {
+    uint32_t start = cycles();
+    for (int i = 0; i < BATCH; ++i) {
+      blocks[i] = l1_malloc(16 << ((args->hpu_id + r + i) & 1));
+    }
+    uint32_t mid = cycles();
+
+    // the other HPUs allocate in the meantime; free in a different order
+    for (int i = 0; i < BATCH; i += 2) {
+      l1_free(blocks[i]);
+    }
+    for (int i = 1; i < BATCH; i += 2) {
+      l1_free(blocks[i]);
+    }
+    uint32_t end = cycles();
+
+    for (int i = 0; i < BATCH; ++i) {
+      if (blocks[i] == NULL)
+        failed++;
+    }
+
+    alloc_cycles += mid - start;
+    free_cycles += end - mid;
+  }
+
+  // the cycles() ecalls are included (one per BATCH operations)
+  amo_add(&__host_data.counters[ALLOC_COUNTER].count, ROUNDS * BATCH);
+  amo_add(&__host_data.counters[ALLOC_COUNTER].sum, alloc_cycles);
+  amo_add(&__host_data.counters[FREE_COUNTER].count, ROUNDS * BATCH);
+  amo_add(&__host_data.counters[FREE_COUNTER].sum, free_cycles);
+  amo_add(&__host_data.counters[FAILED_COUNTER].sum, failed);
+}
+
+__handler__ void l1_alloc_bench_th(handler_args_t *args) {
+  volatile struct perf_counter *c = __host_data.counters;
+
+  printf("l1_alloc_bench: %lu allocs: %lu cycles/alloc; %lu frees: %lu "
+         "cycles/free; %lu failed allocs\n",
+         c[ALLOC_COUNTER].count, c[ALLOC_COUNTER].sum / c[ALLOC_COUNTER].count,
+         c[FREE_COUNTER].count, c[FREE_COUNTER].sum / c[FREE_COUNTER].count,
+         c[FAILED_COUNTER].sum);
+
+  for (int i = 0; i < L1_ALLOC_NUM_CLASSES; ++i) {
+    printf("l1_alloc_bench: cluster %lu class %d: %lu free blocks\n",
+           args->cluster_id, i, l1_alloc_free_blocks(i));
+  }
+}
+
+void init_handlers(handler_fn *hh, handler_fn *ph, handler_fn *th,
+                   void **handler_mem_ptr) {
+  volatile handler_fn handlers[] = {NULL, l1_alloc_bench_ph,
+                                    l1_alloc_bench_th};
+  *hh = handlers[0];
+  *ph = handlers[1];
+  *th = handlers[2];
+}
@@ -0,0 +1,74 @@
+// Copyright 2020 ETH Zurich
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string.h>
+#include <stdio.h>
+
+#include "gdriver.h"
+
+// Arbitration parameters of the two tenants (see MPQ_ARB in hw/verilator_model/Makefile).
+// The quantum is in tasks per round with WRR and in bytes per round with DRR (0: default).
+#ifndef BULK_QUANTUM
+#define BULK_QUANTUM 0
+#endif
+
+#ifndef CTRL_QUANTUM
+#define CTRL_QUANTUM 0
+#endif
+
+// 1: control messages are served before the bulk ones
+#ifndef CTRL_PRIO
+#define CTRL_PRIO 1
+#endif
+
+#define BULK_SRC_ADDR "192.168.0.0"
+#define CTRL_SRC_ADDR "192.168.0.1"
+
+int match_ectx_cb(char *arg1, char *arg2)
+{
+    const char *src_addr = arg1; // source address of the packet in the trace
+    const char *ectx_match_addr = arg2;
+
+    return !strcmp(src_addr, ectx_match_addr);
+}
+
+static int add_tenant(const char *ph, const char *src_addr, uint32_t quantum, uint32_t prio)
+{
+    spin_ec_t *ec = gdriver_get_ectx_mems();
+
+    ec->sched_quantum = quantum;
+    ec->sched_prio = prio;
+
+    return gdriver_add_ectx("build/multi_tenant", NULL, ph, NULL, NULL,
+        NULL, 0, (void *)src_addr, strlen(src_addr) + 1);
+}
+
+int main(int argc, char **argv)
+{
+    int ectx_num;
+
+    if (gdriver_init(argc, argv, match_ectx_cb, &ectx_num) != GDRIVER_OK)
+        return EXIT_FAILURE;
+
+    if (add_tenant("bulk_ph", BULK_SRC_ADDR, BULK_QUANTUM, 0) != GDRIVER_OK)
+        return EXIT_FAILURE;
+
+    if (add_tenant("ctrl_ph", CTRL_SRC_ADDR, CTRL_QUANTUM, CTRL_PRIO) != GDRIVER_OK)
+        return EXIT_FAILURE;
+
+    if (gdriver_run() != GDRIVER_OK)
+        return EXIT_FAILURE;
+
+    return (gdriver_fini() == GDRIVER_OK) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,59 @@
+// Copyright 2020 ETH Zurich
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef HOST
+#include <handler.h>
+#include <packets.h>
+#include <spin_dma.h>
+#else
+#include <handler_profiler.h>
+#endif
+
+// Two tenants share the clusters: a bulk tenant with long messages of full
+// packets that are checksummed and copied to the host, and a control tenant
+// with single-packet messages that only update a counter.
+
+__handler__ void bulk_ph(handler_args_t *args)
+{
+    task_t *task = args->task;
+    ip_hdr_t *ip_hdr = (ip_hdr_t *)task->pkt_mem;
+    uint32_t *pld = (uint32_t *)task->pkt_mem;
+    uint32_t len = ip_hdr->length;
+    uint32_t csum = 0;
+    spin_cmd_t dma;
+
+    for (uint32_t i = 0; i < len / sizeof(uint32_t); i++)
+        csum += pld[i];
+
+    uint64_t host_address = task->host_mem_high;
+    host_address = (host_address << 32) | (task->host_mem_low);
+    spin_dma_to_host(host_address, (uint32_t)task->pkt_mem, len, 1, &dma);
+
+    amo_add((volatile int32_t *)task->handler_mem, (int32_t)csum);
+}
+
+__handler__ void ctrl_ph(handler_args_t *args)
+{
+    task_t *task = args->task;
+
+    amo_add((volatile int32_t *)task->handler_mem, 1);
+}
+
+void init_handlers(handler_fn *hh, handler_fn *ph, handler_fn *th, void **handler_mem_ptr)
+{
+    volatile handler_fn handlers[] = {NULL, bulk_ph, NULL};
+    *hh = handlers[0];
+    *ph = handlers[1];
+    *th = handlers[2];
+}
@@ -14,6 +14,7 @@
 
 #include <stdint.h>
 #include "gdriver.h"
+#include "../handlers/ooorb.h"
 
 static uint32_t seqnum;
 
@@ -25,16 +26,15 @@ uint32_t fill_packet(uint32_t msg_idx, uint32_t pkt_idx, uint8_t *pkt_buff, uint
 
     int_buf[0] = 10;
 
-    uint32_t range_size = 10;
-    if (pkt_idx <= 10)
+    if (pkt_idx < NUM_RANGES)
     {
-        int_buf[0] = 0;
-        int_buf[1] = pkt_idx*range_size;
-        int_buf[2] = (pkt_idx+1)*range_size - 1;
+        int_buf[0] = OP_INSERT;
+        int_buf[1] = pkt_idx*RANGE_SIZE;
+        int_buf[2] = (pkt_idx+1)*RANGE_SIZE - 1;
     }
-    else if (pkt_idx <= 30)
+    else if (pkt_idx < NUM_RANGES + NUM_POPS)
     {
-        int_buf[0] = 1;
+        int_buf[0] = OP_POP;
     }
     return max_pkt_size;
 }
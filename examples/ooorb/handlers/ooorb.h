@@ -0,0 +1,27 @@
+// Copyright 2020 ETH Zurich
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#pragma once
+
+// packets 0..NUM_RANGES-1 insert the byte range [i * RANGE_SIZE, (i + 1) * RANGE_SIZE - 1]
+#define NUM_RANGES 11
+#define RANGE_SIZE 16
+#define MSG_BYTES (NUM_RANGES * RANGE_SIZE)
+
+// the following NUM_POPS packets pop the contiguous prefix
+#define NUM_POPS 20
+
+#define OP_INSERT 0
+#define OP_POP 1
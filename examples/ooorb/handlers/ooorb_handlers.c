@@ -16,52 +16,108 @@
 #include <handler.h>
 #include <packets.h>
 
+#include "ooorb.h"
+
+// OOORB_BITMAP selects the bitmap engine of the runtime (reasm.h) instead of
+// the lazy list, e.g., make DEFINITIONS=-DOOORB_BITMAP
+#ifndef OOORB_BITMAP
 #include "lazylist.h"
+#endif
+
+// bitmap granularity: 1 << OOORB_UNIT_SHIFT bytes
+#ifndef OOORB_UNIT_SHIFT
+#define OOORB_UNIT_SHIFT 2
+#endif
+
+#define INSERT_COUNTER 0
+#define POP_COUNTER 1
 
 typedef struct rb_state
 {
-    lazylist_t list;
     uint32_t next_expected_byte;
+#ifdef OOORB_BITMAP
+    reasm_t rb; // followed by its bitmap
+#else
+    lazylist_t list;
+#endif
 } rb_state_t;
 
+static inline void account(uint32_t counter, uint32_t start)
+{
+    uint32_t end = cycles();
+    amo_add(&__host_data.counters[counter].count, 1);
+    amo_add(&__host_data.counters[counter].sum, end - start);
+}
+
 __handler__ void ooorb_hh(handler_args_t *args) 
 {
     rb_state_t* state = (rb_state_t*) (args->task->scratchpad[0]);
 
     // This should be done on the host and then the initialized memory should be copied on the NIC
+#ifdef OOORB_BITMAP
+    reasm_init(&(state->rb), MSG_BYTES, OOORB_UNIT_SHIFT);
+#else
     lazylist_init(&(state->list), NUM_SEGMENTS);
+#endif
     state->next_expected_byte = 0;
 }
 
 __handler__ void ooorb_ph(handler_args_t *args) 
 {
     rb_state_t* state = (rb_state_t*) (args->task->scratchpad[0]);
-    lazylist_t* list = &(state->list);
-    lazylist_range_t range;
     uint32_t* pkt_info = args->task->pkt_mem;
     uint32_t op = pkt_info[0];
+    uint32_t start = cycles();
+
+#ifdef OOORB_BITMAP
+    reasm_t* rb = &(state->rb);
+
+    if (op == OP_INSERT)
+    {
+        reasm_insert(rb, pkt_info[1], pkt_info[2] - pkt_info[1] + 1);
+        account(INSERT_COUNTER, start);
+    }
+    else if (op == OP_POP)
+    {
+        // the consumer takes everything that is contiguous
+        uint32_t prefix = reasm_prefix(rb);
+        amo_maxu(&state->next_expected_byte, prefix);
+        account(POP_COUNTER, start);
+    }
+#else
+    lazylist_t* list = &(state->list);
+    lazylist_range_t range;
     range.left = pkt_info[1];
     range.right = pkt_info[2];
 
-    if (op == 0)
+    if (op == OP_INSERT)
     {
         //printf("inserting range: [%lu, %lu]\n", range.left, range.right);
         lazylist_insert(list, range);
+        account(INSERT_COUNTER, start);
     } 
-    else if (op == 1) 
+    else if (op == OP_POP) 
     {
         uint32_t popped = lazylist_pop_front(list, state->next_expected_byte, &range);
         if (popped) {
             //printf("popped range: [%lu, %lu]\n", range.left, range.right);
             state->next_expected_byte = range.right + 1;
         }
+        account(POP_COUNTER, start);
     }
+#endif
 }
 
 __handler__ void ooorb_th(handler_args_t *args) 
 {
-
     rb_state_t* state = (rb_state_t*) (args->task->scratchpad[0]);
+    volatile struct perf_counter *c = __host_data.counters;
+
+#ifdef OOORB_BITMAP
+    reasm_t* rb = &(state->rb);
+
+    printf("bitmap (%lu B units): prefix: %lu of %lu B; complete: %d\n", 1 << rb->unit_shift, reasm_prefix(rb), rb->msg_len, reasm_complete(rb));
+#else
     lazylist_t* list = &(state->list);
     lazylist_range_t range;
 
@@ -75,6 +131,14 @@ __handler__ void ooorb_th(handler_args_t *args)
         head = GET_NODE_PTR(list, head->next_idx);
         if (head->range.right == INT32_MAX) break;
     }
+#endif
+
+    // the cycles() ecall is included
+    if (c[INSERT_COUNTER].count > 0 && c[POP_COUNTER].count > 0)
+    {
+        printf("%lu inserts: %lu cycles/insert; %lu pops: %lu cycles/pop\n", c[INSERT_COUNTER].count,
+            c[INSERT_COUNTER].sum / c[INSERT_COUNTER].count, c[POP_COUNTER].count, c[POP_COUNTER].sum / c[POP_COUNTER].count);
+    }
 }
 
 
@@ -85,4 +149,3 @@ void init_handlers(handler_fn * hh, handler_fn *ph, handler_fn *th, void **handl
     *ph = handlers[1];
     *th = handlers[2];
 }
-
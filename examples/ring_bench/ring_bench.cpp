@@ -0,0 +1,287 @@
+// Copyright 2020 ETH Zurich
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Host request polling benchmark: per-HPU slots (fpspin_pop_req style) vs.
+// the shared completion ring (fpspin_ring.h). HPUs are emulated by threads
+// running the same protocol as spin_host.h against a stand-in of the host
+// DMA region and of __host_data, so no FPGA is needed. Reads of the request
+// slots and MMIO writes to the NIC can be given an artificial cost.
+
+#include "fpspin_ring.h"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <getopt.h>
+
+typedef std::chrono::steady_clock bench_clock;
+
+// Same layout as fpspin_flag_t in spin_host.h
+typedef union {
+    struct {
+        uint8_t dma_id;
+        uint32_t len;
+        uint16_t hpu_id;
+    } __attribute__((packed));
+    uint64_t data;
+} flag_t;
+
+static void busy_wait_ns(uint32_t ns)
+{
+    if (ns == 0) return;
+    bench_clock::time_point end = bench_clock::now() + std::chrono::nanoseconds(ns);
+    while (bench_clock::now() < end);
+}
+
+// Host DMA region and NIC-side __host_data as seen by the emulated HPUs and host
+class HostRingStandIn
+{
+public:
+    std::vector<uint64_t> host_mem; // 8-byte words, so descriptor writes are atomic
+    std::vector<uint64_t> flag;
+    uint32_t ring_prod;
+    uint32_t ring_cons;
+    int num_hpus;
+
+    HostRingStandIn(int num_hpus)
+        : host_mem((num_hpus * FPSPIN_RING_HPU_PAGE + FPSPIN_RING_BYTES) / sizeof(uint64_t), 0), flag(num_hpus, 0), num_hpus(num_hpus)
+    {
+        ring_prod = 0;
+        ring_cons = 0;
+    }
+
+    volatile uint8_t *host_base()
+    {
+        return (volatile uint8_t *) &host_mem[0];
+    }
+
+    volatile uint64_t *flags()
+    {
+        return (volatile uint64_t *) &flag[0];
+    }
+
+    volatile uint64_t *hpu_page(int hpu)
+    {
+        return (volatile uint64_t *) (host_base() + hpu * FPSPIN_RING_HPU_PAGE);
+    }
+
+    volatile uint64_t *ring_slot(uint32_t idx)
+    {
+        return (volatile uint64_t *) (host_base() + num_hpus * FPSPIN_RING_HPU_PAGE) + FPSPIN_RING_SLOT(idx);
+    }
+
+    // HPU side: fpspin_host_req
+    void slot_req(int hpu, uint8_t dma_id, uint32_t len)
+    {
+        flag_t f;
+        f.data = 0;
+        f.dma_id = dma_id;
+        f.len = len;
+        f.hpu_id = hpu;
+        std::atomic_thread_fence(std::memory_order_release);
+        *hpu_page(hpu) = f.data;
+    }
+
+    // HPU side: fpspin_ring_host_req
+    void ring_req(int hpu, uint8_t dma_id, uint32_t len, const std::atomic<bool> &stop)
+    {
+        uint32_t idx = __atomic_fetch_add(&ring_prod, 1, __ATOMIC_RELAXED);
+        while (idx - __atomic_load_n(&ring_cons, __ATOMIC_ACQUIRE) >= FPSPIN_RING_SLOTS)
+        {
+            if (stop) return;
+            std::this_thread::yield();
+        }
+
+        fpspin_ring_desc_t desc;
+        desc.seq = FPSPIN_RING_SEQ(idx);
+        desc.dma_id = dma_id;
+        desc.hpu_id = hpu;
+        desc.len = len;
+        std::atomic_thread_fence(std::memory_order_release);
+        *ring_slot(idx) = desc.data;
+    }
+
+    // HPU side: fpspin_wait_host
+    bool wait_host(int hpu, uint8_t dma_id, const std::atomic<bool> &stop)
+    {
+        flag_t f;
+        do {
+            if (stop) return false;
+            std::this_thread::yield();
+            f.data = flags()[hpu];
+        } while (f.dma_id != dma_id);
+        return true;
+    }
+};
+
+typedef struct bench_conf
+{
+    double seconds;
+    uint32_t read_ns;   // host read of a request slot / descriptor
+    uint32_t mmio_ns;   // host write to NIC memory (response flag, doorbell)
+    uint32_t batch;     // max descriptors consumed per doorbell
+} bench_conf_t;
+
+typedef struct bench_result
+{
+    uint64_t requests;
+    uint64_t polls;
+    uint64_t doorbells;
+    double seconds;
+} bench_result_t;
+
+static void hpu_thread(HostRingStandIn *nic, int hpu, bool use_ring, std::atomic<bool> *stop, std::atomic<uint64_t> *done)
+{
+    uint8_t dma_id = 0;
+    while (!*stop)
+    {
+        dma_id++;
+        if (use_ring) nic->ring_req(hpu, dma_id, 64, *stop);
+        else nic->slot_req(hpu, dma_id, 64);
+
+        if (!nic->wait_host(hpu, dma_id, *stop)) break;
+        (*done)++;
+    }
+}
+
+// fpspin_push_resp
+static void slot_respond(HostRingStandIn *nic, int hpu, uint8_t dma_id, uint32_t len, const bench_conf_t &conf)
+{
+    flag_t f;
+    f.data = 0;
+    f.dma_id = dma_id;
+    f.len = len;
+    f.hpu_id = hpu;
+    busy_wait_ns(conf.mmio_ns);
+    std::atomic_thread_fence(std::memory_order_release);
+    nic->flags()[hpu] = f.data;
+}
+
+static bench_result_t run(int num_hpus, bool use_ring, const bench_conf_t &conf)
+{
+    HostRingStandIn nic(num_hpus);
+    std::atomic<bool> stop(false);
+    std::atomic<uint64_t> done(0);
+    bench_result_t res = {0, 0, 0, 0};
+
+    fpspin_ring_t ring;
+    fpspin_ring_init(&ring, nic.host_base(), num_hpus, nic.flags(), &nic.ring_cons);
+    std::vector<fpspin_ring_desc_t> descs(conf.batch);
+    std::vector<uint8_t> last_dma_id(num_hpus, 0);
+
+    std::vector<std::thread> hpus;
+    for (int i = 0; i < num_hpus; i++)
+    {
+        hpus.push_back(std::thread(hpu_thread, &nic, i, use_ring, &stop, &done));
+    }
+
+    bench_clock::time_point start = bench_clock::now();
+    bench_clock::time_point end = start + std::chrono::duration_cast<bench_clock::duration>(std::chrono::duration<double>(conf.seconds));
+
+    while (bench_clock::now() < end)
+    {
+        res.polls++;
+
+        if (use_ring)
+        {
+            // the first read is paid even if nothing is there
+            busy_wait_ns(conf.read_ns);
+            int n = fpspin_ring_poll(&ring, &descs[0], conf.batch);
+            if (n == 0) continue;
+
+            for (int i = 1; i < n; i++) busy_wait_ns(conf.read_ns);
+            for (int i = 0; i < n; i++)
+            {
+                busy_wait_ns(conf.mmio_ns);
+                fpspin_ring_respond(&ring, &descs[i], descs[i].len);
+            }
+
+            busy_wait_ns(conf.mmio_ns);
+            fpspin_ring_doorbell(&ring);
+            res.doorbells++;
+        }
+        else
+        {
+            for (int i = 0; i < num_hpus; i++)
+            {
+                busy_wait_ns(conf.read_ns);
+                flag_t f;
+                f.data = *nic.hpu_page(i);
+                if (f.dma_id == last_dma_id[i]) continue;
+
+                std::atomic_thread_fence(std::memory_order_acquire);
+                last_dma_id[i] = f.dma_id;
+                slot_respond(&nic, i, f.dma_id, f.len, conf);
+            }
+        }
+    }
+
+    res.seconds = std::chrono::duration<double>(bench_clock::now() - start).count();
+    res.requests = done;
+
+    stop = true;
+    for (int i = 0; i < num_hpus; i++) hpus[i].join();
+
+    return res;
+}
+
+static void usage(const char *prog)
+{
+    printf("Usage: %s [-c max_cores] [-t seconds] [-r read_ns] [-m mmio_ns] [-b batch]\n", prog);
+    printf("Prints a CSV line per mode and core count (1, 2, 4, ..., max_cores).\n");
+}
+
+int main(int argc, char **argv)
+{
+    bench_conf_t conf = {1.0, 0, 0, FPSPIN_RING_SLOTS};
+    int max_cores = 16;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "c:t:r:m:b:h")) != -1)
+    {
+        switch (opt)
+        {
+        case 'c': max_cores = atoi(optarg); break;
+        case 't': conf.seconds = atof(optarg); break;
+        case 'r': conf.read_ns = atoi(optarg); break;
+        case 'm': conf.mmio_ns = atoi(optarg); break;
+        case 'b': conf.batch = atoi(optarg); break;
+        default: usage(argv[0]); return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    if (max_cores < 1 || max_cores > 255 || conf.batch < 1)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    printf("mode,cores,requests,seconds,req_per_s,polls,doorbells\n");
+    for (int cores = 1; cores <= max_cores; cores *= 2)
+    {
+        for (int use_ring = 0; use_ring <= 1; use_ring++)
+        {
+            bench_result_t res = run(cores, use_ring, conf);
+            printf("%s,%d,%lu,%.3lf,%.0lf,%lu,%lu\n", use_ring ? "ring" : "slots", cores, res.requests, res.seconds,
+                res.requests / res.seconds, res.polls, res.doorbells);
+            fflush(stdout);
+        }
+    }
+
+    return 0;
+}
@@ -14,6 +14,7 @@
 
 #include <string.h>
 #include <stdio.h>
+#include <stdlib.h>
 
 #include "gdriver.h"
 #include "../handlers/synthetic.h"
@@ -47,6 +48,8 @@ int main(int argc, char **argv)
     params.dma_to_count = 10;
     params.dma_from_size = 64;
     params.dma_from_count = 10;
+    // commands in flight per handler (sweep-cmd-depth)
+    params.cmd_window = (getenv("CMD_WINDOW") != NULL) ? atoi(getenv("CMD_WINDOW")) : 1;
 
     if (gdriver_init(argc, argv, match_ectx_cb, &ectx_num) != GDRIVER_OK)
         return EXIT_FAILURE;
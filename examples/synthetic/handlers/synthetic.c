@@ -35,6 +35,8 @@ __handler__ void synthetic_ph(handler_args_t *args)
     uint32_t src_id;
     uint16_t src_port;
     spin_cmd_t comp;
+    int window = (params.cmd_window > 0) ? params.cmd_window : 1;
+    int outstanding = 0;
 
     for (int i = 0; i < params.loop_spin_count; i++)
 	res += i;
@@ -42,8 +44,13 @@ __handler__ void synthetic_ph(handler_args_t *args)
     if (params.dma_to_count > 0 && params.dma_to_size > 0) {
 	for (int i = 0; i < params.dma_to_count; i++) {
 	    spin_dma_to_host(host_addr, (uint32_t)payload_addr, params.dma_to_size, 1, &comp);
-	    spin_cmd_wait(comp);
+	    if (++outstanding == window) {
+		spin_cmd_wait_all();
+		outstanding = 0;
+	    }
 	}
+	spin_cmd_wait_all();
+	outstanding = 0;
     }
 
     src_id = ip_hdr->source_id;
@@ -59,8 +66,12 @@ __handler__ void synthetic_ph(handler_args_t *args)
 	    spin_dma_from_host(host_addr, (uint32_t)payload_addr, params.dma_from_size, 1, &comp);
 	    spin_cmd_wait(comp);
 	    spin_send_packet(payload_addr, payload_len, &comp);
-	    spin_cmd_wait(comp);
+	    if (++outstanding == window) {
+		spin_cmd_wait_all();
+		outstanding = 0;
+	    }
 	}
+	spin_cmd_wait_all();
     }
 }
 
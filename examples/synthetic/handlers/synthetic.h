@@ -24,4 +24,7 @@ typedef struct benchmark_params
     /* Workload 3: Read data (DMA) from host and send to the network */
     uint32_t dma_from_size;
     int dma_from_count;
+
+    /* Commands issued before waiting for all of them (1: wait for each) */
+    int cmd_window;
 } benchmark_params_t;
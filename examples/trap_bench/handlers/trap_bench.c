@@ -0,0 +1,64 @@
+// Copyright 2020 ETH Zurich
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <handler.h>
+
+// traps measured per packet
+#ifndef CALLS
+#define CALLS 32
+#endif
+
+#define CYCLES_COUNTER 0   // cycles() ecall (served by the trap vector)
+#define PERF_COUNTER 1     // perf_start() + perf_stop() (served in C)
+
+__handler__ void trap_bench_ph(handler_args_t *args) {
+  // mcycle is read in the middle of each trap: the difference between the
+  // first and the last read is CALLS round trips
+  uint32_t start = cycles();
+  for (int i = 0; i < CALLS; ++i) {
+    cycles();
+  }
+  uint32_t mid = cycles();
+
+  for (int i = 0; i < CALLS; ++i) {
+    perf_start();
+    perf_stop(i);
+  }
+  uint32_t end = cycles();
+
+  // the perf loop also includes the last cycles() trap
+  amo_add(&__host_data.counters[CYCLES_COUNTER].count, CALLS);
+  amo_add(&__host_data.counters[CYCLES_COUNTER].sum, mid - start);
+  amo_add(&__host_data.counters[PERF_COUNTER].count, CALLS);
+  amo_add(&__host_data.counters[PERF_COUNTER].sum,
+          (end - mid) - (mid - start) / CALLS);
+}
+
+__handler__ void trap_bench_th(handler_args_t *args) {
+  volatile struct perf_counter *c = __host_data.counters;
+
+  printf("trap_bench: %lu cycles() calls: %lu cycles/call; %lu "
+         "perf_start()/perf_stop() pairs: %lu cycles/pair\n",
+         c[CYCLES_COUNTER].count,
+         c[CYCLES_COUNTER].sum / c[CYCLES_COUNTER].count,
+         c[PERF_COUNTER].count, c[PERF_COUNTER].sum / c[PERF_COUNTER].count);
+}
+
+void init_handlers(handler_fn *hh, handler_fn *ph, handler_fn *th,
+                   void **handler_mem_ptr) {
+  volatile handler_fn handlers[] = {NULL, trap_bench_ph, trap_bench_th};
+  *hh = handlers[0];
+  *ph = handlers[1];
+  *th = handlers[2];
+}
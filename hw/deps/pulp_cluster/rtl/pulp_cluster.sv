@@ -458,6 +458,9 @@ module pulp_cluster
   //signal if the cluster is ready to accept tasks
   output logic                                cluster_active_o,
 
+  //free space in the L1 packet buffer
+  output pspin_cfg_pkg::pkt_buff_space_t          pkt_buff_free_space_o,
+
   //commands out
   input  logic                                cmd_ready_i,
   output logic                                cmd_valid_o,
@@ -1122,7 +1125,8 @@ module pulp_cluster
         .hpu_feedback_i        (hpu_feedback),
 
         .hpu_active_i          (hpu_active),
-        .cluster_active_o      (cluster_active_o)
+        .cluster_active_o      (cluster_active_o),
+        .pkt_buff_free_space_o (pkt_buff_free_space_o)
       );
 
 
@@ -0,0 +1,30 @@
+# Size of the PsPIN instance, shared by the simulation libraries
+# (hw/verilator_model/Makefile), the handler runtime (sw/rules/spin-rt.mk) and
+# the drivers (examples/generic_driver/gdriver.mk). Handlers and drivers must be
+# built with the same values as the library they run on, e.g.:
+#   make -C hw/verilator_model release CLUSTERS=4
+#   make -C examples/copy_to_host deploy driver CLUSTERS=4
+
+# number of clusters (power of two, >= 2, at most NUM_MPQ since the home
+# cluster of a message is given by the low bits of its MPQ)
+CLUSTERS ?= 2
+# HPUs per cluster (power of two, <= 8)
+CORES ?= 8
+
+# libraries of non-default sizes get their own name (e.g., libpspin_4x8.so)
+ifeq ($(CLUSTERS)x$(CORES),2x8)
+PSPIN_CONF_SUFFIX=
+else
+PSPIN_CONF_SUFFIX=_$(CLUSTERS)x$(CORES)
+endif
+
+# pspin_cfg_pkg.sv, pulp_cluster_cfg_pkg.sv
+PSPIN_CONF_VFLAGS=+define+PSPIN_NUM_CLUSTERS=$(CLUSTERS) +define+PSPIN_NUM_CORES=$(CORES)
+# spin_hw_conf.h (simulation libraries and drivers)
+PSPIN_CONF_CFLAGS=-DNUM_CLUSTERS=$(CLUSTERS) -DNUM_CORES=$(CORES)
+# spin_conf.h and link.ld (handlers)
+PSPIN_CONF_RT_CFLAGS=-DNB_CLUSTERS=$(CLUSTERS) -DNB_CORES=$(CORES)
+# sizeof(struct host_data) in host_data.h: one 64-bit flag per HPU, 16 perf
+# counters and the completion ring indices
+PSPIN_CONF_HOST_DATA_SIZE=$(shell echo $$((8 * $(CLUSTERS) * $(CORES) + 8 * 16 + 8)))
+PSPIN_CONF_RT_LDFLAGS=-Wl,--defsym=__rt_nb_pe=$(CORES) -Wl,--defsym=__rt_host_data_size=$(PSPIN_CONF_HOST_DATA_SIZE)
@@ -56,7 +56,10 @@ module cluster_scheduler #(
     input  logic [NUM_CORES-1:0]                        hpu_active_i,
 
     //activation signal out
-    output logic                                        cluster_active_o
+    output logic                                        cluster_active_o,
+
+    //largest packet that the L1 packet buffer can take now (to the scheduler)
+    output logic [$clog2(L1_PKT_BUFF_SIZE):0]           pkt_buff_free_space_o
 );
 
     localparam int unsigned PktBuffMemSlotSize = 64;
@@ -173,6 +176,8 @@ module cluster_scheduler #(
 
     assign cluster_active_o = (~hpu_active_i == '0);
 
+    assign pkt_buff_free_space_o = pkt_buff_free_space;
+
     assign l1_pkt_base_addr = (L1_CLUSTER_BASE + cluster_id_i * L1_CLUSTER_MEM_SIZE) + L1_PKT_BUFF_OFFSET;
     assign l1_pkt_ptr       = l1_pkt_base_addr + free_pkt_idx;
     assign feedback_pkt_idx = hpu_feedback_arb_i.pkt_ptr - l1_pkt_base_addr;
@@ -233,6 +238,15 @@ module cluster_scheduler #(
     //this gets asserted if we are popping an entry associated with an actual DMA transfer.
     assign dma_req_pop_nz = !dma_req_empty && !no_free_hpu && to_pop_q > 0 && ready_task.handler_task.pkt_size > 0;
 
+    //monitoring only: the oldest task is waiting for its packet to be copied to L1
+    logic pkt_dma_wait_mon;
+    assign pkt_dma_wait_mon = !dma_req_empty && to_pop_q == '0 && ready_task.handler_task.pkt_size != '0;
+
+    //monitoring only: bytes of the L1 copy of the task accepted in this cycle (0: none).
+    //Copies complete in order (dma_resp_i), so their wait can be matched to them.
+    logic [31:0] copy_start_mon;
+    assign copy_start_mon = can_issue_dma ? task_descr_i.pkt_size : '0;
+
     //ready hput tasks goes to all HPUs' outputs but only one will be enabled
     assign hpu_task_o = ready_task;
     for (genvar i = 0; i < NUM_CORES; i++) begin : gen_hpu_task
@@ -243,10 +243,20 @@ module task_frontend #(
     logic [31:0] l1_pkt_base_addr; // in this cluster
     logic [NUM_CLUSTERS-1:0][31:0] l1_scratchpad_addr; //in the home cluster
 
+    //the task registers have four scratchpad slots, for the first four clusters
+    localparam int unsigned TASK_SCRATCHPADS = (NUM_CLUSTERS < 4) ? NUM_CLUSTERS : 4;
+    logic [3:0][31:0] task_scratchpad_addr;
+    logic [3:0][31:0] task_scratchpad_size;
+
     logic [31:0] l1_base_addr;
     logic [31:0] l1_home_base_addr;
     logic [31:0] l1_pkt_addr;
 
+    //packet seen by the handler: the L1 copy, or the packet in L2 for
+    //stateless tasks, which are dispatched without a copy
+    logic [31:0] task_pkt_addr;
+    logic [31:0] task_pkt_size;
+
     logic [N_PMP_ENTRIES-1:0] [31:0] pmp_addr_q;
     logic [N_PMP_ENTRIES-1:0] [31:0] pmp_addr_d;
     logic [N_PMP_ENTRIES-1:0] [7:0]  pmp_cfg_q;
@@ -290,17 +300,30 @@ module task_frontend #(
     assign l1_base_addr = (L1_CLUSTER_BASE + cluster_id_i * L1_CLUSTER_MEM_SIZE);
     assign l1_pkt_base_addr = l1_base_addr + L1_RUNTIME_OFFSET;
     assign l1_pkt_addr = current_task_q.pkt_ptr;
+    assign task_pkt_addr = (current_task_q.handler_task.stateless) ? current_task_q.handler_task.pkt_addr : l1_pkt_addr;
+    assign task_pkt_size = (current_task_q.handler_task.stateless) ? current_task_q.handler_task.pkt_l2_size : current_task_q.handler_task.pkt_size;
 
     for (genvar i=0; i<NUM_CLUSTERS; i++) begin: gen_scratchpad_addresses
         assign l1_scratchpad_addr[i] = L1_CLUSTER_BASE + (i * L1_CLUSTER_MEM_SIZE) + L1_SCRATCHPAD_OFFSET + current_task_q.handler_task.scratchpad_addr[i];
     end
 
+    for (genvar i=0; i<4; i++) begin: gen_task_scratchpads
+        if (i < TASK_SCRATCHPADS) begin: gen_slot
+            assign task_scratchpad_addr[i] = l1_scratchpad_addr[i];
+            assign task_scratchpad_size[i] = current_task_q.handler_task.scratchpad_size[i];
+        end else begin: gen_unused_slot
+            assign task_scratchpad_addr[i] = '0;
+            assign task_scratchpad_size[i] = '0;
+        end
+    end
+
     //building feedback
     assign hpu_feedback.pkt_ptr                         = current_task_q.pkt_ptr;
     assign hpu_feedback.feedback_descr.pkt_addr         = current_task_q.handler_task.pkt_addr;
     assign hpu_feedback.feedback_descr.msgid            = current_task_q.handler_task.msgid;
     assign hpu_feedback.feedback_descr.pkt_size         = current_task_q.handler_task.pkt_size;
     assign hpu_feedback.feedback_descr.trigger_feedback = current_task_q.handler_task.trigger_feedback;
+    assign hpu_feedback.feedback_descr.stateless        = current_task_q.handler_task.stateless;
 
     assign hpu_task_ready_o = (state_q == Idle);
     assign hpu_feedback_valid_o = can_send_feedback_i && !feedback_buff_empty;
@@ -359,13 +382,13 @@ module task_frontend #(
     assign pmp_cfg_d[8] = 8'b0_00_11_0_1_1;
     assign pmp_addr_d[8][31:0] = 32'h1c00_7fff;
 
-    for (genvar i=0; i<NUM_CLUSTERS; i++) begin : gen_pmp_scratchpad
+    for (genvar i=0; i<TASK_SCRATCHPADS; i++) begin : gen_pmp_scratchpad
         assign pmp_cfg_d[9+i] = 8'b0_00_11_0_1_1;
         assign pmp_addr_d[9+i][31:12] = l1_scratchpad_addr[i][31:12];
         assign pmp_addr_d[9+i][11:0] = 12'h7FF; // 4 KiB TODO: fix
     end
 
-    for (genvar i=9+NUM_CLUSTERS; i<N_PMP_ENTRIES; i++) begin
+    for (genvar i=9+TASK_SCRATCHPADS; i<N_PMP_ENTRIES; i++) begin
         assign pmp_cfg_d[i] = '0;
         assign pmp_addr_d[i] = '0;
     end
@@ -433,35 +456,35 @@ module task_frontend #(
                 8'h0c: begin //handler memory size 
                     rdata_d = current_task_q.handler_task.handler_mem_size;
                 end
-                8'h10: begin  //L1 packet address
-                    rdata_d = l1_pkt_addr;
+                8'h10: begin  //packet address (L1; L2 for stateless tasks)
+                    rdata_d = task_pkt_addr;
                 end
                 8'h14: begin //packet size
-                    rdata_d = current_task_q.handler_task.pkt_size;
+                    rdata_d = task_pkt_size;
                 end
                 8'h18: begin //scratchpad address 0
-                    rdata_d = l1_scratchpad_addr[0];
+                    rdata_d = task_scratchpad_addr[0];
                 end
                 8'h1c: begin //scratchpad address 1
-                    rdata_d = l1_scratchpad_addr[1];
+                    rdata_d = task_scratchpad_addr[1];
                 end
                 8'h20: begin //scratchpad address 2
-                    rdata_d = l1_scratchpad_addr[2];
+                    rdata_d = task_scratchpad_addr[2];
                 end
                 8'h24: begin //scratchpad address 3
-                    rdata_d = l1_scratchpad_addr[3];
+                    rdata_d = task_scratchpad_addr[3];
                 end                
                 8'h28: begin //scratchpad size 0
-                    rdata_d = current_task_q.handler_task.scratchpad_size[0];
+                    rdata_d = task_scratchpad_size[0];
                 end
                 8'h2c: begin //scratchpad size 1
-                    rdata_d = current_task_q.handler_task.scratchpad_size[1];
+                    rdata_d = task_scratchpad_size[1];
                 end
                 8'h30: begin //scratchpad size 2
-                    rdata_d = current_task_q.handler_task.scratchpad_size[2];
+                    rdata_d = task_scratchpad_size[2];
                 end
                 8'h34: begin //scratchpad size 3
-                    rdata_d = current_task_q.handler_task.scratchpad_size[3];
+                    rdata_d = task_scratchpad_size[3];
                 end
                 8'h38: begin //host memory address (high)
                     rdata_d = current_task_q.handler_task.host_mem_addr[63:32];
@@ -496,6 +519,10 @@ module task_frontend #(
                         handler_error = 1'b1;
                     end
                 end
+
+                8'h58: begin //packet size in L2 (larger than the L1 one with an L1 copy size)
+                    rdata_d = current_task_q.handler_task.pkt_l2_size;
+                end
             endcase
         end
     end
@@ -612,9 +639,11 @@ module cmd_frontend #(
     localparam int unsigned ADD_ISSUE = 0;
     localparam int unsigned ADD_WAIT = 1;
     localparam int unsigned ADD_TEST = 2;
-    //the rest are of the add_idx are used to define the command to issue
+    //3 to 10 are used to define the command to issue
+    localparam int unsigned ADD_PENDING = 11;   //read: bitmap of the commands in flight
+    localparam int unsigned ADD_WAIT_SET = 12;  //write: wait until none of the commands in the bitmap is in flight
 
-    typedef enum logic [2:0] {Disabled, Ready, WaitingBuffer, WaitingID, Waiting} state_t;
+    typedef enum logic [2:0] {Disabled, Ready, WaitingBuffer, WaitingID, Waiting, WaitingSet} state_t;
     state_t state_d, state_q;
 
     //free cmd IDs
@@ -627,6 +656,13 @@ module cmd_frontend #(
     logic [$clog2(NUM_CMDS)-1:0] wt_cmd_idx_q;
     logic wt_cmd_finished;
 
+    //core wants to wait on a set of commands (bitmap of command IDs)
+    logic [NUM_CMDS-1:0] wt_set_d, wt_set_q;
+
+    //commands in flight, not counting the one completing in this cycle
+    logic [NUM_CMDS-1:0] resp_cmd_mask;
+    logic [NUM_CMDS-1:0] pending_cmds;
+
     logic rvalid_d, rvalid_q;
     logic [31:0] rdata_d, rdata_q;
 
@@ -648,17 +684,23 @@ module cmd_frontend #(
     logic cmd_issued;  //core wants to send command (we may stall because no free IDs)
     logic wait_issued; //core wants to wait on a command
     logic test_issued;
+    logic wait_set_issued; //core wants to wait on a set of commands
 
     logic assign_id;
 
     assign cmd_issued  = req_i && add_idx==ADD_ISSUE &&  wen_ni;
     assign wait_issued = req_i && add_idx==ADD_WAIT  && ~wen_ni;
     assign test_issued = req_i && add_idx==ADD_TEST  &&  wen_ni;
+    assign wait_set_issued = req_i && add_idx==ADD_WAIT_SET && ~wen_ni;
 
     assign add_idx = add_i[6:2];
 
     assign no_pending_cmd_o = (free_cmd_ids_q == '0);
 
+    //monitoring only: the core is stalled on a command (no ID, no buffer space, or waiting)
+    logic cmd_stall_mon;
+    assign cmd_stall_mon = (state_q != Ready);
+
     //wait/test cmd id
     assign wt_cmd_idx = wdata_i[$clog2(NUM_CMDS)-1:0];
     assign wt_cmd_idx_d = (wait_issued || test_issued) ? wt_cmd_idx : wt_cmd_idx_q;
@@ -666,6 +708,10 @@ module cmd_frontend #(
 
     assign wt_cmd_finished = (free_cmd_ids_q[wt_cmd_idx_d] == 1'b0) || (cmd_resp_valid_i && cmd_resp_i.cmd_id.local_cmd_id == wt_cmd_idx_d);
 
+    assign resp_cmd_mask = (cmd_resp_valid_i) ? (NUM_CMDS'(1) << cmd_resp_i.cmd_id.local_cmd_id) : '0;
+    assign pending_cmds  = free_cmd_ids_q & ~resp_cmd_mask;
+    assign wt_set_d      = (wait_set_issued) ? wdata_i[NUM_CMDS-1:0] : wt_set_q;
+
     //we push if there is a command and we are not blocking or if we are waiting for the buffer to become non-full
     assign cmd_buff_push = !cmd_buff_full && cmd_issued && state_d==Ready;
 
@@ -730,6 +776,11 @@ module cmd_frontend #(
                 if (wait_issued && !wt_cmd_finished) begin
                     state_d = Waiting; 
                 end                
+
+                //same for a set of commands: wait if any of them is still in flight
+                if (wait_set_issued && (pending_cmds & wt_set_d) != '0) begin
+                    state_d = WaitingSet;
+                end
             end
 
             Disabled: begin
@@ -766,6 +817,12 @@ module cmd_frontend #(
                 end
             end
 
+            WaitingSet: begin
+                if ((pending_cmds & wt_set_q) == '0) begin
+                    state_d = Ready;
+                end
+            end
+
         endcase
     end
 
@@ -854,6 +911,10 @@ module cmd_frontend #(
                 if (test_issued) begin
                     rdata_d = (wt_cmd_finished) ? 32'h0000_0001 : '0; 
                 end
+
+                if (req_i && add_idx == ADD_PENDING && wen_ni) begin
+                    rdata_d = 32'(pending_cmds);
+                end
             end
 
             Waiting: begin
@@ -869,6 +930,7 @@ module cmd_frontend #(
             state_q <= Ready; 
             free_cmd_ids_q <= '0;
             wt_cmd_idx_q <= '0;
+            wt_set_q <= '0;
             rvalid_q <= 1'b0;
             rdata_q <= '0;
             cmd_q <= '0;
@@ -876,9 +938,18 @@ module cmd_frontend #(
             state_q <= state_d;
             free_cmd_ids_q <= free_cmd_ids_d;
             wt_cmd_idx_q <= wt_cmd_idx_d;
+            wt_set_q <= wt_set_d;
             rvalid_q <= rvalid_d;
             rdata_q <= rdata_d;
             cmd_q <= cmd_d;
         end
     end
+
+    // Configuration checks
+    // pragma translate_off
+    initial begin
+        assert (NUM_CMDS >= 2 && NUM_CMDS <= 32)
+            else $fatal (1, "NUM_CMDS must be between 2 and 32 (one bitmap word)!");
+    end
+    // pragma translate_on
 endmodule
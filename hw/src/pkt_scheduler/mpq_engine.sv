@@ -12,16 +12,20 @@ import pspin_cfg_pkg::*;
 
 module mpq_engine #(
     parameter int NUM_HER_SLOTS = 64,
-    parameter int NUM_MPQ = 8
+    parameter int NUM_MPQ = 8,
+    parameter int MPQ_HASH = MPQ_HASH_LOW_BITS,
+    parameter int MPQ_ARB = MPQ_ARB_RR,
+    parameter int HER_BATCH = 1
 )
 (
     input   logic              clk_i,
     input   logic              rst_ni,
 
-    //from pkt gen
-    output logic               her_ready_o,
-    input  logic               her_valid_i,
-    input  her_descr_t         her_i,
+    //from pkt gen: up to HER_BATCH HERs, in arrival order from lane 0. Lane i
+    //is only accepted together with lanes 0 to i-1.
+    output logic [HER_BATCH-1:0]        her_ready_o,
+    input  logic [HER_BATCH-1:0]        her_valid_i,
+    input  her_descr_t [HER_BATCH-1:0]  her_i,
     
     //termination signal    
     input  logic               eos_i,
@@ -46,11 +50,47 @@ module mpq_engine #(
 );
     typedef struct packed {
         mem_addr_t pkt_addr;
-        mem_size_t pkt_size;
+        mem_size_t pkt_size;    // bytes to copy to L1
+        mem_size_t pkt_l2_size;
     } mpq_pkt_t;
 
     localparam int unsigned MPQ_META_LEN   = $bits(mpq_meta_t);
     localparam int unsigned MPQ_META_LEN_B = MPQ_META_LEN/8;
+    localparam int unsigned MPQ_IDX_WIDTH  = $clog2(NUM_MPQ);
+
+    // The MPQs are split in HER_BATCH banks (MPQ index modulo HER_BATCH), each
+    // with its own HER cells and metadata memory, so that a cycle can enqueue
+    // one HER per bank.
+    localparam int unsigned NUM_BANKS      = HER_BATCH;
+    localparam int unsigned MPQ_PER_BANK   = NUM_MPQ / NUM_BANKS;
+    localparam int unsigned BANK_IDX_WIDTH = $clog2(MPQ_PER_BANK);
+
+    // Stateless tasks waiting for the scheduler
+    localparam int unsigned STATELESS_FIFO_DEPTH = 8;
+
+    // MPQ of a HER. All the HERs of a message must map to the same MPQ, so the key
+    // can only contain the msgid and its execution context. Folding all the key bits
+    // avoids that messages whose IDs differ only in the high bits serialize behind
+    // each other in the same MPQ.
+    function automatic logic [MPQ_IDX_WIDTH-1:0] mpq_index(her_descr_t her);
+        logic [63:0] key;
+        logic [MPQ_IDX_WIDTH-1:0] idx;
+
+        if (MPQ_HASH == MPQ_HASH_LOW_BITS) begin
+            return her.msgid[MPQ_IDX_WIDTH-1:0];
+        end
+
+        key = 64'(her.msgid);
+        if (MPQ_HASH == MPQ_HASH_MSGID_EC) begin
+            key[63:32] = her.mpq_meta.handler_mem_addr ^ (her.mpq_meta.ph_addr >> 2);
+        end
+
+        idx = '0;
+        for (int i = 0; i < 64; i += MPQ_IDX_WIDTH) begin
+            idx = idx ^ MPQ_IDX_WIDTH'(key >> i);
+        end
+        return idx;
+    endfunction
 
     // MPQ engine state. This is mainly to handle the case in which
     // task_ready_i is not asserted and enable pipelining between
@@ -68,8 +108,8 @@ module mpq_engine #(
     // Flag saying if an MPQ is being used or not
     logic [NUM_MPQ-1:0] mpq_busy;
 
-    // ID of the MPQ for which we received a new HER
-    logic [$clog2(NUM_MPQ)-1:0] newher_mpq_idx;
+    // ID of the MPQ of the HER on each lane
+    logic [HER_BATCH-1:0][$clog2(NUM_MPQ)-1:0] newher_mpq_idx;
 
     // ID of the MPQ which we are sending a task from
     logic [$clog2(NUM_MPQ)-1:0] tasksent_mpq_idx;
@@ -83,8 +123,8 @@ module mpq_engine #(
     // Next packet to schedule for each MPQ
     mpq_pkt_t mpq_head;
 
-    // New packet to push in the fifo_engine
-    mpq_pkt_t new_pkt;
+    // New packet on each lane to push in the fifo_engine
+    mpq_pkt_t [HER_BATCH-1:0] new_pkt;
 
     // We store the handler_task in order to use it in case we get stalled
     handler_task_t task_q, task_d, new_task;
@@ -97,7 +137,8 @@ module mpq_engine #(
     logic [$clog2(NUM_MPQ)-1:0] selected_mpq_q;
 
     // push/pop drivers for FIFO engine
-    logic fifo_push, fifo_pop;
+    logic [HER_BATCH-1:0] fifo_push;
+    logic fifo_pop;
 
     // flag saying if the FIFO engine is empty of full
     // NOTE: fifo_empty is only used in assertions
@@ -105,13 +146,19 @@ module mpq_engine #(
     logic [NUM_MPQ-1:0] fifo_full;
 
     // Updated MPQs from the FSMs output
-    mpq_t newher_mpq_fsm_s, tasksent_mpq_fsm_s, feedback_mpq_fsm_s;
+    mpq_t [HER_BATCH-1:0] newher_mpq_fsm_s;
+    mpq_t tasksent_mpq_fsm_s, feedback_mpq_fsm_s;
 
     // Flags saying if the FSMs' output is valid
-    logic newher_mpq_fsm_update, tasksent_mpq_fsm_update, feedback_mpq_fsm_update;
+    logic [HER_BATCH-1:0] newher_mpq_fsm_update;
+    logic tasksent_mpq_fsm_update, feedback_mpq_fsm_update;
+
+    // HER enqueued in this cycle for the MPQ that sends a task / gets a feedback
+    logic tasksent_her_new, feedback_her_new;
+    her_descr_t tasksent_her, feedback_her;
 
-    // True if we are writing to the MPQ meta memory
-    logic mpqmeta_write;
+    // True if we are writing to the MPQ meta memory (per lane)
+    logic [HER_BATCH-1:0] mpqmeta_write;
 
     // True if we are reading from MPQ meta memory
     logic mpqmeta_read;
@@ -121,23 +168,82 @@ module mpq_engine #(
 
     // Read output of the MPQ meta memory
     mpq_meta_t mpqmeta_read_mpq;
-    mpq_meta_t mpqmeta_read_mpq_ignored; 
 
     // ready/valid for arbiter 
     logic arb_ready, arb_valid;
 
+    // The HER goes to the stateless FIFO instead of an MPQ
+    logic [HER_BATCH-1:0] her_stateless;
+
+    // The MPQ (or the stateless FIFO) of the HER has space
+    logic [HER_BATCH-1:0] her_space;
+
+    // HER pushed to an MPQ / feedback of a task that came from an MPQ
+    logic [HER_BATCH-1:0] her_mpq_push;
+    logic mpq_feedback;
+
+    // Tasks built from the MPQs
+    logic mpq_task_valid, mpq_task_ready;
+    handler_task_t mpq_task;
+
+    // Tasks of stateless handlers
+    logic stateless_push, stateless_full, stateless_empty;
+    her_descr_t stateless_her;
+    logic stateless_task_valid, stateless_task_ready;
+    handler_task_t stateless_new_task, stateless_task;
+
     assign mpq_full_o = fifo_full;
 
     // define the MPQ indices for the different events
-    assign newher_mpq_idx      = her_i.msgid[$clog2(NUM_MPQ)-1:0];
+    // NOTE: the msgid of the tasks (and so of their feedbacks) is the MPQ index
     assign tasksent_mpq_idx    = mpq_arb_idx; //this one comes one cycle before task_o! 
     assign feedback_mpq_idx    = feedback_i.msgid[$clog2(NUM_MPQ)-1:0];
 
-    // Here we store the packets that are queued for each MPQ
-    assign new_pkt.pkt_addr = her_i.her_addr;
-    assign new_pkt.pkt_size = her_i.xfer_size;
+    for (genvar i = 0; i < HER_BATCH; i++) begin : gen_her_lane
+        assign newher_mpq_idx[i]      = mpq_index(her_i[i]);
+
+        // Here we store the packets that are queued for each MPQ
+        // with an L1 copy size in the execution context, only that prefix of
+        // the packet goes to L1; the handler reads the rest from L2
+        assign new_pkt[i].pkt_addr    = her_i[i].her_addr;
+        assign new_pkt[i].pkt_size    = (her_i[i].mpq_meta.l1_copy_size != '0 && her_i[i].mpq_meta.l1_copy_size < her_i[i].xfer_size) ?
+                                            her_i[i].mpq_meta.l1_copy_size : her_i[i].xfer_size;
+        assign new_pkt[i].pkt_l2_size = her_i[i].her_size;
+
+        assign her_stateless[i] = (her_i[i].mpq_meta.stateless != '0);
+        assign her_space[i]     = (her_stateless[i]) ? !stateless_full : !fifo_full[newher_mpq_idx[i]];
+        assign her_mpq_push[i]  = her_ready_o[i] && her_valid_i[i] && !her_stateless[i];
+    end
 
-    assign fifo_push = her_ready_o && her_valid_i;
+    // Define ready signal on the HER input interface. We can get a new HER if
+    // the MPQ to which the HER will go has space (stateless HERs only need
+    // space in the stateless FIFO). The lanes are taken in order, and a cycle
+    // takes at most one HER per MPQ bank and one stateless HER, so the HERs of
+    // a message (same MPQ) are enqueued in order.
+    always_comb begin
+        logic [NUM_BANKS-1:0] bank_taken;
+        logic stateless_taken, in_order;
+
+        bank_taken = '0;
+        stateless_taken = 1'b0;
+        in_order = 1'b1;
+        for (int i = 0; i < HER_BATCH; i++) begin
+            her_ready_o[i] = in_order && her_space[i] &&
+                             ((her_stateless[i]) ? !stateless_taken : !bank_taken[newher_mpq_idx[i] % NUM_BANKS]);
+            in_order = her_ready_o[i] && her_valid_i[i];
+            if (in_order) begin
+                if (her_stateless[i]) begin
+                    stateless_taken = 1'b1;
+                end else begin
+                    bank_taken[newher_mpq_idx[i] % NUM_BANKS] = 1'b1;
+                end
+            end
+        end
+    end
+
+    assign mpq_feedback     = feedback_valid_i && feedback_ready_o && !feedback_i.stateless;
+
+    assign fifo_push = her_mpq_push;
 
     // Note: this is quite ugly, should be fixed.
     assign fifo_pop  = (arb_ready && arb_valid && (
@@ -146,63 +252,213 @@ module mpq_engine #(
                         (mpq_q[tasksent_mpq_idx].state == Completion) /* pop EOM when the completion is sent */
                        ));
 
-    fifo_engine #(
-        .NUM_CELLS(NUM_HER_SLOTS),
-        .NUM_STATIC_CELLS_PER_FIFO(NUM_MPQ_STATIC_CELLS),
-        .NUM_FIFO(NUM_MPQ),
-        .elem_t(mpq_pkt_t)
-    ) i_fifo_engine (
-        .clk_i              (clk_i),
-        .rst_ni             (rst_ni),
-        .new_el_i           (new_pkt),
-        .push_i             (fifo_push),
-        .fifo_push_id_i     (newher_mpq_idx),
-        .pop_i              (fifo_pop),
-        .fifo_pop_id_i      (tasksent_mpq_idx),
-        .data_o             (mpq_head),
-        .empty_o            (fifo_empty),
-        .fifo_full_o        (fifo_full)
-    );
-
     // MPQ metadata memory
-    assign mpqmeta_write = her_valid_i && her_ready_o && !mpq_busy[newher_mpq_idx];
+    for (genvar i = 0; i < HER_BATCH; i++) begin : gen_mpqmeta_write
+        assign mpqmeta_write[i] = her_mpq_push[i] && !mpq_busy[newher_mpq_idx[i]];
+    end
     assign mpqmeta_read = arb_ready && arb_valid;
 
-    tc_sram #(
-        .NumWords   (NUM_MPQ),
-        .DataWidth  (MPQ_META_LEN),
-        .NumPorts   (2)
-    ) i_mpq_meta_mem (
-        .clk_i      (clk_i),
-        .rst_ni     (rst_ni),
-        .req_i      ({mpqmeta_write, mpqmeta_read}),
-        .we_i       ({mpqmeta_write, 1'b0}),
-        .addr_i     ({newher_mpq_idx, tasksent_mpq_idx}),
-        .wdata_i    ({her_i.mpq_meta, {MPQ_META_LEN{1'b0}}}),
-        .be_i       ({{MPQ_META_LEN_B{1'b1}}, {MPQ_META_LEN_B{1'b0}}}),
-        .rdata_o    ({mpqmeta_read_mpq_ignored, mpqmeta_read_mpq})
-    );
+    // One FIFO engine and metadata memory per bank. The bank of the MPQ
+    // that sends a task is read in the arbitration cycle, and its output is
+    // selected in the next one (selected_mpq_q).
+    mpq_pkt_t [NUM_BANKS-1:0] bank_head;
+    mpq_meta_t [NUM_BANKS-1:0] bank_meta;
+    logic [NUM_BANKS-1:0] bank_empty;
+
+    for (genvar b = 0; b < NUM_BANKS; b++) begin : gen_mpq_bank
+        logic push, meta_write;
+        logic [BANK_IDX_WIDTH-1:0] push_id, pop_id;
+        logic [MPQ_PER_BANK-1:0] full;
+        mpq_pkt_t push_pkt;
+        mpq_meta_t push_meta, meta_ignored;
+
+        // the HER (at most one per cycle) of the lane that goes to this bank
+        always_comb begin
+            push = 1'b0;
+            meta_write = 1'b0;
+            push_id = '0;
+            push_pkt = new_pkt[0];
+            push_meta = her_i[0].mpq_meta;
+            for (int i = 0; i < HER_BATCH; i++) begin
+                if (fifo_push[i] && newher_mpq_idx[i] % NUM_BANKS == b) begin
+                    push = 1'b1;
+                    meta_write = mpqmeta_write[i];
+                    push_id = BANK_IDX_WIDTH'(newher_mpq_idx[i] / NUM_BANKS);
+                    push_pkt = new_pkt[i];
+                    push_meta = her_i[i].mpq_meta;
+                end
+            end
+        end
+
+        assign pop_id = BANK_IDX_WIDTH'(tasksent_mpq_idx / NUM_BANKS);
+
+        fifo_engine #(
+            .NUM_CELLS(NUM_HER_SLOTS / NUM_BANKS),
+            .NUM_STATIC_CELLS_PER_FIFO(NUM_MPQ_STATIC_CELLS),
+            .NUM_FIFO(MPQ_PER_BANK),
+            .elem_t(mpq_pkt_t)
+        ) i_fifo_engine (
+            .clk_i              (clk_i),
+            .rst_ni             (rst_ni),
+            .new_el_i           (push_pkt),
+            .push_i             (push),
+            .fifo_push_id_i     (push_id),
+            .pop_i              (fifo_pop && tasksent_mpq_idx % NUM_BANKS == b),
+            .fifo_pop_id_i      (pop_id),
+            .data_o             (bank_head[b]),
+            .empty_o            (bank_empty[b]),
+            .fifo_full_o        (full)
+        );
+
+        for (genvar j = 0; j < MPQ_PER_BANK; j++) begin : gen_fifo_full
+            assign fifo_full[j * NUM_BANKS + b] = full[j];
+        end
+
+        tc_sram #(
+            .NumWords   (MPQ_PER_BANK),
+            .DataWidth  (MPQ_META_LEN),
+            .NumPorts   (2)
+        ) i_mpq_meta_mem (
+            .clk_i      (clk_i),
+            .rst_ni     (rst_ni),
+            .req_i      ({meta_write, mpqmeta_read}),
+            .we_i       ({meta_write, 1'b0}),
+            .addr_i     ({push_id, pop_id}),
+            .wdata_i    ({push_meta, {MPQ_META_LEN{1'b0}}}),
+            .be_i       ({{MPQ_META_LEN_B{1'b1}}, {MPQ_META_LEN_B{1'b0}}}),
+            .rdata_o    ({meta_ignored, bank_meta[b]})
+        );
+    end
+
+    assign fifo_empty       = (bank_empty == '1);
+    assign mpq_head         = bank_head[selected_mpq_q % NUM_BANKS];
+    assign mpqmeta_read_mpq = bank_meta[selected_mpq_q % NUM_BANKS];
+
+    // Arbitration parameters of the message in each MPQ, taken from its EC
+    // when the message starts (the metadata memory is read only after the
+    // arbitration).
+    mem_size_t [NUM_MPQ-1:0] mpq_quantum_q;
+    logic [NUM_MPQ-1:0] mpq_prio_q;
+
+    always_ff @(posedge clk_i, negedge rst_ni) begin
+        if (~rst_ni) begin
+            mpq_quantum_q <= '0;
+            mpq_prio_q <= '0;
+        end else begin
+            for (int i = 0; i < HER_BATCH; i++) begin
+                if (mpqmeta_write[i]) begin
+                    mpq_quantum_q[newher_mpq_idx[i]] <= her_i[i].mpq_meta.sched_quantum;
+                    mpq_prio_q[newher_mpq_idx[i]] <= (her_i[i].mpq_meta.sched_prio != '0);
+                end
+            end
+        end
+    end
+
+    // Strict priority: only the MPQs of priority ECs compete if any of them is ready
+    logic [NUM_MPQ-1:0] arb_req;
+    assign arb_req = ((mpq_valid & mpq_prio_q) != '0) ? (mpq_valid & mpq_prio_q) : mpq_valid;
 
     // Select a ready MPQ
-    rr_arb_tree #(
-        .NumIn      (NUM_MPQ),
-        .DataWidth  (0),
-        .ExtPrio    (0),
-        .AxiVldRdy  (1),
-        .LockIn     (1)
-    ) i_mpq_rr_arb (
-        .clk_i      (clk_i),
-        .rst_ni     (rst_ni),
-        .flush_i    (1'b0),
-        .rr_i       ('0),
-        .req_i      (mpq_valid),
-        .gnt_o      (),
-        .data_i     (),
-        .gnt_i      (arb_ready),
-        .req_o      (arb_valid),
-        .data_o     (),
-        .idx_o      (mpq_arb_idx)
-    );
+    if (MPQ_ARB == MPQ_ARB_RR) begin : gen_rr_arb
+        rr_arb_tree #(
+            .NumIn      (NUM_MPQ),
+            .DataWidth  (0),
+            .ExtPrio    (0),
+            .AxiVldRdy  (1),
+            .LockIn     (1)
+        ) i_mpq_rr_arb (
+            .clk_i      (clk_i),
+            .rst_ni     (rst_ni),
+            .flush_i    (1'b0),
+            .rr_i       ('0),
+            .req_i      (arb_req),
+            .gnt_o      (),
+            .data_i     (),
+            .gnt_i      (arb_ready),
+            .req_o      (arb_valid),
+            .data_o     (),
+            .idx_o      (mpq_arb_idx)
+        );
+    end else begin : gen_credit_arb
+        // The arbiter stays on the current MPQ while it has credit, then moves
+        // to the next ready MPQ in round-robin order and adds its quantum to its
+        // credit. WRR charges one credit per task. DRR charges the packet bytes
+        // (the whole packet in L2, not the L1 copy prefix) one cycle after the
+        // grant, when the packet size is read from the FIFO engine, so the
+        // credit can go negative (the excess is paid in the next turn).
+        // Credits are cleared when an MPQ has no message.
+        typedef logic signed [31:0] credit_t;
+        credit_t credit_q [NUM_MPQ];
+        credit_t credit_d [NUM_MPQ];
+
+        logic [MPQ_IDX_WIDTH-1:0] arb_cur_q, arb_cur_d;
+        logic [MPQ_IDX_WIDTH-1:0] arb_next, arb_next_offset;
+        logic [2*NUM_MPQ-1:0] arb_req_rot;
+        logic arb_stay;
+
+        // ready MPQs after the current one, in round-robin order
+        assign arb_req_rot = {arb_req, arb_req} >> (arb_cur_q + 1);
+
+        lzc #(
+            .WIDTH  (NUM_MPQ),
+            .MODE   (1'b0)
+        ) i_arb_next_lzc (
+            .in_i    (arb_req_rot[NUM_MPQ-1:0]),
+            .cnt_o   (arb_next_offset),
+            .empty_o ()
+        );
+
+        assign arb_next    = arb_cur_q + 1 + arb_next_offset;
+        assign arb_stay    = arb_req[arb_cur_q] && credit_q[arb_cur_q] > 0;
+        assign arb_valid   = (arb_req != '0);
+        assign mpq_arb_idx = (arb_stay) ? arb_cur_q : arb_next;
+
+        always_comb begin
+            credit_t quantum;
+
+            arb_cur_d = arb_cur_q;
+            credit_d = credit_q;
+
+            if (MPQ_ARB == MPQ_ARB_WRR) begin
+                quantum = (mpq_quantum_q[arb_next] != '0) ? credit_t'(mpq_quantum_q[arb_next]) : credit_t'(MPQ_WRR_DEFAULT_WEIGHT);
+            end else begin
+                quantum = (mpq_quantum_q[arb_next] != '0) ? credit_t'(mpq_quantum_q[arb_next]) : credit_t'(MPQ_DRR_DEFAULT_QUANTUM);
+            end
+
+            // DRR: charge the task built from the previous grant
+            if (MPQ_ARB == MPQ_ARB_DRR && state_q == Ready) begin
+                credit_d[selected_mpq_q] = credit_d[selected_mpq_q] - credit_t'(mpq_head.pkt_l2_size);
+            end
+
+            if (arb_ready && arb_valid) begin
+                if (!arb_stay) begin
+                    arb_cur_d = arb_next;
+                    credit_d[arb_next] = credit_d[arb_next] + quantum;
+                end
+                if (MPQ_ARB == MPQ_ARB_WRR) begin
+                    credit_d[mpq_arb_idx] = credit_d[mpq_arb_idx] - 1;
+                end
+            end
+
+            for (int i = 0; i < NUM_MPQ; i++) begin
+                if (!mpq_busy[i]) begin
+                    credit_d[i] = '0;
+                end
+            end
+        end
+
+        always_ff @(posedge clk_i, negedge rst_ni) begin
+            if (~rst_ni) begin
+                arb_cur_q <= '0;
+                for (int i = 0; i < NUM_MPQ; i++) begin
+                    credit_q[i] <= '0;
+                end
+            end else begin
+                arb_cur_q <= arb_cur_d;
+                credit_q <= credit_d;
+            end
+        end
+    end
 
     // Define state
     always_comb begin
@@ -217,7 +473,7 @@ module mpq_engine #(
                 end
             end
             Ready: begin
-                if (task_ready_i == 1'b0) begin
+                if (mpq_task_ready == 1'b0) begin
                     state_d = Stalled;
                 end else begin
                     state_d = (arb_valid == 1'b1) ? Ready : Idle;
@@ -225,7 +481,7 @@ module mpq_engine #(
                 end
             end
             Stalled: begin
-                if (task_ready_i == 1'b1) begin
+                if (mpq_task_ready == 1'b1) begin
                     state_d = (arb_valid == 1'b1) ? Ready : Idle;
                     arb_ready = (arb_valid == 1'b1); //to pipeline next memory read
                 end
@@ -237,10 +493,10 @@ module mpq_engine #(
     // we delay mpq_arb_idx because the the memory read output will be
     // ready at the next cycle
 
-    assign task_valid_o = (state_q == Ready || state_q == Stalled);
+    assign mpq_task_valid = (state_q == Ready || state_q == Stalled);
 
     //this seems overworked.. 
-    assign task_o = (state_q==Ready) ? new_task : task_q;
+    assign mpq_task = (state_q==Ready) ? new_task : task_q;
     assign task_d = (state_q==Ready) ? new_task : task_q;
 
     assign mpq_out_state_d = (arb_ready && arb_valid) ? mpq_q[tasksent_mpq_idx].state : mpq_out_state_q;
@@ -254,6 +510,7 @@ module mpq_engine #(
                 new_task.handler_fun_size = mpqmeta_read_mpq.hh_size;
                 new_task.pkt_addr = mpq_head.pkt_addr;
                 new_task.pkt_size = mpq_head.pkt_size;
+                new_task.pkt_l2_size = mpq_head.pkt_l2_size;
                 new_task.trigger_feedback = new_task_triggers_feedback_q;
             end
 
@@ -262,6 +519,7 @@ module mpq_engine #(
                 new_task.handler_fun_size = mpqmeta_read_mpq.ph_size;
                 new_task.pkt_addr = mpq_head.pkt_addr;
                 new_task.pkt_size = mpq_head.pkt_size;
+                new_task.pkt_l2_size = mpq_head.pkt_l2_size;
                 new_task.trigger_feedback = new_task_triggers_feedback_q;
             end
 
@@ -270,6 +528,7 @@ module mpq_engine #(
                 new_task.handler_fun_size = mpqmeta_read_mpq.th_size;
                 new_task.pkt_addr = mpq_head.pkt_addr;
                 new_task.pkt_size = mpq_head.pkt_size;
+                new_task.pkt_l2_size = mpq_head.pkt_l2_size;
                 new_task.trigger_feedback = new_task_triggers_feedback_q;
             end
 
@@ -278,12 +537,14 @@ module mpq_engine #(
                 new_task.handler_fun_size = '0;
                 new_task.pkt_addr = '0;
                 new_task.pkt_size = '0;
+                new_task.pkt_l2_size = '0;
                 new_task.trigger_feedback = 1'b0;
             end
         endcase
     end
 
     assign new_task.msgid            = selected_mpq_q;
+    assign new_task.stateless        = 1'b0;
     assign new_task.handler_mem_addr = mpqmeta_read_mpq.handler_mem_addr;
     assign new_task.handler_mem_size = mpqmeta_read_mpq.handler_mem_size;
     assign new_task.host_mem_addr    = mpqmeta_read_mpq.host_mem_addr;
@@ -295,39 +556,59 @@ module mpq_engine #(
     end
     
     // Update MPQ state
-    // This unit might have to process at most three MPQs at the same time:
-    // - the MPQ for which we get a new HER,
+    // This unit might have to process at most HER_BATCH + 2 MPQs at the same time:
+    // - the MPQs for which we get a new HER (one per lane),
     // - the MPQ for which we get a completion feedback,
     // - the MPQ that gets selected to send a new task.
-    // For this reason, we keep three mpq_fsm. It can happen that two or all FSM
+    // For this reason, we keep HER_BATCH + 2 mpq_fsm. It can happen that two or all FSM
     // will be fed with the same MPQ (e.g., getting a new HER and a completion feedback
     // for the same MPQ in the same cycle). In that case, the FSM will produce the same
-    // output state, so it does not matter which output gets written. 
-    mpq_fsm #(
-    ) i_newher_mpq_fsm (
-        .her_new_i          (her_valid_i && her_ready_o),
-        .task_sent_i        (arb_valid && arb_ready && tasksent_mpq_idx == newher_mpq_idx),
-        .feedback_i         (feedback_valid_i && feedback_ready_o && feedback_mpq_idx == newher_mpq_idx),
-
-        .her_new_has_hh_i   (her_i.mpq_meta.hh_addr != '0),
-        .her_new_has_th_i   (her_i.mpq_meta.th_addr != '0),
-        .her_new_is_eom_i   (her_i.eom),
-
-        .mpq_q              (mpq_q[newher_mpq_idx]),
-        .mpq_o              (newher_mpq_fsm_s),
+    // output state, so it does not matter which output gets written. The lanes
+    // enqueued in a cycle go to different banks, so to different MPQs.
+    for (genvar i = 0; i < HER_BATCH; i++) begin : gen_newher_mpq_fsm
+        mpq_fsm #(
+        ) i_newher_mpq_fsm (
+            .her_new_i          (her_mpq_push[i]),
+            .task_sent_i        (arb_valid && arb_ready && tasksent_mpq_idx == newher_mpq_idx[i]),
+            .feedback_i         (mpq_feedback && feedback_mpq_idx == newher_mpq_idx[i]),
+
+            .her_new_has_hh_i   (her_i[i].mpq_meta.hh_addr != '0),
+            .her_new_has_th_i   (her_i[i].mpq_meta.th_addr != '0),
+            .her_new_is_eom_i   (her_i[i].eom),
+
+            .mpq_q              (mpq_q[newher_mpq_idx[i]]),
+            .mpq_o              (newher_mpq_fsm_s[i]),
+
+            .update_o           (newher_mpq_fsm_update[i])
+        );
+    end
 
-        .update_o           (newher_mpq_fsm_update)
-    );
+    always_comb begin
+        tasksent_her_new = 1'b0;
+        feedback_her_new = 1'b0;
+        tasksent_her = her_i[0];
+        feedback_her = her_i[0];
+        for (int i = 0; i < HER_BATCH; i++) begin
+            if (her_mpq_push[i] && newher_mpq_idx[i] == tasksent_mpq_idx) begin
+                tasksent_her_new = 1'b1;
+                tasksent_her = her_i[i];
+            end
+            if (her_mpq_push[i] && newher_mpq_idx[i] == feedback_mpq_idx) begin
+                feedback_her_new = 1'b1;
+                feedback_her = her_i[i];
+            end
+        end
+    end
 
     mpq_fsm #(
     ) i_tasksent_mpq_fsm (
-        .her_new_i          (her_valid_i && her_ready_o && newher_mpq_idx == tasksent_mpq_idx),
+        .her_new_i          (tasksent_her_new),
         .task_sent_i        (arb_valid && arb_ready),
-        .feedback_i         (feedback_valid_i && feedback_ready_o && feedback_mpq_idx == tasksent_mpq_idx),
+        .feedback_i         (mpq_feedback && feedback_mpq_idx == tasksent_mpq_idx),
 
-        .her_new_has_hh_i   (her_i.mpq_meta.hh_addr != '0),
-        .her_new_has_th_i   (her_i.mpq_meta.th_addr != '0),
-        .her_new_is_eom_i   (her_i.eom),
+        .her_new_has_hh_i   (tasksent_her.mpq_meta.hh_addr != '0),
+        .her_new_has_th_i   (tasksent_her.mpq_meta.th_addr != '0),
+        .her_new_is_eom_i   (tasksent_her.eom),
 
         .mpq_q              (mpq_q[tasksent_mpq_idx]),
         .mpq_o              (tasksent_mpq_fsm_s),
@@ -337,13 +618,13 @@ module mpq_engine #(
 
     mpq_fsm #(
     ) i_feedback_mpq_fsm (
-        .her_new_i          (her_valid_i && her_ready_o && newher_mpq_idx == feedback_mpq_idx),
+        .her_new_i          (feedback_her_new),
         .task_sent_i        (arb_valid && arb_ready && feedback_mpq_idx == tasksent_mpq_idx),
-        .feedback_i         (feedback_valid_i && feedback_ready_o),
+        .feedback_i         (mpq_feedback),
 
-        .her_new_has_hh_i   (her_i.mpq_meta.hh_addr != '0),
-        .her_new_has_th_i   (her_i.mpq_meta.th_addr != '0),
-        .her_new_is_eom_i   (her_i.eom),
+        .her_new_has_hh_i   (feedback_her.mpq_meta.hh_addr != '0),
+        .her_new_has_th_i   (feedback_her.mpq_meta.th_addr != '0),
+        .her_new_is_eom_i   (feedback_her.eom),
 
         .mpq_q              (mpq_q[feedback_mpq_idx]),
         .mpq_o              (feedback_mpq_fsm_s),
@@ -354,8 +635,10 @@ module mpq_engine #(
     always_comb begin
         mpq_d = mpq_q;
 
-        if (newher_mpq_fsm_update) begin
-            mpq_d[newher_mpq_idx] = newher_mpq_fsm_s;
+        for (int i = 0; i < HER_BATCH; i++) begin
+            if (newher_mpq_fsm_update[i]) begin
+                mpq_d[newher_mpq_idx[i]] = newher_mpq_fsm_s[i];
+            end
         end
 
         if (tasksent_mpq_fsm_update) begin
@@ -375,9 +658,78 @@ module mpq_engine #(
         assign mpq_busy[i]  = (mpq_q[i].state != Free);
     end
 
-    // Define ready signal on the HER input interface. We can 
-    // get a new HER if the MPQ to which the HER will go has space. 
-    assign her_ready_o = !fifo_full[newher_mpq_idx]; //((~fifo_full) != '0);
+    // Stateless handlers: the HER becomes a payload handler task right away,
+    // without an MPQ, a header or a completion handler. It is not ordered
+    // with the other packets of its message, and its feedback does not
+    // touch any MPQ. Nothing is copied to L1 (pkt_size 0): the cluster
+    // dispatches the task without a DMA and the handler reads the packet
+    // in L2 (see hpu_driver).
+    assign stateless_new_task.msgid            = stateless_her.msgid;
+    assign stateless_new_task.handler_fun      = stateless_her.mpq_meta.ph_addr;
+    assign stateless_new_task.handler_fun_size = stateless_her.mpq_meta.ph_size;
+    assign stateless_new_task.handler_mem_addr = stateless_her.mpq_meta.handler_mem_addr;
+    assign stateless_new_task.handler_mem_size = stateless_her.mpq_meta.handler_mem_size;
+    assign stateless_new_task.host_mem_addr    = stateless_her.mpq_meta.host_mem_addr;
+    assign stateless_new_task.host_mem_size    = stateless_her.mpq_meta.host_mem_size;
+    assign stateless_new_task.pkt_addr         = stateless_her.her_addr;
+    assign stateless_new_task.pkt_size         = '0;
+    assign stateless_new_task.pkt_l2_size      = stateless_her.her_size;
+    assign stateless_new_task.trigger_feedback = 1'b1;
+    assign stateless_new_task.stateless        = 1'b1;
+    assign stateless_new_task.scratchpad_addr  = stateless_her.mpq_meta.scratchpad_addr;
+    assign stateless_new_task.scratchpad_size  = stateless_her.mpq_meta.scratchpad_size;
+
+    // at most one stateless HER is enqueued per cycle
+    always_comb begin
+        stateless_push = 1'b0;
+        stateless_her = her_i[0];
+        for (int i = 0; i < HER_BATCH; i++) begin
+            if (her_ready_o[i] && her_valid_i[i] && her_stateless[i]) begin
+                stateless_push = 1'b1;
+                stateless_her = her_i[i];
+            end
+        end
+    end
+
+    assign stateless_task_valid = !stateless_empty;
+
+    fifo_v3 #(
+        .dtype     (handler_task_t),
+        .DEPTH     (STATELESS_FIFO_DEPTH)
+    ) i_stateless_fifo (
+        .clk_i     (clk_i),
+        .rst_ni    (rst_ni),
+        .flush_i   (1'b0),
+        .testmode_i(1'b0),
+        .full_o    (stateless_full),
+        .empty_o   (stateless_empty),
+        .usage_o   (),
+        .data_i    (stateless_new_task),
+        .push_i    (stateless_push),
+        .data_o    (stateless_task),
+        .pop_i     (stateless_task_valid && stateless_task_ready)
+    );
+
+    // MPQ and stateless tasks share the output in round-robin order
+    rr_arb_tree #(
+        .NumIn      (2),
+        .DataType   (handler_task_t),
+        .ExtPrio    (0),
+        .AxiVldRdy  (1),
+        .LockIn     (1)
+    ) i_task_rr_arb (
+        .clk_i      (clk_i),
+        .rst_ni     (rst_ni),
+        .flush_i    (1'b0),
+        .rr_i       ('0),
+        .req_i      ({stateless_task_valid, mpq_task_valid}),
+        .gnt_o      ({stateless_task_ready, mpq_task_ready}),
+        .data_i     ({stateless_task, mpq_task}),
+        .gnt_i      (task_ready_i),
+        .req_o      (task_valid_o),
+        .data_o     (task_o),
+        .idx_o      ()
+    );
 
     // Forward the feedback to the NIC inbound engine
     assign feedback_ready_o     = nic_feedback_ready_i;
@@ -403,6 +755,18 @@ module mpq_engine #(
         end
     end
 
+    // Configuration checks
+    // pragma translate_off
+    initial begin
+        assert (NUM_MPQ == 2**$clog2(NUM_MPQ) && NUM_MPQ <= 2**C_MSGID_WIDTH)
+            else $fatal (1, "NUM_MPQ must be a power of two that fits in a msgid!");
+        assert (NUM_HER_SLOTS >= NUM_MPQ * NUM_MPQ_STATIC_CELLS)
+            else $fatal (1, "Not enough MPQ cells for the static ones!");
+        assert (HER_BATCH == 2**$clog2(HER_BATCH) && HER_BATCH <= 8 && NUM_MPQ >= 2 * HER_BATCH)
+            else $fatal (1, "HER_BATCH must be a power of two up to 8 and at most NUM_MPQ / 2!");
+    end
+    // pragma translate_on
+
     // Simulation only
     // pragma translate_off
     `ifndef VERILATOR
@@ -413,8 +777,10 @@ module mpq_engine #(
                 $display("%0d MPQ engine got feedback for msg id %0d", $time, feedback_i.msgid);
             end
 
-            if (her_ready_o && her_valid_i) begin
-                $display("%0d MPQ engine got new packet for msg id %0d", $time, her_i.msgid);
+            for (int i = 0; i < HER_BATCH; i++) begin
+                if (her_ready_o[i] && her_valid_i[i]) begin
+                    $display("%0d MPQ engine got new packet for msg id %0d", $time, her_i[i].msgid);
+                end
             end
 
         end
@@ -422,7 +788,7 @@ module mpq_engine #(
 
     // Assertions
     nonempty : assert property(
-      @(posedge clk_i) (mpq_busy=='0 && eos_i) |-> (fifo_empty))
+      @(posedge clk_i) (mpq_busy=='0 && eos_i) |-> (fifo_empty && stateless_empty))
         else $fatal (1, "Termination detected but there still are packets to process!");
 
     for (genvar i=0; i<NUM_MPQ; i++) begin
@@ -11,14 +11,17 @@
 import pspin_cfg_pkg::*;
 
 /** 
- NOTE: this module needs to be revisioned because by introducing a packet buffer in L1 we don't have
- the concept of "packet slots" anymore. The cluster_occup_i signal should be signal the available space
- instead of the number of available packet slots. 
+ NOTE: with a packet buffer in L1 we don't have the concept of "packet slots" anymore. The default
+ policy (SCHED_POLICY_HOME) still balances the number of assigned packets; SCHED_POLICY_SPACE and
+ SCHED_POLICY_TWO_CHOICE use the free space of the L1 packet buffers (cluster_free_space_i). All
+ policies keep at most NUM_HERS_PER_CLUSTER packets in a cluster.
 **/
 
 module scheduler #(
     parameter int NUM_CLUSTERS          = 4,
-    parameter int NUM_HERS_PER_CLUSTER  = 64
+    parameter int NUM_HERS_PER_CLUSTER  = 64,
+    parameter int SCHED_POLICY          = SCHED_POLICY_HOME,
+    parameter int HOME_MIN_FREE         = 8192 //[B], SCHED_POLICY_SPACE only
 ) (
     input   logic                               clk_i,
     input   logic                               rst_ni,
@@ -41,8 +44,10 @@ module scheduler #(
     //output IF to pktgen for feedbacks
     output logic                                pktgen_feedback_valid_o,
     input  logic                                pktgen_feedback_ready_i,
-    output feedback_descr_t                     pktgen_feedback_o 
-    
+    output feedback_descr_t                     pktgen_feedback_o,
+
+    //free space in the L1 packet buffers of the clusters
+    input  pkt_buff_space_t [NUM_CLUSTERS-1:0]  cluster_free_space_i
 );
 
     /////////////////////////
@@ -112,6 +117,13 @@ module scheduler #(
     logic [$clog2(NUM_CLUSTERS)-1:0] sel_cluster_id;
 
     handler_task_t task_q, task_d;
+
+    // registered like the other cluster signals. It lags the assignments by a few cycles,
+    // so it is a hint: the ready signal of the cluster still guards the allocation.
+    pkt_buff_space_t [NUM_CLUSTERS-1:0] cluster_free_space_q;
+
+    // pseudo-random cluster for SCHED_POLICY_TWO_CHOICE, advanced on every task
+    logic [15:0] lfsr_q, lfsr_d;
     /** end state **/
 
     /** combinatorial part **/
@@ -146,7 +158,64 @@ module scheduler #(
     //there might not space even if the occupation is ok).
     assign no_cluster_avail     = (cluster_occup_q[c_occup_min] >= MAX_OCC) ? 1'b1 : 1'b0;    
     assign can_use_home_cluster = (no_cluster_avail || (cluster_occup_q[home_cluster_id] < MAX_OCC && cluster_task_ready_id[home_cluster_id]));
-    assign sel_cluster_id       = (can_use_home_cluster) ? home_cluster_id : c_occup_min;
+
+    //clusters that can take a task now
+    logic [NUM_CLUSTERS-1:0] cluster_avail;
+    for (genvar i = 0; i < NUM_CLUSTERS; i++) begin : gen_cluster_avail
+        assign cluster_avail[i] = cluster_task_ready_id[i] && (cluster_occup_q[i] < MAX_OCC);
+    end
+
+    //available cluster with the most free space (home cluster if none is available)
+    logic [$clog2(NUM_CLUSTERS)-1:0] c_space_max;
+    always_comb begin
+        c_space_max = home_cluster_id;
+        for (int i = 0; i < NUM_CLUSTERS; i++) begin
+            if (cluster_avail[i] && (!cluster_avail[c_space_max] || cluster_free_space_q[i] > cluster_free_space_q[c_space_max])) begin
+                c_space_max = i;
+            end
+        end
+    end
+
+    //SCHED_POLICY_SPACE: stay in the home cluster while it keeps HOME_MIN_FREE bytes free after
+    //taking the packet, or if no other cluster has more free space.
+    logic space_use_home_cluster;
+    assign space_use_home_cluster = no_cluster_avail || (cluster_avail[home_cluster_id] &&
+                                    (cluster_free_space_q[home_cluster_id] >= task_descr_i.pkt_size + HOME_MIN_FREE ||
+                                     cluster_free_space_q[c_space_max] <= cluster_free_space_q[home_cluster_id]));
+
+    //SCHED_POLICY_TWO_CHOICE: the one with more free space between the home cluster and a random
+    //one. If neither is available, the one with the most free space.
+    logic [$clog2(NUM_CLUSTERS)-1:0] rand_cluster_id;
+    logic [$clog2(NUM_CLUSTERS)-1:0] two_choice_id;
+    assign rand_cluster_id = lfsr_q[$clog2(NUM_CLUSTERS)-1:0];
+    assign lfsr_d = (task_valid_i && task_ready_o) ? ((lfsr_q >> 1) ^ (lfsr_q[0] ? 16'hB400 : 16'h0)) : lfsr_q;
+
+    always_comb begin
+        if (no_cluster_avail) begin
+            two_choice_id = home_cluster_id;
+        end else if (cluster_avail[rand_cluster_id] && (!cluster_avail[home_cluster_id] ||
+                     cluster_free_space_q[rand_cluster_id] > cluster_free_space_q[home_cluster_id])) begin
+            two_choice_id = rand_cluster_id;
+        end else if (cluster_avail[home_cluster_id]) begin
+            two_choice_id = home_cluster_id;
+        end else begin
+            two_choice_id = c_space_max;
+        end
+    end
+
+    //stateless tasks have no home cluster: they go to the least loaded one
+    always_comb begin
+        if (task_descr_i.stateless) begin
+            sel_cluster_id = c_occup_min;
+        end else begin
+            case (SCHED_POLICY)
+                SCHED_POLICY_SPACE      : sel_cluster_id = (space_use_home_cluster) ? home_cluster_id : c_space_max;
+                SCHED_POLICY_TWO_CHOICE : sel_cluster_id = two_choice_id;
+                default                 : sel_cluster_id = (can_use_home_cluster) ? home_cluster_id : c_occup_min;
+            endcase
+        end
+    end
+
     assign cluster_id_d         = (state_q == ServePacket) ? sel_cluster_id : cluster_id_q;
 
     //task is put on all the output interfaces. Only the selected cluster ID will have
@@ -200,11 +269,15 @@ module scheduler #(
             cluster_id_q <= '0;
             task_q <= '0;
             cluster_occup_q <= '0;
+            cluster_free_space_q <= '0;
+            lfsr_q <= 16'hACE1;
         end else begin
             state_q <= state_d;
             cluster_id_q <= cluster_id_d;
             task_q <= task_d;
             cluster_occup_q <= cluster_occup_d;
+            cluster_free_space_q <= cluster_free_space_i;
+            lfsr_q <= lfsr_d;
         end
     end
 
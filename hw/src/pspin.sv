@@ -29,10 +29,10 @@ module pspin #(
   AXI_BUS.Master axi_host_mst,  // Host master port: to write to host memory
   AXI_BUS.Slave  axi_host_slv,  // Host slave port: to let the host write to L2 prog mem and L2 handler mem
 
-  //from pktgen
-  output logic                            her_ready_o,
-  input  logic                            her_valid_i,
-  input  pspin_cfg_pkg::her_descr_t       her_i,
+  //from pktgen (up to HER_BATCH HERs per cycle, see mpq_engine)
+  output logic [pspin_cfg_pkg::HER_BATCH-1:0] her_ready_o,
+  input  logic [pspin_cfg_pkg::HER_BATCH-1:0] her_valid_i,
+  input  pspin_cfg_pkg::her_descr_t [pspin_cfg_pkg::HER_BATCH-1:0] her_i,
   
   //termination signal    
   input  logic                            eos_i,
@@ -294,6 +294,9 @@ module pspin #(
   logic [N_CLUSTERS-1:0]                            loc_sched_ready;
   pspin_cfg_pkg::feedback_descr_t [N_CLUSTERS-1:0]  loc_sched_feedback;
 
+  // cluster_schedulers -> scheduler (L1 packet buffer free space)
+  pspin_cfg_pkg::pkt_buff_space_t [N_CLUSTERS-1:0]  cluster_free_space;
+
   logic [N_CLUSTERS-1:0]                            cluster_active_q;
   logic [N_CLUSTERS-1:0]                            cluster_active_d;
 
@@ -322,7 +325,10 @@ module pspin #(
 
   mpq_engine #(
     .NUM_HER_SLOTS          (pspin_cfg_pkg::NUM_MPQ_CELLS),
-    .NUM_MPQ                (N_MPQ) 
+    .NUM_MPQ                (N_MPQ),
+    .MPQ_HASH               (pspin_cfg_pkg::MPQ_HASH),
+    .MPQ_ARB                (pspin_cfg_pkg::MPQ_ARB),
+    .HER_BATCH              (pspin_cfg_pkg::HER_BATCH)
   ) i_mpq_engine (
     .rst_ni                 (rst_ni),
     .clk_i                  (clk_i),
@@ -351,7 +357,9 @@ module pspin #(
 
   scheduler #(
     .NUM_CLUSTERS             (N_CLUSTERS),
-    .NUM_HERS_PER_CLUSTER     (pspin_cfg_pkg::NUM_HERS_PER_CLUSTER)
+    .NUM_HERS_PER_CLUSTER     (pspin_cfg_pkg::NUM_HERS_PER_CLUSTER),
+    .SCHED_POLICY             (pspin_cfg_pkg::SCHED_POLICY),
+    .HOME_MIN_FREE            (pspin_cfg_pkg::SCHED_HOME_MIN_FREE)
   ) i_scheduler (
     .rst_ni                   (rst_ni),
     .clk_i                    (clk_i),
@@ -374,7 +382,8 @@ module pspin #(
     // from cluster schedulers
     .cluster_feedback_valid_i (loc_sched_valid),
     .cluster_feedback_ready_o (loc_sched_ready),
-    .cluster_feedback_i       (loc_sched_feedback)
+    .cluster_feedback_i       (loc_sched_feedback),
+    .cluster_free_space_i     (cluster_free_space)
   );
 
   soc_dma_wrap #(
@@ -569,6 +578,7 @@ module pspin #(
         .feedback_ready_i     (loc_sched_ready[i]),
         .feedback_o           (loc_sched_feedback[i]),
         .cluster_active_o     (cluster_active_d[i]),
+        .pkt_buff_free_space_o (cluster_free_space[i]),
         .cmd_ready_i          (cluster_cmd_ready[i]),
         .cmd_valid_o          (cluster_cmd_valid[i]),
         .cmd_o                (cluster_cmd[i]),
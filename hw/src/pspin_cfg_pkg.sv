@@ -28,13 +28,58 @@ package automatic pspin_cfg_pkg;
   localparam int unsigned       C_MSGID_WIDTH           = 10;
   localparam int unsigned       C_ADDR_WIDTH            = AXI_AW;
   localparam int unsigned       C_HOST_ADDR_WIDTH       = HOST_AXI_AW;
-  localparam int unsigned       NUM_CLUSTERS            = 2;
-  localparam int unsigned       NUM_CORES               = 8;
 
-  //MPQ engine
-  localparam int unsigned       NUM_MPQ                 = 16;
-  localparam int unsigned       NUM_MPQ_CELLS           = 128;
-  localparam int unsigned       NUM_MPQ_STATIC_CELLS    = 1; //per MPQ
+  //set with CLUSTERS and CORES (hw/pspin_conf.mk); NUM_CLUSTERS must be a power of two
+`ifndef PSPIN_NUM_CLUSTERS
+`define PSPIN_NUM_CLUSTERS 2
+`endif
+  localparam int unsigned       NUM_CLUSTERS            = `PSPIN_NUM_CLUSTERS;
+  localparam int unsigned       NUM_CORES               = pulp_cluster_cfg_pkg::N_CORES;
+
+  //MPQ engine; set with NUM_MPQ, NUM_MPQ_CELLS, NUM_MPQ_STATIC_CELLS and MPQ_HASH in
+  //the verilator model Makefile. NUM_MPQ must be a power of two and NUM_MPQ_CELLS at
+  //least NUM_MPQ * NUM_MPQ_STATIC_CELLS (the rest is shared among the MPQs).
+`ifndef PSPIN_NUM_MPQ
+`define PSPIN_NUM_MPQ 16
+`endif
+`ifndef PSPIN_NUM_MPQ_CELLS
+`define PSPIN_NUM_MPQ_CELLS 128
+`endif
+`ifndef PSPIN_NUM_MPQ_STATIC_CELLS
+`define PSPIN_NUM_MPQ_STATIC_CELLS 1
+`endif
+`ifndef PSPIN_MPQ_HASH
+`define PSPIN_MPQ_HASH 0
+`endif
+`ifndef PSPIN_MPQ_ARB
+`define PSPIN_MPQ_ARB 0
+`endif
+`ifndef PSPIN_HER_BATCH
+`define PSPIN_HER_BATCH 1
+`endif
+  localparam int unsigned       NUM_MPQ                 = `PSPIN_NUM_MPQ;
+  localparam int unsigned       NUM_MPQ_CELLS           = `PSPIN_NUM_MPQ_CELLS;
+  localparam int unsigned       NUM_MPQ_STATIC_CELLS    = `PSPIN_NUM_MPQ_STATIC_CELLS; //per MPQ
+
+  //MPQ of a message (mpq_engine.sv)
+  localparam int unsigned       MPQ_HASH_LOW_BITS       = 0; // msgid low bits
+  localparam int unsigned       MPQ_HASH_MSGID          = 1; // XOR-fold of the msgid
+  localparam int unsigned       MPQ_HASH_MSGID_EC       = 2; // XOR-fold of the msgid and of the EC (handler memory, PH)
+  localparam int unsigned       MPQ_HASH                = `PSPIN_MPQ_HASH;
+
+  //arbitration among the MPQs with a task ready (mpq_engine.sv). ECs with sched_prio
+  //set are always served first; sched_quantum is the share of the WRR/DRR arbiters.
+  localparam int unsigned       MPQ_ARB_RR              = 0; // round robin, one task per turn
+  localparam int unsigned       MPQ_ARB_WRR             = 1; // weighted round robin (tasks per turn)
+  localparam int unsigned       MPQ_ARB_DRR             = 2; // deficit round robin (bytes per turn)
+  localparam int unsigned       MPQ_ARB                 = `PSPIN_MPQ_ARB;
+  localparam int unsigned       MPQ_WRR_DEFAULT_WEIGHT  = 1;
+  localparam int unsigned       MPQ_DRR_DEFAULT_QUANTUM = 2048; // [B]
+
+  //HERs that the MPQ engine can enqueue per cycle (1, 2, 4 or 8, at most NUM_MPQ / 2;
+  //set with HER_BATCH in the verilator model Makefile). The MPQs are split in
+  //HER_BATCH banks, and a cycle takes at most one HER per bank.
+  localparam int unsigned       HER_BATCH               = `PSPIN_HER_BATCH;
 
   localparam int unsigned       HER_FLAGS_IS_HDR_IDX    = 4;
   localparam int unsigned       HER_FLAGS_IS_CMPL_IDX   = 5;
@@ -65,8 +110,28 @@ package automatic pspin_cfg_pkg;
   //number of messages per cluster
   localparam int unsigned       NUM_MSG_PER_CLUSTER     = NUM_MPQ / NUM_CLUSTERS;
 
-  //max number of commands that an HPU can keep in flight
-  localparam int unsigned       NUM_HPU_CMDS            = 4;
+  //cluster selection policy of the scheduler (scheduler.sv); set with SCHED_POLICY
+  //and SCHED_HOME_MIN_FREE in the verilator model Makefile
+  localparam int unsigned       SCHED_POLICY_HOME       = 0; // home cluster, least occupied if full
+  localparam int unsigned       SCHED_POLICY_SPACE      = 1; // home cluster, most L1 free space if short
+  localparam int unsigned       SCHED_POLICY_TWO_CHOICE = 2; // home or a random cluster, most L1 free space
+`ifndef PSPIN_SCHED_POLICY
+`define PSPIN_SCHED_POLICY 0
+`endif
+`ifndef PSPIN_SCHED_HOME_MIN_FREE
+`define PSPIN_SCHED_HOME_MIN_FREE 8192
+`endif
+  localparam int unsigned       SCHED_POLICY            = `PSPIN_SCHED_POLICY;
+  //L1 packet buffer bytes that must stay free in the home cluster before
+  //leaving it (SCHED_POLICY_SPACE)
+  localparam int unsigned       SCHED_HOME_MIN_FREE     = `PSPIN_SCHED_HOME_MIN_FREE;
+
+  //max number of commands that an HPU can keep in flight (2 to 32, HPU_CMDS
+  //in the verilator model Makefile)
+`ifndef PSPIN_HPU_CMDS
+`define PSPIN_HPU_CMDS 4
+`endif
+  localparam int unsigned       NUM_HPU_CMDS            = `PSPIN_HPU_CMDS;
 
   //Number of command interfaces (NIC outbound, soc-level DMA) and IDs
   //NOTE: the IDs need to be consistent with the inputs of the cmd unit.
@@ -113,6 +178,7 @@ package automatic pspin_cfg_pkg;
   `AXI_TYPEDEF_RESP_T(host_resp_t, b_t, r_t)
 
   typedef logic [$clog2(NUM_HERS_PER_CLUSTER):0] cluster_occup_t;
+  typedef logic [$clog2(L1_PKT_BUFF_SIZE):0] pkt_buff_space_t;
   typedef logic [31:0] pkt_ptr_t;
 
   typedef logic [C_ADDR_WIDTH-1:0] mem_addr_t;
@@ -125,6 +191,7 @@ package automatic pspin_cfg_pkg;
     mem_size_t                 pkt_size;
     logic [C_MSGID_WIDTH-1:0]  msgid;
     logic                      trigger_feedback;
+    logic                      stateless;
   } feedback_descr_t;
 
   typedef struct packed {
@@ -153,6 +220,16 @@ package automatic pspin_cfg_pkg;
     mem_addr_t [NUM_CLUSTERS-1:0] scratchpad_addr;
     mem_size_t [NUM_CLUSTERS-1:0] scratchpad_size;
 
+    //MPQ arbitration
+    mem_size_t                 sched_quantum;
+    logic [7:0]                sched_prio;
+
+    //bytes of each packet copied to L1 before the handler starts (0: all)
+    mem_size_t                 l1_copy_size;
+
+    //stateless handler: no MPQ ordering, any cluster, payload handler only
+    logic [7:0]                stateless;
+
   } mpq_meta_t;
 
   typedef struct packed {
@@ -185,9 +262,11 @@ package automatic pspin_cfg_pkg;
     mem_size_t                      host_mem_size;
 
     mem_addr_t                      pkt_addr;
-    mem_size_t                      pkt_size;
+    mem_size_t                      pkt_size;       // bytes copied to L1
+    mem_size_t                      pkt_l2_size;    // whole packet (L2)
 
     logic                           trigger_feedback;
+    logic                           stateless;      // not ordered by an MPQ
 
     mem_addr_t [NUM_CLUSTERS-1:0]   scratchpad_addr;
     mem_size_t [NUM_CLUSTERS-1:0]   scratchpad_size;
@@ -36,6 +36,30 @@ module pspin_verilator #(
     // MPQ full signal
     output logic [NUM_MPQ-1:0]              mpq_full_o,
 
+    // HPU monitoring; HPU i is core i%NUM_CORES of cluster i/NUM_CORES
+    output logic [NUM_CLUSTERS*NUM_CORES-1:0][31:0] hpu_pc_o,       // PC (ID stage)
+    output logic [NUM_CLUSTERS*NUM_CORES-1:0][31:0] hpu_status_o,   // see HPU_STATUS_* in pspin.hpp
+    output logic [NUM_CLUSTERS*NUM_CORES-1:0][31:0] hpu_handler_o,  // current handler function
+    output logic [NUM_CLUSTERS*NUM_CORES-1:0][31:0] hpu_pkt_addr_o, // current packet (L2)
+    output logic [NUM_CLUSTERS*NUM_CORES-1:0][31:0] hpu_mpq_o,      // current MPQ
+    output logic [NUM_CLUSTERS*NUM_CORES-1:0][31:0] hpu_instret_o,  // minstret
+    output logic [NUM_CLUSTERS*NUM_CORES-1:0][31:0] hpu_ld_stall_o, // mhpmcounter3 (load-use stalls, see perf_start())
+    output logic [NUM_CLUSTERS-1:0][31:0]   cl_copy_start_o,  // bytes of the L1 packet copy of a task accepted in this cycle (0: none)
+    output logic [NUM_CLUSTERS-1:0][31:0]   cl_copy_pkt_size_o, // L2 size of that packet
+    output logic [NUM_CLUSTERS-1:0][31:0]   cl_copy_done_o,   // 1: the oldest L1 packet copy completed
+
+    // MPQ monitoring
+    output logic [NUM_MPQ-1:0][31:0]        mpq_length_o,   // HERs queued in the MPQ
+    output logic [NUM_MPQ-1:0][31:0]        mpq_status_o,   // see MPQ_STATUS_* in pspin.hpp
+    output logic [7:0][31:0]                her_mpq_o,      // MPQ of the HER on each input lane (0 above HER_BATCH)
+    output logic [7:0]                      mpq_her_valid_o,  // HER for an MPQ (not stateless) on the lane
+    output logic [7:0]                      mpq_her_ready_o,
+    output logic [7:0][31:0]                mpq_her_msgid_o,
+    output logic                            mpq_task_valid_o, // a task leaves the MPQ engine
+    output logic [31:0]                     mpq_task_mpq_o,   // its MPQ
+    output logic [31:0]                     mpq_task_size_o,  // its packet size
+    output logic                            mpq_stateless_task_o, // a task of a stateless EC leaves the MPQ engine
+
 
     /** NIC inbound engine AXI slave port **/
     // WRITE ADDRESS CHANNEL
@@ -284,6 +308,10 @@ module pspin_verilator #(
     input  mem_size_t                       her_meta_ph_size_i,
     input  mem_addr_t                       her_meta_th_addr_i,
     input  mem_size_t                       her_meta_th_size_i,
+    input  mem_size_t                       her_meta_sched_quantum_i,
+    input  logic [7:0]                      her_meta_sched_prio_i,
+    input  mem_size_t                       her_meta_l1_copy_size_i,
+    input  logic [7:0]                      her_meta_stateless_i,
     input  mem_addr_t                       her_meta_scratchpad_0_addr_i,
     input  mem_size_t                       her_meta_scratchpad_0_size_i,
     input  mem_addr_t                       her_meta_scratchpad_1_addr_i,
@@ -293,6 +321,12 @@ module pspin_verilator #(
     input  mem_addr_t                       her_meta_scratchpad_3_addr_i,
     input  mem_size_t                       her_meta_scratchpad_3_size_i,
 
+    // batched HERs, used instead of the fields above if HER_BATCH > 1. Lane i is
+    // only accepted together with lanes 0..i-1.
+    output logic [HER_BATCH-1:0]            her_batch_ready_o,
+    input  logic [HER_BATCH-1:0]            her_batch_valid_i,
+    input  her_descr_t [HER_BATCH-1:0]      her_batch_i,
+
     // to pktgen
     input  logic                            feedback_ready_i,
     output logic                            feedback_valid_o,
@@ -304,7 +338,7 @@ module pspin_verilator #(
     /** NIC outbound engine or NIC command unit **/
     input  logic                            nic_cmd_req_ready_i,
     output logic                            nic_cmd_req_valid_o,
-    output pspin_cmd_id_t                   nic_cmd_req_id_o,
+    output logic [31:0]                     nic_cmd_req_id_o,     // pspin_cmd_id_t (width depends on NUM_HPU_CMDS)
     output nid_t                            nic_cmd_req_nid_o,
     output fid_t                            nic_cmd_req_fid_o,
     output host_addr_t                      nic_cmd_req_src_addr_o,
@@ -312,7 +346,7 @@ module pspin_verilator #(
     output user_ptr_t                       nic_cmd_req_user_ptr_o,
 
     input logic                             nic_cmd_resp_valid_i,
-    input pspin_cmd_id_t                    nic_cmd_resp_id_i
+    input logic [31:0]                      nic_cmd_resp_id_i
 );
 
     import pulp_cluster_cfg_pkg::N_TCDM_BANKS;
@@ -367,6 +401,9 @@ module pspin_verilator #(
 
 
     her_descr_t         her_descr;
+    logic [HER_BATCH-1:0] her_ready;
+    logic [HER_BATCH-1:0] her_valid;
+    her_descr_t [HER_BATCH-1:0] her_batch;
     feedback_descr_t    feedback;
     pspin_cmd_t         nic_cmd_req;
     pspin_cmd_resp_t    nic_cmd_resp;
@@ -389,9 +426,9 @@ module pspin_verilator #(
         .axi_host_mst         (axi_host_mst),
         .axi_host_slv         (axi_host_slv),
 
-        .her_ready_o          (her_ready_o),
-        .her_valid_i          (her_valid_i),
-        .her_i                (her_descr),
+        .her_ready_o          (her_ready),
+        .her_valid_i          (her_valid),
+        .her_i                (her_batch),
         .eos_i                (eos_i),
         .nic_feedback_ready_i (feedback_ready_i),
         .nic_feedback_valid_o (feedback_valid_o),
@@ -432,8 +469,60 @@ module pspin_verilator #(
         $readmemh({get_slm_path(), "prog_mem_stim.slm"}, i_pspin.i_prog_mem.i_sram.i_tc_sram.sram);
     end
     
+    for (genvar iCluster = 0; iCluster < NUM_CLUSTERS; iCluster++) begin: gen_hpu_mon_cluster
+        for (genvar iCore = 0; iCore < NUM_CORES; iCore++) begin: gen_hpu_mon_core
+            localparam int unsigned HPU_ID = iCluster*NUM_CORES + iCore;
+
+            assign hpu_pc_o[HPU_ID]         = i_pspin.gen_clusters[iCluster].gen_cluster_sync.i_cluster.i_ooc.i_bound.CORE[iCore].core_region_i.RISCV_CORE.pc_id;
+            assign hpu_status_o[HPU_ID][0]  = i_pspin.gen_clusters[iCluster].gen_cluster_sync.i_cluster.i_ooc.i_bound.hpu_active[iCore] &&
+                                              !i_pspin.gen_clusters[iCluster].gen_cluster_sync.i_cluster.i_ooc.i_bound.hpu_task_ready[iCore];
+            assign hpu_status_o[HPU_ID][1]  = i_pspin.gen_clusters[iCluster].gen_cluster_sync.i_cluster.i_ooc.i_bound.CORE[iCore].i_hpu_driver.i_cmd_frontend.cmd_stall_mon;
+            // only the HPU that gets the waiting task (the lowest free one) waits for its copy
+            assign hpu_status_o[HPU_ID][2]  = i_pspin.gen_clusters[iCluster].gen_cluster_sync.i_cluster.i_ooc.i_bound.i_cluster_scheduler.pkt_dma_wait_mon &&
+                                              !i_pspin.gen_clusters[iCluster].gen_cluster_sync.i_cluster.i_ooc.i_bound.i_cluster_scheduler.no_free_hpu &&
+                                              i_pspin.gen_clusters[iCluster].gen_cluster_sync.i_cluster.i_ooc.i_bound.i_cluster_scheduler.free_hpu_idx == iCore;
+            assign hpu_status_o[HPU_ID][3]  = i_pspin.gen_clusters[iCluster].gen_cluster_sync.i_cluster.i_ooc.i_bound.hpu_active[iCore];
+            assign hpu_status_o[HPU_ID][4]  = i_pspin.gen_clusters[iCluster].gen_cluster_sync.i_cluster.i_ooc.i_bound.CORE[iCore].core_region_i.perf_counters[4];
+            assign hpu_status_o[HPU_ID][5]  = !i_pspin.gen_clusters[iCluster].gen_cluster_sync.i_cluster.i_ooc.i_bound.CORE[iCore].core_region_i.RISCV_CORE.cs_registers_i.mcountinhibit_q[3];
+            assign hpu_status_o[HPU_ID][31:6] = '0;
+            assign hpu_handler_o[HPU_ID]    = i_pspin.gen_clusters[iCluster].gen_cluster_sync.i_cluster.i_ooc.i_bound.CORE[iCore].i_hpu_driver.i_task_frontend.current_task_q.handler_task.handler_fun;
+            assign hpu_pkt_addr_o[HPU_ID]   = i_pspin.gen_clusters[iCluster].gen_cluster_sync.i_cluster.i_ooc.i_bound.CORE[iCore].i_hpu_driver.i_task_frontend.current_task_q.handler_task.pkt_addr;
+            assign hpu_mpq_o[HPU_ID]        = 32'(i_pspin.gen_clusters[iCluster].gen_cluster_sync.i_cluster.i_ooc.i_bound.CORE[iCore].i_hpu_driver.i_task_frontend.current_task_q.handler_task.msgid);
+            assign hpu_instret_o[HPU_ID]    = i_pspin.gen_clusters[iCluster].gen_cluster_sync.i_cluster.i_ooc.i_bound.CORE[iCore].core_region_i.RISCV_CORE.cs_registers_i.mhpmcounter_q[2][31:0];
+            assign hpu_ld_stall_o[HPU_ID]   = i_pspin.gen_clusters[iCluster].gen_cluster_sync.i_cluster.i_ooc.i_bound.CORE[iCore].core_region_i.RISCV_CORE.cs_registers_i.mhpmcounter_q[3][31:0];
+        end
+
+        assign cl_copy_start_o[iCluster]    = i_pspin.gen_clusters[iCluster].gen_cluster_sync.i_cluster.i_ooc.i_bound.i_cluster_scheduler.copy_start_mon;
+        assign cl_copy_pkt_size_o[iCluster] = i_pspin.gen_clusters[iCluster].gen_cluster_sync.i_cluster.i_ooc.i_bound.i_cluster_scheduler.task_descr_i.pkt_l2_size;
+        assign cl_copy_done_o[iCluster]     = 32'(i_pspin.gen_clusters[iCluster].gen_cluster_sync.i_cluster.i_ooc.i_bound.i_cluster_scheduler.dma_resp_i);
+    end
+
+    for (genvar iMPQ = 0; iMPQ < NUM_MPQ; iMPQ++) begin: gen_mpq_mon
+        assign mpq_length_o[iMPQ]       = 32'(i_pspin.i_mpq_engine.mpq_q[iMPQ].length);
+        assign mpq_status_o[iMPQ][0]    = i_pspin.i_mpq_engine.mpq_busy[iMPQ];
+        assign mpq_status_o[iMPQ][1]    = i_pspin.i_mpq_engine.fifo_full[iMPQ];
+        assign mpq_status_o[iMPQ][31:2] = '0;
+    end
+    for (genvar i = 0; i < 8; i++) begin: gen_her_mon
+        if (i < HER_BATCH) begin: gen_lane
+            assign her_mpq_o[i]       = 32'(i_pspin.i_mpq_engine.newher_mpq_idx[i]);
+            assign mpq_her_valid_o[i] = her_valid[i] && !i_pspin.i_mpq_engine.her_stateless[i];
+            assign mpq_her_ready_o[i] = her_ready[i];
+            assign mpq_her_msgid_o[i] = 32'(her_batch[i].msgid);
+        end else begin: gen_no_lane
+            assign her_mpq_o[i]       = '0;
+            assign mpq_her_valid_o[i] = 1'b0;
+            assign mpq_her_ready_o[i] = 1'b0;
+            assign mpq_her_msgid_o[i] = '0;
+        end
+    end
+    assign mpq_task_valid_o = i_pspin.i_mpq_engine.mpq_task_valid && i_pspin.i_mpq_engine.mpq_task_ready;
+    assign mpq_task_mpq_o   = 32'(i_pspin.i_mpq_engine.mpq_task.msgid);
+    assign mpq_task_size_o  = 32'(i_pspin.i_mpq_engine.mpq_task.pkt_size);
+    assign mpq_stateless_task_o = i_pspin.i_mpq_engine.stateless_task_valid && i_pspin.i_mpq_engine.stateless_task_ready;
+
     /* enable instruction fetch signal */
-    assign cl_fetch_en = (rst_ni) ? 4'b1111 : '0;
+    assign cl_fetch_en = (rst_ni) ? '1 : '0;
 
     // Connecting axi_ni
     assign axi_ni.aw_addr                           = ni_slave_aw_addr_i;
@@ -642,6 +731,18 @@ module pspin_verilator #(
     assign host_master_b_ready_o                    = axi_host_mst.b_ready;
 
     // Connecting her_descr
+    if (HER_BATCH == 1) begin: gen_her_fields
+        assign her_valid         = her_valid_i;
+        assign her_batch         = her_descr;
+        assign her_ready_o       = her_ready;
+        assign her_batch_ready_o = '0;
+    end else begin: gen_her_batch
+        assign her_valid         = her_batch_valid_i;
+        assign her_batch         = her_batch_i;
+        assign her_ready_o       = 1'b0;
+        assign her_batch_ready_o = her_ready;
+    end
+
     assign her_descr.msgid                          = her_msgid_i;
     assign her_descr.eom                            = her_is_eom_i;
     assign her_descr.her_addr                       = her_addr_i;
@@ -657,10 +758,26 @@ module pspin_verilator #(
     assign her_descr.mpq_meta.ph_size               = her_meta_ph_size_i;
     assign her_descr.mpq_meta.th_addr               = her_meta_th_addr_i;
     assign her_descr.mpq_meta.th_size               = her_meta_th_size_i;
-    assign her_descr.mpq_meta.scratchpad_addr[0]    = her_meta_scratchpad_0_addr_i;
-    assign her_descr.mpq_meta.scratchpad_addr[1]    = her_meta_scratchpad_1_addr_i;
-    assign her_descr.mpq_meta.scratchpad_size[0]    = her_meta_scratchpad_0_size_i;
-    assign her_descr.mpq_meta.scratchpad_size[1]    = her_meta_scratchpad_1_size_i;
+    assign her_descr.mpq_meta.sched_quantum         = her_meta_sched_quantum_i;
+    assign her_descr.mpq_meta.sched_prio            = her_meta_sched_prio_i;
+    assign her_descr.mpq_meta.l1_copy_size          = her_meta_l1_copy_size_i;
+    assign her_descr.mpq_meta.stateless             = her_meta_stateless_i;
+
+    // scratchpads of the first four clusters (see the task registers in hpu_driver.sv)
+    mem_addr_t [3:0] her_meta_scratchpad_addr;
+    mem_size_t [3:0] her_meta_scratchpad_size;
+    assign her_meta_scratchpad_addr = {her_meta_scratchpad_3_addr_i, her_meta_scratchpad_2_addr_i, her_meta_scratchpad_1_addr_i, her_meta_scratchpad_0_addr_i};
+    assign her_meta_scratchpad_size = {her_meta_scratchpad_3_size_i, her_meta_scratchpad_2_size_i, her_meta_scratchpad_1_size_i, her_meta_scratchpad_0_size_i};
+
+    for (genvar i = 0; i < NUM_CLUSTERS; i++) begin: gen_her_scratchpads
+        if (i < 4) begin: gen_slot
+            assign her_descr.mpq_meta.scratchpad_addr[i] = her_meta_scratchpad_addr[i];
+            assign her_descr.mpq_meta.scratchpad_size[i] = her_meta_scratchpad_size[i];
+        end else begin: gen_no_slot
+            assign her_descr.mpq_meta.scratchpad_addr[i] = '0;
+            assign her_descr.mpq_meta.scratchpad_size[i] = '0;
+        end
+    end
 
     // Connecting feedback
     assign feedback_her_addr_o                      = feedback.pkt_addr;
@@ -668,7 +785,7 @@ module pspin_verilator #(
     assign feedback_msgid_o                         = feedback.msgid;
 
     // Connecting NIC command request
-    assign nic_cmd_req_id_o                         = nic_cmd_req.cmd_id;
+    assign nic_cmd_req_id_o                         = 32'(nic_cmd_req.cmd_id);
     assign nic_cmd_req_nid_o                        = nic_cmd_req.descr.nic_cmd.nid;
     assign nic_cmd_req_fid_o                        = nic_cmd_req.descr.nic_cmd.fid;
     assign nic_cmd_req_src_addr_o                   = nic_cmd_req.descr.nic_cmd.src_addr;
@@ -676,7 +793,7 @@ module pspin_verilator #(
     assign nic_cmd_req_user_ptr_o                   = nic_cmd_req.descr.nic_cmd.user_ptr;
 
     // Connecting NIC command response
-    assign nic_cmd_resp.cmd_id                      = nic_cmd_resp_id_i;
+    assign nic_cmd_resp.cmd_id                      = pspin_cmd_id_t'(nic_cmd_resp_id_i);
 
 
   // Observe SoC bus for errors.
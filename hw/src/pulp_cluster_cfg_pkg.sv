@@ -15,8 +15,11 @@ package automatic pulp_cluster_cfg_pkg;
   // -- Decoupling of cluster clock domain
   localparam bit          ASYNC = 1'b0;
   localparam int unsigned DC_BUF_W = 8;
-  // -- Cores
-  localparam int unsigned N_CORES = 8; // must be a power of 2 and <= 8
+  // -- Cores (set with CORES, see hw/pspin_conf.mk)
+`ifndef PSPIN_NUM_CORES
+`define PSPIN_NUM_CORES 8
+`endif
+  localparam int unsigned N_CORES = `PSPIN_NUM_CORES; // must be a power of 2 and <= 8
   // -- AXI
   localparam int unsigned AXI_AW = 32; // [bit]
   localparam int unsigned AXI_DW = 64; // [bit]
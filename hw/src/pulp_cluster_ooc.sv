@@ -337,6 +337,7 @@ module pulp_cluster_ooc (
   output pspin_cfg_pkg::feedback_descr_t feedback_o,
 
   output logic                       cluster_active_o,
+  output pspin_cfg_pkg::pkt_buff_space_t pkt_buff_free_space_o,
 
   input  logic                       cmd_ready_i,
   output logic                       cmd_valid_o,
@@ -662,6 +663,7 @@ module pulp_cluster_ooc (
     .feedback_ready_i     (feedback_ready_i),
     .feedback_o           (feedback_o),
     .cluster_active_o     (cluster_active_o),
+    .pkt_buff_free_space_o (pkt_buff_free_space_o),
     .cmd_ready_i          (cmd_ready_i),
     .cmd_valid_o          (cmd_valid_o),
     .cmd_o                (cmd_o),
@@ -701,6 +703,7 @@ module pulp_cluster_sync (
   input  logic                       feedback_ready_i,
   output pspin_cfg_pkg::feedback_descr_t feedback_o,
   output logic                       cluster_active_o,
+  output pspin_cfg_pkg::pkt_buff_space_t pkt_buff_free_space_o,
   input  logic                       cmd_ready_i,
   output logic                       cmd_valid_o,
   output pspin_cfg_pkg::pspin_cmd_t      cmd_o,
@@ -974,6 +977,7 @@ module pulp_cluster_sync (
     .feedback_ready_i     (feedback_ready_i),
     .feedback_o           (feedback_o),
     .cluster_active_o     (cluster_active_o),
+    .pkt_buff_free_space_o (pkt_buff_free_space_o),
     .cmd_ready_i          (cmd_ready_i),
     .cmd_valid_o          (cmd_valid_o),
     .cmd_o                (cmd_o),
@@ -21,22 +21,115 @@
 extern "C" {  
 #endif  
 
+// Ingress network impairments (applied before packets are written to L2)
+typedef struct ni_impair_conf
+{
+    uint64_t seed;
+    double   drop_prob;         // independent loss probability
+    double   dup_prob;          // duplication probability
+    double   reorder_prob;      // probability of delivering a later packet first
+    uint32_t reorder_window;    // max displacement (in packets) + 1
+    double   ge_p;              // Gilbert-Elliott: good -> bad probability (0: disabled)
+    double   ge_r;              // Gilbert-Elliott: bad -> good probability
+    double   ge_loss_good;      // loss probability in the good state
+    double   ge_loss_bad;       // loss probability in the bad state
+} ni_impair_conf_t;
+
+#define NI_MAX_PRIORITIES 8
+
+typedef enum ni_ingress_mode
+{
+    NI_INGRESS_UNBOUNDED = 0,   // packets wait in the network for L2 space
+    NI_INGRESS_PFC,             // lossless: pause the sender (XOFF/XON)
+    NI_INGRESS_TAIL_DROP,
+    NI_INGRESS_RED
+} ni_ingress_mode_t;
+
+// NIC ingress buffer (packets received and waiting for L2 space)
+typedef struct ni_ingress_conf
+{
+    ni_ingress_mode_t mode;
+    uint32_t buffer_size;       // bytes per priority
+    uint32_t num_priorities;    // 1..NI_MAX_PRIORITIES (higher value: higher priority)
+    int32_t  prio_offset;       // packet byte holding the priority (-1: all packets in class 0)
+    uint8_t  prio_shift;        // priority = (pkt[prio_offset] >> prio_shift) & prio_mask
+    uint8_t  prio_mask;
+    uint32_t xoff_threshold;    // PFC: bytes
+    uint32_t xon_threshold;     // PFC: bytes
+    uint32_t pause_delay;       // PFC: cycles between XOFF and the sender stopping
+    uint32_t red_min_threshold; // RED: bytes
+    uint32_t red_max_threshold; // RED: bytes
+    double   red_max_prob;
+    double   red_weight;        // RED: weight of the occupancy average
+} ni_ingress_conf_t;
+
 typedef struct ni_conf
 {
     uint32_t axi_aw_buffer;
     uint32_t axi_w_buffer;
     uint32_t axi_b_buffer;
+    ni_impair_conf_t impair;
+    ni_ingress_conf_t ingress;
 } ni_conf_t;
 
+#define NO_MAX_PORTS 16
+#define NO_MAX_TRAFFIC_CLASSES 8
+
+typedef enum no_sched_policy
+{
+    NO_SCHED_STRICT = 0,        // highest non-empty class first
+    NO_SCHED_DRR,               // deficit round robin, tc_weight: quantum (bytes)
+    NO_SCHED_WFQ                // weighted fair queueing, tc_weight: weight
+} no_sched_policy_t;
+
+// Headers of the packets of RDMA commands (FID > 0)
+typedef enum no_pkt_format
+{
+    NO_PKT_FORMAT_OPAQUE = 0,   // zeroed 32-byte header
+    NO_PKT_FORMAT_ROCEV2,       // Eth/IPv4/UDP/BTH(/RETH) RDMA write
+    NO_PKT_FORMAT_SLMP          // Eth/IPv4/UDP/SLMP
+} no_pkt_format_t;
+
 typedef struct no_conf
 {
     uint32_t axi_ar_buffer;
     uint32_t axi_r_buffer;
     double   network_G;
     uint32_t max_pkt_size;
-    uint32_t max_network_queue_len;
+    uint32_t max_network_queue_len;     // per port
+    uint32_t num_ports;                 // 1..NO_MAX_PORTS; port = nid % num_ports
+    uint32_t num_tcs;                   // 1..NO_MAX_TRAFFIC_CLASSES; class = (nid / num_ports) % num_tcs
+    no_sched_policy_t sched_policy;
+    double   port_G[NO_MAX_PORTS];      // 0: network_G
+    uint32_t tc_weight[NO_MAX_TRAFFIC_CLASSES];
+    no_pkt_format_t pkt_format;
+    uint8_t  icrc;                      // append a 4-byte CRC to RDMA packets
+    uint32_t src_nid;                   // source address in the packet headers
 } no_conf_t;
 
+typedef enum pcie_model
+{
+    PCIE_MODEL_SIMPLE = 0,      // fixed latency (pcie_L) + per-byte gap (pcie_G)
+    PCIE_MODEL_TLP              // TLPs, flow-control credits, and read tags
+} pcie_model_t;
+
+// TLP-level PCIe model (host DMA). Data credits are 16 bytes.
+typedef struct pcie_tlp_conf
+{
+    uint32_t mps;               // max payload size (bytes)
+    uint32_t mrrs;              // max read request size (bytes)
+    uint32_t tlp_overhead;      // header, sequence number, LCRC, and framing bytes per TLP
+    uint32_t latency;           // one-way latency (cycles)
+    uint32_t ph_credits;        // posted header
+    uint32_t pd_credits;        // posted data
+    uint32_t nph_credits;       // non-posted header
+    uint32_t cplh_credits;      // completion header (NIC receive buffer)
+    uint32_t cpld_credits;      // completion data (NIC receive buffer)
+    uint32_t max_read_tags;     // outstanding read requests
+    uint32_t cpl_jitter;        // max extra completion latency (cycles)
+    uint64_t seed;
+} pcie_tlp_conf_t;
+
 typedef struct pcie_slv_conf
 {
     uint32_t axi_aw_buffer;
@@ -45,16 +138,103 @@ typedef struct pcie_slv_conf
     uint32_t axi_b_buffer;
     uint32_t axi_r_buffer;
     uint32_t pcie_L;
-    double   pcie_G;
+    double   pcie_G;            // ns/B
+    pcie_model_t model;
+    pcie_tlp_conf_t tlp;
 } pcie_slv_conf_t;
 
+// Waveform tracing (only effective with libpspin_debug.so).
+// If any trigger is set (>= 0), tracing starts when the trigger fires and
+// the [start_cycle, stop_cycle) window is relative to that cycle.
+typedef struct trace_conf
+{
+    const char *file;           // NULL: waves.vcd (waves.fst with TRACE_FST=1)
+    const char *scope;          // NULL: trace the whole design
+    uint32_t levels;            // hierarchy levels to trace below scope (0: all)
+    uint8_t  enabled;
+    uint64_t start_cycle;
+    uint64_t stop_cycle;        // 0: trace until the end of the simulation
+    int64_t  trigger_msgid;     // first HER of this message
+    int64_t  trigger_feedback;  // feedback of the N-th packet
+    int64_t  trigger_pc;        // any HPU reaching this PC
+    uint32_t flush_interval;    // cycles between trace flushes
+} trace_conf_t;
+
+typedef enum sched_model_policy
+{
+    SCHED_MODEL_HOME = 0,       // home cluster, least occupied if it is full (RTL)
+    SCHED_MODEL_LEAST_OCCUPIED,
+    SCHED_MODEL_ROUND_ROBIN,
+    SCHED_MODEL_SPACE_AWARE,    // home cluster while it keeps home_min_free bytes, most free L1 otherwise (RTL)
+    SCHED_MODEL_TWO_CHOICE      // more free L1 between home and a pseudo-random cluster (RTL)
+} sched_model_policy_t;
+
+// Cycle-approximate model of the packet scheduling pipeline (MPQ engine,
+// scheduler, cluster schedulers, HPUs). Only used by libpspin_native.so.
+typedef struct sched_model_conf
+{
+    uint8_t  enabled;
+    uint32_t num_clusters;
+    uint32_t num_cores;         // per cluster
+    uint32_t num_mpq;
+    uint32_t mpq_cells;         // HERs queued in the MPQ engine
+    uint32_t her_batch;         // HERs enqueued per cycle (HER_BATCH: MPQ banks)
+    uint32_t hers_per_cluster;  // tasks assigned to a cluster and not completed
+    uint32_t l1_pkt_buff_size;  // bytes per cluster
+    uint32_t l2_pkt_buff_size;  // bytes
+    sched_model_policy_t policy;
+    uint32_t home_min_free;     // bytes (SCHED_MODEL_SPACE_AWARE)
+    const char *handler_profile; // handler,cycles CSV (NULL: native durations)
+    double   cycles_per_ns;     // native durations -> cycles
+    uint64_t seed;              // handler profile sampling
+    uint32_t dispatch_latency;  // cycles from the task assignment to the handler start
+    uint32_t feedback_latency;  // cycles from the feedback arbiter to the NIC
+    uint32_t dma_latency;       // cycles of an L2 -> L1 packet copy (plus 64 B/cycle)
+} sched_model_conf_t;
+
 typedef struct pspin_conf {
     const char *slm_files_path;
     ni_conf_t ni_conf;
     no_conf_t no_conf;
     pcie_slv_conf_t pcie_slv_conf;
+    trace_conf_t trace_conf;
+    const char *chrome_trace_file;  // NULL: no chrome trace-event export
+    const char *msg_stats_file;     // NULL: no export; *.json: JSON, CSV otherwise
+    const char *hpu_util_file;      // per-HPU utilization time series (CSV)
+    uint32_t hpu_util_interval;     // cycles between samples (0: no time series)
+    const char *perf_samples_file;  // NULL: perf_start()/perf_stop() windows are only summarized
+    const char *handler_profile_file; // handler,cycles CSV of all handler executions (NULL: none)
+    sched_model_conf_t sched_model;
 } pspin_conf_t;
 
+typedef enum pspinsim_stat_type
+{
+    PSPINSIM_STAT_COUNTER,
+    PSPINSIM_STAT_GAUGE,
+    PSPINSIM_STAT_HISTOGRAM
+} pspinsim_stat_type_t;
+
+typedef enum pspinsim_stats_format
+{
+    PSPINSIM_STATS_JSON,
+    PSPINSIM_STATS_CSV
+} pspinsim_stats_format_t;
+
+#define PSPINSIM_STAT_HIST_BUCKETS 64
+
+// Snapshot of a statistic. Strings and buckets are owned by the simulator.
+typedef struct pspinsim_stat
+{
+    const char *module;
+    const char *name;
+    pspinsim_stat_type_t type;
+    uint64_t value;             // counters: value; histograms: number of samples
+    double gauge;               // gauges: value; histograms: mean
+    uint64_t min;               // histograms only
+    uint64_t max;               // histograms only
+    const uint64_t *buckets;    // histograms only: bucket i counts [2^i, 2^(i+1)), bucket 0 also counts 0
+} pspinsim_stat_t;
+
 typedef void (*pkt_out_cb_t)(uint8_t*, size_t);
 typedef void (*pkt_feedback_cb_t)(uint64_t, uint64_t, uint64_t, uint64_t);
 typedef void (*pcie_slv_write_cb_t)(uint64_t, uint8_t*, size_t);
@@ -69,11 +249,19 @@ int pspinsim_run();
 int pspinsim_run_tick(uint8_t *done_flag);
 int pspinsim_fini();
 
+int pspinsim_trace_enable(uint8_t enable);
+
+int pspinsim_stats_count(uint32_t *count);
+int pspinsim_stats_get(uint32_t idx, pspinsim_stat_t *stat);
+int pspinsim_stats_find(const char *module, const char *name, pspinsim_stat_t *stat);
+int pspinsim_stats_dump(const char *path, pspinsim_stats_format_t format);
+
 int pspinsim_packet_trace_read(const char* pkt_file_path, const char* data_file_path);
 int pspinsim_packet_add(spin_ec_t* ec, uint32_t msgid, uint8_t* pkt_data, size_t pkt_len, size_t pkt_l1_len, uint8_t eom, uint32_t wait_cycles, uint64_t user_ptr);
 int pspinsim_packet_eos();
 
 int pspinsim_cb_set_pkt_out(pkt_out_cb_t cb);
+int pspinsim_cb_set_port_pkt_out(uint32_t port, pkt_out_cb_t cb);
 int pspinsim_cb_set_pcie_slv_write(pcie_slv_write_cb_t cb);
 int pspinsim_cb_set_pcie_slv_read(pcie_slv_read_cb_t cb);
 int pspinsim_cb_set_pcie_mst_write_completion(pcie_mst_write_cb_t cb);
@@ -57,6 +57,20 @@ typedef struct spin_ec
     mem_addr_t scratchpad_addr[NUM_CLUSTERS];
     mem_size_t scratchpad_size[NUM_CLUSTERS];
 
+    //MPQ arbitration (MPQ_ARB in the verilator model Makefile)
+    uint32_t sched_quantum;     // DRR: bytes per round; WRR: tasks per round (0: default)
+    uint32_t sched_prio;        // 1: strict priority over the other ECs (control traffic)
+
+    //bytes of each packet copied to L1 before the handler starts (0: all);
+    //the whole packet stays in L2 (task->l2_pkt_mem, spin_pkt_l2_size())
+    uint32_t l1_copy_size;
+
+    //1: stateless handler. Every packet runs only the payload handler, on the
+    //least loaded cluster and without waiting for the other packets of its
+    //message. Nothing is copied to L1: task->pkt_mem is the packet in L2
+    //and l1_copy_size is ignored.
+    uint32_t stateless;
+
 } __attribute__((__packed__)) spin_ec_t;
 
 typedef uint32_t spin_nic_addr_t;
@@ -14,10 +14,28 @@
 
 #pragma once
 
-// WARNING: this has to match pspin_cfg_pkg.sv !!!
+// set by hw/pspin_conf.mk (CLUSTERS, CORES), with the same values passed to the RTL
+#ifndef NUM_CLUSTERS
 #define NUM_CLUSTERS 2
+#endif
+#ifndef NUM_CORES
 #define NUM_CORES 8
+#endif
+
+// WARNING: this has to match pspin_cfg_pkg.sv !!!
 #define C_MSGID_WIDTH 10
+
+// the task of a handler has the scratchpads of the first four clusters (hpu_driver.sv)
+#define TASK_SCRATCHPAD_SLOTS 4
+#define NUM_TASK_SCRATCHPADS (NUM_CLUSTERS < TASK_SCRATCHPAD_SLOTS ? NUM_CLUSTERS : TASK_SCRATCHPAD_SLOTS)
+
+// set by the Makefile, with the same value passed to the RTL
+#ifndef NUM_MPQ
+#define NUM_MPQ 16
+#endif
+#ifndef HER_BATCH
+#define HER_BATCH 1
+#endif
 #define PCIE_START_ADDR 0x1000000000000000
 
 // 1 MiB
@@ -0,0 +1,147 @@
+// Copyright 2020 ETH Zurich
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdarg.h>
+
+// Process IDs used in the trace
+#define CTRACE_PID_NIC_INBOUND 0
+#define CTRACE_PID_NIC_OUTBOUND 1
+#define CTRACE_PID_PCIE 2
+#define CTRACE_PID_CLUSTER(C) (10 + (C))
+
+namespace PsPIN
+{
+    // Writes events in the Chrome trace-event JSON format (open with
+    // about://tracing or https://ui.perfetto.dev). Times are in ps.
+    class ChromeTrace
+    {
+    private:
+        FILE *trace_file;
+        bool first_event;
+
+    public:
+        ChromeTrace(const char *filename)
+        {
+            first_event = true;
+            trace_file = fopen(filename, "w");
+            if (trace_file == NULL)
+            {
+                printf("Error: cannot open chrome trace file %s!\n", filename);
+                return;
+            }
+
+            fprintf(trace_file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+        }
+
+        ~ChromeTrace()
+        {
+            if (trace_file == NULL) return;
+
+            fprintf(trace_file, "\n]}\n");
+            fclose(trace_file);
+        }
+
+        bool is_open()
+        {
+            return trace_file != NULL;
+        }
+
+        void process_name(uint32_t pid, const char *name)
+        {
+            if (!begin_event("M", "process_name", "__metadata", pid, 0, 0)) return;
+            fprintf(trace_file, ",\"args\":{\"name\":\"%s\"}}", name);
+        }
+
+        void thread_name(uint32_t pid, uint32_t tid, const char *name)
+        {
+            if (!begin_event("M", "thread_name", "__metadata", pid, tid, 0)) return;
+            fprintf(trace_file, ",\"args\":{\"name\":\"%s\"}}", name);
+        }
+
+        // Span on a (pid, tid) track. args_fmt is a printf format for the
+        // content of the JSON args object (e.g., "\"size\":%u").
+        void complete(const char *name, const char *cat, uint32_t pid, uint32_t tid, uint64_t start, uint64_t end, const char *args_fmt = NULL, ...)
+        {
+            if (!begin_event("X", name, cat, pid, tid, start)) return;
+            fprintf(trace_file, ",\"dur\":%.6lf", ps_to_us(end - start));
+
+            va_list args;
+            va_start(args, args_fmt);
+            write_args(args_fmt, args);
+            va_end(args);
+        }
+
+        // Span that can overlap with others on the same process (e.g., packets)
+        void async_begin(const char *name, const char *cat, uint32_t pid, uint64_t id, uint64_t time, const char *args_fmt = NULL, ...)
+        {
+            if (!begin_event("b", name, cat, pid, 0, time)) return;
+            fprintf(trace_file, ",\"id\":\"0x%lx\"", id);
+
+            va_list args;
+            va_start(args, args_fmt);
+            write_args(args_fmt, args);
+            va_end(args);
+        }
+
+        void async_end(const char *name, const char *cat, uint32_t pid, uint64_t id, uint64_t time)
+        {
+            if (!begin_event("e", name, cat, pid, 0, time)) return;
+            fprintf(trace_file, ",\"id\":\"0x%lx\"}", id);
+        }
+
+        void instant(const char *name, const char *cat, uint32_t pid, uint32_t tid, uint64_t time, const char *args_fmt = NULL, ...)
+        {
+            if (!begin_event("i", name, cat, pid, tid, time)) return;
+            fprintf(trace_file, ",\"s\":\"t\"");
+
+            va_list args;
+            va_start(args, args_fmt);
+            write_args(args_fmt, args);
+            va_end(args);
+        }
+
+    private:
+        static double ps_to_us(uint64_t t)
+        {
+            return ((double) t) / 1000000;
+        }
+
+        bool begin_event(const char *ph, const char *name, const char *cat, uint32_t pid, uint32_t tid, uint64_t time)
+        {
+            if (trace_file == NULL) return false;
+
+            fprintf(trace_file, "%s{\"ph\":\"%s\",\"name\":\"%s\",\"cat\":\"%s\",\"pid\":%u,\"tid\":%u,\"ts\":%.6lf",
+                first_event ? "" : ",\n", ph, name, cat, pid, tid, ps_to_us(time));
+            first_event = false;
+
+            return true;
+        }
+
+        void write_args(const char *args_fmt, va_list args)
+        {
+            if (args_fmt != NULL)
+            {
+                fprintf(trace_file, ",\"args\":{");
+                vfprintf(trace_file, args_fmt, args);
+                fprintf(trace_file, "}");
+            }
+            fprintf(trace_file, "}");
+        }
+    };
+
+} // namespace PsPIN
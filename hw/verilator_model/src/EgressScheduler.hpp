@@ -0,0 +1,222 @@
+// Copyright 2020 ETH Zurich
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "SimStats.hpp"
+#include "pspinsim.h"
+
+#include <vector>
+#include <queue>
+#include <algorithm>
+#include <string>
+#include <string.h>
+#include <assert.h>
+#include <stdio.h>
+
+namespace PsPIN
+{
+    // Chooses which traffic class of an egress port transmits next. It only
+    // tracks the length of the queued packets: the owner keeps the packets in
+    // per-class FIFOs and pops the one of the class returned by dequeue().
+    // Strict priority serves the highest non-empty class; DRR gives each class
+    // tc_weight bytes of credit per round; WFQ is self-clocked (the virtual
+    // time is the finish tag of the last packet sent).
+    class EgressScheduler
+    {
+    private:
+        typedef struct queued_pkt
+        {
+            uint32_t bytes;
+            double finish_tag;
+        } queued_pkt_t;
+
+        typedef struct tc_state
+        {
+            std::queue<queued_pkt_t> pkts;
+            uint32_t weight;
+
+            int64_t deficit;
+            bool quantum_added;
+            double last_finish_tag;
+
+            // statistics
+            uint64_t sent_pkts;
+            uint64_t sent_bytes;
+            uint64_t max_queued;
+        } tc_state_t;
+
+        no_sched_policy_t policy;
+        std::vector<tc_state_t> tcs;
+
+        uint32_t drr_current;
+        double virtual_time;
+
+    public:
+        EgressScheduler(no_sched_policy_t policy, uint32_t num_tcs, const uint32_t *weights)
+            : policy(policy), tcs(num_tcs)
+        {
+            for (uint32_t i = 0; i < num_tcs; i++)
+            {
+                tcs[i].weight = std::max(weights[i], (uint32_t) 1);
+                tcs[i].deficit = 0;
+                tcs[i].quantum_added = false;
+                tcs[i].last_finish_tag = 0;
+                tcs[i].sent_pkts = 0;
+                tcs[i].sent_bytes = 0;
+                tcs[i].max_queued = 0;
+            }
+
+            drr_current = 0;
+            virtual_time = 0;
+        }
+
+        uint32_t num_tcs()
+        {
+            return tcs.size();
+        }
+
+        void enqueue(uint32_t tc, uint32_t bytes)
+        {
+            tc_state_t &t = tcs[tc];
+
+            queued_pkt_t pkt;
+            pkt.bytes = bytes;
+            pkt.finish_tag = std::max(virtual_time, t.last_finish_tag) + ((double) bytes) / t.weight;
+            t.last_finish_tag = pkt.finish_tag;
+
+            t.pkts.push(pkt);
+            t.max_queued = std::max(t.max_queued, (uint64_t) t.pkts.size());
+        }
+
+        bool empty()
+        {
+            for (uint32_t i = 0; i < tcs.size(); i++)
+            {
+                if (!tcs[i].pkts.empty()) return false;
+            }
+            return true;
+        }
+
+        // Returns the class whose head packet is sent next (-1: nothing queued)
+        int dequeue()
+        {
+            if (empty()) return -1;
+
+            int tc;
+            switch (policy)
+            {
+            case NO_SCHED_DRR:
+                tc = select_drr();
+                break;
+            case NO_SCHED_WFQ:
+                tc = select_wfq();
+                break;
+            default:
+                tc = select_strict();
+                break;
+            }
+
+            tc_state_t &t = tcs[tc];
+            queued_pkt_t &pkt = t.pkts.front();
+
+            if (policy == NO_SCHED_WFQ) virtual_time = pkt.finish_tag;
+
+            t.sent_pkts++;
+            t.sent_bytes += pkt.bytes;
+            t.pkts.pop();
+
+            return tc;
+        }
+
+    private:
+        int select_strict()
+        {
+            for (int i = tcs.size() - 1; i >= 0; i--)
+            {
+                if (!tcs[i].pkts.empty()) return i;
+            }
+            assert(0);
+            return -1;
+        }
+
+        // The current class keeps sending while its head fits in the deficit;
+        // the quantum is added once per visit.
+        int select_drr()
+        {
+            while (true)
+            {
+                tc_state_t &t = tcs[drr_current];
+
+                if (t.pkts.empty())
+                {
+                    t.deficit = 0;
+                    t.quantum_added = false;
+                    drr_current = (drr_current + 1) % tcs.size();
+                    continue;
+                }
+
+                if (!t.quantum_added)
+                {
+                    t.deficit += t.weight;
+                    t.quantum_added = true;
+                }
+
+                if (t.pkts.front().bytes <= t.deficit)
+                {
+                    t.deficit -= t.pkts.front().bytes;
+                    return drr_current;
+                }
+
+                t.quantum_added = false;
+                drr_current = (drr_current + 1) % tcs.size();
+            }
+        }
+
+        int select_wfq()
+        {
+            int best = -1;
+            for (uint32_t i = 0; i < tcs.size(); i++)
+            {
+                if (tcs[i].pkts.empty()) continue;
+                if (best < 0 || tcs[i].pkts.front().finish_tag < tcs[best].pkts.front().finish_tag) best = i;
+            }
+            return best;
+        }
+
+    public:
+        void print_stats(const char *prefix)
+        {
+            for (uint32_t i = 0; i < tcs.size(); i++)
+            {
+                printf("%sClass %u: packets: %lu; bytes: %lu; max queued: %lu\n", prefix, i, tcs[i].sent_pkts, tcs[i].sent_bytes, tcs[i].max_queued);
+            }
+        }
+
+        void register_stats(SimStats &stats, const char *module, const std::string &prefix)
+        {
+            char name[32];
+            for (uint32_t i = 0; i < tcs.size(); i++)
+            {
+                snprintf(name, sizeof(name), "tc%u.", i);
+                std::string pre = prefix + name;
+
+                stats.add_counter(module, pre + "pkts", &tcs[i].sent_pkts);
+                stats.add_counter(module, pre + "bytes", &tcs[i].sent_bytes);
+                stats.add_counter(module, pre + "max_queued", &tcs[i].max_queued);
+            }
+        }
+    };
+
+} // namespace PsPIN
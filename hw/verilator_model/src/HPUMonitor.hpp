@@ -0,0 +1,529 @@
+// Copyright 2020 ETH Zurich
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "Vpspin_verilator.h"
+#include "verilated.h"
+#include "SimModule.hpp"
+#include "ChromeTrace.hpp"
+#include "pspin.hpp"
+#include "spin.h"
+
+#include <vector>
+#include <deque>
+#include <map>
+#include <string>
+#include <string.h>
+#include <stdio.h>
+
+namespace PsPIN
+{
+    // Observes the HPUs (read-only), tracks handler executions, and accounts
+    // where each HPU spends its cycles. It also times the L2-to-L1 packet
+    // copy of every task, from the cycle its cluster accepts it to the
+    // completion of the copy (the handler cannot start before).
+    // perf_start()/perf_stop() windows (see pspin.h) are recorded here from
+    // the same core counters that the runtime writes to __hpu_perf in L2,
+    // plus the TCDM contention and command wait cycles of the window.
+    class HPUMonitor : public SimModule
+    {
+    private:
+        typedef struct perf_sample
+        {
+            uint64_t cycles;
+            uint64_t instret;
+            uint64_t ld_stall;
+            uint64_t tcdm_cont;
+            uint64_t dma_wait;
+        } perf_sample_t;
+
+        // Cycle accounting. Cycles are counted only once the HPU driver is
+        // active; busy + pkt_dma_wait + idle = active. cmd_stall is part of busy.
+        typedef struct hpu_cycles
+        {
+            uint64_t busy;
+            uint64_t cmd_stall;
+            uint64_t pkt_dma_wait;
+            uint64_t idle;
+        } hpu_cycles_t;
+
+        typedef struct hpu_state
+        {
+            bool running;
+            uint64_t handler_start;
+            uint64_t handler_cmd_stall_start;
+            uint32_t handler;
+            uint32_t pkt_addr;
+            uint32_t mpq;
+
+            hpu_cycles_t cycles;
+            hpu_cycles_t last_sample;
+            uint64_t handlers;
+            uint64_t home_handlers;
+
+            bool perf;
+            uint64_t perf_start;
+            uint32_t perf_instret_start;
+            perf_sample_t perf_window;
+            perf_sample_t perf_total;
+            uint64_t perf_samples;
+            StatsHistogram perf_cycles_hist;
+        } hpu_state_t;
+
+        typedef struct handler_stats
+        {
+            uint64_t count;
+            uint64_t sum_time;
+            uint64_t max_time;
+            uint64_t cmd_stall_cycles;
+            perf_sample_t perf;
+            uint64_t perf_samples;
+        } handler_stats_t;
+
+    private:
+        hpu_mon_port_t &hpu_mon;
+        std::vector<hpu_state_t> hpus;
+
+        ChromeTrace *ctrace;
+
+        // Utilization time series
+        FILE *util_file;
+        uint32_t util_interval;
+        uint64_t cycles;
+
+        // perf_start()/perf_stop() samples
+        FILE *perf_file;
+
+        // Duration of every handler, by name
+        FILE *profile_file;
+        std::map<uint32_t, std::string> handler_names;
+
+        //statistics
+    private:
+        uint64_t total_handlers;
+        uint64_t sum_handler_time;
+        uint64_t max_handler_time;
+        StatsHistogram handler_time_hist;
+
+        std::map<uint32_t, handler_stats_t> handler_stats;
+
+        // L1 packet copies: start cycles of the pending ones, per cluster
+        // (they complete in order)
+        std::vector<std::deque<uint64_t>> pending_copies;
+        uint64_t copies;
+        uint64_t copy_bytes;
+        uint64_t prefix_copies;     // only a prefix of the packet (L1 copy size)
+        uint64_t sum_copy_wait;
+        uint64_t max_copy_wait;
+        StatsHistogram copy_wait_hist;
+
+    public:
+        HPUMonitor(hpu_mon_port_t &hpu_mon)
+            : hpu_mon(hpu_mon), hpus(NUM_HPUS), pending_copies(NUM_CLUSTERS)
+        {
+            ctrace = NULL;
+            util_file = NULL;
+            util_interval = 0;
+            cycles = 0;
+            perf_file = NULL;
+            profile_file = NULL;
+
+            for (int i = 0; i < NUM_HPUS; i++)
+            {
+                hpus[i].running = false;
+                hpus[i].handler_start = 0;
+                hpus[i].handler_cmd_stall_start = 0;
+                hpus[i].handler = 0;
+                hpus[i].pkt_addr = 0;
+                hpus[i].mpq = 0;
+                memset(&hpus[i].cycles, 0, sizeof(hpu_cycles_t));
+                memset(&hpus[i].last_sample, 0, sizeof(hpu_cycles_t));
+                hpus[i].handlers = 0;
+                hpus[i].home_handlers = 0;
+                hpus[i].perf = false;
+                hpus[i].perf_start = 0;
+                hpus[i].perf_instret_start = 0;
+                memset(&hpus[i].perf_window, 0, sizeof(perf_sample_t));
+                memset(&hpus[i].perf_total, 0, sizeof(perf_sample_t));
+                hpus[i].perf_samples = 0;
+            }
+
+            total_handlers = 0;
+            sum_handler_time = 0;
+            max_handler_time = 0;
+
+            copies = 0;
+            copy_bytes = 0;
+            prefix_copies = 0;
+            sum_copy_wait = 0;
+            max_copy_wait = 0;
+        }
+
+        ~HPUMonitor()
+        {
+            if (util_file != NULL)
+                fclose(util_file);
+            if (perf_file != NULL)
+                fclose(perf_file);
+            if (profile_file != NULL)
+                fclose(profile_file);
+        }
+
+        // Every interval cycles, writes a CSV row per HPU with the cycles
+        // spent in each state since the previous sample.
+        int set_util_sampling(const char *filename, uint32_t interval)
+        {
+            if (interval == 0) return SPIN_SUCCESS;
+
+            util_file = fopen(filename, "w");
+            if (util_file == NULL)
+            {
+                printf("Error: cannot open HPU utilization file %s!\n", filename);
+                return SPIN_ERR;
+            }
+
+            util_interval = interval;
+            fprintf(util_file, "cycle,cluster,core,busy,cmd_stall,pkt_dma_wait,idle\n");
+
+            return SPIN_SUCCESS;
+        }
+
+        // Writes a CSV row per perf_start()/perf_stop() window
+        int set_perf_samples(const char *filename)
+        {
+            perf_file = fopen(filename, "w");
+            if (perf_file == NULL)
+            {
+                printf("Error: cannot open perf samples file %s!\n", filename);
+                return SPIN_ERR;
+            }
+
+            fprintf(perf_file, "cycle,cluster,core,handler,cycles,instret,ld_stall,tcdm_cont,dma_wait\n");
+
+            return SPIN_SUCCESS;
+        }
+
+        // Writes a CSV row (handler, cycles) per handler execution
+        int set_handler_profile(const char *filename)
+        {
+            profile_file = fopen(filename, "w");
+            if (profile_file == NULL)
+            {
+                printf("Error: cannot open handler profile %s!\n", filename);
+                return SPIN_ERR;
+            }
+
+            fprintf(profile_file, "handler,cycles\n");
+
+            return SPIN_SUCCESS;
+        }
+
+        // Handlers without a name are reported by address
+        void set_handler_name(uint32_t handler, const char *name)
+        {
+            handler_names[handler] = name;
+        }
+
+        void set_chrome_trace(ChromeTrace *ctrace)
+        {
+            this->ctrace = ctrace;
+
+            if (ctrace == NULL) return;
+
+            char name[32];
+            for (int c = 0; c < NUM_CLUSTERS; c++)
+            {
+                snprintf(name, sizeof(name), "Cluster %d", c);
+                ctrace->process_name(CTRACE_PID_CLUSTER(c), name);
+                for (int i = 0; i < NUM_CORES; i++)
+                {
+                    snprintf(name, sizeof(name), "HPU %d", i);
+                    ctrace->thread_name(CTRACE_PID_CLUSTER(c), i, name);
+                }
+            }
+        }
+
+        void posedge()
+        {
+            cycles++;
+
+            for (int i = 0; i < NUM_HPUS; i++)
+            {
+                uint32_t status = hpu_mon.status_i[i];
+                bool running = (status & HPU_STATUS_RUNNING) != 0;
+                hpu_state_t &hpu = hpus[i];
+
+                if (running && !hpu.running)
+                {
+                    hpu.handler_start = sim_time();
+                    hpu.handler_cmd_stall_start = hpu.cycles.cmd_stall;
+                    hpu.handler = hpu_mon.handler_i[i];
+                    hpu.pkt_addr = hpu_mon.pkt_addr_i[i];
+                    hpu.mpq = hpu_mon.mpq_i[i];
+                }
+                else if (!running && hpu.running)
+                {
+                    handler_done(i, hpu);
+                }
+
+                hpu.running = running;
+
+                bool perf = (status & HPU_STATUS_PERF) != 0;
+                if (perf && !hpu.perf)
+                {
+                    hpu.perf_start = cycles;
+                    hpu.perf_instret_start = hpu_mon.instret_i[i];
+                    memset(&hpu.perf_window, 0, sizeof(perf_sample_t));
+                }
+
+                if (perf)
+                {
+                    if (status & HPU_STATUS_TCDM_CONT) hpu.perf_window.tcdm_cont++;
+                    if (status & HPU_STATUS_CMD_STALL) hpu.perf_window.dma_wait++;
+                }
+                else if (hpu.perf)
+                {
+                    perf_window_done(i, hpu);
+                }
+
+                hpu.perf = perf;
+
+                if (status & HPU_STATUS_ACTIVE)
+                {
+                    if (running)
+                    {
+                        hpu.cycles.busy++;
+                        if (status & HPU_STATUS_CMD_STALL) hpu.cycles.cmd_stall++;
+                    }
+                    else if (status & HPU_STATUS_PKT_DMA_WAIT)
+                    {
+                        hpu.cycles.pkt_dma_wait++;
+                    }
+                    else
+                    {
+                        hpu.cycles.idle++;
+                    }
+                }
+            }
+
+            for (int i = 0; i < NUM_CLUSTERS; i++)
+            {
+                std::deque<uint64_t> &pending = pending_copies[i];
+
+                if (hpu_mon.copy_done_i[i] && !pending.empty())
+                {
+                    uint64_t wait = cycles - pending.front();
+                    pending.pop_front();
+
+                    sum_copy_wait += wait;
+                    if (wait > max_copy_wait) max_copy_wait = wait;
+                    copy_wait_hist.add(wait);
+                }
+
+                uint32_t copy_size = hpu_mon.copy_start_i[i];
+                if (copy_size > 0)
+                {
+                    pending.push_back(cycles);
+                    copies++;
+                    copy_bytes += copy_size;
+                    if (copy_size < hpu_mon.copy_pkt_size_i[i]) prefix_copies++;
+                }
+            }
+
+            if (util_file != NULL && cycles % util_interval == 0)
+            {
+                sample_util();
+            }
+        }
+
+        void negedge()
+        {
+        }
+
+    private:
+        void handler_done(uint32_t hpu_id, hpu_state_t &hpu)
+        {
+            // tasks without handler are only forwarded to the feedback path
+            if (hpu.handler == 0) return;
+
+            uint64_t handler_time = sim_time() - hpu.handler_start;
+
+            total_handlers++;
+            sum_handler_time += handler_time;
+            max_handler_time = std::max(max_handler_time, handler_time);
+            handler_time_hist.add(handler_time / 1000);
+
+            // the home cluster of a message is given by the low bits of its MPQ
+            hpu.handlers++;
+            if (hpu.mpq % NUM_CLUSTERS == hpu_id / NUM_CORES) hpu.home_handlers++;
+
+            handler_stats_t &hs = get_handler_stats(hpu.handler);
+            hs.count++;
+            hs.sum_time += handler_time;
+            hs.max_time = std::max(hs.max_time, handler_time);
+            hs.cmd_stall_cycles += hpu.cycles.cmd_stall - hpu.handler_cmd_stall_start;
+
+            if (profile_file != NULL)
+            {
+                auto it = handler_names.find(hpu.handler);
+                if (it != handler_names.end()) fprintf(profile_file, "%s,%lu\n", it->second.c_str(), handler_time / 1000);
+                else fprintf(profile_file, "0x%x,%lu\n", hpu.handler, handler_time / 1000);
+            }
+
+            if (ctrace)
+            {
+                ctrace->complete("handler", "hpu", CTRACE_PID_CLUSTER(hpu_id / NUM_CORES), hpu_id % NUM_CORES, hpu.handler_start, sim_time(),
+                    "\"handler\":\"0x%x\",\"pkt_addr\":\"0x%x\",\"mpq\":%u", hpu.handler, hpu.pkt_addr, hpu.mpq);
+            }
+        }
+
+        handler_stats_t &get_handler_stats(uint32_t handler)
+        {
+            auto it = handler_stats.find(handler);
+            if (it == handler_stats.end())
+            {
+                handler_stats_t hs;
+                memset(&hs, 0, sizeof(hs));
+                it = handler_stats.insert(std::make_pair(handler, hs)).first;
+            }
+            return it->second;
+        }
+
+        // The core counters are read once perf_stop() has inhibited them
+        void perf_window_done(uint32_t hpu_id, hpu_state_t &hpu)
+        {
+            perf_sample_t &w = hpu.perf_window;
+            w.cycles = cycles - hpu.perf_start;
+            w.instret = (uint32_t) (hpu_mon.instret_i[hpu_id] - hpu.perf_instret_start);
+            w.ld_stall = hpu_mon.ld_stall_i[hpu_id];
+
+            add_perf_sample(hpu.perf_total, w);
+            hpu.perf_samples++;
+            hpu.perf_cycles_hist.add(w.cycles);
+
+            handler_stats_t &hs = get_handler_stats(hpu.handler);
+            add_perf_sample(hs.perf, w);
+            hs.perf_samples++;
+
+            if (perf_file != NULL)
+            {
+                fprintf(perf_file, "%lu,%d,%d,0x%x,%lu,%lu,%lu,%lu,%lu\n", cycles, hpu_id / NUM_CORES, hpu_id % NUM_CORES, hpu.handler,
+                    w.cycles, w.instret, w.ld_stall, w.tcdm_cont, w.dma_wait);
+            }
+        }
+
+        static void add_perf_sample(perf_sample_t &total, const perf_sample_t &s)
+        {
+            total.cycles += s.cycles;
+            total.instret += s.instret;
+            total.ld_stall += s.ld_stall;
+            total.tcdm_cont += s.tcdm_cont;
+            total.dma_wait += s.dma_wait;
+        }
+
+        static void print_perf(const char *prefix, uint64_t samples, const perf_sample_t &p)
+        {
+            printf("%sperf samples: %lu; cycles: %lu; IPC: %.3lf; load-use stalls: %.2lf%%; TCDM contention: %.2lf%%; command wait: %.2lf%%\n",
+                prefix, samples, p.cycles, (p.cycles > 0) ? ((double) p.instret) / p.cycles : 0,
+                percent(p.ld_stall, p.cycles), percent(p.tcdm_cont, p.cycles), percent(p.dma_wait, p.cycles));
+        }
+
+        void sample_util()
+        {
+            for (int i = 0; i < NUM_HPUS; i++)
+            {
+                hpu_state_t &hpu = hpus[i];
+
+                fprintf(util_file, "%lu,%d,%d,%lu,%lu,%lu,%lu\n", cycles, i / NUM_CORES, i % NUM_CORES,
+                    hpu.cycles.busy - hpu.last_sample.busy,
+                    hpu.cycles.cmd_stall - hpu.last_sample.cmd_stall,
+                    hpu.cycles.pkt_dma_wait - hpu.last_sample.pkt_dma_wait,
+                    hpu.cycles.idle - hpu.last_sample.idle);
+
+                hpu.last_sample = hpu.cycles;
+            }
+        }
+
+        static double percent(uint64_t part, uint64_t total)
+        {
+            return (total > 0) ? (100.0 * part) / total : 0;
+        }
+
+    public:
+        void print_stats()
+        {
+            double avg_handler_time = (total_handlers > 0) ? ((double) sum_handler_time) / (1000 * total_handlers) : 0;
+
+            printf("HPU monitor:\n");
+            printf("\tHandlers: %lu; avg duration: %.3lf ns; max duration: %lu ns\n", total_handlers, avg_handler_time, max_handler_time / 1000);
+            printf("\tL1 packet copies: %lu (prefix only: %lu); bytes: %lu; wait per task: avg: %.2lf cycles; max: %lu cycles\n",
+                copies, prefix_copies, copy_bytes, (copies > 0) ? ((double) sum_copy_wait) / copies : 0, max_copy_wait);
+
+            for (int i = 0; i < NUM_HPUS; i++)
+            {
+                hpu_state_t &hpu = hpus[i];
+                uint64_t active = hpu.cycles.busy + hpu.cycles.pkt_dma_wait + hpu.cycles.idle;
+
+                printf("\tCluster %d HPU %d: busy: %.2lf%% (cmd stall: %.2lf%%); L1 packet DMA wait: %.2lf%%; idle: %.2lf%%; handlers: %lu (home cluster: %lu)\n",
+                    i / NUM_CORES, i % NUM_CORES, percent(hpu.cycles.busy, active), percent(hpu.cycles.cmd_stall, active),
+                    percent(hpu.cycles.pkt_dma_wait, active), percent(hpu.cycles.idle, active), hpu.handlers, hpu.home_handlers);
+
+                if (hpu.perf_samples > 0) print_perf("\t\t", hpu.perf_samples, hpu.perf_total);
+            }
+
+            for (auto it = handler_stats.begin(); it != handler_stats.end(); ++it)
+            {
+                handler_stats_t &hs = it->second;
+
+                printf("\tHandler 0x%x: executions: %lu; avg duration: %.3lf ns; max duration: %lu ns; cmd stall: %lu cycles\n",
+                    it->first, hs.count, ((double) hs.sum_time) / (1000 * hs.count), hs.max_time / 1000, hs.cmd_stall_cycles);
+
+                if (hs.perf_samples > 0) print_perf("\t\t", hs.perf_samples, hs.perf);
+            }
+        }
+
+        void register_stats(SimStats &stats)
+        {
+            stats.add_counter("hpu_monitor", "handlers", &total_handlers);
+            stats.add_histogram("hpu_monitor", "handler_duration_ns", &handler_time_hist);
+            stats.add_counter("hpu_monitor", "l1_copies", &copies);
+            stats.add_counter("hpu_monitor", "l1_copy_bytes", &copy_bytes);
+            stats.add_counter("hpu_monitor", "l1_prefix_copies", &prefix_copies);
+            stats.add_histogram("hpu_monitor", "l1_copy_wait_cycles", &copy_wait_hist);
+
+            char prefix[32];
+            for (int i = 0; i < NUM_HPUS; i++)
+            {
+                snprintf(prefix, sizeof(prefix), "cluster%d.hpu%d.", i / NUM_CORES, i % NUM_CORES);
+                std::string p(prefix);
+
+                stats.add_counter("hpu_monitor", p + "busy_cycles", &hpus[i].cycles.busy);
+                stats.add_counter("hpu_monitor", p + "cmd_stall_cycles", &hpus[i].cycles.cmd_stall);
+                stats.add_counter("hpu_monitor", p + "pkt_dma_wait_cycles", &hpus[i].cycles.pkt_dma_wait);
+                stats.add_counter("hpu_monitor", p + "idle_cycles", &hpus[i].cycles.idle);
+                stats.add_counter("hpu_monitor", p + "handlers", &hpus[i].handlers);
+                stats.add_counter("hpu_monitor", p + "home_handlers", &hpus[i].home_handlers);
+                stats.add_counter("hpu_monitor", p + "perf.samples", &hpus[i].perf_samples);
+                stats.add_counter("hpu_monitor", p + "perf.cycles", &hpus[i].perf_total.cycles);
+                stats.add_counter("hpu_monitor", p + "perf.instret", &hpus[i].perf_total.instret);
+                stats.add_counter("hpu_monitor", p + "perf.ld_stall_cycles", &hpus[i].perf_total.ld_stall);
+                stats.add_counter("hpu_monitor", p + "perf.tcdm_cont_cycles", &hpus[i].perf_total.tcdm_cont);
+                stats.add_counter("hpu_monitor", p + "perf.dma_wait_cycles", &hpus[i].perf_total.dma_wait);
+                stats.add_histogram("hpu_monitor", p + "perf.window_cycles", &hpus[i].perf_cycles_hist);
+            }
+        }
+    };
+
+} // namespace PsPIN
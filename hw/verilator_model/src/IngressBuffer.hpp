@@ -0,0 +1,221 @@
+// Copyright 2020 ETH Zurich
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "SimStats.hpp"
+#include "pspinsim.h"
+
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <string>
+#include <string.h>
+#include <assert.h>
+#include <stdio.h>
+
+namespace PsPIN
+{
+    // Accounting and admission policy of the NIC ingress buffer, i.e., the
+    // per-priority queues where packets wait for space in the L2 packet buffer.
+    // In PFC mode a priority is paused (XOFF) when its occupancy reaches
+    // xoff_threshold and resumed (XON) when it drops to xon_threshold; the
+    // sender stops pause_delay cycles after XOFF, the packets arriving in the
+    // meantime use the headroom up to buffer_size. In tail-drop and RED mode
+    // the sender is never paused and packets are dropped instead.
+    class IngressBuffer
+    {
+    private:
+        typedef struct prio_state
+        {
+            uint64_t occupancy;
+            bool xoff;
+            uint32_t pause_countdown;
+            double red_avg;
+
+            // statistics
+            uint64_t pause_cycles;
+            uint64_t xoff_events;
+            uint64_t drops;
+            uint64_t red_drops;
+            uint64_t pkts;
+            uint64_t max_occupancy;
+            uint64_t max_headroom;
+            uint64_t sum_occupancy;
+        } prio_state_t;
+
+        ni_ingress_conf_t conf;
+        std::vector<prio_state_t> prios;
+        std::mt19937_64 red_rng;
+        std::uniform_real_distribution<double> uniform;
+
+        uint64_t cycles;
+
+    public:
+        IngressBuffer(ni_ingress_conf_t &conf, uint64_t seed)
+            : conf(conf), red_rng(seed + 4), uniform(0.0, 1.0) // seed..seed+3 are used by IngressImpairment
+        {
+            if (this->conf.num_priorities == 0) this->conf.num_priorities = 1;
+            if (this->conf.num_priorities > NI_MAX_PRIORITIES) this->conf.num_priorities = NI_MAX_PRIORITIES;
+
+            prios.resize(this->conf.num_priorities);
+            for (uint32_t i = 0; i < prios.size(); i++)
+            {
+                memset(&prios[i], 0, sizeof(prio_state_t));
+            }
+
+            cycles = 0;
+        }
+
+        uint32_t num_priorities()
+        {
+            return prios.size();
+        }
+
+        uint32_t classify(const uint8_t *pkt_data, size_t pkt_len)
+        {
+            if (conf.prio_offset < 0 || (size_t) conf.prio_offset >= pkt_len) return 0;
+
+            uint32_t prio = (pkt_data[conf.prio_offset] >> conf.prio_shift) & conf.prio_mask;
+            return std::min(prio, (uint32_t) prios.size() - 1);
+        }
+
+        // The sender holds packets of a paused priority
+        bool paused(uint32_t prio)
+        {
+            prio_state_t &p = prios[prio];
+            return conf.mode == NI_INGRESS_PFC && p.xoff && p.pause_countdown == 0;
+        }
+
+        // A packet of this priority is arriving: returns false if it is dropped
+        bool admit(uint32_t prio, uint32_t bytes)
+        {
+            prio_state_t &p = prios[prio];
+
+            if (conf.mode == NI_INGRESS_RED)
+            {
+                p.red_avg = (1 - conf.red_weight) * p.red_avg + conf.red_weight * p.occupancy;
+
+                bool red_drop = false;
+                if (p.red_avg >= conf.red_max_threshold)
+                {
+                    red_drop = true;
+                }
+                else if (p.red_avg >= conf.red_min_threshold && conf.red_max_threshold > conf.red_min_threshold)
+                {
+                    double prob = conf.red_max_prob * (p.red_avg - conf.red_min_threshold) / (conf.red_max_threshold - conf.red_min_threshold);
+                    red_drop = uniform(red_rng) < prob;
+                }
+
+                if (red_drop)
+                {
+                    p.red_drops++;
+                    p.drops++;
+                    return false;
+                }
+            }
+
+            // tail drop (in PFC mode: the headroom was not enough)
+            if (p.occupancy + bytes > conf.buffer_size)
+            {
+                p.drops++;
+                return false;
+            }
+
+            p.pkts++;
+            p.occupancy += bytes;
+            p.max_occupancy = std::max(p.max_occupancy, p.occupancy);
+
+            if (conf.mode == NI_INGRESS_PFC)
+            {
+                if (p.occupancy > conf.xoff_threshold)
+                    p.max_headroom = std::max(p.max_headroom, p.occupancy - conf.xoff_threshold);
+
+                if (!p.xoff && p.occupancy >= conf.xoff_threshold)
+                {
+                    p.xoff = true;
+                    p.pause_countdown = conf.pause_delay;
+                    p.xoff_events++;
+                }
+            }
+
+            return true;
+        }
+
+        // A packet of this priority left the buffer (written to L2)
+        void release(uint32_t prio, uint32_t bytes)
+        {
+            prio_state_t &p = prios[prio];
+
+            assert(p.occupancy >= bytes);
+            p.occupancy -= bytes;
+
+            if (p.xoff && p.occupancy <= conf.xon_threshold)
+            {
+                p.xoff = false;
+            }
+        }
+
+        void tick()
+        {
+            cycles++;
+
+            for (uint32_t i = 0; i < prios.size(); i++)
+            {
+                prio_state_t &p = prios[i];
+
+                if (p.xoff && p.pause_countdown > 0) p.pause_countdown--;
+                if (paused(i)) p.pause_cycles++;
+
+                p.sum_occupancy += p.occupancy;
+            }
+        }
+
+        void print_stats()
+        {
+            static const char *mode_names[] = {"unbounded", "PFC", "tail drop", "RED"};
+
+            printf("\tIngress buffer (%s; %u B per priority):\n", mode_names[conf.mode], conf.buffer_size);
+            for (uint32_t i = 0; i < prios.size(); i++)
+            {
+                prio_state_t &p = prios[i];
+                double avg_occupancy = (cycles > 0) ? ((double) p.sum_occupancy) / cycles : 0;
+
+                printf("\t\tPriority %u: packets: %lu; drops: %lu (RED: %lu); XOFF: %lu; paused: %lu cycles; occupancy: avg: %.1lf B; max: %lu B; max headroom: %lu B\n",
+                    i, p.pkts, p.drops, p.red_drops, p.xoff_events, p.pause_cycles, avg_occupancy, p.max_occupancy, p.max_headroom);
+            }
+        }
+
+        void register_stats(SimStats &stats, const char *module)
+        {
+            char prefix[32];
+            for (uint32_t i = 0; i < prios.size(); i++)
+            {
+                snprintf(prefix, sizeof(prefix), "ingress.prio%u.", i);
+                std::string pre(prefix);
+                prio_state_t *p = &prios[i];
+
+                stats.add_counter(module, pre + "pkts", &p->pkts);
+                stats.add_counter(module, pre + "drops", &p->drops);
+                stats.add_counter(module, pre + "red_drops", &p->red_drops);
+                stats.add_counter(module, pre + "xoff_events", &p->xoff_events);
+                stats.add_counter(module, pre + "pause_cycles", &p->pause_cycles);
+                stats.add_counter(module, pre + "max_occupancy", &p->max_occupancy);
+                stats.add_counter(module, pre + "max_headroom", &p->max_headroom);
+                stats.add_gauge(module, pre + "avg_occupancy", [this, p]() { return (cycles > 0) ? ((double) p->sum_occupancy) / cycles : 0; });
+            }
+        }
+    };
+
+} // namespace PsPIN
@@ -0,0 +1,147 @@
+// Copyright 2020 ETH Zurich
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "SimStats.hpp"
+#include "pspinsim.h"
+
+#include <random>
+#include <algorithm>
+#include <functional>
+#include <stdio.h>
+
+namespace PsPIN
+{
+    // Network impairments applied to the packets arriving at the NIC inbound
+    // engine: random and burst (Gilbert-Elliott) loss, duplication, and
+    // bounded reordering. Each impairment draws from its own generator, so
+    // enabling one does not change the sequence of decisions of the others.
+    class IngressImpairment
+    {
+    private:
+        ni_impair_conf_t conf;
+
+        std::mt19937_64 drop_rng;
+        std::mt19937_64 burst_rng;
+        std::mt19937_64 dup_rng;
+        std::mt19937_64 reorder_rng;
+        std::uniform_real_distribution<double> uniform;
+
+        bool burst_bad_state;
+
+        //statistics
+    private:
+        uint64_t total_pkts;
+        uint64_t dropped_pkts;
+        uint64_t burst_dropped_pkts;
+        uint64_t duplicated_pkts;
+        uint64_t reordered_pkts;
+        uint64_t bad_state_pkts;
+
+    public:
+        IngressImpairment(ni_impair_conf_t &conf)
+            : conf(conf), drop_rng(conf.seed), burst_rng(conf.seed + 1), dup_rng(conf.seed + 2), reorder_rng(conf.seed + 3), uniform(0.0, 1.0)
+        {
+            burst_bad_state = false;
+
+            total_pkts = 0;
+            dropped_pkts = 0;
+            burst_dropped_pkts = 0;
+            duplicated_pkts = 0;
+            reordered_pkts = 0;
+            bad_state_pkts = 0;
+        }
+
+        static bool is_enabled(ni_impair_conf_t &conf)
+        {
+            return conf.drop_prob > 0 || conf.dup_prob > 0 || conf.ge_p > 0 || (conf.reorder_prob > 0 && conf.reorder_window > 1);
+        }
+
+        // Returns the position (0: no reordering) of the packet, among the
+        // first queue_len ones, that should be delivered instead of the head.
+        // Packets for which movable() is false are not swapped.
+        uint32_t reorder(size_t queue_len, std::function<bool(uint32_t)> movable)
+        {
+            uint32_t window = std::min((size_t) conf.reorder_window, queue_len);
+            if (window <= 1 || conf.reorder_prob == 0) return 0;
+            if (uniform(reorder_rng) >= conf.reorder_prob) return 0;
+
+            uint32_t pos = 1 + (reorder_rng() % (window - 1));
+            if (!movable(0) || !movable(pos)) return 0;
+
+            reordered_pkts++;
+            return pos;
+        }
+
+        // Called once per delivered packet
+        bool drop()
+        {
+            total_pkts++;
+
+            bool dropped = false;
+
+            if (conf.ge_p > 0)
+            {
+                // Gilbert-Elliott: first move the channel state, then lose with the state's probability
+                if (burst_bad_state)
+                    burst_bad_state = uniform(burst_rng) >= conf.ge_r;
+                else
+                    burst_bad_state = uniform(burst_rng) < conf.ge_p;
+
+                if (burst_bad_state) bad_state_pkts++;
+
+                double loss = burst_bad_state ? conf.ge_loss_bad : conf.ge_loss_good;
+                if (uniform(burst_rng) < loss)
+                {
+                    burst_dropped_pkts++;
+                    dropped = true;
+                }
+            }
+
+            if (!dropped && conf.drop_prob > 0 && uniform(drop_rng) < conf.drop_prob)
+            {
+                dropped = true;
+            }
+
+            if (dropped) dropped_pkts++;
+            return dropped;
+        }
+
+        bool duplicate()
+        {
+            if (conf.dup_prob == 0 || uniform(dup_rng) >= conf.dup_prob) return false;
+
+            duplicated_pkts++;
+            return true;
+        }
+
+        void print_stats()
+        {
+            printf("\tImpairments: packets: %lu; dropped: %lu (burst: %lu; bad state: %lu pkts); duplicated: %lu; reordered: %lu\n",
+                total_pkts, dropped_pkts, burst_dropped_pkts, bad_state_pkts, duplicated_pkts, reordered_pkts);
+        }
+
+        void register_stats(SimStats &stats, const char *module)
+        {
+            stats.add_counter(module, "impair.pkts", &total_pkts);
+            stats.add_counter(module, "impair.dropped", &dropped_pkts);
+            stats.add_counter(module, "impair.burst_dropped", &burst_dropped_pkts);
+            stats.add_counter(module, "impair.bad_state_pkts", &bad_state_pkts);
+            stats.add_counter(module, "impair.duplicated", &duplicated_pkts);
+            stats.add_counter(module, "impair.reordered", &reordered_pkts);
+        }
+    };
+
+} // namespace PsPIN
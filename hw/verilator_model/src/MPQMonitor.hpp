@@ -0,0 +1,194 @@
+// Copyright 2020 ETH Zurich
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "Vpspin_verilator.h"
+#include "verilated.h"
+#include "SimModule.hpp"
+#include "pspin.hpp"
+
+#include <vector>
+#include <string>
+#include <stdio.h>
+#include <assert.h>
+
+namespace PsPIN
+{
+    // Observes the MPQ engine (read-only): per-MPQ occupancy and the cycles
+    // in which an MPQ blocks the HER input. The input is in order, so a full
+    // MPQ also stalls the HERs of all the other messages behind it
+    // (head-of-line blocking). With HER_BATCH > 1 only the first input lane
+    // blocks the input; the other lanes wait for the next cycle. The tasks and bytes served per MPQ show how
+    // the arbitration (MPQ_ARB) shares the clusters among the messages.
+    // Tasks of stateless ECs bypass the MPQs and are only counted.
+    class MPQMonitor : public SimModule
+    {
+    private:
+        typedef struct mpq_state
+        {
+            uint64_t hers;
+            uint64_t shared_hers;   // entered while the MPQ was busy with another message
+            uint64_t sum_length;    // over all cycles (average occupancy)
+            uint64_t max_length;
+            uint64_t busy_cycles;
+            uint64_t full_cycles;
+            uint64_t hol_cycles;    // the HER on the input waits for this MPQ
+            uint64_t tasks;
+            uint64_t task_bytes;
+            uint32_t last_msgid;
+        } mpq_state_t;
+
+    private:
+        mpq_mon_port_t &mpq_mon;
+        std::vector<mpq_state_t> mpqs;
+
+        //statistics
+        uint64_t cycles;
+        uint64_t hers;
+        uint64_t hol_cycles;
+        uint64_t tasks;
+        uint64_t stateless_tasks;
+
+    public:
+        MPQMonitor(mpq_mon_port_t &mpq_mon)
+            : mpq_mon(mpq_mon), mpqs(NUM_MPQ)
+        {
+            cycles = 0;
+            hers = 0;
+            hol_cycles = 0;
+            tasks = 0;
+            stateless_tasks = 0;
+
+            for (int i = 0; i < NUM_MPQ; i++)
+            {
+                mpqs[i].hers = 0;
+                mpqs[i].shared_hers = 0;
+                mpqs[i].sum_length = 0;
+                mpqs[i].max_length = 0;
+                mpqs[i].busy_cycles = 0;
+                mpqs[i].full_cycles = 0;
+                mpqs[i].hol_cycles = 0;
+                mpqs[i].tasks = 0;
+                mpqs[i].task_bytes = 0;
+                mpqs[i].last_msgid = 0;
+            }
+        }
+
+        void posedge()
+        {
+            cycles++;
+
+            for (int i = 0; i < NUM_MPQ; i++)
+            {
+                mpq_state_t &mpq = mpqs[i];
+                uint32_t length = mpq_mon.length_i[i];
+                uint32_t status = mpq_mon.status_i[i];
+
+                mpq.sum_length += length;
+                if (length > mpq.max_length) mpq.max_length = length;
+                if (status & MPQ_STATUS_BUSY) mpq.busy_cycles++;
+                if (status & MPQ_STATUS_FULL) mpq.full_cycles++;
+            }
+
+            if (*mpq_mon.task_valid_i)
+            {
+                uint32_t task_idx = *mpq_mon.task_mpq_i;
+                assert(task_idx < NUM_MPQ);
+                mpqs[task_idx].tasks++;
+                mpqs[task_idx].task_bytes += *mpq_mon.task_size_i;
+                tasks++;
+            }
+
+            if (*mpq_mon.stateless_task_i) stateless_tasks++;
+
+            for (int i = 0; i < HER_BATCH; i++)
+            {
+                if (!(*mpq_mon.her_valid_i & (1 << i))) continue;
+
+                uint32_t idx = mpq_mon.her_mpq_i[i];
+                assert(idx < NUM_MPQ);
+                mpq_state_t &mpq = mpqs[idx];
+
+                if (!(*mpq_mon.her_ready_i & (1 << i)))
+                {
+                    if (i == 0)
+                    {
+                        mpq.hol_cycles++;
+                        hol_cycles++;
+                    }
+                    return;
+                }
+
+                uint32_t msgid = mpq_mon.her_msgid_i[i];
+                if ((mpq_mon.status_i[idx] & MPQ_STATUS_BUSY) && msgid != mpq.last_msgid) mpq.shared_hers++;
+                mpq.last_msgid = msgid;
+                mpq.hers++;
+                hers++;
+            }
+        }
+
+        void negedge()
+        {
+        }
+
+        void print_stats()
+        {
+            printf("MPQ monitor (%d MPQs):\n", NUM_MPQ);
+            printf("\tHERs: %lu; tasks: %lu; stateless tasks: %lu; input blocked by a full MPQ: %lu cycles\n", hers, tasks, stateless_tasks, hol_cycles);
+
+            for (int i = 0; i < NUM_MPQ; i++)
+            {
+                mpq_state_t &mpq = mpqs[i];
+                if (mpq.hers == 0 && mpq.hol_cycles == 0 && mpq.tasks == 0) continue;
+
+                printf("\tMPQ %d: HERs: %lu (behind another message: %lu); tasks: %lu (%.2lf%%); bytes: %lu; avg length: %.2lf; max length: %lu; busy: %.2lf%%; full: %.2lf%%; input blocked: %lu cycles\n",
+                    i, mpq.hers, mpq.shared_hers, mpq.tasks, percent(mpq.tasks, tasks), mpq.task_bytes,
+                    (cycles > 0) ? ((double) mpq.sum_length) / cycles : 0, mpq.max_length,
+                    percent(mpq.busy_cycles, cycles), percent(mpq.full_cycles, cycles), mpq.hol_cycles);
+            }
+        }
+
+        void register_stats(SimStats &stats)
+        {
+            stats.add_counter("mpq_monitor", "cycles", &cycles);
+            stats.add_counter("mpq_monitor", "hers", &hers);
+            stats.add_counter("mpq_monitor", "hol_blocked_cycles", &hol_cycles);
+            stats.add_counter("mpq_monitor", "tasks", &tasks);
+            stats.add_counter("mpq_monitor", "stateless_tasks", &stateless_tasks);
+
+            for (int i = 0; i < NUM_MPQ; i++)
+            {
+                std::string p = "mpq" + std::to_string(i) + ".";
+
+                stats.add_counter("mpq_monitor", p + "hers", &mpqs[i].hers);
+                stats.add_counter("mpq_monitor", p + "shared_hers", &mpqs[i].shared_hers);
+                stats.add_counter("mpq_monitor", p + "length_sum", &mpqs[i].sum_length);
+                stats.add_counter("mpq_monitor", p + "max_length", &mpqs[i].max_length);
+                stats.add_counter("mpq_monitor", p + "busy_cycles", &mpqs[i].busy_cycles);
+                stats.add_counter("mpq_monitor", p + "full_cycles", &mpqs[i].full_cycles);
+                stats.add_counter("mpq_monitor", p + "hol_blocked_cycles", &mpqs[i].hol_cycles);
+                stats.add_counter("mpq_monitor", p + "tasks", &mpqs[i].tasks);
+                stats.add_counter("mpq_monitor", p + "task_bytes", &mpqs[i].task_bytes);
+            }
+        }
+
+    private:
+        static double percent(uint64_t part, uint64_t total)
+        {
+            return (total > 0) ? (100.0 * part) / total : 0;
+        }
+    };
+
+} // namespace PsPIN
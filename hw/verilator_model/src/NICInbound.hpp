@@ -19,13 +19,21 @@
 #include "verilated.h"
 #include "SimModule.hpp"
 #include "AXIMaster.hpp"
+#include "ChromeTrace.hpp"
+#include "IngressImpairment.hpp"
+#include "IngressBuffer.hpp"
 #include "pspin.hpp"
 #include "spin.h"
 #include "pspinsim.h"
 
 #include <queue>
+#include <deque>
 #include <vector>
+#include <map>
+#include <tuple>
 #include <unordered_map>
+#include <algorithm>
+#include <string.h>
 #include <stdio.h>
 
 #define NI_PKT_ADDR_ALIGNMENT 64
@@ -44,6 +52,8 @@ namespace PsPIN
             std::vector<uint8_t> pkt_data;
             size_t pkt_len;
             uint32_t wait_cycles;
+            bool impaired;      // drop/duplicate already decided
+            bool reordered;     // already moved by a reorder (at most once)
         } incoming_her_t;
 
     public:
@@ -52,6 +62,10 @@ namespace PsPIN
     public:
         typedef std::function<void(uint64_t, uint64_t, uint64_t, uint64_t)> pkt_feedback_cb_t;
 
+        // Simulation-internal listeners (e.g., trace triggers)
+        typedef std::function<void(her_descr_t &)> her_sent_listener_t;
+        typedef std::function<void(uint32_t)> feedback_listener_t;
+
     private:
         AXIMaster<AXIPortType> axi_driver;
         axi_addr_t l2_pkt_buff_start;
@@ -59,7 +73,7 @@ namespace PsPIN
         uint32_t hers_to_send;
 
         //HERs that are coming from the network (virtual delay applied)
-        std::queue<incoming_her_t> incoming_hers;
+        std::deque<incoming_her_t> incoming_hers;
 
         //HERs that have been read and for which a DMA write is in flight
         std::queue<her_descr_t> queued_hers;
@@ -67,6 +81,17 @@ namespace PsPIN
         //HERs that are ready to be sent to PsPIN (DMA completed)
         std::queue<her_descr_t> ready_hers;
 
+        //HER_BATCH > 1: HERs on the input lanes (lane i in her_lanes[i]) and
+        //how many of them PsPIN takes at the next clock edge
+        std::deque<her_descr_t> her_lanes;
+        uint32_t her_lanes_accepted;
+
+        //Packed mpq_meta_t of the last execution context (HER_BATCH > 1).
+        //Consecutive HERs mostly share it, so it is packed once.
+        uint32_t meta_image[(HER_META_BITS + 31) / 32];
+        spin_ec_t meta_image_ec;
+        bool meta_image_valid;
+
         uint32_t packet_wait_cycles;
 
         FILE *pkt_file;
@@ -81,6 +106,20 @@ namespace PsPIN
         bool app_sent_eos;
 
         pkt_feedback_cb_t feedback_cb;
+        her_sent_listener_t her_sent_listener;
+        feedback_listener_t feedback_listener;
+
+        ChromeTrace *ctrace;
+
+        IngressImpairment *impair;
+
+        //Packets received from the network and waiting for L2 space (one queue per priority)
+        IngressBuffer *ingress;
+        std::vector<std::deque<incoming_her_t>> ingress_queues;
+
+        //Per-packet latencies of each message, only kept for the message
+        //statistics export (they grow with every packet)
+        bool keep_pkt_latencies;
 
         //Statistics
     private:
@@ -89,28 +128,78 @@ namespace PsPIN
             uint64_t nic_arrival_time;
             uint64_t pspin_arrival_time;
             uint32_t size;
+            uint32_t msgid;
+            size_t msg_idx;
+            uint8_t eom;
             uint64_t user_ptr;
         } pktentry_t;
 
+        // One entry per message instance (a msgid can be reused after its EOM)
+        typedef struct msg_stats
+        {
+            uint32_t msgid;
+            uint32_t hh_addr;
+            uint32_t ph_addr;
+            uint32_t th_addr;
+            uint32_t pkts;
+            uint64_t bytes;
+            uint64_t first_arrival;     // NIC arrival of the header packet
+            uint64_t last_arrival;
+            uint64_t tail_done;         // feedback of the EOM packet (0: not completed)
+            std::vector<uint64_t> pkt_latencies;
+        } msg_stats_t;
+
+        // Per execution context, aggregated from the messages
+        typedef struct ec_stats
+        {
+            uint32_t hh_addr;
+            uint32_t ph_addr;
+            uint32_t th_addr;
+            uint32_t msgs;
+            uint32_t completed_msgs;
+            uint64_t pkts;
+            uint64_t bytes;
+            uint64_t first_arrival;
+            uint64_t last_arrival;
+            std::vector<uint64_t> pkt_latencies;
+            std::vector<uint64_t> completion_times;
+        } ec_stats_t;
+
+        typedef struct latency_summary
+        {
+            uint64_t min;
+            uint64_t p50;
+            uint64_t p90;
+            uint64_t p99;
+            uint64_t max;
+        } latency_summary_t;
+
         uint64_t total_bytes_sent;
         uint64_t total_pkts;
 
         uint64_t time_last_feedback;
         uint64_t time_first_feedback;
-        uint32_t total_feedbacks;
-        uint32_t ni_ctrl_stalls;
+        uint64_t total_feedbacks;
+        uint64_t ni_ctrl_stalls;
+        uint64_t her_batches;
 
         uint64_t sum_pkt_latency;
         uint64_t min_pkt_latency;
         uint64_t max_pkt_latency;
 
+        StatsHistogram pkt_latency_hist;
+
         std::unordered_map<axi_addr_t, pktentry> pktmap;
 
+        std::vector<msg_stats_t> msgs;
+        std::unordered_map<uint32_t, size_t> open_msgs;
+
     public:
         NICInbound<AXIPortType>(AXIPortType &ni_mst, ni_control_port_t &ni_ctrl, axi_addr_t l2_pkt_buff_start, uint32_t l2_pkt_buff_size)
             : axi_driver(ni_mst), ni_ctrl(ni_ctrl), l2_pkt_buff_start(l2_pkt_buff_start), l2_pkt_buff_size(l2_pkt_buff_size)
         {
             *ni_ctrl.her_valid_o = 0;
+            *ni_ctrl.her_batch_valid_o = 0;
             *ni_ctrl.eos_o = 0;
 
             // Accept feedbacks
@@ -123,6 +212,12 @@ namespace PsPIN
 
             app_sent_eos = false;
 
+            ctrace = NULL;
+            impair = NULL;
+            ingress = NULL;
+
+            keep_pkt_latencies = false;
+
             head_ptr = 0;
             tail_ptr = 0;
             cut_ptr = 0;
@@ -140,6 +235,10 @@ namespace PsPIN
             min_pkt_latency = 0;
             max_pkt_latency = 0;
             ni_ctrl_stalls = 0;
+            her_batches = 0;
+
+            her_lanes_accepted = 0;
+            meta_image_valid = false;
 
             hers_to_send = 0;
 
@@ -152,6 +251,10 @@ namespace PsPIN
                 fclose(data_file);
             if (pkt_file != NULL)
                 fclose(pkt_file);
+            if (impair != NULL)
+                delete impair;
+            if (ingress != NULL)
+                delete ingress;
         }
 
         void set_feedback_cb(pkt_feedback_cb_t cb)
@@ -159,6 +262,41 @@ namespace PsPIN
             this->feedback_cb = cb;
         }
 
+        void set_her_sent_listener(her_sent_listener_t listener)
+        {
+            this->her_sent_listener = listener;
+        }
+
+        void set_feedback_listener(feedback_listener_t listener)
+        {
+            this->feedback_listener = listener;
+        }
+
+        void set_keep_pkt_latencies(bool keep)
+        {
+            this->keep_pkt_latencies = keep;
+        }
+
+        void set_chrome_trace(ChromeTrace *ctrace)
+        {
+            this->ctrace = ctrace;
+            if (ctrace) ctrace->process_name(CTRACE_PID_NIC_INBOUND, "NIC inbound");
+        }
+
+        void set_impairment(ni_impair_conf_t &conf)
+        {
+            if (IngressImpairment::is_enabled(conf))
+                impair = new IngressImpairment(conf);
+        }
+
+        void set_ingress_buffer(ni_ingress_conf_t &conf, uint64_t seed)
+        {
+            if (conf.mode == NI_INGRESS_UNBOUNDED) return;
+
+            ingress = new IngressBuffer(conf, seed);
+            ingress_queues.resize(ingress->num_priorities());
+        }
+
         void set_eos()
         {
             app_sent_eos = true;
@@ -172,8 +310,10 @@ namespace PsPIN
             memcpy(&(ih.pkt_data[0]), pkt_data, pkt_len);
             ih.pkt_len = pkt_len;
             ih.wait_cycles = wait_cycles;
+            ih.impaired = false;
+            ih.reordered = false;
 
-            incoming_hers.push(ih);
+            incoming_hers.push_back(ih);
             hers_to_send++;
 
             return SPIN_SUCCESS;
@@ -224,6 +364,11 @@ namespace PsPIN
                 her_descr.mpq_meta.host_mem_addr = PCIE_START_ADDR;
                 her_descr.mpq_meta.host_mem_size = 0x40000000;
 
+                her_descr.mpq_meta.sched_quantum = 0;
+                her_descr.mpq_meta.sched_prio = 0;
+                her_descr.mpq_meta.l1_copy_size = 0;
+                her_descr.mpq_meta.stateless = 0;
+
                 for (int i = 0; i < NUM_CLUSTERS; i++)
                 {
                     her_descr.mpq_meta.scratchpad_addr[i] = 0;
@@ -327,7 +472,6 @@ namespace PsPIN
             axi_driver.write(pkt_addr, pkt_data, pkt_size, 0);
 
             her_descr.her_addr = pkt_addr;
-            her_descr.nic_arrival_time = sim_time();
 
             queued_hers.push(her_descr);
 
@@ -335,6 +479,17 @@ namespace PsPIN
         }
 
         void progress_incoming_packets()
+        {
+            progress_network_arrivals();
+
+            if (ingress != NULL)
+            {
+                drain_ingress_buffer();
+                ingress->tick();
+            }
+        }
+
+        void progress_network_arrivals()
         {
             if (incoming_hers.empty())
                 return;
@@ -346,14 +501,27 @@ namespace PsPIN
                     return;
             }
 
+            if (impair != NULL && !incoming_hers.front().impaired)
+            {
+                if (!impair_head())
+                    return;
+            }
+
+            if (ingress != NULL)
+            {
+                ingress_arrival();
+                return;
+            }
+
             incoming_her_t &ih = incoming_hers.front();
+            ih.her.nic_arrival_time = sim_time();
 
             if (process_packet(ih.her, &(ih.pkt_data[0]), ih.pkt_len))
             {
                 // we won't serve the next packet before wait_cycles;
                 packet_wait_cycles = ih.wait_cycles;
 
-                incoming_hers.pop();
+                incoming_hers.pop_front();
             }
             else
             {
@@ -363,6 +531,102 @@ namespace PsPIN
             }
         }
 
+        // Applies the ingress impairments to the packet at the head of the
+        // queue (once per packet). Returns false if the packet is dropped.
+        // A packet is moved by at most one reorder, so no packet ends up
+        // more than the reorder window away from its original position.
+        bool impair_head()
+        {
+            uint32_t pos = impair->reorder(incoming_hers.size(), [this](uint32_t i) { return !incoming_hers[i].reordered; });
+            if (pos > 0)
+            {
+                // swap the packets but keep the arrival gaps in place
+                std::swap(incoming_hers[0].wait_cycles, incoming_hers[pos].wait_cycles);
+                std::swap(incoming_hers[0], incoming_hers[pos]);
+                incoming_hers[0].reordered = true;
+                incoming_hers[pos].reordered = true;
+            }
+
+            incoming_her_t &ih = incoming_hers.front();
+            ih.impaired = true;
+
+            if (impair->drop())
+            {
+                // the packet still occupied its slot on the wire
+                packet_wait_cycles = ih.wait_cycles;
+                incoming_hers.pop_front();
+                discard_packet();
+                return false;
+            }
+
+            if (impair->duplicate())
+            {
+                // the copy arrives back-to-back with the original
+                incoming_her_t dup = ih;
+                ih.wait_cycles = 0;
+                incoming_hers.insert(incoming_hers.begin() + 1, dup);
+                hers_to_send++;
+            }
+
+            return true;
+        }
+
+        // Moves the packet at the head of the network queue to the ingress buffer
+        void ingress_arrival()
+        {
+            incoming_her_t &ih = incoming_hers.front();
+            uint32_t prio = ingress->classify(&(ih.pkt_data[0]), ih.pkt_len);
+
+            // PFC: the sender holds this packet and, in order, the ones behind it
+            if (ingress->paused(prio))
+                return;
+
+            packet_wait_cycles = ih.wait_cycles;
+
+            if (ingress->admit(prio, ih.pkt_len))
+            {
+                ih.her.nic_arrival_time = sim_time();
+                ingress_queues[prio].push_back(ih);
+            }
+            else
+            {
+                discard_packet();
+            }
+
+            incoming_hers.pop_front();
+        }
+
+        // Writes at most one packet per cycle to L2, highest priority first
+        void drain_ingress_buffer()
+        {
+            for (int prio = ingress_queues.size() - 1; prio >= 0; prio--)
+            {
+                if (ingress_queues[prio].empty())
+                    continue;
+
+                incoming_her_t &ih = ingress_queues[prio].front();
+                if (process_packet(ih.her, &(ih.pkt_data[0]), ih.pkt_len))
+                {
+                    ingress->release(prio, ih.pkt_len);
+                    ingress_queues[prio].pop_front();
+                }
+
+                // strict priority: lower priorities wait for L2 space as well
+                return;
+            }
+        }
+
+        // A packet will never be sent to PsPIN (e.g., dropped)
+        void discard_packet()
+        {
+            hers_to_send--;
+
+            if (hers_to_send == 0 && app_sent_eos)
+            {
+                *ni_ctrl.eos_o = 1;
+            }
+        }
+
         void posedge()
         {
             if (*ni_ctrl.pspin_active_i)
@@ -386,6 +650,12 @@ namespace PsPIN
         // Progress HERs
         void her_progress_posedge()
         {
+            if (HER_BATCH > 1)
+            {
+                her_batch_progress_posedge();
+                return;
+            }
+
 	    *ni_ctrl.her_valid_o = 0;
 
 	    if (!(*ni_ctrl.her_ready_i == 1))
@@ -416,45 +686,163 @@ namespace PsPIN
             *ni_ctrl.her_o.mpq_meta.ph_size = her.mpq_meta.ph_size;
             *ni_ctrl.her_o.mpq_meta.th_addr = her.mpq_meta.th_addr;
             *ni_ctrl.her_o.mpq_meta.th_size = her.mpq_meta.th_size;
-            *ni_ctrl.her_o.mpq_meta.scratchpad_addr[0] = her.mpq_meta.scratchpad_addr[0];
-            *ni_ctrl.her_o.mpq_meta.scratchpad_addr[1] = her.mpq_meta.scratchpad_addr[1];
-            *ni_ctrl.her_o.mpq_meta.scratchpad_addr[2] = her.mpq_meta.scratchpad_addr[2];
-            *ni_ctrl.her_o.mpq_meta.scratchpad_addr[3] = her.mpq_meta.scratchpad_addr[3];
-            *ni_ctrl.her_o.mpq_meta.scratchpad_size[0] = her.mpq_meta.scratchpad_size[0];
-            *ni_ctrl.her_o.mpq_meta.scratchpad_size[1] = her.mpq_meta.scratchpad_size[1];
-            *ni_ctrl.her_o.mpq_meta.scratchpad_size[2] = her.mpq_meta.scratchpad_size[2];
-            *ni_ctrl.her_o.mpq_meta.scratchpad_size[3] = her.mpq_meta.scratchpad_size[3];
+            *ni_ctrl.her_o.mpq_meta.sched_quantum = her.mpq_meta.sched_quantum;
+            *ni_ctrl.her_o.mpq_meta.sched_prio = her.mpq_meta.sched_prio;
+            *ni_ctrl.her_o.mpq_meta.l1_copy_size = her.mpq_meta.l1_copy_size;
+            *ni_ctrl.her_o.mpq_meta.stateless = her.mpq_meta.stateless;
+            for (int i = 0; i < NUM_TASK_SCRATCHPADS; i++)
+            {
+                *ni_ctrl.her_o.mpq_meta.scratchpad_addr[i] = her.mpq_meta.scratchpad_addr[i];
+                *ni_ctrl.her_o.mpq_meta.scratchpad_size[i] = her.mpq_meta.scratchpad_size[i];
+            }
 
             *ni_ctrl.her_valid_o = 1;
 
-            hers_to_send--;
-
             ready_hers.pop();
 
-            SIM_PRINT("HER sent (0x%x)\n", *ni_ctrl.her_o.her_addr);
+            her_sent(her);
+        }
+
+        // Keeps up to HER_BATCH ready HERs on the input lanes. The MPQ engine
+        // takes a prefix of them per cycle (see her_progress_negedge).
+        void her_batch_progress_posedge()
+        {
+            bool changed = her_lanes_accepted > 0;
+
+            for (uint32_t i = 0; i < her_lanes_accepted; i++)
+            {
+                her_sent(her_lanes.front());
+                her_lanes.pop_front();
+            }
+            her_lanes_accepted = 0;
+
+            while (her_lanes.size() < HER_BATCH && !ready_hers.empty())
+            {
+                her_lanes.push_back(ready_hers.front());
+                ready_hers.pop();
+                changed = true;
+            }
+
+            if (!changed) return;
+
+            memset(ni_ctrl.her_batch_o, 0, HER_BATCH_WORDS * sizeof(uint32_t));
+            for (uint32_t i = 0; i < her_lanes.size(); i++)
+            {
+                her_pack(her_lanes[i], ni_ctrl.her_batch_o, i * HER_DESCR_BITS);
+            }
+
+            *ni_ctrl.her_batch_valid_o = (1 << her_lanes.size()) - 1;
+        }
+
+        // ORs the low width bits of val into words at bit offset pos
+        static void put_bits(uint32_t *words, uint32_t &pos, uint64_t val, uint32_t width)
+        {
+            while (width > 0)
+            {
+                uint32_t bit = pos % 32;
+                uint32_t n = std::min(32 - bit, width);
+                uint64_t mask = (1ULL << n) - 1;
+
+                words[pos / 32] |= (uint32_t) ((val & mask) << bit);
+
+                val >>= n;
+                pos += n;
+                width -= n;
+            }
+        }
+
+        // Packs a her_descr_t at bit offset pos of a zeroed buffer. The last
+        // field of a packed SV struct is its LSB, so fields go in reverse.
+        void her_pack(her_descr_t &her, uint32_t *words, uint32_t pos)
+        {
+            mpq_meta_t &meta = her.mpq_meta;
+
+            if (!meta_image_valid || memcmp(&meta, &meta_image_ec, sizeof(mpq_meta_t)) != 0)
+            {
+                uint32_t mpos = 0;
+                memset(meta_image, 0, sizeof(meta_image));
+
+                put_bits(meta_image, mpos, meta.stateless, 8);
+                put_bits(meta_image, mpos, meta.l1_copy_size, 32);
+                put_bits(meta_image, mpos, meta.sched_prio, 8);
+                put_bits(meta_image, mpos, meta.sched_quantum, 32);
+                for (int i = 0; i < NUM_CLUSTERS; i++)
+                    put_bits(meta_image, mpos, (i < NUM_TASK_SCRATCHPADS) ? meta.scratchpad_size[i] : 0, 32);
+                for (int i = 0; i < NUM_CLUSTERS; i++)
+                    put_bits(meta_image, mpos, (i < NUM_TASK_SCRATCHPADS) ? meta.scratchpad_addr[i] : 0, 32);
+                put_bits(meta_image, mpos, meta.th_size, 32);
+                put_bits(meta_image, mpos, meta.th_addr, 32);
+                put_bits(meta_image, mpos, meta.ph_size, 32);
+                put_bits(meta_image, mpos, meta.ph_addr, 32);
+                put_bits(meta_image, mpos, meta.hh_size, 32);
+                put_bits(meta_image, mpos, meta.hh_addr, 32);
+                put_bits(meta_image, mpos, meta.host_mem_size, 32);
+                put_bits(meta_image, mpos, meta.host_mem_addr, 64);
+                put_bits(meta_image, mpos, meta.handler_mem_size, 32);
+                put_bits(meta_image, mpos, meta.handler_mem_addr, 32);
+                assert(mpos == HER_META_BITS);
+
+                meta_image_ec = meta;
+                meta_image_valid = true;
+            }
+
+            for (uint32_t bit = 0; bit < HER_META_BITS; bit += 32)
+                put_bits(words, pos, meta_image[bit / 32], std::min(32U, (uint32_t) HER_META_BITS - bit));
+
+            put_bits(words, pos, her.xfer_size, 32);
+            put_bits(words, pos, her.her_size, 32);
+            put_bits(words, pos, her.her_addr, 32);
+            put_bits(words, pos, her.eom, 1);
+            put_bits(words, pos, her.msgid, C_MSGID_WIDTH);
+        }
+
+        // Bookkeeping of a HER handed to PsPIN
+        void her_sent(her_descr_t &her)
+        {
+            hers_to_send--;
+
+            SIM_PRINT("HER sent (0x%x)\n", her.her_addr);
 
             pktentry_t pktentry;
             pktentry.pspin_arrival_time = sim_time();
             pktentry.nic_arrival_time = her.nic_arrival_time;
             pktentry.size = her.her_size;
+            pktentry.msgid = her.msgid;
+            pktentry.msg_idx = msg_stats_add_pkt(her);
+            pktentry.eom = her.eom;
             pktentry.user_ptr = her.user_ptr;
 
-            assert(pktmap.find(*ni_ctrl.her_o.her_addr) == pktmap.end());
-            pktmap[*ni_ctrl.her_o.her_addr] = pktentry;
+            assert(pktmap.find(her.her_addr) == pktmap.end());
+            pktmap[her.her_addr] = pktentry;
 
             //stats
             total_bytes_sent += her.her_size;
             total_pkts++;
 
+            if (her_sent_listener)
+                her_sent_listener(her);
+
             if (hers_to_send == 0 && app_sent_eos)
             {
                 *ni_ctrl.eos_o = 1;
             }
         }
 
+        // The inputs are settled: the lanes that PsPIN takes at the next
+        // clock edge are the prefix of the valid lanes that are also ready.
         void her_progress_negedge()
         {
-	    /* Nothing to do here yet */
+            if (HER_BATCH == 1 || her_lanes.empty()) return;
+
+            uint8_t taken = *ni_ctrl.her_batch_valid_o & *ni_ctrl.her_batch_ready_i;
+            her_lanes_accepted = 0;
+            while (her_lanes_accepted < her_lanes.size() && (taken & (1 << her_lanes_accepted)))
+                her_lanes_accepted++;
+
+            if (her_lanes_accepted == 0)
+                ni_ctrl_stalls++;
+            else
+                her_batches++;
         }
 
         // Get feedback
@@ -469,14 +857,31 @@ namespace PsPIN
 
                 SIM_PRINT("INFO FEEDBACK 0x%x %lu %u\n", *ni_ctrl.feedback_her_addr_i, latency, pktentry.size);
 
-                //assert(*ni_ctrl.feedback_her_size_i == pktentry.size);
-                free_pkt_space(*ni_ctrl.feedback_her_addr_i, *ni_ctrl.feedback_her_size_i);
+                // the feedback carries the bytes copied to L1, which can be
+                // fewer than the packet in L2 (L1 copy size, stateless ECs)
+                free_pkt_space(*ni_ctrl.feedback_her_addr_i, pktentry.size);
 
                 sum_pkt_latency += latency;
+                pkt_latency_hist.add(latency / 1000);
+
+                msg_stats_t &msg = msgs[pktentry.msg_idx];
+                if (keep_pkt_latencies) msg.pkt_latencies.push_back(latency);
+                if (pktentry.eom) msg.tail_done = sim_time();
 
                 if (feedback_cb)
                     feedback_cb(pktentry.user_ptr, pktentry.nic_arrival_time, pktentry.pspin_arrival_time, sim_time());
 
+                if (ctrace)
+                {
+                    // packet lifetime: NIC arrival -> HER sent to PsPIN -> feedback
+                    uint64_t pkt_id = ((uint64_t) total_feedbacks << 32) | *ni_ctrl.feedback_her_addr_i;
+                    ctrace->async_begin("packet", "pkt", CTRACE_PID_NIC_INBOUND, pkt_id, pktentry.nic_arrival_time,
+                        "\"msgid\":%u,\"size\":%u,\"her_addr\":\"0x%x\"", pktentry.msgid, pktentry.size, *ni_ctrl.feedback_her_addr_i);
+                    ctrace->async_begin("in PsPIN", "pkt", CTRACE_PID_NIC_INBOUND, pkt_id, pktentry.pspin_arrival_time);
+                    ctrace->async_end("in PsPIN", "pkt", CTRACE_PID_NIC_INBOUND, pkt_id, sim_time());
+                    ctrace->async_end("packet", "pkt", CTRACE_PID_NIC_INBOUND, pkt_id, sim_time());
+                }
+
                 pktmap.erase(*ni_ctrl.feedback_her_addr_i);
 
                 if (total_feedbacks == 0)
@@ -493,6 +898,9 @@ namespace PsPIN
 
                 time_last_feedback = sim_time();
 
+                if (feedback_listener)
+                    feedback_listener(total_feedbacks);
+
                 total_feedbacks++;
             }
         }
@@ -526,20 +934,264 @@ namespace PsPIN
             }
         }
 
+        size_t msg_stats_add_pkt(her_descr_t &her)
+        {
+            size_t msg_idx;
+            auto it = open_msgs.find(her.msgid);
+
+            if (it == open_msgs.end())
+            {
+                msg_stats_t msg;
+                msg.msgid = her.msgid;
+                msg.hh_addr = her.mpq_meta.hh_addr;
+                msg.ph_addr = her.mpq_meta.ph_addr;
+                msg.th_addr = her.mpq_meta.th_addr;
+                msg.pkts = 0;
+                msg.bytes = 0;
+                msg.first_arrival = her.nic_arrival_time;
+                msg.tail_done = 0;
+
+                msg_idx = msgs.size();
+                msgs.push_back(msg);
+                open_msgs[her.msgid] = msg_idx;
+            }
+            else
+            {
+                msg_idx = it->second;
+            }
+
+            msg_stats_t &msg = msgs[msg_idx];
+            msg.pkts++;
+            msg.bytes += her.her_size;
+            msg.last_arrival = her.nic_arrival_time;
+
+            // next packets with this msgid belong to a new message
+            if (her.eom) open_msgs.erase(her.msgid);
+
+            return msg_idx;
+        }
+
+        // Groups messages by execution context (handler addresses).
+        // msg_ec[i] is the index in ecs of the EC of msgs[i].
+        void aggregate_ec_stats(std::vector<ec_stats_t> &ecs, std::vector<uint32_t> &msg_ec)
+        {
+            std::map<std::tuple<uint32_t, uint32_t, uint32_t>, uint32_t> ec_idx;
+
+            msg_ec.resize(msgs.size());
+
+            for (size_t i = 0; i < msgs.size(); i++)
+            {
+                msg_stats_t &msg = msgs[i];
+                auto key = std::make_tuple(msg.hh_addr, msg.ph_addr, msg.th_addr);
+                auto it = ec_idx.find(key);
+
+                if (it == ec_idx.end())
+                {
+                    ec_stats_t ec;
+                    ec.hh_addr = msg.hh_addr;
+                    ec.ph_addr = msg.ph_addr;
+                    ec.th_addr = msg.th_addr;
+                    ec.msgs = 0;
+                    ec.completed_msgs = 0;
+                    ec.pkts = 0;
+                    ec.bytes = 0;
+                    ec.first_arrival = msg.first_arrival;
+                    ec.last_arrival = msg.last_arrival;
+
+                    it = ec_idx.insert(std::make_pair(key, (uint32_t) ecs.size())).first;
+                    ecs.push_back(ec);
+                }
+
+                ec_stats_t &ec = ecs[it->second];
+                msg_ec[i] = it->second;
+
+                ec.msgs++;
+                ec.pkts += msg.pkts;
+                ec.bytes += msg.bytes;
+                ec.first_arrival = std::min(ec.first_arrival, msg.first_arrival);
+                ec.last_arrival = std::max(ec.last_arrival, msg.last_arrival);
+                ec.pkt_latencies.insert(ec.pkt_latencies.end(), msg.pkt_latencies.begin(), msg.pkt_latencies.end());
+
+                if (msg.tail_done != 0)
+                {
+                    ec.completed_msgs++;
+                    ec.completion_times.push_back(msg.tail_done - msg.first_arrival);
+                }
+            }
+        }
+
+        // Nearest-rank percentiles (values in ps)
+        static latency_summary_t summarize(std::vector<uint64_t> values)
+        {
+            latency_summary_t summary;
+            memset(&summary, 0, sizeof(summary));
+
+            if (values.empty()) return summary;
+
+            std::sort(values.begin(), values.end());
+            summary.min = values.front();
+            summary.p50 = values[(values.size() - 1) * 50 / 100];
+            summary.p90 = values[(values.size() - 1) * 90 / 100];
+            summary.p99 = values[(values.size() - 1) * 99 / 100];
+            summary.max = values.back();
+
+            return summary;
+        }
+
+        static void write_summary_json(FILE *out, const char *name, latency_summary_t s)
+        {
+            fprintf(out, "\"%s\":{\"min\":%lu,\"p50\":%lu,\"p90\":%lu,\"p99\":%lu,\"max\":%lu}",
+                name, s.min / 1000, s.p50 / 1000, s.p90 / 1000, s.p99 / 1000, s.max / 1000);
+        }
+
     public:
+        // Per-message and per-EC statistics. The format is JSON if the file
+        // name ends with ".json", CSV (one row per message) otherwise. Times in ns.
+        int export_msg_stats(const char *filename)
+        {
+            FILE *out = fopen(filename, "w");
+            if (out == NULL)
+            {
+                printf("Error: cannot open message statistics file %s!\n", filename);
+                return SPIN_ERR;
+            }
+
+            std::vector<ec_stats_t> ecs;
+            std::vector<uint32_t> msg_ec;
+            aggregate_ec_stats(ecs, msg_ec);
+
+            size_t len = strlen(filename);
+            bool json = len >= 5 && strcmp(filename + len - 5, ".json") == 0;
+
+            if (json)
+            {
+                fprintf(out, "{\"messages\":[");
+                for (size_t i = 0; i < msgs.size(); i++)
+                {
+                    msg_stats_t &msg = msgs[i];
+                    uint64_t completion_time = (msg.tail_done != 0) ? msg.tail_done - msg.first_arrival : 0;
+
+                    fprintf(out, "%s\n{\"msgid\":%u,\"ec\":%u,\"pkts\":%u,\"bytes\":%lu,\"first_arrival\":%lu,\"last_arrival\":%lu,\"tail_done\":%lu,\"completion_time\":%lu,",
+                        (i == 0) ? "" : ",", msg.msgid, msg_ec[i], msg.pkts, msg.bytes, msg.first_arrival / 1000, msg.last_arrival / 1000, msg.tail_done / 1000, completion_time / 1000);
+                    write_summary_json(out, "pkt_latency", summarize(msg.pkt_latencies));
+                    fprintf(out, "}");
+                }
+
+                fprintf(out, "],\n\"ecs\":[");
+                for (size_t i = 0; i < ecs.size(); i++)
+                {
+                    ec_stats_t &ec = ecs[i];
+
+                    fprintf(out, "%s\n{\"ec\":%lu,\"hh_addr\":\"0x%x\",\"ph_addr\":\"0x%x\",\"th_addr\":\"0x%x\",\"msgs\":%u,\"completed_msgs\":%u,\"pkts\":%lu,\"bytes\":%lu,\"first_arrival\":%lu,\"last_arrival\":%lu,",
+                        (i == 0) ? "" : ",", i, ec.hh_addr, ec.ph_addr, ec.th_addr, ec.msgs, ec.completed_msgs, ec.pkts, ec.bytes, ec.first_arrival / 1000, ec.last_arrival / 1000);
+                    write_summary_json(out, "pkt_latency", summarize(ec.pkt_latencies));
+                    fprintf(out, ",");
+                    write_summary_json(out, "completion_time", summarize(ec.completion_times));
+                    fprintf(out, "}");
+                }
+                fprintf(out, "\n]}\n");
+            }
+            else
+            {
+                fprintf(out, "msgid,ec,hh_addr,ph_addr,th_addr,pkts,bytes,first_arrival,last_arrival,tail_done,completion_time,pkt_latency_min,pkt_latency_p50,pkt_latency_p90,pkt_latency_p99,pkt_latency_max\n");
+                for (size_t i = 0; i < msgs.size(); i++)
+                {
+                    msg_stats_t &msg = msgs[i];
+                    uint64_t completion_time = (msg.tail_done != 0) ? msg.tail_done - msg.first_arrival : 0;
+                    latency_summary_t lat = summarize(msg.pkt_latencies);
+
+                    fprintf(out, "%u,%u,0x%x,0x%x,0x%x,%u,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu\n",
+                        msg.msgid, msg_ec[i], msg.hh_addr, msg.ph_addr, msg.th_addr, msg.pkts, msg.bytes,
+                        msg.first_arrival / 1000, msg.last_arrival / 1000, msg.tail_done / 1000, completion_time / 1000,
+                        lat.min / 1000, lat.p50 / 1000, lat.p90 / 1000, lat.p99 / 1000, lat.max / 1000);
+                }
+            }
+
+            fclose(out);
+            return SPIN_SUCCESS;
+        }
+
         void print_stats()
         {
-            double avg_pkt_length = ((double)total_bytes_sent) / total_pkts;
-            double avg_intra_feedback = ((double)(time_last_feedback - time_first_feedback)) / (1000 * (total_feedbacks - 1));
-            double avg_feedback_throughput = THROUGHPUT_1GHZ(avg_intra_feedback, avg_pkt_length);
-            double avg_pkt_latency = ((double)sum_pkt_latency) / (1000 * total_pkts);
+            double avg_pkt_latency = (total_pkts > 0) ? ((double)sum_pkt_latency) / (1000 * total_pkts) : 0;
 
             printf("NIC inbound engine:\n");
             printf("\tPackets: %lu; Bytes: %lu\n", total_pkts, total_bytes_sent);
-            printf("\tAvg packet length: %.3lf B\n", avg_pkt_length);
-            printf("\tFeedback throughput: %.3lf Gbit/s (feedback arrival time: %.3lf ns)\n", avg_feedback_throughput, avg_intra_feedback);
+            printf("\tAvg packet length: %.3lf B\n", avg_pkt_length());
+            printf("\tFeedback throughput: %.3lf Gbit/s (feedback arrival time: %.3lf ns)\n", avg_feedback_throughput(), avg_intra_feedback());
+            printf("\tFeedback rate: %.3lf Mpps\n", avg_feedback_rate());
             printf("\tPacket latency: avg: %.3lf ns; min: %lu ns; max: %lu ns\n", avg_pkt_latency, min_pkt_latency / 1000, max_pkt_latency / 1000);
-            printf("\tHER stalls: %d\n", ni_ctrl_stalls);
+            printf("\tHER stalls: %lu\n", ni_ctrl_stalls);
+            if (HER_BATCH > 1)
+                printf("\tHER batches: %lu (avg %.2lf HERs per batch, max %d)\n", her_batches,
+                    (her_batches > 0) ? ((double) total_pkts) / her_batches : 0, HER_BATCH);
+
+            if (impair != NULL)
+                impair->print_stats();
+
+            if (ingress != NULL)
+                ingress->print_stats();
+
+            std::vector<ec_stats_t> ecs;
+            std::vector<uint32_t> msg_ec;
+            aggregate_ec_stats(ecs, msg_ec);
+
+            for (size_t i = 0; i < ecs.size(); i++)
+            {
+                ec_stats_t &ec = ecs[i];
+                latency_summary_t mct = summarize(ec.completion_times);
+
+                printf("\tEC %lu (hh: 0x%x; ph: 0x%x; th: 0x%x): messages: %u (completed: %u); packets: %lu; bytes: %lu\n",
+                    i, ec.hh_addr, ec.ph_addr, ec.th_addr, ec.msgs, ec.completed_msgs, ec.pkts, ec.bytes);
+                printf("\t\tMessage completion time: p50: %lu ns; p90: %lu ns; p99: %lu ns; max: %lu ns\n",
+                    mct.p50 / 1000, mct.p90 / 1000, mct.p99 / 1000, mct.max / 1000);
+            }
+        }
+
+        void register_stats(SimStats &stats)
+        {
+            stats.add_counter("nic_inbound", "pkts", &total_pkts);
+            stats.add_counter("nic_inbound", "bytes", &total_bytes_sent);
+            stats.add_counter("nic_inbound", "feedbacks", &total_feedbacks);
+            stats.add_counter("nic_inbound", "her_stalls", &ni_ctrl_stalls);
+            stats.add_counter("nic_inbound", "her_batches", &her_batches);
+            stats.add_gauge("nic_inbound", "msgs", [this]() { return (double) msgs.size(); });
+            stats.add_gauge("nic_inbound", "avg_pkt_length_bytes", [this]() { return avg_pkt_length(); });
+            stats.add_gauge("nic_inbound", "feedback_throughput_gbps", [this]() { return avg_feedback_throughput(); });
+            stats.add_gauge("nic_inbound", "feedback_rate_mpps", [this]() { return avg_feedback_rate(); });
+            stats.add_histogram("nic_inbound", "pkt_latency_ns", &pkt_latency_hist);
+
+            if (impair != NULL)
+                impair->register_stats(stats, "nic_inbound");
+
+            if (ingress != NULL)
+                ingress->register_stats(stats, "nic_inbound");
+        }
+
+    private:
+        double avg_pkt_length()
+        {
+            return (total_pkts > 0) ? ((double)total_bytes_sent) / total_pkts : 0;
+        }
+
+        // ns between consecutive feedbacks
+        double avg_intra_feedback()
+        {
+            if (total_feedbacks < 2) return 0;
+            return ((double)(time_last_feedback - time_first_feedback)) / (1000 * (total_feedbacks - 1));
+        }
+
+        double avg_feedback_throughput()
+        {
+            double intra = avg_intra_feedback();
+            return (intra > 0) ? THROUGHPUT_1GHZ(intra, avg_pkt_length()) : 0;
+        }
+
+        // Millions of packets per second (small-packet benchmarks)
+        double avg_feedback_rate()
+        {
+            double intra = avg_intra_feedback();
+            return (intra > 0) ? 1000 / intra : 0;
         }
     };
 
@@ -19,12 +19,16 @@
 #include "verilated.h"
 #include "SimModule.hpp"
 #include "AXIMaster.hpp"
+#include "ChromeTrace.hpp"
+#include "EgressScheduler.hpp"
+#include "PacketFormat.hpp"
 #include "pspin.hpp"
 
 #include <queue>
+#include <vector>
+#include <unordered_map>
 #include <stdio.h>
 
-#define RDMA_HEADER_LENGTH 32
 #define NUM_PARALLEL_CMD 16
 
 // The network delay is computed by slicing the packet in words
@@ -44,14 +48,19 @@ namespace PsPIN
             uint64_t source_addr;
             uint32_t current_offset;
             uint32_t length;
+            uint32_t header_length;
             uint32_t payload_length;
-            uint8_t cmd_id;
+            uint32_t cmd_id;
+            uint32_t nid;
+            uint32_t port;
+            uint32_t tc;
             bool is_last;
             std::vector<uint8_t> data;
 
             NetworkPacket(uint32_t length) : length(length)
             {
                 current_offset = 0;
+                header_length = 0;
                 data.resize(length);
             }
         };
@@ -63,7 +72,9 @@ namespace PsPIN
                 uint32_t length;
                 uint32_t nid;
                 uint32_t fid;
-                uint8_t cmd_id;
+                uint32_t cmd_id;
+                uint32_t total_length;
+                uint32_t offset; // bytes already packetized
         };
 
         class Packetizer
@@ -72,11 +83,20 @@ namespace PsPIN
                 uint32_t num_parallel_cmds;
                 uint32_t max_packet_len;
                 std::queue<NICCommand> commands;
+                PacketFormat *format;
+                uint32_t src_nid;
 
             public:
                 Packetizer(uint32_t num_parallel_cmds, uint32_t max_packet_len) : num_parallel_cmds(num_parallel_cmds), max_packet_len(max_packet_len)
                 {
-                    ;
+                    format = NULL;
+                    src_nid = 0;
+                }
+
+                void set_format(PacketFormat *format, uint32_t src_nid)
+                {
+                    this->format = format;
+                    this->src_nid = src_nid;
                 }
 
                 bool has_free_cmd_slot()
@@ -89,6 +109,13 @@ namespace PsPIN
                     return commands.size() > 0;
                 }
 
+                // destination of the next packet
+                uint32_t next_nid()
+                {
+                    assert(!commands.empty());
+                    return commands.front().nid;
+                }
+
                 void new_cmd(NICCommand cmd)
                 {
                     assert(commands.size() < num_parallel_cmds);
@@ -102,25 +129,49 @@ namespace PsPIN
                     commands.pop();
 
                     uint32_t header_length = 0;
+                    uint32_t payloadlen;
+                    uint32_t trailer_length = 0;
                     if (cmd.fid>0) { /* RDMA (can be multi packet) */
-                        header_length = RDMA_HEADER_LENGTH;
+                        header_length = format->header_length(cmd.offset == 0);
+                        uint32_t budget = max_packet_len - header_length - format->trailer_length(0);
+                        payloadlen = std::min(format->max_payload(budget), cmd.length);
+                        trailer_length = format->trailer_length(payloadlen);
                     } else { /* single packet */
                         assert(cmd.length <= max_packet_len);
+                        payloadlen = cmd.length;
                     }
 
-                    uint32_t payloadlen = std::min(max_packet_len - header_length, cmd.length);
-                    uint32_t pktlen = header_length + payloadlen;
+                    uint32_t pktlen = header_length + payloadlen + trailer_length;
 
                     NetworkPacket pkt(pktlen);
 
                     pkt.cmd_id = cmd.cmd_id;
+                    pkt.nid = cmd.nid;
                     pkt.is_last = cmd.length - payloadlen == 0;
                     pkt.length = pktlen;
+                    pkt.header_length = header_length;
                     pkt.payload_length = payloadlen;
                     pkt.source_addr = cmd.source_addr;
 
+                    if (cmd.fid>0)
+                    {
+                        PacketFormat::pkt_desc_t desc;
+                        desc.src_nid = src_nid;
+                        desc.dst_nid = cmd.nid;
+                        desc.fid = cmd.fid;
+                        desc.source_addr = cmd.source_addr - cmd.offset;
+                        desc.cmd_length = cmd.total_length;
+                        desc.offset = cmd.offset;
+                        desc.payload_length = payloadlen;
+                        desc.pkt_length = pktlen;
+                        desc.first = cmd.offset == 0;
+                        desc.last = pkt.is_last;
+                        format->write_header(&pkt.data[0], desc);
+                    }
+
                     cmd.length -= payloadlen;
                     cmd.source_addr += payloadlen;
+                    cmd.offset += payloadlen;
 
                     //printf("generating packet: length: %d; payload: %d; new cmd length: %d; next pkt addr: 0x%lx\n", pktlen, payloadlen, cmd.length, cmd.source_addr);
 
@@ -135,48 +186,133 @@ namespace PsPIN
     public:
             typedef std::function<void(uint8_t*, size_t)> out_packet_cb_t;
 
+    private:
+        // Egress port: own link (G), per-class queues, and packet callback
+        class EgressPort
+        {
+        public:
+            double network_G; //ns
+            uint32_t wait_cycles;
+            uint32_t buffered_pkts; // queued + being read by DMA
+            std::vector<std::queue<NetworkPacket>> tc_queues;
+            EgressScheduler scheduler;
+            out_packet_cb_t pktout_cb;
+
+            // statistics
+            uint64_t pkts;
+            uint64_t bytes;
+            uint64_t busy_cycles;
+
+            EgressPort(double network_G, no_sched_policy_t policy, uint32_t num_tcs, const uint32_t *tc_weights)
+                : network_G(network_G), tc_queues(num_tcs), scheduler(policy, num_tcs, tc_weights)
+            {
+                wait_cycles = 0;
+                buffered_pkts = 0;
+                pkts = 0;
+                bytes = 0;
+                busy_cycles = 0;
+            }
+        };
+
     private:
         AXIMaster<AXIPortType> axi_driver;
         no_cmd_port &no_cmd;
-        double network_G; //ns
         uint32_t max_pkt_length;
         uint32_t network_buffer_size;
 
-        uint32_t wait_cycles;
+        std::vector<EgressPort*> ports;
+        uint32_t num_tcs;
 
-        std::queue<NetworkPacket> network_queue;
+        PacketFormat *format;
 
         std::queue<NetworkPacket> dma_pkt_in_flight;
 
+        // completed commands; one response is sent per cycle
+        std::queue<uint32_t> cmd_resps;
+
         Packetizer packetizer;
 
+        ChromeTrace *ctrace;
+
+        // arrival time of in-flight commands (by command ID)
+        std::unordered_map<uint32_t, uint64_t> cmd_start_time;
+
     public:
         out_packet_cb_t pktout_cb;
 
     //statistics
     private:
-        uint32_t total_cmds;
-        uint32_t total_pkts;
-        uint32_t total_bytes;
+        uint64_t total_cmds;
+        uint64_t total_pkts;
+        uint64_t total_bytes;
+        uint64_t total_payload_bytes;
         uint64_t time_first_pkt;
         uint64_t time_last_pkt;
 
     public:
         NICOutbound<AXIPortType>(AXIPortType &no_mst, no_cmd_port_t &no_cmd, double network_G, uint32_t max_pkt_length, uint32_t network_buffer_size)
-            : axi_driver(no_mst), no_cmd(no_cmd), network_G(network_G), max_pkt_length(max_pkt_length), network_buffer_size(network_buffer_size), packetizer(NUM_PARALLEL_CMD, max_pkt_length)
+            : axi_driver(no_mst), no_cmd(no_cmd), max_pkt_length(max_pkt_length), network_buffer_size(network_buffer_size), packetizer(NUM_PARALLEL_CMD, max_pkt_length)
         {
             *no_cmd.no_cmd_resp_valid_o = 0;
             *no_cmd.no_cmd_req_ready_o = 0;
 
-            wait_cycles = 0;
+            uint32_t weight = max_pkt_length;
+            ports.push_back(new EgressPort(network_G, NO_SCHED_STRICT, 1, &weight));
+            num_tcs = 1;
+
+            format = new OpaquePacketFormat(false);
+            packetizer.set_format(format, 0);
+
+            ctrace = NULL;
 
             total_cmds = 0;
             total_pkts = 0;
             total_bytes = 0;
+            total_payload_bytes = 0;
             time_first_pkt = 0;
             time_last_pkt = 0;
         }
 
+        ~NICOutbound()
+        {
+            for (uint32_t i = 0; i < ports.size(); i++)
+            {
+                delete ports[i];
+            }
+            delete format;
+        }
+
+        // Headers of the packets of RDMA commands. Must be called before any
+        // command is received.
+        void set_packet_format(no_pkt_format_t pkt_format, bool icrc, uint32_t src_nid)
+        {
+            delete format;
+            format = PacketFormat::create(pkt_format, icrc);
+            packetizer.set_format(format, src_nid);
+        }
+
+        // Replaces the single egress link with conf.num_ports ports, each with
+        // conf.num_tcs traffic classes. Commands are steered by their NID:
+        // port = nid % num_ports, class = (nid / num_ports) % num_tcs.
+        // Must be called before any command is received.
+        void set_egress_ports(no_conf_t &conf)
+        {
+            uint32_t num_ports = std::min(std::max(conf.num_ports, (uint32_t) 1), (uint32_t) NO_MAX_PORTS);
+            num_tcs = std::min(std::max(conf.num_tcs, (uint32_t) 1), (uint32_t) NO_MAX_TRAFFIC_CLASSES);
+
+            for (uint32_t i = 0; i < ports.size(); i++)
+            {
+                delete ports[i];
+            }
+            ports.clear();
+
+            for (uint32_t i = 0; i < num_ports; i++)
+            {
+                double G = (conf.port_G[i] > 0) ? conf.port_G[i] : conf.network_G;
+                ports.push_back(new EgressPort(G, conf.sched_policy, num_tcs, conf.tc_weight));
+            }
+        }
+
         void posedge()
         {
             progress_axi_reads();
@@ -192,12 +328,51 @@ namespace PsPIN
             axi_driver.negedge();
         }
 
+        // Default callback, used by the ports without their own
         void set_packet_out_cb(out_packet_cb_t cb)
         {
             this->pktout_cb = cb;
         }
 
+        int set_port_packet_out_cb(uint32_t port, out_packet_cb_t cb)
+        {
+            if (port >= ports.size()) return SPIN_ERR;
+            ports[port]->pktout_cb = cb;
+            return SPIN_SUCCESS;
+        }
+
+        void set_chrome_trace(ChromeTrace *ctrace)
+        {
+            this->ctrace = ctrace;
+
+            if (ctrace == NULL) return;
+            ctrace->process_name(CTRACE_PID_NIC_OUTBOUND, "NIC outbound");
+            ctrace->thread_name(CTRACE_PID_NIC_OUTBOUND, 0, "Commands");
+            if (ports.size() == 1)
+            {
+                ctrace->thread_name(CTRACE_PID_NIC_OUTBOUND, 1, "Egress link");
+                return;
+            }
+
+            char name[32];
+            for (uint32_t i = 0; i < ports.size(); i++)
+            {
+                snprintf(name, sizeof(name), "Egress port %u", i);
+                ctrace->thread_name(CTRACE_PID_NIC_OUTBOUND, 1 + i, name);
+            }
+        }
+
     private:
+        uint32_t nid_to_port(uint32_t nid)
+        {
+            return nid % ports.size();
+        }
+
+        uint32_t nid_to_tc(uint32_t nid)
+        {
+            return (nid / ports.size()) % num_tcs;
+        }
+
         void handle_cmd_posedge()
         {
             *no_cmd.no_cmd_req_ready_o = 0;
@@ -213,24 +388,36 @@ namespace PsPIN
                 cmd.nid = *no_cmd.no_cmd_req_nid_i;
                 cmd.fid = *no_cmd.no_cmd_req_fid_i;
                 cmd.cmd_id =  *no_cmd.no_cmd_req_id_i;
+                cmd.total_length = cmd.length;
+                cmd.offset = 0;
                 
                 assert(cmd.fid>0 || cmd.length <= max_pkt_length);
 
                 SIM_PRINT("NIC outbound got new command: source_addr: 0x%lx; length: %d; FID: %d (>0 is RDMA)\n", cmd.source_addr, cmd.length, cmd.fid);
                 total_cmds++;
 
+                if (ctrace) cmd_start_time[cmd.cmd_id] = sim_time();
+
                 packetizer.new_cmd(cmd);
 
                 *no_cmd.no_cmd_req_ready_o = 1;
             }
         }
 
+        // The packets of a command all go to the same port and class, so
+        // they leave in order. A full port blocks the packetizer.
         void progress_packets()
         {
-            bool can_send_pkt = network_queue.size() + dma_pkt_in_flight.size() < network_buffer_size;
-            if (packetizer.has_packets() && can_send_pkt)
+            if (!packetizer.has_packets()) return;
+
+            EgressPort *port = ports[nid_to_port(packetizer.next_nid())];
+            bool can_send_pkt = port->buffered_pkts < network_buffer_size;
+            if (can_send_pkt)
             {
                 NetworkPacket pkt = packetizer.get_next_packet();
+                pkt.port = nid_to_port(pkt.nid);
+                pkt.tc = nid_to_tc(pkt.nid);
+                port->buffered_pkts++;
                 axi_driver.read(pkt.source_addr, pkt.payload_length);
                 dma_pkt_in_flight.push(pkt);
             }
@@ -238,38 +425,72 @@ namespace PsPIN
 
         void progress_netqueue()
         {
+            for (uint32_t i = 0; i < ports.size(); i++)
+            {
+                progress_port(i, *ports[i]);
+            }
+
             *no_cmd.no_cmd_resp_valid_o = 0;
+            if (!cmd_resps.empty())
+            {
+                *no_cmd.no_cmd_resp_valid_o = 1;
+                *no_cmd.no_cmd_resp_id_o = cmd_resps.front();
+                cmd_resps.pop();
+            }
+        }
 
-            if (wait_cycles > 0)
+        void progress_port(uint32_t port_id, EgressPort &port)
+        {
+            if (port.wait_cycles > 0)
             {
-                wait_cycles--;
-                if (wait_cycles > 0) return;
+                port.busy_cycles++;
+                port.wait_cycles--;
+                if (port.wait_cycles > 0) return;
             }
 
-            if (!network_queue.empty())
+            int tc = port.scheduler.dequeue();
+            if (tc >= 0)
             {
-                NetworkPacket &pkt = network_queue.front();
+                std::queue<NetworkPacket> &queue = port.tc_queues[tc];
+                NetworkPacket &pkt = queue.front();
                 
-                wait_cycles = ((uint32_t)(network_G * WORD_SIZE)) * std::floor((double) pkt.length / WORD_SIZE);
+                port.wait_cycles = ((uint32_t)(port.network_G * WORD_SIZE)) * std::floor((double) pkt.length / WORD_SIZE);
 
                 if (pkt.is_last)
                 {
-                    *no_cmd.no_cmd_resp_valid_o = 1;
-                    *no_cmd.no_cmd_resp_id_o = pkt.cmd_id;
+                    cmd_resps.push(pkt.cmd_id);
                 }
 
                 // TODO: packet is ready. This is the point where we can do something with it.
 
-                if (pktout_cb) pktout_cb((uint8_t*) &(pkt.data[0]), pkt.length);
+                if (port.pktout_cb) port.pktout_cb((uint8_t*) &(pkt.data[0]), pkt.length);
+                else if (pktout_cb) pktout_cb((uint8_t*) &(pkt.data[0]), pkt.length);
+
+                if (ctrace)
+                {
+                    ctrace->complete("packet", "egress", CTRACE_PID_NIC_OUTBOUND, 1 + port_id, sim_time(), sim_time() + port.wait_cycles * 1000,
+                        "\"size\":%u,\"cmd_id\":%u,\"tc\":%d", pkt.length, (uint32_t) pkt.cmd_id, tc);
+
+                    if (pkt.is_last && cmd_start_time.find(pkt.cmd_id) != cmd_start_time.end())
+                    {
+                        ctrace->async_begin("NIC command", "cmd", CTRACE_PID_NIC_OUTBOUND, pkt.cmd_id, cmd_start_time[pkt.cmd_id], "\"cmd_id\":%u", (uint32_t) pkt.cmd_id);
+                        ctrace->async_end("NIC command", "cmd", CTRACE_PID_NIC_OUTBOUND, pkt.cmd_id, sim_time());
+                        cmd_start_time.erase(pkt.cmd_id);
+                    }
+                }
 
-                SIM_PRINT("packet sent; size: %d; wait_cycles: %d (G: %lf); is_last: %d\n", pkt.length, wait_cycles, network_G, (uint32_t) pkt.is_last);
+                SIM_PRINT("packet sent; port: %u; class: %d; size: %d; wait_cycles: %d (G: %lf); is_last: %d\n", port_id, tc, pkt.length, port.wait_cycles, port.network_G, (uint32_t) pkt.is_last);
 
                 if (total_pkts==0) time_first_pkt = sim_time();
                 time_last_pkt = sim_time();
                 total_pkts++;
                 total_bytes += pkt.length;
+                total_payload_bytes += pkt.payload_length;
+                port.pkts++;
+                port.bytes += pkt.length;
+                port.buffered_pkts--;
 
-                network_queue.pop();
+                queue.pop();
 
             }
         }
@@ -293,7 +514,7 @@ namespace PsPIN
                 assert(!dma_pkt_in_flight.empty());
                 NetworkPacket &pkt = dma_pkt_in_flight.front();
 
-                uint8_t *dest_ptr = ((uint8_t *)&(pkt.data[0])) + pkt.current_offset;
+                uint8_t *dest_ptr = ((uint8_t *)&(pkt.data[0])) + pkt.header_length + pkt.current_offset;
                 read_complete = axi_driver.consume_r_beat(dest_ptr, length);
 
                 pkt.current_offset += length;
@@ -302,7 +523,10 @@ namespace PsPIN
                 {
                     //printf("pkt.current_offset: %d; pkt.length: %d\n", pkt.current_offset, pkt.length);
                     assert(pkt.current_offset == pkt.payload_length);
-                    network_queue.push(pkt);
+                    if (pkt.header_length > 0) format->write_trailer(&pkt.data[0], pkt.length);
+                    EgressPort &port = *ports[pkt.port];
+                    port.scheduler.enqueue(pkt.tc, pkt.length);
+                    port.tc_queues[pkt.tc].push(pkt);
                     dma_pkt_in_flight.pop();
                 }
             }
@@ -311,15 +535,67 @@ namespace PsPIN
         public:
             void print_stats()
             {
-                double avg_pkt_length = ((double) total_bytes) / total_pkts;            
-                double avg_intra_pkt = ((double) (time_last_pkt - time_first_pkt)) / (1000*(total_pkts-1));
-                double avg_pkt_throughput = THROUGHPUT_1GHZ(avg_intra_pkt, avg_pkt_length);            
-
                 printf("NIC outbound engine:\n");
-                printf("\tCommands: %d; Packets: %d; Bytes: %d\n", total_cmds, total_pkts, total_bytes);
-                printf("\tAvg packet length: %.3lf B\n", avg_pkt_length);
-                printf("\tPacket throughput: %.3lf Gbit/s (pkt departure time: %.3lf ns)\n", avg_pkt_throughput, avg_intra_pkt);
+                printf("\tCommands: %lu; Packets: %lu; Bytes: %lu\n", total_cmds, total_pkts, total_bytes);
+                printf("\tAvg packet length: %.3lf B; payload: %lu B (%.2lf%% of wire bytes)\n", avg_pkt_length(), total_payload_bytes, payload_percent());
+                printf("\tPacket throughput: %.3lf Gbit/s (pkt departure time: %.3lf ns)\n", avg_pkt_throughput(), avg_intra_pkt());
+
+                if (ports.size() == 1 && num_tcs == 1) return;
+
+                for (uint32_t i = 0; i < ports.size(); i++)
+                {
+                    EgressPort &port = *ports[i];
+                    printf("\tPort %u: packets: %lu; bytes: %lu; link busy: %lu cycles\n", i, port.pkts, port.bytes, port.busy_cycles);
+                    if (num_tcs > 1) port.scheduler.print_stats("\t\t");
+                }
+            }
+
+            void register_stats(SimStats &stats)
+            {
+                stats.add_counter("nic_outbound", "cmds", &total_cmds);
+                stats.add_counter("nic_outbound", "pkts", &total_pkts);
+                stats.add_counter("nic_outbound", "bytes", &total_bytes);
+                stats.add_counter("nic_outbound", "payload_bytes", &total_payload_bytes);
+                stats.add_gauge("nic_outbound", "goodput_gbps", [this]() { return avg_pkt_throughput() * payload_percent() / 100; });
+                stats.add_gauge("nic_outbound", "avg_pkt_length_bytes", [this]() { return avg_pkt_length(); });
+                stats.add_gauge("nic_outbound", "pkt_throughput_gbps", [this]() { return avg_pkt_throughput(); });
+
+                char prefix[32];
+                for (uint32_t i = 0; i < ports.size(); i++)
+                {
+                    snprintf(prefix, sizeof(prefix), "port%u.", i);
+                    std::string pre(prefix);
+
+                    stats.add_counter("nic_outbound", pre + "pkts", &ports[i]->pkts);
+                    stats.add_counter("nic_outbound", pre + "bytes", &ports[i]->bytes);
+                    stats.add_counter("nic_outbound", pre + "busy_cycles", &ports[i]->busy_cycles);
+                    ports[i]->scheduler.register_stats(stats, "nic_outbound", pre);
+                }
+            }
+
+        private:
+            double avg_pkt_length()
+            {
+                return (total_pkts > 0) ? ((double) total_bytes) / total_pkts : 0;
+            }
+
+            // ns between consecutive departures
+            double avg_intra_pkt()
+            {
+                if (total_pkts < 2) return 0;
+                return ((double) (time_last_pkt - time_first_pkt)) / (1000*(total_pkts-1));
+            }
+
+            double payload_percent()
+            {
+                return (total_bytes > 0) ? (100.0 * total_payload_bytes) / total_bytes : 0;
+            }
+
+            double avg_pkt_throughput()
+            {
+                double intra = avg_intra_pkt();
+                return (intra > 0) ? THROUGHPUT_1GHZ(intra, avg_pkt_length()) : 0;
             }
     };
 
-} // namespace PsPIN
\ No newline at end of file
+} // namespace PsPIN
@@ -58,7 +58,7 @@ namespace PsPIN
         mst_write_cb_t write_cb;
         mst_read_cb_t read_cb;
 
-        uint32_t bytes_written, bytes_read;
+        uint64_t bytes_written, bytes_read;
 
     public:
         PCIeMaster<AXIPortType>(AXIPortType &axi_mst) 
@@ -119,10 +119,16 @@ namespace PsPIN
         void print_stats()
         {
             printf("PCIe Master:\n");
-            printf("\tBytes written: %d; Bytes read: %d\n", bytes_written, bytes_read);
+            printf("\tBytes written: %lu; Bytes read: %lu\n", bytes_written, bytes_read);
         
         }
 
+        void register_stats(SimStats &stats)
+        {
+            stats.add_counter("pcie_master", "bytes_written", &bytes_written);
+            stats.add_counter("pcie_master", "bytes_read", &bytes_read);
+        }
+
     private:
         void progress_axi_writes()
         {
@@ -20,6 +20,8 @@
 #include "SimModule.hpp"
 #include "AXIMaster.hpp"
 #include "AXISlave.hpp"
+#include "ChromeTrace.hpp"
+#include "PCIeTLPModel.hpp"
 #include "pspin.hpp"
 
 #include <queue>
@@ -47,8 +49,15 @@ namespace PsPIN
         {
             r_beat_request_t req;
             uint64_t time;
+            bool request_done; // TLP model: last beat of a read request
         } pcie_read_t;
 
+        typedef struct pcie_burst
+        {
+            uint64_t start_time;
+            uint64_t addr;
+        } pcie_burst_t;
+
     private:
         AXISlave<AXISlvPortType> axi_driver_slv;
 
@@ -58,23 +67,33 @@ namespace PsPIN
         uint32_t write_wait_cycles;
         uint32_t read_wait_cycles;
 
+        // NULL: fixed latency + per-byte gap
+        PCIeTLPModel *tlp;
+
         std::queue<pcie_write_t> in_flight_write_requests;
         std::queue<pcie_read_t> in_flight_read_requests;
 
+        // in-flight bursts (for the chrome trace)
+        ChromeTrace *ctrace;
+        std::queue<pcie_burst_t> write_bursts;
+        std::queue<pcie_burst_t> read_bursts;
+        bool write_burst_open, read_burst_open;
+        uint32_t write_burst_bytes, read_burst_bytes;
+
     public:
         typedef std::function<void(uint64_t, uint8_t*, size_t)> slv_write_cb_t;
         typedef std::function<void(uint64_t, uint8_t*, size_t)> slv_read_cb_t;
 
     // Statistics
     private:
-        uint32_t bytes_written;
-        uint32_t bytes_read;
+        uint64_t bytes_written;
+        uint64_t bytes_read;
         uint64_t time_first_read;
         uint64_t time_last_write;
         uint64_t time_first_write;
         uint64_t time_last_read;
-        uint32_t num_reads;
-        uint32_t num_writes;
+        uint64_t num_reads;
+        uint64_t num_writes;
 
         slv_write_cb_t slv_write_cb;
         slv_read_cb_t slv_read_cb;
@@ -86,6 +105,14 @@ namespace PsPIN
             write_wait_cycles = 0;
             read_wait_cycles = 0;
 
+            tlp = NULL;
+
+            ctrace = NULL;
+            write_burst_open = false;
+            read_burst_open = false;
+            write_burst_bytes = 0;
+            read_burst_bytes = 0;
+
             axi_driver_slv.set_ar_buffer(ar_buffer_size);
             axi_driver_slv.set_aw_buffer(aw_buffer_size);
             axi_driver_slv.set_w_buffer(w_buffer_size);
@@ -102,6 +129,17 @@ namespace PsPIN
             num_writes = 0;
         }
 
+        ~PCIeSlave()
+        {
+            delete tlp;
+        }
+
+        void set_tlp_model(pcie_tlp_conf_t &conf)
+        {
+            delete tlp;
+            tlp = new PCIeTLPModel(conf, pcie_G);
+        }
+
         void set_slv_write_cb(slv_write_cb_t cb)
         {
             this->slv_write_cb = cb;
@@ -112,10 +150,26 @@ namespace PsPIN
             this->slv_read_cb = cb;
         }
 
+        void set_chrome_trace(ChromeTrace *ctrace)
+        {
+            this->ctrace = ctrace;
+
+            if (ctrace == NULL) return;
+            ctrace->process_name(CTRACE_PID_PCIE, "PCIe (host DMA)");
+            ctrace->thread_name(CTRACE_PID_PCIE, 0, "Host writes");
+            ctrace->thread_name(CTRACE_PID_PCIE, 1, "Host reads");
+        }
+
     private: 
 
         void progress_new_writes() 
         {
+            if (tlp)
+            {
+                progress_new_tlp_writes();
+                return;
+            }
+
             if (write_wait_cycles > 0) {
                 write_wait_cycles--;
                 if (write_wait_cycles > 0) return;
@@ -131,12 +185,38 @@ namespace PsPIN
 
                 in_flight_write_requests.push(write);
 
+                if (ctrace)
+                {
+                    if (!write_burst_open) write_bursts.push({sim_time(), w_beat_req.addr});
+                    write_burst_open = !w_beat_req.w_beat.w_last;
+                }
+
                 write_wait_cycles = (uint32_t) (pcie_G * w_beat_req.data_size);
                 //SIM_PRINT("PCIe write wait cycles: %u\n", write_wait_cycles);
             }
         }
 
 
+        void progress_new_tlp_writes()
+        {
+            double now = cycles();
+            if (!axi_driver_slv.has_w_beat() || !tlp->can_write(now, AXI_SW)) return;
+
+            w_beat_request_t w_beat_req = axi_driver_slv.get_next_w_beat();
+
+            pcie_write_t write;
+            write.req = w_beat_req;
+            write.time = (uint64_t) (tlp->write_beat(now, w_beat_req.addr, w_beat_req.data_size, w_beat_req.w_beat.w_last) * 1000);
+
+            in_flight_write_requests.push(write);
+
+            if (ctrace)
+            {
+                if (!write_burst_open) write_bursts.push({sim_time(), w_beat_req.addr});
+                write_burst_open = !w_beat_req.w_beat.w_last;
+            }
+        }
+
         void progress_in_flight_writes()
         {
             if (in_flight_write_requests.empty()) return;
@@ -167,6 +247,19 @@ namespace PsPIN
                     axi_driver_slv.send_b_beat();
                 }
 
+                if (ctrace)
+                {
+                    write_burst_bytes += write.req.data_size;
+                    if (write.req.w_beat.w_last)
+                    {
+                        assert(!write_bursts.empty());
+                        pcie_burst_t &burst = write_bursts.front();
+                        ctrace->complete("write", "dma", CTRACE_PID_PCIE, 0, burst.start_time, sim_time(), "\"addr\":\"0x%lx\",\"bytes\":%u", burst.addr, write_burst_bytes);
+                        write_bursts.pop();
+                        write_burst_bytes = 0;
+                    }
+                }
+
                 in_flight_write_requests.pop();
             }
         }
@@ -174,6 +267,12 @@ namespace PsPIN
 
         void progress_new_reads()
         {
+            if (tlp)
+            {
+                progress_new_tlp_reads();
+                return;
+            }
+
            if (read_wait_cycles > 0) {
                 read_wait_cycles--;
                 return;
@@ -186,14 +285,41 @@ namespace PsPIN
                 pcie_read_t read;
                 read.req = r_beat_req;
                 read.time = sim_time() + pcie_L;
+                read.request_done = false;
 
                 in_flight_read_requests.push(read);
+
+                if (ctrace)
+                {
+                    if (!read_burst_open) read_bursts.push({sim_time(), r_beat_req.addr});
+                    read_burst_open = !r_beat_req.r_beat.r_last;
+                }
                 
                 read_wait_cycles = (uint32_t) (pcie_G * r_beat_req.data_size);
             }
         }
 
 
+        void progress_new_tlp_reads()
+        {
+            double now = cycles();
+            if (!axi_driver_slv.has_r_beat() || !tlp->can_read(now)) return;
+
+            r_beat_request_t r_beat_req = axi_driver_slv.get_next_r_beat();
+
+            pcie_read_t read;
+            read.req = r_beat_req;
+            read.time = (uint64_t) (tlp->read_beat(now, r_beat_req.addr, r_beat_req.data_size, r_beat_req.r_beat.r_last, read.request_done) * 1000);
+
+            in_flight_read_requests.push(read);
+
+            if (ctrace)
+            {
+                if (!read_burst_open) read_bursts.push({sim_time(), r_beat_req.addr});
+                read_burst_open = !r_beat_req.r_beat.r_last;
+            }
+        }
+
         void progress_in_flight_reads()
         {
             if (in_flight_read_requests.empty()) return;
@@ -211,7 +337,21 @@ namespace PsPIN
                 num_reads++;
                 time_last_read = sim_time();
 
+                if (ctrace)
+                {
+                    read_burst_bytes += read.req.data_size;
+                    if (read.req.r_beat.r_last)
+                    {
+                        assert(!read_bursts.empty());
+                        pcie_burst_t &burst = read_bursts.front();
+                        ctrace->complete("read", "dma", CTRACE_PID_PCIE, 1, burst.start_time, sim_time(), "\"addr\":\"0x%lx\",\"bytes\":%u", burst.addr, read_burst_bytes);
+                        read_bursts.pop();
+                        read_burst_bytes = 0;
+                    }
+                }
+
                 axi_driver_slv.send_r_beat(read.req.r_beat);
+                if (read.request_done) tlp->read_delivered();
                 in_flight_read_requests.pop();
             }
         }
@@ -219,8 +359,15 @@ namespace PsPIN
 
     private:
 
+        double cycles()
+        {
+            return ((double) sim_time()) / 1000;
+        }
+
         void posedge()
         {
+            if (tlp) tlp->tick(cycles());
+
             //push staff on the AXI interface
             progress_in_flight_reads();
             progress_in_flight_writes();
@@ -242,15 +389,35 @@ namespace PsPIN
 
     public: 
         void print_stats()
+        {
+            printf("PCIe Slave:\n");
+            printf("\tWrites: beats: %lu; bytes: %lu; avg throughput: %.03lf Gbit/s\n", num_writes, bytes_written, write_throughput());
+            printf("\tReads: beats: %lu; bytes: %lu; avg throughput: %.03lf Gbit/s\n", num_reads, bytes_read, read_throughput());
+            if (tlp) tlp->print_stats();
+        }
+
+        void register_stats(SimStats &stats)
+        {
+            stats.add_counter("pcie_slave", "write_beats", &num_writes);
+            stats.add_counter("pcie_slave", "bytes_written", &bytes_written);
+            stats.add_counter("pcie_slave", "read_beats", &num_reads);
+            stats.add_counter("pcie_slave", "bytes_read", &bytes_read);
+            stats.add_gauge("pcie_slave", "write_throughput_gbps", [this]() { return write_throughput(); });
+            stats.add_gauge("pcie_slave", "read_throughput_gbps", [this]() { return read_throughput(); });
+            if (tlp) tlp->register_stats(stats, "pcie_slave");
+        }
+
+    private:
+        double write_throughput()
         {
             double write_time = ((double) (time_last_write - time_first_write)) / 1000;
-            double read_time = ((double) (time_last_read - time_first_read)) / 1000;
-            double write_throghput = THROUGHPUT_1GHZ(write_time, bytes_written);            
-            double read_throghput = THROUGHPUT_1GHZ(read_time, bytes_read);            
+            return (write_time > 0) ? THROUGHPUT_1GHZ(write_time, bytes_written) : 0;
+        }
 
-            printf("PCIe Slave:\n");
-            printf("\tWrites: beats: %d; bytes: %d; avg throughput: %.03lf Gbit/s\n", num_writes, bytes_written, write_throghput);
-            printf("\tReads: beats: %d; bytes: %d; avg throughput: %.03lf Gbit/s\n", num_reads, bytes_read, read_throghput);
+        double read_throughput()
+        {
+            double read_time = ((double) (time_last_read - time_first_read)) / 1000;
+            return (read_time > 0) ? THROUGHPUT_1GHZ(read_time, bytes_read) : 0;
         }
     };
 
@@ -0,0 +1,316 @@
+// Copyright 2020 ETH Zurich
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "SimStats.hpp"
+#include "pspinsim.h"
+
+#include <queue>
+#include <random>
+#include <algorithm>
+#include <assert.h>
+#include <stdio.h>
+
+#define PCIE_CREDIT_BYTES 16
+
+namespace PsPIN
+{
+    // TLP-level timing of the PCIe link used by the NIC to access host memory.
+    // Times are in cycles (1 GHz). AXI write beats are grouped in posted TLPs
+    // of at most MPS bytes (split at MPS-aligned addresses); AXI read beats
+    // are grouped in read requests of at most MRRS bytes, each taking a tag,
+    // and answered with completions of at most MPS bytes. Every TLP adds
+    // tlp_overhead bytes on its link direction.
+    // Posted and non-posted credits are the host's: they return one latency
+    // after the TLP reached the host. Completion credits are the NIC's receive
+    // buffer: they are reserved when a read request is sent and released when
+    // its data is handed to AXI. Completions may be delayed by up to cpl_jitter
+    // cycles; since AXI data is returned in order, a late completion also holds
+    // back the ones behind it.
+    class PCIeTLPModel
+    {
+    private:
+        typedef struct credit_return
+        {
+            double time;
+            uint32_t ph;
+            uint32_t pd;
+            uint32_t nph;
+        } credit_return_t;
+
+        typedef struct read_reservation
+        {
+            uint32_t cplh;
+            uint32_t cpld;
+        } read_reservation_t;
+
+        pcie_tlp_conf_t conf;
+        double pcie_G; // ns/B
+
+        // available credits
+        uint32_t ph, pd, nph, cplh, cpld;
+        uint32_t tags_in_use;
+
+        std::queue<credit_return_t> credit_returns;
+        std::queue<read_reservation_t> read_reservations;
+
+        double tx_free; // NIC -> host
+        double rx_free; // host -> NIC
+
+        bool write_tlp_open;
+        bool read_open;
+        double read_cpl_start;
+        double last_read_cpl_ready;
+
+        std::mt19937_64 jitter_rng;
+
+        //statistics
+    private:
+        uint64_t write_tlps;
+        uint64_t read_requests;
+        uint64_t cpl_tlps;
+        uint64_t tx_overhead_bytes;
+        uint64_t rx_overhead_bytes;
+        uint64_t posted_credit_stalls;
+        uint64_t nonposted_credit_stalls;
+        uint64_t cpl_credit_stalls;
+        uint64_t tag_stalls;
+        uint64_t held_completions;
+        uint64_t held_cpl_cycles;
+        uint64_t max_tags_in_use;
+
+    public:
+        PCIeTLPModel(pcie_tlp_conf_t &conf, double pcie_G)
+            : conf(conf), pcie_G(pcie_G), jitter_rng(conf.seed)
+        {
+            ph = conf.ph_credits;
+            pd = conf.pd_credits;
+            nph = conf.nph_credits;
+            cplh = conf.cplh_credits;
+            cpld = conf.cpld_credits;
+            tags_in_use = 0;
+
+            tx_free = 0;
+            rx_free = 0;
+            write_tlp_open = false;
+            read_open = false;
+            read_cpl_start = 0;
+            last_read_cpl_ready = 0;
+
+            write_tlps = 0;
+            read_requests = 0;
+            cpl_tlps = 0;
+            tx_overhead_bytes = 0;
+            rx_overhead_bytes = 0;
+            posted_credit_stalls = 0;
+            nonposted_credit_stalls = 0;
+            cpl_credit_stalls = 0;
+            tag_stalls = 0;
+            held_completions = 0;
+            held_cpl_cycles = 0;
+            max_tags_in_use = 0;
+        }
+
+        void tick(double now)
+        {
+            while (!credit_returns.empty() && credit_returns.front().time <= now)
+            {
+                credit_return_t &r = credit_returns.front();
+                ph += r.ph;
+                pd += r.pd;
+                nph += r.nph;
+                credit_returns.pop();
+            }
+        }
+
+        // The link can take a write beat of at most max_bytes this cycle
+        bool can_write(double now, uint32_t max_bytes)
+        {
+            if (tx_free > now + 1) return false;
+
+            if (ph == 0 || pd < data_credits(max_bytes))
+            {
+                posted_credit_stalls++;
+                return false;
+            }
+
+            return true;
+        }
+
+        // Returns when the beat reaches the host
+        double write_beat(double now, uint64_t addr, uint32_t bytes, bool last)
+        {
+            credit_return_t ret = {0, 0, data_credits(bytes), 0};
+            uint32_t wire_bytes = bytes;
+
+            if (!write_tlp_open || addr % conf.mps == 0)
+            {
+                ph--;
+                ret.ph = 1;
+                write_tlps++;
+                wire_bytes += conf.tlp_overhead;
+                tx_overhead_bytes += conf.tlp_overhead;
+            }
+            pd -= ret.pd;
+
+            tx_free = std::max(now, tx_free) + wire_bytes * pcie_G;
+            double arrival = tx_free + conf.latency;
+
+            ret.time = arrival + conf.latency;
+            credit_returns.push(ret);
+
+            write_tlp_open = !last && (addr + bytes) % conf.mps != 0;
+
+            return arrival;
+        }
+
+        // The link can take a read beat this cycle (a new read request is
+        // needed when none is open)
+        bool can_read(double now)
+        {
+            if (read_open) return true;
+
+            if (tx_free > now + 1) return false;
+
+            if (tags_in_use >= conf.max_read_tags)
+            {
+                tag_stalls++;
+                return false;
+            }
+
+            if (nph == 0)
+            {
+                nonposted_credit_stalls++;
+                return false;
+            }
+
+            if (cplh < cplh_per_request() || cpld < data_credits(conf.mrrs))
+            {
+                cpl_credit_stalls++;
+                return false;
+            }
+
+            return true;
+        }
+
+        // Returns when the beat is received by the NIC. request_done is set
+        // on the last beat of a read request: read_delivered() must be called
+        // once that beat has been handed to AXI.
+        double read_beat(double now, uint64_t addr, uint32_t bytes, bool last, bool &request_done)
+        {
+            bool new_cpl = false;
+
+            if (!read_open)
+            {
+                read_open = true;
+                new_cpl = true;
+
+                read_reservation_t res = {cplh_per_request(), data_credits(conf.mrrs)};
+                read_reservations.push(res);
+                cplh -= res.cplh;
+                cpld -= res.cpld;
+                nph--;
+                tags_in_use++;
+                max_tags_in_use = std::max(max_tags_in_use, (uint64_t) tags_in_use);
+
+                read_requests++;
+                tx_overhead_bytes += conf.tlp_overhead;
+                tx_free = std::max(now, tx_free) + conf.tlp_overhead * pcie_G;
+
+                double arrival = tx_free + conf.latency;
+                credit_return_t ret = {arrival + conf.latency, 0, 0, 1};
+                credit_returns.push(ret);
+
+                uint32_t jitter = (conf.cpl_jitter > 0) ? jitter_rng() % (conf.cpl_jitter + 1) : 0;
+                read_cpl_start = arrival + jitter;
+
+                // completions are returned to AXI in request order
+                if (read_cpl_start < last_read_cpl_ready)
+                {
+                    held_completions++;
+                    held_cpl_cycles += last_read_cpl_ready - read_cpl_start;
+                }
+                last_read_cpl_ready = std::max(read_cpl_start, last_read_cpl_ready);
+            }
+            else if (addr % conf.mps == 0)
+            {
+                new_cpl = true;
+            }
+
+            uint32_t wire_bytes = bytes;
+            if (new_cpl)
+            {
+                cpl_tlps++;
+                wire_bytes += conf.tlp_overhead;
+                rx_overhead_bytes += conf.tlp_overhead;
+            }
+
+            rx_free = std::max(read_cpl_start, rx_free) + wire_bytes * pcie_G;
+
+            request_done = last || (addr + bytes) % conf.mrrs == 0;
+            if (request_done) read_open = false;
+
+            return rx_free + conf.latency;
+        }
+
+        void read_delivered()
+        {
+            assert(!read_reservations.empty());
+            read_reservation_t &res = read_reservations.front();
+            cplh += res.cplh;
+            cpld += res.cpld;
+            tags_in_use--;
+            read_reservations.pop();
+        }
+
+        void print_stats()
+        {
+            printf("\tTLPs (MPS: %u B; MRRS: %u B): writes: %lu; read requests: %lu; completions: %lu; overhead bytes: to host: %lu; from host: %lu\n",
+                conf.mps, conf.mrrs, write_tlps, read_requests, cpl_tlps, tx_overhead_bytes, rx_overhead_bytes);
+            printf("\tCredit stalls (cycles): posted: %lu; non-posted: %lu; completion: %lu; read tags: %lu (max in use: %lu)\n",
+                posted_credit_stalls, nonposted_credit_stalls, cpl_credit_stalls, tag_stalls, max_tags_in_use);
+            printf("\tCompletions held behind earlier ones: %lu (%lu cycles)\n", held_completions, held_cpl_cycles);
+        }
+
+        void register_stats(SimStats &stats, const char *module)
+        {
+            stats.add_counter(module, "tlp.write_tlps", &write_tlps);
+            stats.add_counter(module, "tlp.read_requests", &read_requests);
+            stats.add_counter(module, "tlp.completions", &cpl_tlps);
+            stats.add_counter(module, "tlp.tx_overhead_bytes", &tx_overhead_bytes);
+            stats.add_counter(module, "tlp.rx_overhead_bytes", &rx_overhead_bytes);
+            stats.add_counter(module, "tlp.posted_credit_stalls", &posted_credit_stalls);
+            stats.add_counter(module, "tlp.nonposted_credit_stalls", &nonposted_credit_stalls);
+            stats.add_counter(module, "tlp.cpl_credit_stalls", &cpl_credit_stalls);
+            stats.add_counter(module, "tlp.tag_stalls", &tag_stalls);
+            stats.add_counter(module, "tlp.max_tags_in_use", &max_tags_in_use);
+            stats.add_counter(module, "tlp.held_completions", &held_completions);
+            stats.add_counter(module, "tlp.held_cpl_cycles", &held_cpl_cycles);
+        }
+
+    private:
+        static uint32_t data_credits(uint32_t bytes)
+        {
+            return (bytes + PCIE_CREDIT_BYTES - 1) / PCIE_CREDIT_BYTES;
+        }
+
+        // worst case: an unaligned request is split in one more completion
+        uint32_t cplh_per_request()
+        {
+            return (conf.mrrs + conf.mps - 1) / conf.mps + 1;
+        }
+    };
+
+} // namespace PsPIN
@@ -0,0 +1,308 @@
+// Copyright 2020 ETH Zurich
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "pspinsim.h"
+
+#include <unordered_map>
+#include <string.h>
+#include <stdint.h>
+
+#define RDMA_HEADER_LENGTH 32
+
+#define ETH_HEADER_LENGTH 14
+#define IPV4_HEADER_LENGTH 20
+#define UDP_HEADER_LENGTH 8
+#define ROCE_BTH_LENGTH 12
+#define ROCE_RETH_LENGTH 16
+#define ROCE_ICRC_LENGTH 4
+#define SLMP_HEADER_LENGTH 10
+
+#define ETHERTYPE_IPV4 0x0800
+#define IP_PROTO_UDP 17
+#define ROCEV2_UDP_PORT 4791
+#define SLMP_UDP_PORT 9330
+
+// RC opcodes
+#define ROCE_OP_WRITE_FIRST 0x06
+#define ROCE_OP_WRITE_MIDDLE 0x07
+#define ROCE_OP_WRITE_LAST 0x08
+#define ROCE_OP_WRITE_ONLY 0x0a
+
+// SLMP flags (see sw/runtime/include/packets.h)
+#define SLMP_FLAG_EOM 0x8000
+#define SLMP_FLAG_SYN 0x4000
+
+namespace PsPIN
+{
+    // Headers prepended by the NIC outbound engine to the packets of RDMA
+    // commands (FID > 0). Packets of non-RDMA commands are sent as they are,
+    // since handlers build their own headers.
+    class PacketFormat
+    {
+    public:
+        typedef struct pkt_desc
+        {
+            uint32_t src_nid;
+            uint32_t dst_nid;
+            uint32_t fid;
+            uint64_t source_addr;   // of the command
+            uint32_t cmd_length;    // bytes of the whole command
+            uint32_t offset;        // of this packet's payload in the command
+            uint32_t payload_length;
+            uint32_t pkt_length;    // header + payload + trailer
+            bool first;
+            bool last;
+        } pkt_desc_t;
+
+    protected:
+        bool icrc;
+
+    private:
+        uint32_t crc_table[256];
+
+    public:
+        PacketFormat(bool icrc) : icrc(icrc)
+        {
+            for (uint32_t i = 0; i < 256; i++)
+            {
+                uint32_t c = i;
+                for (int k = 0; k < 8; k++)
+                {
+                    c = (c & 1) ? 0xedb88320 ^ (c >> 1) : c >> 1;
+                }
+                crc_table[i] = c;
+            }
+        }
+
+        virtual ~PacketFormat() {}
+
+        static PacketFormat *create(no_pkt_format_t format, bool icrc);
+
+        virtual uint32_t header_length(bool first) = 0;
+
+        // Largest payload fitting in budget bytes (packet size minus header and ICRC)
+        virtual uint32_t max_payload(uint32_t budget)
+        {
+            return budget;
+        }
+
+        // Bytes after the payload (padding and ICRC)
+        virtual uint32_t trailer_length(uint32_t payload_length)
+        {
+            return icrc ? ROCE_ICRC_LENGTH : 0;
+        }
+
+        virtual void write_header(uint8_t *hdr, const pkt_desc_t &desc) = 0;
+
+        // Called once the payload is in the packet
+        void write_trailer(uint8_t *pkt, uint32_t pkt_length)
+        {
+            if (!icrc) return;
+
+            // CRC32 of the packet (the RoCEv2 ICRC also masks the variant fields)
+            uint32_t crc_length = pkt_length - ROCE_ICRC_LENGTH;
+            uint32_t crc = 0xffffffff;
+            for (uint32_t i = 0; i < crc_length; i++)
+            {
+                crc = crc_table[(crc ^ pkt[i]) & 0xff] ^ (crc >> 8);
+            }
+            crc = ~crc;
+            memcpy(pkt + crc_length, &crc, ROCE_ICRC_LENGTH);
+        }
+
+    protected:
+        static void put16(uint8_t *p, uint16_t v)
+        {
+            p[0] = v >> 8;
+            p[1] = v;
+        }
+
+        static void put24(uint8_t *p, uint32_t v)
+        {
+            p[0] = v >> 16;
+            p[1] = v >> 8;
+            p[2] = v;
+        }
+
+        static void put32(uint8_t *p, uint32_t v)
+        {
+            put16(p, v >> 16);
+            put16(p + 2, v);
+        }
+
+        static void put64(uint8_t *p, uint64_t v)
+        {
+            put32(p, v >> 32);
+            put32(p + 4, v);
+        }
+
+        // Ethernet + IPv4 + UDP; node IDs are used as MAC and IP addresses
+        static uint8_t *write_udp_ip(uint8_t *p, const pkt_desc_t &desc, uint16_t udp_port)
+        {
+            uint8_t *eth = p;
+            eth[0] = 0x02;
+            put32(eth + 2, desc.dst_nid);
+            eth[6] = 0x02;
+            put32(eth + 8, desc.src_nid);
+            put16(eth + 12, ETHERTYPE_IPV4);
+
+            uint8_t *ip = eth + ETH_HEADER_LENGTH;
+            uint16_t ip_length = desc.pkt_length - ETH_HEADER_LENGTH;
+            ip[0] = 0x45;
+            put16(ip + 2, ip_length);
+            ip[8] = 64;
+            ip[9] = IP_PROTO_UDP;
+            put32(ip + 12, desc.src_nid);
+            put32(ip + 16, desc.dst_nid);
+            put16(ip + 10, ip_checksum(ip));
+
+            uint8_t *udp = ip + IPV4_HEADER_LENGTH;
+            put16(udp, udp_port);
+            put16(udp + 2, udp_port);
+            put16(udp + 4, ip_length - IPV4_HEADER_LENGTH);
+
+            return udp + UDP_HEADER_LENGTH;
+        }
+
+        static uint16_t ip_checksum(const uint8_t *ip)
+        {
+            uint32_t acc = 0;
+            for (int i = 0; i < IPV4_HEADER_LENGTH; i += 2)
+            {
+                acc += (ip[i] << 8) | ip[i + 1];
+            }
+            while (acc >> 16) acc = (acc & 0xffff) + (acc >> 16);
+            return ~acc;
+        }
+    };
+
+    // The original format: an opaque (zeroed) 32-byte header
+    class OpaquePacketFormat : public PacketFormat
+    {
+    public:
+        OpaquePacketFormat(bool icrc) : PacketFormat(icrc) {}
+
+        uint32_t header_length(bool first)
+        {
+            return RDMA_HEADER_LENGTH;
+        }
+
+        void write_header(uint8_t *hdr, const pkt_desc_t &desc)
+        {
+        }
+    };
+
+    // RoCEv2-like RDMA write: Eth/IPv4/UDP/BTH, plus RETH on the first packet.
+    // The QP is the FID; PSNs are sequential per QP. The remote address and
+    // key are not modeled: RETH carries the source address and the FID.
+    class RoCEv2PacketFormat : public PacketFormat
+    {
+    private:
+        std::unordered_map<uint32_t, uint32_t> next_psn;
+
+    public:
+        RoCEv2PacketFormat(bool icrc) : PacketFormat(icrc) {}
+
+        uint32_t header_length(bool first)
+        {
+            return ETH_HEADER_LENGTH + IPV4_HEADER_LENGTH + UDP_HEADER_LENGTH + ROCE_BTH_LENGTH + (first ? ROCE_RETH_LENGTH : 0);
+        }
+
+        // payloads are padded to 4 bytes
+        uint32_t max_payload(uint32_t budget)
+        {
+            return budget & ~3u;
+        }
+
+        uint32_t trailer_length(uint32_t payload_length)
+        {
+            return pad(payload_length) + PacketFormat::trailer_length(payload_length);
+        }
+
+        void write_header(uint8_t *hdr, const pkt_desc_t &desc)
+        {
+            uint8_t *bth = write_udp_ip(hdr, desc, ROCEV2_UDP_PORT);
+
+            uint8_t opcode;
+            if (desc.first) opcode = desc.last ? ROCE_OP_WRITE_ONLY : ROCE_OP_WRITE_FIRST;
+            else opcode = desc.last ? ROCE_OP_WRITE_LAST : ROCE_OP_WRITE_MIDDLE;
+
+            uint32_t &psn = next_psn[desc.fid];
+
+            bth[0] = opcode;
+            bth[1] = pad(desc.payload_length) << 4;
+            put16(bth + 2, 0xffff);
+            put24(bth + 5, desc.fid);
+            bth[8] = desc.last ? 0x80 : 0; // ack request
+            put24(bth + 9, psn);
+            psn = (psn + 1) & 0xffffff;
+
+            if (desc.first)
+            {
+                uint8_t *reth = bth + ROCE_BTH_LENGTH;
+                put64(reth, desc.source_addr);
+                put32(reth + 8, desc.fid);
+                put32(reth + 12, desc.cmd_length);
+            }
+        }
+
+    private:
+        static uint32_t pad(uint32_t payload_length)
+        {
+            return (4 - (payload_length & 3)) & 3;
+        }
+    };
+
+    // sPIN Lightweight Message Protocol (slmp_pkt_hdr_t in packets.h).
+    // The message ID is the FID.
+    class SLMPPacketFormat : public PacketFormat
+    {
+    public:
+        SLMPPacketFormat(bool icrc) : PacketFormat(icrc) {}
+
+        uint32_t header_length(bool first)
+        {
+            return ETH_HEADER_LENGTH + IPV4_HEADER_LENGTH + UDP_HEADER_LENGTH + SLMP_HEADER_LENGTH;
+        }
+
+        void write_header(uint8_t *hdr, const pkt_desc_t &desc)
+        {
+            uint8_t *slmp = write_udp_ip(hdr, desc, SLMP_UDP_PORT);
+
+            uint16_t flags = 0;
+            if (desc.first) flags |= SLMP_FLAG_SYN;
+            if (desc.last) flags |= SLMP_FLAG_EOM;
+
+            put16(slmp, flags);
+            put32(slmp + 2, desc.fid);
+            put32(slmp + 6, desc.offset);
+        }
+    };
+
+    inline PacketFormat *PacketFormat::create(no_pkt_format_t format, bool icrc)
+    {
+        switch (format)
+        {
+        case NO_PKT_FORMAT_ROCEV2:
+            return new RoCEv2PacketFormat(icrc);
+        case NO_PKT_FORMAT_SLMP:
+            return new SLMPPacketFormat(icrc);
+        default:
+            return new OpaquePacketFormat(icrc);
+        }
+    }
+
+} // namespace PsPIN
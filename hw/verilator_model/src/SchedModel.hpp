@@ -0,0 +1,924 @@
+// Copyright 2020 ETH Zurich
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "SimStats.hpp"
+#include "pspinsim.h"
+
+#include <vector>
+#include <deque>
+#include <functional>
+#include <algorithm>
+#include <string>
+#include <string.h>
+#include <assert.h>
+#include <stdio.h>
+
+namespace PsPIN
+{
+    // Cycle-approximate model of the packet scheduling pipeline:
+    //  - NIC inbound: packets are written to the L2 packet buffer (64 B/cycle)
+    //    and their HERs are pushed to the MPQ engine in order, up to her_batch
+    //    per cycle (at most one per MPQ bank, msgid % her_batch, and one
+    //    stateless HER);
+    //  - MPQ engine (mpq_engine.sv): one MPQ per msgid % num_mpq, same FSM
+    //    (header -> payload -> draining -> completion), round-robin among
+    //    the MPQs that have a task ready, one task per cycle; packets of
+    //    stateless ECs skip the MPQs (stateless FIFO, no L1 copy) and share
+    //    the output with them in round-robin order;
+    //  - scheduler (scheduler.sv): cluster occupancy counters and the
+    //    configured policy (the RTL implements HOME, SPACE_AWARE and
+    //    TWO_CHOICE, selected with SCHED_POLICY at build time); stateless
+    //    tasks go to the least occupied cluster;
+    //  - cluster schedulers (cluster_scheduler.sv): task FIFO, L1 packet
+    //    buffer space, in-order L2 -> L1 copies, lowest free HPU first;
+    //  - feedback arbiters: one feedback per cycle per cluster and overall.
+    // Handlers are opaque: the owner runs them when they start and returns
+    // their duration in cycles. Interconnect contention is not modeled.
+    // The L1 packet buffers are the ring buffers of cluster_rb_shim.sv, and the
+    // statistics use the definitions of the RTL simulation. The latencies of
+    // the pipeline stages are estimates: make model-check in an example
+    // measures the error against the RTL.
+    class SchedModel
+    {
+    public:
+        // (handler, packet, cluster, core) -> handler duration (cycles)
+        typedef std::function<uint64_t(uint32_t, uint64_t, uint32_t, uint32_t)> exec_cb_t;
+
+        // (packet, NIC arrival, PsPIN arrival, now), times in cycles
+        typedef std::function<void(uint64_t, uint64_t, uint64_t, uint64_t)> feedback_cb_t;
+
+    private:
+        static const uint32_t BEAT_SIZE = 64;           // bytes per cycle (512-bit AXI)
+        static const uint32_t L2_WRITE_LATENCY = 4;
+        static const uint32_t SCHED_LATENCY = 2;        // spill registers to the cluster
+        static const uint32_t PKT_BUFF_SLOT_SIZE = 64;  // L1 packet buffer allocation unit
+        static const uint32_t PKT_BUFF_NUM_RB = 4;      // ring buffers per L1 packet buffer
+        static const uint32_t STATELESS_FIFO_DEPTH = 8;
+
+        typedef struct model_pkt
+        {
+            uint64_t id;
+            uint32_t msgid;
+            uint32_t hh, ph, th;
+            uint32_t size;          // bytes in L2
+            uint32_t xfer_size;     // bytes copied to L1
+            bool eom;
+            bool stateless;
+            uint32_t wait_cycles;
+            uint64_t nic_arrival;
+            uint64_t pspin_arrival;
+            uint64_t her_ready;
+        } model_pkt_t;
+
+        typedef struct model_task
+        {
+            model_pkt_t *pkt;
+            uint32_t handler;
+            uint32_t mpq;
+            uint32_t xfer_size;
+            uint32_t l1_rb;         // L1 packet buffer slot
+            uint32_t l1_slot;
+            bool trigger_feedback;
+            bool stateless;
+            uint64_t ready;         // L1 copy done
+            uint32_t cluster;
+            uint32_t core;
+            uint64_t end;
+        } model_task_t;
+
+        typedef enum mpq_state
+        {
+            MPQ_FREE,
+            MPQ_HEADER,
+            MPQ_HEADER_RUNNING,
+            MPQ_PAYLOAD,
+            MPQ_PAYLOAD_DRAINING,
+            MPQ_COMPLETION,
+            MPQ_COMPLETION_RUNNING
+        } mpq_state_t;
+
+        typedef struct mpq
+        {
+            mpq_state_t state;
+            std::deque<model_pkt_t*> fifo;
+            uint32_t length;        // packets without a payload task yet
+            uint32_t in_flight;
+            bool eom_seen;
+            bool has_completion;
+            uint32_t hh, ph, th;    // written by the first HER of a free MPQ
+        } mpq_t;
+
+        // One ring buffer of the L1 packet buffer (cluster_rb.sv): packets
+        // take contiguous slots from the tail (wrapping to slot 0 if they do
+        // not fit before the end) and the head only moves over freed slots.
+        typedef struct pkt_rb
+        {
+            std::vector<bool> used;
+            uint32_t head;
+            uint32_t tail;
+
+            bool empty() { return head == tail && std::find(used.begin(), used.end(), true) == used.end(); }
+
+            // contiguous free slots
+            uint32_t free_slots()
+            {
+                uint32_t n = used.size();
+                if (head == tail && !empty()) return 0;
+                if (head <= tail) return std::max(n - tail, head);
+                return head - tail;
+            }
+
+            uint32_t alloc(uint32_t slots)
+            {
+                uint32_t idx = (head <= tail && used.size() - tail < slots) ? 0 : tail;
+                for (uint32_t i = idx; i < idx + slots; i++) used[i] = true;
+                tail = (idx + slots) % used.size();
+                return idx;
+            }
+
+            void free(uint32_t idx, uint32_t slots)
+            {
+                uint32_t n = used.size();
+                for (uint32_t i = idx; i < idx + slots; i++) used[i] = false;
+                if (empty())
+                {
+                    head = tail = 0;
+                    return;
+                }
+                // RTL: a full ring buffer (head == tail) only restarts when empty
+                uint32_t max_incr = (tail >= head) ? tail - head : tail + n - head;
+                uint32_t incr = 0;
+                while (incr < max_incr && !used[(head + incr) % n]) incr++;
+                head = (head + incr) % n;
+            }
+        } pkt_rb_t;
+
+        typedef struct cluster
+        {
+            uint32_t occupancy;     // scheduler view
+            std::vector<pkt_rb_t> pkt_rbs;
+            uint64_t dma_free;
+            std::deque<model_task_t*> tasks;
+            std::vector<uint64_t> hpu_free;
+            std::vector<model_task_t*> running;
+
+            // statistics
+            uint64_t num_tasks;
+            uint64_t home_tasks;
+            std::vector<uint64_t> hpu_busy;
+        } cluster_t;
+
+        sched_model_conf_t conf;
+        exec_cb_t exec_cb;
+        feedback_cb_t feedback_cb;
+
+        uint64_t now;
+        bool eos;
+
+        std::deque<model_pkt_t*> incoming;
+        uint64_t next_arrival;
+        uint32_t l2_used;
+        uint64_t l2_write_free;
+        std::deque<model_pkt_t*> hers;
+
+        std::vector<mpq_t> mpqs;
+        std::vector<uint32_t> mpq_dynamic_used;     // per bank
+        uint32_t mpq_rr;
+        std::deque<model_pkt_t*> stateless_fifo;
+        bool stateless_turn;    // round robin between the MPQs and the stateless FIFO
+        model_task_t *mpq_out;
+
+        std::vector<cluster_t> clusters;
+        uint32_t rr_cluster;
+        uint16_t lfsr;      // same sequence as the scheduler (TWO_CHOICE)
+
+        std::deque<model_task_t*> sched_feedbacks;
+        std::deque<model_task_t*> nic_feedbacks;
+        uint64_t pending_pkts;
+
+        //statistics
+        uint64_t pkts;
+        uint64_t bytes;
+        uint64_t tasks;
+        uint64_t l2_stall_cycles;
+        uint64_t mpq_stall_cycles;
+        uint64_t sched_stall_cycles;
+        uint64_t first_arrival;
+        uint64_t first_feedback;
+        uint64_t last_feedback;
+        uint64_t sum_pkt_latency;
+        StatsHistogram pkt_latency_hist;
+        StatsHistogram handler_cycles_hist;
+
+    public:
+        SchedModel(sched_model_conf_t &conf, exec_cb_t exec_cb, feedback_cb_t feedback_cb)
+            : conf(conf), exec_cb(exec_cb), feedback_cb(feedback_cb), mpqs(conf.num_mpq), mpq_dynamic_used(conf.her_batch, 0),
+              clusters(conf.num_clusters)
+        {
+            now = 0;
+            eos = false;
+            next_arrival = 0;
+            l2_used = 0;
+            l2_write_free = 0;
+            mpq_rr = 0;
+            stateless_turn = false;
+            mpq_out = NULL;
+            rr_cluster = 0;
+            lfsr = 0xACE1;
+            pending_pkts = 0;
+
+            for (uint32_t i = 0; i < conf.num_mpq; i++)
+            {
+                mpqs[i].state = MPQ_FREE;
+                mpqs[i].length = 0;
+                mpqs[i].in_flight = 0;
+                mpqs[i].eom_seen = false;
+                mpqs[i].has_completion = false;
+                mpqs[i].hh = mpqs[i].ph = mpqs[i].th = 0;
+            }
+
+            for (uint32_t i = 0; i < conf.num_clusters; i++)
+            {
+                clusters[i].occupancy = 0;
+                clusters[i].pkt_rbs.resize(PKT_BUFF_NUM_RB);
+                for (auto &rb : clusters[i].pkt_rbs)
+                {
+                    rb.used.assign(conf.l1_pkt_buff_size / PKT_BUFF_NUM_RB / PKT_BUFF_SLOT_SIZE, false);
+                    rb.head = rb.tail = 0;
+                }
+                clusters[i].dma_free = 0;
+                clusters[i].hpu_free.assign(conf.num_cores, 0);
+                clusters[i].running.assign(conf.num_cores, NULL);
+                clusters[i].num_tasks = 0;
+                clusters[i].home_tasks = 0;
+                clusters[i].hpu_busy.assign(conf.num_cores, 0);
+            }
+
+            pkts = 0;
+            bytes = 0;
+            tasks = 0;
+            l2_stall_cycles = 0;
+            mpq_stall_cycles = 0;
+            sched_stall_cycles = 0;
+            first_arrival = 0;
+            first_feedback = 0;
+            last_feedback = 0;
+            sum_pkt_latency = 0;
+        }
+
+        ~SchedModel()
+        {
+            for (auto pkt : incoming) delete pkt;
+            for (auto pkt : hers) delete pkt;
+            for (auto pkt : stateless_fifo) delete pkt;
+        }
+
+        // Parameters of the RTL (pspin_cfg_pkg.sv); the latencies are estimates
+        static void default_conf(sched_model_conf_t &conf)
+        {
+            memset(&conf, 0, sizeof(sched_model_conf_t));
+            conf.num_clusters = NUM_CLUSTERS;
+            conf.num_cores = NUM_CORES;
+            conf.num_mpq = NUM_MPQ;
+            conf.mpq_cells = 128;
+            conf.her_batch = HER_BATCH;
+            conf.hers_per_cluster = 12 + NUM_CORES;
+            conf.l1_pkt_buff_size = 64 * 1024;
+            conf.l2_pkt_buff_size = 512 * 1024;
+            conf.policy = SCHED_MODEL_HOME;
+            conf.home_min_free = 8192;
+            conf.cycles_per_ns = 1.0;
+            conf.seed = 1;
+            conf.dispatch_latency = 12;
+            conf.feedback_latency = 4;
+            conf.dma_latency = 16;
+        }
+
+        static int check_conf(sched_model_conf_t &conf)
+        {
+            if (conf.num_clusters == 0 || conf.num_cores == 0 || conf.num_mpq == 0 || conf.mpq_cells < conf.num_mpq ||
+                conf.her_batch == 0 || conf.her_batch > 8 || (conf.her_batch & (conf.her_batch - 1)) != 0 || conf.num_mpq % conf.her_batch != 0 ||
+                conf.hers_per_cluster == 0 || conf.l1_pkt_buff_size % (PKT_BUFF_NUM_RB * PKT_BUFF_SLOT_SIZE) != 0 ||
+                conf.l1_pkt_buff_size == 0 || conf.l2_pkt_buff_size == 0)
+            {
+                printf("Error: invalid scheduler model configuration!\n");
+                return SPIN_ERR;
+            }
+            return SPIN_SUCCESS;
+        }
+
+        // Can be called while the model runs (e.g., from the feedback callback):
+        // the packet arrives wait_cycles after the previous one or, if the NIC
+        // has no packets left, after the current cycle. Stateless packets run
+        // only ph and are not copied to L1 (xfer_size is ignored).
+        void add_packet(uint64_t id, uint32_t msgid, uint32_t hh, uint32_t ph, uint32_t th, uint32_t size, uint32_t xfer_size, bool eom, uint32_t wait_cycles, bool stateless = false)
+        {
+            model_pkt_t *pkt = new model_pkt_t;
+            pkt->id = id;
+            pkt->msgid = msgid;
+            pkt->hh = hh;
+            pkt->ph = ph;
+            pkt->th = th;
+            pkt->size = size;
+            pkt->xfer_size = (stateless) ? 0 : std::min(xfer_size, conf.l1_pkt_buff_size / PKT_BUFF_NUM_RB);
+            pkt->eom = eom;
+            pkt->stateless = stateless;
+            pkt->wait_cycles = wait_cycles;
+            pkt->nic_arrival = 0;
+            pkt->pspin_arrival = 0;
+            pkt->her_ready = 0;
+
+            if (incoming.empty()) next_arrival = std::max(next_arrival, now);
+            incoming.push_back(pkt);
+            pending_pkts++;
+        }
+
+        void set_eos()
+        {
+            eos = true;
+        }
+
+        // Runs until all packets are processed and EOS is set
+        int run()
+        {
+            while (!(eos && pending_pkts == 0))
+            {
+                if (pending_pkts == 0)
+                {
+                    printf("Error: no packets left but no EOS from the driver!\n");
+                    return SPIN_ERR;
+                }
+
+                tick();
+                now++;
+            }
+
+            return SPIN_SUCCESS;
+        }
+
+        uint64_t cycles()
+        {
+            return now;
+        }
+
+        void print_stats()
+        {
+            // same definition as the NIC inbound engine of the RTL simulation
+            double intra = (pkts > 1) ? ((double) (last_feedback - first_feedback)) / (pkts - 1) : 0;
+            double avg_pkt_size = (pkts > 0) ? ((double) bytes) / pkts : 0;
+
+            printf("\nScheduler model (%u clusters x %u HPUs; policy: %s)\n", conf.num_clusters, conf.num_cores, policy_name());
+            printf("\tWarning: estimates; check their error against the RTL with make model-check\n");
+            printf("\tCycles: %lu; packets: %lu; tasks: %lu\n", now, pkts, tasks);
+            printf("\tFeedback throughput: %.3lf Gbit/s (at 1 GHz); Feedback rate: %.3lf Mpps\n",
+                (intra > 0) ? (8.0 * avg_pkt_size) / intra : 0, (intra > 0) ? 1000 / intra : 0);
+            printf("\tPacket latency (cycles): avg: %.2lf; min: %lu; max: %lu\n",
+                (pkts > 0) ? ((double) sum_pkt_latency) / pkts : 0, pkt_latency_hist.min, pkt_latency_hist.max);
+            printf("\tHandler cycles: avg: %.2lf; min: %lu; max: %lu\n", handler_cycles_hist.mean(), handler_cycles_hist.min, handler_cycles_hist.max);
+            printf("\tStalls (cycles): L2 full: %lu; MPQ full: %lu; no cluster available: %lu\n", l2_stall_cycles, mpq_stall_cycles, sched_stall_cycles);
+            for (uint32_t i = 0; i < conf.num_clusters; i++)
+            {
+                cluster_t &c = clusters[i];
+                uint64_t busy = 0;
+                for (uint32_t j = 0; j < conf.num_cores; j++) busy += c.hpu_busy[j];
+                printf("\tCluster %u: tasks: %lu (home: %.2lf%%); HPU utilization: %.2lf%%\n", i, c.num_tasks,
+                    (c.num_tasks > 0) ? (100.0 * c.home_tasks) / c.num_tasks : 0,
+                    (now > 0) ? (100.0 * busy) / (now * conf.num_cores) : 0);
+            }
+        }
+
+        void register_stats(SimStats &stats)
+        {
+            stats.add_counter("sched_model", "cycles", &now);
+            stats.add_counter("sched_model", "packets", &pkts);
+            stats.add_counter("sched_model", "bytes", &bytes);
+            stats.add_counter("sched_model", "tasks", &tasks);
+            stats.add_counter("sched_model", "l2_stall_cycles", &l2_stall_cycles);
+            stats.add_counter("sched_model", "mpq_stall_cycles", &mpq_stall_cycles);
+            stats.add_counter("sched_model", "sched_stall_cycles", &sched_stall_cycles);
+            stats.add_histogram("sched_model", "pkt_latency", &pkt_latency_hist);
+            stats.add_histogram("sched_model", "handler_cycles", &handler_cycles_hist);
+            for (uint32_t i = 0; i < conf.num_clusters; i++)
+            {
+                std::string p = "cluster" + std::to_string(i) + ".";
+                stats.add_counter("sched_model", p + "tasks", &clusters[i].num_tasks);
+                stats.add_counter("sched_model", p + "home_tasks", &clusters[i].home_tasks);
+                for (uint32_t j = 0; j < conf.num_cores; j++)
+                {
+                    stats.add_counter("sched_model", p + "hpu" + std::to_string(j) + ".busy", &clusters[i].hpu_busy[j]);
+                }
+            }
+        }
+
+    private:
+        const char *policy_name()
+        {
+            switch (conf.policy)
+            {
+            case SCHED_MODEL_LEAST_OCCUPIED: return "least occupied";
+            case SCHED_MODEL_ROUND_ROBIN: return "round robin";
+            case SCHED_MODEL_SPACE_AWARE: return "space aware";
+            case SCHED_MODEL_TWO_CHOICE: return "two choice";
+            default: return "home";
+            }
+        }
+
+        // Later stages first, so that a task moves at most one stage per cycle
+        void tick()
+        {
+            nic_feedback_progress();
+            sched_feedback_progress();
+            cluster_feedback_progress();
+            cluster_dispatch();
+            sched_progress();
+            mpq_progress();
+            her_progress();
+            nic_arrivals();
+        }
+
+        /*** NIC inbound ***/
+
+        void nic_arrivals()
+        {
+            if (incoming.empty() || now < next_arrival) return;
+
+            model_pkt_t *pkt = incoming.front();
+            if (l2_used + pkt->size > conf.l2_pkt_buff_size)
+            {
+                l2_stall_cycles++;
+                return;
+            }
+
+            incoming.pop_front();
+            l2_used += pkt->size;
+            pkt->nic_arrival = now;
+            if (pkts == 0 && hers.empty()) first_arrival = now;
+
+            uint64_t start = std::max(now, l2_write_free);
+            l2_write_free = start + beats(pkt->size);
+            pkt->her_ready = l2_write_free + L2_WRITE_LATENCY;
+            hers.push_back(pkt);
+
+            next_arrival = now + std::max(pkt->wait_cycles, (uint32_t) 1);
+        }
+
+        // Up to her_batch HERs in order: the first one that cannot be taken
+        // (full MPQ, bank or stateless FIFO already used) blocks the others
+        void her_progress()
+        {
+            uint32_t banks_taken = 0;
+            bool stateless_taken = false;
+
+            for (uint32_t n = 0; n < conf.her_batch; n++)
+            {
+                if (hers.empty() || hers.front()->her_ready > now) return;
+
+                model_pkt_t *pkt = hers.front();
+                if (pkt->stateless)
+                {
+                    if (stateless_taken) return;
+                    if (stateless_fifo.size() >= STATELESS_FIFO_DEPTH)
+                    {
+                        if (n == 0) mpq_stall_cycles++;
+                        return;
+                    }
+                    hers.pop_front();
+                    pkt->pspin_arrival = now;
+                    stateless_fifo.push_back(pkt);
+                    stateless_taken = true;
+                    continue;
+                }
+
+                uint32_t idx = pkt->msgid % conf.num_mpq;
+                uint32_t bank = idx % conf.her_batch;
+                if (banks_taken & (1 << bank)) return;
+                if (mpq_full(idx))
+                {
+                    if (n == 0) mpq_stall_cycles++;
+                    return;
+                }
+
+                hers.pop_front();
+                pkt->pspin_arrival = now;
+                mpq_push(idx, pkt);
+                banks_taken |= 1 << bank;
+            }
+        }
+
+        void mpq_push(uint32_t idx, model_pkt_t *pkt)
+        {
+            mpq_t &mpq = mpqs[idx];
+
+            if (!mpq.fifo.empty()) mpq_dynamic_used[idx % conf.her_batch]++;
+            mpq.fifo.push_back(pkt);
+            mpq.length++;
+            if (pkt->eom) mpq.eom_seen = true;
+
+            if (mpq.state == MPQ_FREE)
+            {
+                mpq.state = (pkt->hh != 0) ? MPQ_HEADER : MPQ_PAYLOAD;
+                mpq.has_completion = pkt->th != 0;
+                mpq.hh = pkt->hh;
+                mpq.ph = pkt->ph;
+                mpq.th = pkt->th;
+            }
+        }
+
+        // fifo_engine (one per bank): one static cell per MPQ, the others
+        // are shared by the MPQs of the bank
+        bool mpq_full(uint32_t idx)
+        {
+            uint32_t bank_cells = (conf.mpq_cells - conf.num_mpq) / conf.her_batch;
+            return !mpqs[idx].fifo.empty() && mpq_dynamic_used[idx % conf.her_batch] >= bank_cells;
+        }
+
+        void mpq_pop(uint32_t idx)
+        {
+            mpq_t &mpq = mpqs[idx];
+            mpq.fifo.pop_front();
+            if (!mpq.fifo.empty()) mpq_dynamic_used[idx % conf.her_batch]--;
+        }
+
+        /*** MPQ engine ***/
+
+        bool mpq_valid(mpq_t &mpq)
+        {
+            return mpq.state == MPQ_HEADER || (mpq.state == MPQ_PAYLOAD && mpq.length > 0) || mpq.state == MPQ_COMPLETION;
+        }
+
+        void mpq_progress()
+        {
+            if (mpq_out != NULL) return;
+
+            bool mpq_ready = false;
+            for (uint32_t i = 0; i < conf.num_mpq && !mpq_ready; i++) mpq_ready = mpq_valid(mpqs[i]);
+
+            if (!stateless_fifo.empty() && (stateless_turn || !mpq_ready))
+            {
+                model_task_t *task = new model_task_t;
+                task->pkt = stateless_fifo.front();
+                task->mpq = task->pkt->msgid % conf.num_mpq;
+                task->handler = task->pkt->ph;
+                task->xfer_size = 0;
+                task->ready = now;
+                task->trigger_feedback = true;
+                task->stateless = true;
+                stateless_fifo.pop_front();
+
+                stateless_turn = false;
+                mpq_out = task;
+                tasks++;
+                return;
+            }
+            if (mpq_ready) stateless_turn = true;
+
+            for (uint32_t i = 0; i < conf.num_mpq; i++)
+            {
+                uint32_t idx = (mpq_rr + i) % conf.num_mpq;
+                mpq_t &mpq = mpqs[idx];
+                if (!mpq_valid(mpq)) continue;
+
+                mpq_rr = (idx + 1) % conf.num_mpq;
+
+                model_task_t *task = new model_task_t;
+                task->pkt = mpq.fifo.front();
+                task->mpq = idx;
+                task->xfer_size = task->pkt->xfer_size;
+                task->ready = now + 1; // MPQ meta memory read
+                task->trigger_feedback = false;
+                task->stateless = false;
+
+                switch (mpq.state)
+                {
+                case MPQ_HEADER:
+                    task->handler = mpq.hh;
+                    mpq.state = MPQ_HEADER_RUNNING;
+                    break;
+                case MPQ_PAYLOAD:
+                    task->handler = mpq.ph;
+                    mpq.length--;
+                    if (mpq.eom_seen && mpq.length == 0)
+                    {
+                        mpq.state = MPQ_PAYLOAD_DRAINING;
+                    }
+                    // the EOM packet stays for the completion handler
+                    if (!(mpq.state == MPQ_PAYLOAD_DRAINING && mpq.has_completion))
+                    {
+                        task->trigger_feedback = true;
+                        mpq_pop(idx);
+                    }
+                    break;
+                default:
+                    task->handler = mpq.th;
+                    mpq.state = MPQ_COMPLETION_RUNNING;
+                    task->trigger_feedback = true;
+                    mpq_pop(idx);
+                    break;
+                }
+
+                mpq.in_flight++;
+                mpq_out = task;
+                tasks++;
+                return;
+            }
+        }
+
+        void mpq_feedback(model_task_t *task)
+        {
+            mpq_t &mpq = mpqs[task->mpq];
+
+            switch (mpq.state)
+            {
+            case MPQ_HEADER_RUNNING:
+                mpq.state = MPQ_PAYLOAD;
+                break;
+            case MPQ_PAYLOAD_DRAINING:
+                if (mpq.in_flight == 1) mpq.state = (mpq.has_completion) ? MPQ_COMPLETION : MPQ_FREE;
+                break;
+            case MPQ_COMPLETION_RUNNING:
+                mpq.state = MPQ_FREE;
+                break;
+            default:
+                break;
+            }
+
+            mpq.in_flight--;
+            if (mpq.state == MPQ_FREE) mpq.eom_seen = false;
+
+            // packets of the next message that arrived while this one was running
+            if (mpq.state == MPQ_FREE && !mpq.fifo.empty())
+            {
+                model_pkt_t *pkt = mpq.fifo.front();
+                mpq.state = (pkt->hh != 0) ? MPQ_HEADER : MPQ_PAYLOAD;
+                mpq.has_completion = pkt->th != 0;
+                mpq.hh = pkt->hh;
+                mpq.ph = pkt->ph;
+                mpq.th = pkt->th;
+                for (auto p : mpq.fifo) if (p->eom) mpq.eom_seen = true;
+            }
+        }
+
+        /*** Scheduler ***/
+
+        // Free space seen by the scheduler: the largest contiguous region of
+        // one ring buffer (cluster_rb_shim.sv), not the total free space
+        uint32_t pkt_buff_free(uint32_t c)
+        {
+            uint32_t slots = 0;
+            for (auto &rb : clusters[c].pkt_rbs) slots = std::max(slots, rb.free_slots());
+            return slots * PKT_BUFF_SLOT_SIZE;
+        }
+
+        bool cluster_ready(uint32_t c, model_task_t *task)
+        {
+            return clusters[c].tasks.size() < conf.hers_per_cluster && pkt_buff_free(c) >= alloc_size(task->xfer_size);
+        }
+
+        bool available(uint32_t c, model_task_t *task)
+        {
+            return clusters[c].occupancy < conf.hers_per_cluster && cluster_ready(c, task);
+        }
+
+        // Returns the selected cluster, or -1 if the task must wait
+        int select_cluster(model_task_t *task)
+        {
+            uint32_t max_occ = conf.hers_per_cluster;
+            uint32_t home = task->mpq % conf.num_clusters;
+            int min_c = -1;
+            int space_c = -1; // most L1 free space, below max_occ
+            for (uint32_t i = 0; i < conf.num_clusters; i++)
+            {
+                if (!cluster_ready(i, task)) continue;
+                if (min_c < 0 || clusters[i].occupancy < clusters[min_c].occupancy) min_c = i;
+                if (clusters[i].occupancy < max_occ && (space_c < 0 || pkt_buff_free(i) > pkt_buff_free(space_c))) space_c = i;
+            }
+
+            // stateless tasks have no home cluster
+            if (task->stateless) return (min_c >= 0 && clusters[min_c].occupancy < max_occ) ? min_c : -1;
+
+            switch (conf.policy)
+            {
+            case SCHED_MODEL_LEAST_OCCUPIED:
+                return (min_c >= 0 && clusters[min_c].occupancy < max_occ) ? min_c : -1;
+
+            case SCHED_MODEL_ROUND_ROBIN:
+                for (uint32_t i = 0; i < conf.num_clusters; i++)
+                {
+                    uint32_t c = (rr_cluster + i) % conf.num_clusters;
+                    if (clusters[c].occupancy < max_occ && cluster_ready(c, task))
+                    {
+                        rr_cluster = (c + 1) % conf.num_clusters;
+                        return c;
+                    }
+                }
+                return -1;
+
+            case SCHED_MODEL_SPACE_AWARE:
+            {
+                if (space_c < 0) return cluster_ready(home, task) ? home : -1;
+                if (!available(home, task)) return space_c;
+                uint32_t home_free = pkt_buff_free(home);
+                bool keeps_free = home_free >= alloc_size(task->xfer_size) + conf.home_min_free;
+                return (keeps_free || pkt_buff_free(space_c) <= home_free) ? home : space_c;
+            }
+
+            case SCHED_MODEL_TWO_CHOICE:
+            {
+                if (space_c < 0) return cluster_ready(home, task) ? home : -1;
+                uint32_t other = lfsr % conf.num_clusters;
+                if (available(other, task) && (!available(home, task) || pkt_buff_free(other) > pkt_buff_free(home))) return other;
+                return available(home, task) ? home : space_c;
+            }
+
+            default:
+            {
+                if (min_c < 0 || clusters[min_c].occupancy >= max_occ)
+                {
+                    // RTL: nothing better to do than the home cluster
+                    return cluster_ready(home, task) ? home : -1;
+                }
+                return (clusters[home].occupancy < max_occ && cluster_ready(home, task)) ? home : min_c;
+            }
+            }
+        }
+
+        void sched_progress()
+        {
+            if (mpq_out == NULL || mpq_out->ready > now) return;
+
+            model_task_t *task = mpq_out;
+            int c = select_cluster(task);
+            if (c < 0)
+            {
+                sched_stall_cycles++;
+                return;
+            }
+
+            mpq_out = NULL;
+            lfsr = (lfsr >> 1) ^ ((lfsr & 1) ? 0xB400 : 0);
+
+            cluster_t &cl = clusters[c];
+            cl.occupancy++;
+            cl.num_tasks++;
+            if ((uint32_t) c == task->mpq % conf.num_clusters) cl.home_tasks++;
+
+            task->cluster = c;
+            if (task->xfer_size > 0)
+            {
+                // first ring buffer with enough contiguous space
+                uint32_t slots = alloc_size(task->xfer_size) / PKT_BUFF_SLOT_SIZE;
+                uint32_t rb = 0;
+                while (cl.pkt_rbs[rb].free_slots() < slots) rb++;
+                task->l1_rb = rb;
+                task->l1_slot = cl.pkt_rbs[rb].alloc(slots);
+            }
+
+            uint64_t arrival = now + SCHED_LATENCY;
+            if (task->xfer_size > 0)
+            {
+                uint64_t start = std::max(arrival, cl.dma_free);
+                cl.dma_free = start + beats(task->xfer_size);
+                task->ready = cl.dma_free + conf.dma_latency;
+            }
+            else
+            {
+                task->ready = arrival;
+            }
+
+            cl.tasks.push_back(task);
+        }
+
+        /*** Cluster schedulers and HPUs ***/
+
+        void cluster_dispatch()
+        {
+            for (uint32_t c = 0; c < conf.num_clusters; c++)
+            {
+                cluster_t &cl = clusters[c];
+                if (cl.tasks.empty() || cl.tasks.front()->ready > now) continue;
+
+                int core = -1;
+                for (uint32_t i = 0; i < conf.num_cores; i++)
+                {
+                    if (cl.running[i] == NULL && cl.hpu_free[i] <= now)
+                    {
+                        core = i;
+                        break;
+                    }
+                }
+                if (core < 0) continue;
+
+                model_task_t *task = cl.tasks.front();
+                cl.tasks.pop_front();
+
+                uint64_t start = now + conf.dispatch_latency;
+                uint64_t duration = 0;
+                if (task->handler != 0)
+                {
+                    duration = exec_cb(task->handler, task->pkt->id, c, core);
+                    handler_cycles_hist.add(duration);
+                }
+
+                task->core = core;
+                task->end = start + duration;
+                cl.running[core] = task;
+                cl.hpu_busy[core] += task->end - now;
+            }
+        }
+
+        // One HPU feedback per cycle per cluster, the earliest first
+        void cluster_feedback_progress()
+        {
+            for (uint32_t c = 0; c < conf.num_clusters; c++)
+            {
+                cluster_t &cl = clusters[c];
+                int sel = -1;
+                for (uint32_t i = 0; i < conf.num_cores; i++)
+                {
+                    model_task_t *t = cl.running[i];
+                    if (t == NULL || t->end > now) continue;
+                    if (sel < 0 || t->end < cl.running[sel]->end) sel = i;
+                }
+                if (sel < 0) continue;
+
+                model_task_t *task = cl.running[sel];
+                cl.running[sel] = NULL;
+                cl.hpu_free[sel] = now + 1;
+                if (task->xfer_size > 0)
+                    cl.pkt_rbs[task->l1_rb].free(task->l1_slot, alloc_size(task->xfer_size) / PKT_BUFF_SLOT_SIZE);
+                sched_feedbacks.push_back(task);
+            }
+        }
+
+        // One cluster feedback per cycle to the MPQ engine and the NIC
+        void sched_feedback_progress()
+        {
+            if (sched_feedbacks.empty()) return;
+
+            model_task_t *task = sched_feedbacks.front();
+            sched_feedbacks.pop_front();
+
+            clusters[task->cluster].occupancy--;
+            if (!task->stateless) mpq_feedback(task);
+
+            if (task->trigger_feedback)
+            {
+                task->end = now + conf.feedback_latency;
+                nic_feedbacks.push_back(task);
+            }
+            else
+            {
+                delete task;
+            }
+        }
+
+        void nic_feedback_progress()
+        {
+            while (!nic_feedbacks.empty() && nic_feedbacks.front()->end <= now)
+            {
+                model_task_t *task = nic_feedbacks.front();
+                nic_feedbacks.pop_front();
+
+                model_pkt_t *pkt = task->pkt;
+                l2_used -= pkt->size;
+
+                uint64_t latency = now - pkt->nic_arrival;
+                pkts++;
+                bytes += pkt->size;
+                sum_pkt_latency += latency;
+                pkt_latency_hist.add(latency);
+                if (pkts == 1) first_feedback = now;
+                last_feedback = now;
+                pending_pkts--;
+
+                feedback_cb(pkt->id, pkt->nic_arrival, pkt->pspin_arrival, now);
+
+                delete pkt;
+                delete task;
+            }
+        }
+
+        static uint64_t beats(uint32_t size)
+        {
+            return (size + BEAT_SIZE - 1) / BEAT_SIZE;
+        }
+
+        static uint32_t alloc_size(uint32_t size)
+        {
+            return (size + PKT_BUFF_SLOT_SIZE - 1) / PKT_BUFF_SLOT_SIZE * PKT_BUFF_SLOT_SIZE;
+        }
+    };
+}
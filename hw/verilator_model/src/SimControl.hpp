@@ -15,27 +15,66 @@
 #pragma once
 
 #include "verilated.h"
+#ifdef VERILATOR_HAS_TRACE_FST
+#include "verilated_fst_c.h"
+typedef VerilatedFstC SimTrace;
+#else
 #include "verilated_vcd_c.h"
+typedef VerilatedVcdC SimTrace;
+#endif
 
 #include "SimModule.hpp"
 
+#include <stdio.h>
 #include <vector>
 #include <functional>
 
+#define SIM_TRACE_MAX_LEVELS 99
+#define SIM_TRACE_DEFAULT_FLUSH_INTERVAL 10000
+
 template<class T>
 class SimControl
 {
+public:
+    typedef std::function<bool()> trace_trigger_cond_t;
+
 private:
     T *tb;
-    VerilatedVcdC *m_trace;
+    SimTrace *m_trace;
     uint64_t m_tickcount;
     bool trace;
     std::vector<std::reference_wrapper<SimModule>> sim_modules;
 
+    // Trace window (in cycles). If a trigger is armed, the window is
+    // relative to the cycle in which the trigger fired.
+    uint64_t trace_start_cycle;
+    uint64_t trace_stop_cycle;
+    bool trace_enabled;
+    bool trace_armed;
+    bool trace_triggered;
+    uint64_t trace_trigger_cycle;
+    trace_trigger_cond_t trace_trigger_cond;
+
+    // The trace is flushed every trace_flush_interval cycles
+    uint32_t trace_flush_interval;
+    uint64_t trace_last_flush;
+    bool trace_dumping;
+
 public:
-    SimControl(T *tb, const char *trace_filename) : tb(tb)
+    SimControl(T *tb, const char *trace_filename, const char *trace_scope = NULL, int trace_levels = SIM_TRACE_MAX_LEVELS) : tb(tb)
     {
         m_tickcount = 0;
+        m_trace = NULL;
+
+        trace_start_cycle = 0;
+        trace_stop_cycle = 0;
+        trace_enabled = true;
+        trace_armed = false;
+        trace_triggered = false;
+        trace_trigger_cycle = 0;
+        trace_flush_interval = SIM_TRACE_DEFAULT_FLUSH_INTERVAL;
+        trace_last_flush = 0;
+        trace_dumping = false;
 
 #ifdef VERILATOR_HAS_TRACE
         trace = trace_filename != NULL;
@@ -44,10 +83,22 @@ public:
         {
             Verilated::traceEverOn(true);
 
-            m_trace = new VerilatedVcdC;
+            m_trace = new SimTrace;
+
+            if (trace_levels <= 0) trace_levels = SIM_TRACE_MAX_LEVELS;
+
+            // Restrict the dumped hierarchy (must happen before open)
+            if (trace_scope != NULL)
+            {
+#if defined(VERILATOR_VERSION_INTEGER) && VERILATOR_VERSION_INTEGER >= 5000000
+                m_trace->dumpvars(trace_levels, trace_scope);
+#else
+                printf("Warning: trace scope filtering needs verilator >= 5.0; tracing the whole design (use TRACE_DEPTH to limit it)\n");
+#endif
+            }
 
             // Initialize trace
-            tb->trace(m_trace, 99);
+            tb->trace(m_trace, trace_levels);
             m_trace->open(trace_filename);
             printf("trace on!\n");
         }
@@ -60,11 +111,69 @@ public:
     ~SimControl()
     {
 #ifdef VERILATOR_HAS_TRACE
-        m_trace->flush();
-        m_trace->close();
+        if (trace)
+        {
+            m_trace->flush();
+            m_trace->close();
+            delete m_trace;
+        }
 #endif
     }
 
+    bool has_trace()
+    {
+        return trace;
+    }
+
+    // Dump only cycles in [start_cycle, stop_cycle). stop_cycle=0 means no stop.
+    void set_trace_window(uint64_t start_cycle, uint64_t stop_cycle)
+    {
+        trace_start_cycle = start_cycle;
+        trace_stop_cycle = stop_cycle;
+    }
+
+    void set_trace_flush_interval(uint32_t cycles)
+    {
+        trace_flush_interval = cycles;
+    }
+
+    void set_trace_enabled(bool enabled)
+    {
+        trace_enabled = enabled;
+    }
+
+    // Tracing does not start until trace_trigger() is called
+    void arm_trace_trigger()
+    {
+        trace_armed = true;
+        trace_triggered = false;
+    }
+
+    // Arm the trigger and fire it when cond() returns true (evaluated every cycle)
+    void set_trace_trigger_cond(trace_trigger_cond_t cond)
+    {
+        trace_trigger_cond = cond;
+        arm_trace_trigger();
+    }
+
+    void trace_trigger()
+    {
+        if (!trace_armed || trace_triggered) return;
+
+        trace_triggered = true;
+        trace_trigger_cycle = m_tickcount;
+        printf("[%lu] trace triggered!\n", time());
+    }
+
+    bool trace_active()
+    {
+        if (!trace || !trace_enabled) return false;
+        if (trace_armed && !trace_triggered) return false;
+
+        uint64_t cycle = m_tickcount - trace_trigger_cycle;
+        return cycle >= trace_start_cycle && (trace_stop_cycle == 0 || cycle < trace_stop_cycle);
+    }
+
     std::vector<std::reference_wrapper<SimModule>>& get_modules()
     {
         return sim_modules;
@@ -98,11 +207,18 @@ public:
     {
         m_tickcount++;
 
+        if (trace_armed && !trace_triggered && trace_trigger_cond && trace_trigger_cond())
+        {
+            trace_trigger();
+        }
+
+        bool dump = trace_active();
+
         tb->clk_i = 1;
         tb->eval();
 
 #ifdef VERILATOR_HAS_TRACE
-        if (trace)
+        if (dump)
         {
             m_trace->dump(1000 * m_tickcount);
         }
@@ -118,10 +234,9 @@ public:
         tb->eval();
 
 #ifdef VERILATOR_HAS_TRACE
-        if (trace)
+        if (dump)
         {
             m_trace->dump(1000 * m_tickcount + 250);
-            m_trace->flush();
         }
 #endif
 
@@ -129,7 +244,7 @@ public:
         tb->eval();
 
 #ifdef VERILATOR_HAS_TRACE
-        if (trace)
+        if (dump)
         {
             m_trace->dump(1000 * m_tickcount + 500);
         }
@@ -141,10 +256,18 @@ public:
         tb->eval();
 
 #ifdef VERILATOR_HAS_TRACE
-        if (trace)
+        if (dump)
         {
             m_trace->dump(1000 * m_tickcount + 750);
         }
+
+        // Flush periodically and whenever the trace window closes
+        if ((dump && m_tickcount - trace_last_flush >= trace_flush_interval) || (!dump && trace_dumping))
+        {
+            m_trace->flush();
+            trace_last_flush = m_tickcount;
+        }
+        trace_dumping = dump;
 #endif
 
     }
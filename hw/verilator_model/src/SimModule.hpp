@@ -14,6 +14,7 @@
 
 #pragma once
 #include <stdint.h>
+#include "SimStats.hpp"
 
 #define SIM_PRINT(FORMAT, ...) printf ("[%lu][%s:%u]: " FORMAT, sim_time(), __FILE__, __LINE__, ## __VA_ARGS__)
 
@@ -24,6 +25,9 @@ public:
 
     virtual void print_stats() = 0;
 
+    // Expose counters to the statistics registry (optional)
+    virtual void register_stats(PsPIN::SimStats &stats) {}
+
 public:
     uint64_t sim_time() {
         return sc_time_stamp();
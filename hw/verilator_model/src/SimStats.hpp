@@ -0,0 +1,272 @@
+// Copyright 2020 ETH Zurich
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "spin.h"
+#include "pspinsim.h"
+
+#include <vector>
+#include <string>
+#include <functional>
+#include <algorithm>
+#include <cmath>
+#include <cinttypes>
+#include <string.h>
+#include <stdio.h>
+
+namespace PsPIN
+{
+    // Power-of-two buckets: bucket 0 counts 0 and 1, bucket i counts [2^i, 2^(i+1)).
+    class StatsHistogram
+    {
+    public:
+        uint64_t count;
+        uint64_t sum;
+        uint64_t min;
+        uint64_t max;
+        uint64_t buckets[PSPINSIM_STAT_HIST_BUCKETS];
+
+    public:
+        StatsHistogram()
+        {
+            count = 0;
+            sum = 0;
+            min = 0;
+            max = 0;
+            memset(buckets, 0, sizeof(buckets));
+        }
+
+        void add(uint64_t value)
+        {
+            uint32_t bucket = 0;
+            while (bucket < PSPINSIM_STAT_HIST_BUCKETS - 1 && (value >> (bucket + 1)) != 0) bucket++;
+            buckets[bucket]++;
+
+            min = (count == 0) ? value : std::min(min, value);
+            max = (count == 0) ? value : std::max(max, value);
+            sum += value;
+            count++;
+        }
+
+        double mean() const
+        {
+            return (count > 0) ? ((double) sum) / count : 0;
+        }
+    };
+
+    // Registry of the statistics exposed by the simulation modules.
+    // Modules register pointers to their counters (and getters for derived
+    // values) once; values are read when the registry is queried.
+    class SimStats
+    {
+    private:
+        typedef struct stat_entry
+        {
+            std::string module;
+            std::string name;
+            pspinsim_stat_type_t type;
+            const uint64_t *counter;
+            std::function<double()> gauge;
+            const StatsHistogram *hist;
+        } stat_entry_t;
+
+        std::vector<stat_entry_t> entries;
+
+    public:
+        void add_counter(const char *module, const std::string &name, const uint64_t *value)
+        {
+            stat_entry_t entry = {module, name, PSPINSIM_STAT_COUNTER, value, nullptr, NULL};
+            entries.push_back(entry);
+        }
+
+        void add_gauge(const char *module, const std::string &name, std::function<double()> getter)
+        {
+            stat_entry_t entry = {module, name, PSPINSIM_STAT_GAUGE, NULL, getter, NULL};
+            entries.push_back(entry);
+        }
+
+        void add_histogram(const char *module, const std::string &name, const StatsHistogram *hist)
+        {
+            stat_entry_t entry = {module, name, PSPINSIM_STAT_HISTOGRAM, NULL, nullptr, hist};
+            entries.push_back(entry);
+        }
+
+        uint32_t size()
+        {
+            return entries.size();
+        }
+
+        int get(uint32_t idx, pspinsim_stat_t *stat)
+        {
+            if (idx >= entries.size()) return SPIN_ERR;
+
+            stat_entry_t &entry = entries[idx];
+
+            memset(stat, 0, sizeof(pspinsim_stat_t));
+            stat->module = entry.module.c_str();
+            stat->name = entry.name.c_str();
+            stat->type = entry.type;
+
+            switch (entry.type)
+            {
+            case PSPINSIM_STAT_COUNTER:
+                stat->value = *entry.counter;
+                break;
+            case PSPINSIM_STAT_GAUGE:
+                stat->gauge = entry.gauge();
+                break;
+            case PSPINSIM_STAT_HISTOGRAM:
+                stat->value = entry.hist->count;
+                stat->gauge = entry.hist->mean();
+                stat->min = entry.hist->min;
+                stat->max = entry.hist->max;
+                stat->buckets = entry.hist->buckets;
+                break;
+            }
+
+            return SPIN_SUCCESS;
+        }
+
+        int find(const char *module, const char *name, pspinsim_stat_t *stat)
+        {
+            for (uint32_t i = 0; i < entries.size(); i++)
+            {
+                if (entries[i].module == module && entries[i].name == name)
+                    return get(i, stat);
+            }
+
+            return SPIN_ERR;
+        }
+
+        int dump(const char *filename, pspinsim_stats_format_t format)
+        {
+            FILE *out = fopen(filename, "w");
+            if (out == NULL)
+            {
+                printf("Error: cannot open statistics file %s!\n", filename);
+                return SPIN_ERR;
+            }
+
+            if (format == PSPINSIM_STATS_JSON)
+            {
+                fprintf(out, "[");
+                for (uint32_t i = 0; i < entries.size(); i++)
+                {
+                    fprintf(out, "%s\n", (i == 0) ? "" : ",");
+                    dump_json(out, i);
+                }
+                fprintf(out, "\n]\n");
+            }
+            else
+            {
+                // histogram buckets are ';'-separated, up to the last non-empty one
+                fprintf(out, "module,name,type,value,mean,min,max,buckets\n");
+                for (uint32_t i = 0; i < entries.size(); i++)
+                {
+                    dump_csv(out, i);
+                }
+            }
+
+            fclose(out);
+            return SPIN_SUCCESS;
+        }
+
+    private:
+        static const char *type_name(pspinsim_stat_type_t type)
+        {
+            switch (type)
+            {
+            case PSPINSIM_STAT_COUNTER: return "counter";
+            case PSPINSIM_STAT_GAUGE: return "gauge";
+            case PSPINSIM_STAT_HISTOGRAM: return "histogram";
+            }
+            return "unknown";
+        }
+
+        static uint32_t used_buckets(const uint64_t *buckets)
+        {
+            uint32_t used = PSPINSIM_STAT_HIST_BUCKETS;
+            while (used > 0 && buckets[used - 1] == 0) used--;
+            return used;
+        }
+
+        // NaN and infinity are not valid JSON: null (JSON) or an empty field (CSV)
+        static void print_double(FILE *out, double value, const char *non_finite)
+        {
+            if (std::isfinite(value)) fprintf(out, "%.6lf", value);
+            else fprintf(out, "%s", non_finite);
+        }
+
+        void dump_json(FILE *out, uint32_t idx)
+        {
+            pspinsim_stat_t stat;
+            if (get(idx, &stat) != SPIN_SUCCESS) return;
+
+            fprintf(out, "{\"module\":\"%s\",\"name\":\"%s\",\"type\":\"%s\",", stat.module, stat.name, type_name(stat.type));
+
+            switch (stat.type)
+            {
+            case PSPINSIM_STAT_COUNTER:
+                fprintf(out, "\"value\":%" PRIu64 "}", stat.value);
+                break;
+            case PSPINSIM_STAT_GAUGE:
+                fprintf(out, "\"value\":");
+                print_double(out, stat.gauge, "null");
+                fprintf(out, "}");
+                break;
+            case PSPINSIM_STAT_HISTOGRAM:
+                fprintf(out, "\"count\":%" PRIu64 ",\"mean\":", stat.value);
+                print_double(out, stat.gauge, "null");
+                fprintf(out, ",\"min\":%" PRIu64 ",\"max\":%" PRIu64 ",\"buckets\":[", stat.min, stat.max);
+                for (uint32_t b = 0; b < used_buckets(stat.buckets); b++)
+                {
+                    fprintf(out, "%s%" PRIu64, (b == 0) ? "" : ",", stat.buckets[b]);
+                }
+                fprintf(out, "]}");
+                break;
+            }
+        }
+
+        void dump_csv(FILE *out, uint32_t idx)
+        {
+            pspinsim_stat_t stat;
+            if (get(idx, &stat) != SPIN_SUCCESS) return;
+
+            fprintf(out, "%s,%s,%s,", stat.module, stat.name, type_name(stat.type));
+
+            switch (stat.type)
+            {
+            case PSPINSIM_STAT_COUNTER:
+                fprintf(out, "%" PRIu64 ",,,,\n", stat.value);
+                break;
+            case PSPINSIM_STAT_GAUGE:
+                print_double(out, stat.gauge, "");
+                fprintf(out, ",,,,\n");
+                break;
+            case PSPINSIM_STAT_HISTOGRAM:
+                fprintf(out, "%" PRIu64 ",", stat.value);
+                print_double(out, stat.gauge, "");
+                fprintf(out, ",%" PRIu64 ",%" PRIu64 ",", stat.min, stat.max);
+                for (uint32_t b = 0; b < used_buckets(stat.buckets); b++)
+                {
+                    fprintf(out, "%s%" PRIu64, (b == 0) ? "" : ";", stat.buckets[b]);
+                }
+                fprintf(out, "\n");
+                break;
+            }
+        }
+    };
+
+} // namespace PsPIN
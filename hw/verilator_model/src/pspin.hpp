@@ -21,6 +21,20 @@
 
 #define THROUGHPUT_1GHZ(T, S) (((double)8 * S) / T)
 
+#define NUM_HPUS (NUM_CLUSTERS * NUM_CORES)
+
+// hpu_status bits
+#define HPU_STATUS_RUNNING 0x1      // executing a task
+#define HPU_STATUS_CMD_STALL 0x2    // stalled on a command (issue or wait)
+#define HPU_STATUS_PKT_DMA_WAIT 0x4 // the next task of the cluster, which goes to this HPU, waits for its L1 packet copy
+#define HPU_STATUS_ACTIVE 0x8       // HPU driver initialized
+#define HPU_STATUS_TCDM_CONT 0x10   // data request to the TCDM not granted
+#define HPU_STATUS_PERF 0x20        // between perf_start() and perf_stop()
+
+// mpq_status bits
+#define MPQ_STATUS_BUSY 0x1         // serving a message
+#define MPQ_STATUS_FULL 0x2         // cannot take more HERs
+
 #define NI_CTRL_PORT_ASSIGN(SRC, SRC_PREFIX, DST)                                                             \
     {                                                                                                         \
         (DST)->her_ready_i = &((SRC)->EVALUATOR(SRC_PREFIX, ready_o));                                        \
@@ -41,6 +55,10 @@
         (DST)->her_o.mpq_meta.ph_size = &((SRC)->EVALUATOR(SRC_PREFIX, meta_ph_size_i));                      \
         (DST)->her_o.mpq_meta.th_addr = &((SRC)->EVALUATOR(SRC_PREFIX, meta_th_addr_i));                      \
         (DST)->her_o.mpq_meta.th_size = &((SRC)->EVALUATOR(SRC_PREFIX, meta_th_size_i));                      \
+        (DST)->her_o.mpq_meta.sched_quantum = &((SRC)->EVALUATOR(SRC_PREFIX, meta_sched_quantum_i));          \
+        (DST)->her_o.mpq_meta.sched_prio = &((SRC)->EVALUATOR(SRC_PREFIX, meta_sched_prio_i));                \
+        (DST)->her_o.mpq_meta.l1_copy_size = &((SRC)->EVALUATOR(SRC_PREFIX, meta_l1_copy_size_i));            \
+        (DST)->her_o.mpq_meta.stateless = &((SRC)->EVALUATOR(SRC_PREFIX, meta_stateless_i));                  \
         (DST)->her_o.mpq_meta.scratchpad_addr[0] = &((SRC)->EVALUATOR(SRC_PREFIX, meta_scratchpad_0_addr_i)); \
         (DST)->her_o.mpq_meta.scratchpad_size[0] = &((SRC)->EVALUATOR(SRC_PREFIX, meta_scratchpad_0_size_i)); \
         (DST)->her_o.mpq_meta.scratchpad_addr[1] = &((SRC)->EVALUATOR(SRC_PREFIX, meta_scratchpad_1_addr_i)); \
@@ -49,6 +67,9 @@
         (DST)->her_o.mpq_meta.scratchpad_size[2] = &((SRC)->EVALUATOR(SRC_PREFIX, meta_scratchpad_2_size_i)); \
         (DST)->her_o.mpq_meta.scratchpad_addr[3] = &((SRC)->EVALUATOR(SRC_PREFIX, meta_scratchpad_3_addr_i)); \
         (DST)->her_o.mpq_meta.scratchpad_size[3] = &((SRC)->EVALUATOR(SRC_PREFIX, meta_scratchpad_3_size_i)); \
+        (DST)->her_batch_ready_i = &((SRC)->EVALUATOR(SRC_PREFIX, batch_ready_o));                           \
+        (DST)->her_batch_valid_o = &((SRC)->EVALUATOR(SRC_PREFIX, batch_valid_i));                           \
+        (DST)->her_batch_o = &((SRC)->EVALUATOR(SRC_PREFIX, batch_i)[0]);                                     \
         (DST)->pspin_active_i = &tb->pspin_active_o;                                                          \
         (DST)->feedback_valid_i = &tb->feedback_valid_o;                                                      \
         (DST)->feedback_ready_o = &tb->feedback_ready_i;                                                      \
@@ -72,6 +93,34 @@
         (DST)->no_cmd_resp_id_o = &((SRC)->EVALUATOR(SRC_PREFIX, resp_id_i));           \
     }
 
+#define HPU_MON_PORT_ASSIGN(SRC, DST)                          \
+    {                                                          \
+        (DST)->pc_i = &((SRC)->hpu_pc_o[0]);                   \
+        (DST)->status_i = &((SRC)->hpu_status_o[0]);           \
+        (DST)->handler_i = &((SRC)->hpu_handler_o[0]);         \
+        (DST)->pkt_addr_i = &((SRC)->hpu_pkt_addr_o[0]);       \
+        (DST)->mpq_i = &((SRC)->hpu_mpq_o[0]);                 \
+        (DST)->instret_i = &((SRC)->hpu_instret_o[0]);         \
+        (DST)->ld_stall_i = &((SRC)->hpu_ld_stall_o[0]);       \
+        (DST)->copy_start_i = &((SRC)->cl_copy_start_o[0]);    \
+        (DST)->copy_pkt_size_i = &((SRC)->cl_copy_pkt_size_o[0]); \
+        (DST)->copy_done_i = &((SRC)->cl_copy_done_o[0]);      \
+    }
+
+#define MPQ_MON_PORT_ASSIGN(SRC, DST)                          \
+    {                                                          \
+        (DST)->length_i = &((SRC)->mpq_length_o[0]);           \
+        (DST)->status_i = &((SRC)->mpq_status_o[0]);           \
+        (DST)->her_mpq_i = &((SRC)->her_mpq_o[0]);             \
+        (DST)->her_valid_i = &((SRC)->mpq_her_valid_o);        \
+        (DST)->her_ready_i = &((SRC)->mpq_her_ready_o);        \
+        (DST)->her_msgid_i = &((SRC)->mpq_her_msgid_o[0]);     \
+        (DST)->task_valid_i = &((SRC)->mpq_task_valid_o);      \
+        (DST)->task_mpq_i = &((SRC)->mpq_task_mpq_o);          \
+        (DST)->task_size_i = &((SRC)->mpq_task_size_o);        \
+        (DST)->stateless_task_i = &((SRC)->mpq_stateless_task_o); \
+    }
+
 namespace PsPIN
 {
 
@@ -117,9 +166,19 @@ namespace PsPIN
         mem_addr_t *th_addr;
         mem_size_t *th_size;
 
-        //L1 scratchpads
-        mem_addr_t *scratchpad_addr[NUM_CLUSTERS];
-        mem_size_t *scratchpad_size[NUM_CLUSTERS];
+        //MPQ arbitration
+        uint32_t *sched_quantum;
+        uint8_t *sched_prio;
+
+        //L1 copy size
+        uint32_t *l1_copy_size;
+
+        //stateless handler
+        uint8_t *stateless;
+
+        //L1 scratchpads (HER ports of the first clusters)
+        mem_addr_t *scratchpad_addr[TASK_SCRATCHPAD_SLOTS];
+        mem_size_t *scratchpad_size[TASK_SCRATCHPAD_SLOTS];
 
     } __attribute__((__packed__)) mpq_meta_p_t;
 
@@ -136,11 +195,19 @@ namespace PsPIN
         mpq_meta_p_t mpq_meta;
     } __attribute__((__packed__)) her_descr_p_t;
 
+    // her_descr_t of pspin_cfg_pkg.sv, in bits (batched HER interface)
+#define HER_META_BITS (32 * 2 + 64 + 32 + 32 * 6 + 64 * NUM_CLUSTERS + 32 + 8 + 32 + 8)
+#define HER_DESCR_BITS (C_MSGID_WIDTH + 1 + 32 * 3 + HER_META_BITS)
+#define HER_BATCH_WORDS ((HER_BATCH * HER_DESCR_BITS + 31) / 32)
+
     typedef struct ni_control_port
     {
         uint8_t *her_valid_o;
         uint8_t *her_ready_i;
         her_descr_p_t her_o;
+        uint8_t *her_batch_ready_i;     // HER_BATCH > 1: one bit per lane
+        uint8_t *her_batch_valid_o;     // HER_BATCH > 1: one bit per lane, from bit 0
+        uint32_t *her_batch_o;          // HER_BATCH > 1: packed her_descr_t (HER_DESCR_BITS each)
         uint8_t *pspin_active_i;
         uint8_t *feedback_valid_i;
         uint8_t *feedback_ready_o;
@@ -158,13 +225,44 @@ namespace PsPIN
         uint64_t *no_cmd_req_src_addr_i;
         uint32_t *no_cmd_req_length_i;
         uint64_t *no_cmd_req_user_ptr_i;
-        uint8_t *no_cmd_req_id_i;
+        uint32_t *no_cmd_req_id_i;
         uint32_t *no_cmd_req_nid_i;
         uint32_t *no_cmd_req_fid_i;
 
         // Response
         uint8_t *no_cmd_resp_valid_o;
-        uint8_t *no_cmd_resp_id_o;
+        uint32_t *no_cmd_resp_id_o;
     } no_cmd_port_t;
 
+    // One entry per HPU (copy_*: one entry per cluster)
+    typedef struct hpu_mon_port
+    {
+        uint32_t *pc_i;
+        uint32_t *status_i;
+        uint32_t *handler_i;
+        uint32_t *pkt_addr_i;
+        uint32_t *mpq_i;
+        uint32_t *instret_i;
+        uint32_t *ld_stall_i;
+        uint32_t *copy_start_i;
+        uint32_t *copy_pkt_size_i;
+        uint32_t *copy_done_i;
+    } hpu_mon_port_t;
+
+    // One entry per MPQ, plus the HER input lanes (her_*: 8 entries, or one bit
+    // per lane) and the task output interface
+    typedef struct mpq_mon_port
+    {
+        uint32_t *length_i;
+        uint32_t *status_i;
+        uint32_t *her_mpq_i;
+        uint8_t *her_valid_i;
+        uint8_t *her_ready_i;
+        uint32_t *her_msgid_i;
+        uint8_t *task_valid_i;
+        uint32_t *task_mpq_i;
+        uint32_t *task_size_i;
+        uint8_t *stateless_task_i;
+    } mpq_mon_port_t;
+
 } // namespace PsPIN
@@ -26,18 +26,39 @@
 #include "NICOutbound.hpp"
 #include "PCIeSlave.hpp"
 #include "PCIeMaster.hpp"
+#include "HPUMonitor.hpp"
+#include "MPQMonitor.hpp"
+#include "ChromeTrace.hpp"
+#include "SimStats.hpp"
 #include "SimControl.hpp"
+#include "SchedModel.hpp"
 
 #include "pspinsim.h"
 #include "spin.h"
 #include "pspin.hpp"
 
 #define VCD_FILE "waves.vcd"
+#define FST_FILE "waves.fst"
+
+#ifdef VERILATOR_HAS_TRACE_FST
+#define DEFAULT_TRACE_FILE FST_FILE
+#else
+#define DEFAULT_TRACE_FILE VCD_FILE
+#endif
+#define DEFAULT_TRACE_LEVELS 0
+#define DEFAULT_TRACE_START_CYCLE 0
+#define DEFAULT_TRACE_STOP_CYCLE 0
+#define DEFAULT_TRACE_FLUSH_INTERVAL 10000
+
+#define DEFAULT_HPU_UTIL_FILE "hpu_util.csv"
 
 
 #define DEFAULT_NI_AXI_AW_BUFFER 32
 #define DEFAULT_NI_AXI_W_BUFFER 32
 #define DEFAULT_NI_AXI_B_BUFFER 32
+#define DEFAULT_NI_IMPAIR_SEED 1
+#define DEFAULT_NI_INGRESS_BUFFER_SIZE (64*1024)
+#define DEFAULT_NI_INGRESS_PAUSE_DELAY 100
 
 #define NETWORK_G_200G 0.037252
 #define NETWORK_G_400G 0.018626
@@ -57,6 +78,16 @@
 #define DEFAULT_PCIE_SLV_R_BUFFER_SIZE 32
 #define DEFAULT_PCIE_SLV_L 2
 #define DEFAULT_PCIE_SLV_G PCIE_G_5_16
+#define DEFAULT_PCIE_TLP_MPS 256
+#define DEFAULT_PCIE_TLP_MRRS 512
+#define DEFAULT_PCIE_TLP_OVERHEAD 24
+#define DEFAULT_PCIE_TLP_LATENCY 400
+#define DEFAULT_PCIE_TLP_PH_CREDITS 32
+#define DEFAULT_PCIE_TLP_PD_CREDITS 512
+#define DEFAULT_PCIE_TLP_NPH_CREDITS 32
+#define DEFAULT_PCIE_TLP_CPLH_CREDITS 128
+#define DEFAULT_PCIE_TLP_CPLD_CREDITS 1024
+#define DEFAULT_PCIE_TLP_READ_TAGS 32
 
 #define PATH_MAX 1024
 
@@ -68,14 +99,21 @@ AXIPort<uint32_t, uint64_t> no_mst;
 no_cmd_port_t no_cmd;
 AXIPort<uint64_t, uint64_t> pcie_slv_port;
 AXIPort<uint32_t, uint64_t> pcie_mst_port;
+hpu_mon_port_t hpu_monitor_port;
+mpq_mon_port_t mpq_monitor_port;
 
 SimControl<Vpspin_verilator> *sim;
 NICInbound<AXIPort<uint32_t, uint64_t>> *ni;
 NICOutbound<AXIPort<uint32_t, uint64_t>> *no;
 PCIeSlave<AXIPort<uint64_t, uint64_t>> *pcie_slv;
 PCIeMaster<AXIPort<uint32_t, uint64_t>> *pcie_mst;
+HPUMonitor *hpu_mon;
+MPQMonitor *mpq_mon;
+ChromeTrace *ctrace;
+SimStats sim_stats;
 
 char slm_path[PATH_MAX];
+char msg_stats_path[PATH_MAX];
 
 double sc_time_stamp()
 {   // Called by $time in Verilog
@@ -93,12 +131,48 @@ int pspinsim_default_conf(pspin_conf_t *conf)
     conf->ni_conf.axi_aw_buffer = DEFAULT_NI_AXI_AW_BUFFER;
     conf->ni_conf.axi_w_buffer = DEFAULT_NI_AXI_W_BUFFER;
     conf->ni_conf.axi_b_buffer = DEFAULT_NI_AXI_B_BUFFER;
+    conf->ni_conf.impair.seed = DEFAULT_NI_IMPAIR_SEED;
+    conf->ni_conf.impair.drop_prob = 0;
+    conf->ni_conf.impair.dup_prob = 0;
+    conf->ni_conf.impair.reorder_prob = 0;
+    conf->ni_conf.impair.reorder_window = 0;
+    conf->ni_conf.impair.ge_p = 0;
+    conf->ni_conf.impair.ge_r = 1;
+    conf->ni_conf.impair.ge_loss_good = 0;
+    conf->ni_conf.impair.ge_loss_bad = 1;
+    conf->ni_conf.ingress.mode = NI_INGRESS_UNBOUNDED;
+    conf->ni_conf.ingress.buffer_size = DEFAULT_NI_INGRESS_BUFFER_SIZE;
+    conf->ni_conf.ingress.num_priorities = 1;
+    conf->ni_conf.ingress.prio_offset = -1;
+    conf->ni_conf.ingress.prio_shift = 0;
+    conf->ni_conf.ingress.prio_mask = NI_MAX_PRIORITIES - 1;
+    conf->ni_conf.ingress.xoff_threshold = DEFAULT_NI_INGRESS_BUFFER_SIZE * 3 / 4;
+    conf->ni_conf.ingress.xon_threshold = DEFAULT_NI_INGRESS_BUFFER_SIZE / 2;
+    conf->ni_conf.ingress.pause_delay = DEFAULT_NI_INGRESS_PAUSE_DELAY;
+    conf->ni_conf.ingress.red_min_threshold = DEFAULT_NI_INGRESS_BUFFER_SIZE / 4;
+    conf->ni_conf.ingress.red_max_threshold = DEFAULT_NI_INGRESS_BUFFER_SIZE * 3 / 4;
+    conf->ni_conf.ingress.red_max_prob = 0.1;
+    conf->ni_conf.ingress.red_weight = 0.002;
 
     conf->no_conf.axi_ar_buffer = DEFAULT_NO_AXI_AR_BUFFER;
     conf->no_conf.axi_r_buffer = DEFAULT_NO_AXI_R_BUFFER;
     conf->no_conf.network_G = DEFAULT_NO_NETWORK_G;
     conf->no_conf.max_pkt_size = DEFAULT_NO_MAX_PKT_SIZE;
     conf->no_conf.max_network_queue_len = DEFAULT_NO_NET_PKT_QUEUE_LEN;
+    conf->no_conf.num_ports = 1;
+    conf->no_conf.num_tcs = 1;
+    conf->no_conf.sched_policy = NO_SCHED_STRICT;
+    for (int i = 0; i < NO_MAX_PORTS; i++)
+    {
+        conf->no_conf.port_G[i] = 0;
+    }
+    for (int i = 0; i < NO_MAX_TRAFFIC_CLASSES; i++)
+    {
+        conf->no_conf.tc_weight[i] = DEFAULT_NO_MAX_PKT_SIZE;
+    }
+    conf->no_conf.pkt_format = NO_PKT_FORMAT_OPAQUE;
+    conf->no_conf.icrc = 0;
+    conf->no_conf.src_nid = 0;
 
     conf->pcie_slv_conf.axi_aw_buffer = DEFAULT_PCIE_SLV_AW_BUFFER_SIZE;
     conf->pcie_slv_conf.axi_w_buffer = DEFAULT_PCIE_SLV_W_BUFFER_SIZE;
@@ -107,22 +181,58 @@ int pspinsim_default_conf(pspin_conf_t *conf)
     conf->pcie_slv_conf.axi_r_buffer = DEFAULT_PCIE_SLV_R_BUFFER_SIZE;
     conf->pcie_slv_conf.pcie_L = DEFAULT_PCIE_SLV_L;
     conf->pcie_slv_conf.pcie_G = DEFAULT_PCIE_SLV_G;
+    conf->pcie_slv_conf.model = PCIE_MODEL_SIMPLE;
+    conf->pcie_slv_conf.tlp.mps = DEFAULT_PCIE_TLP_MPS;
+    conf->pcie_slv_conf.tlp.mrrs = DEFAULT_PCIE_TLP_MRRS;
+    conf->pcie_slv_conf.tlp.tlp_overhead = DEFAULT_PCIE_TLP_OVERHEAD;
+    conf->pcie_slv_conf.tlp.latency = DEFAULT_PCIE_TLP_LATENCY;
+    conf->pcie_slv_conf.tlp.ph_credits = DEFAULT_PCIE_TLP_PH_CREDITS;
+    conf->pcie_slv_conf.tlp.pd_credits = DEFAULT_PCIE_TLP_PD_CREDITS;
+    conf->pcie_slv_conf.tlp.nph_credits = DEFAULT_PCIE_TLP_NPH_CREDITS;
+    conf->pcie_slv_conf.tlp.cplh_credits = DEFAULT_PCIE_TLP_CPLH_CREDITS;
+    conf->pcie_slv_conf.tlp.cpld_credits = DEFAULT_PCIE_TLP_CPLD_CREDITS;
+    conf->pcie_slv_conf.tlp.max_read_tags = DEFAULT_PCIE_TLP_READ_TAGS;
+    conf->pcie_slv_conf.tlp.cpl_jitter = 0;
+    conf->pcie_slv_conf.tlp.seed = 1;
+
+    conf->trace_conf.file = NULL;
+    conf->trace_conf.scope = NULL;
+    conf->trace_conf.levels = DEFAULT_TRACE_LEVELS;
+    conf->trace_conf.enabled = 1;
+    conf->trace_conf.start_cycle = DEFAULT_TRACE_START_CYCLE;
+    conf->trace_conf.stop_cycle = DEFAULT_TRACE_STOP_CYCLE;
+    conf->trace_conf.trigger_msgid = -1;
+    conf->trace_conf.trigger_feedback = -1;
+    conf->trace_conf.trigger_pc = -1;
+    conf->trace_conf.flush_interval = DEFAULT_TRACE_FLUSH_INTERVAL;
+
+    conf->chrome_trace_file = NULL;
+    conf->msg_stats_file = NULL;
+    conf->hpu_util_file = DEFAULT_HPU_UTIL_FILE;
+    conf->hpu_util_interval = 0;
+    conf->perf_samples_file = NULL;
+    conf->handler_profile_file = NULL;
+
+    // only used by libpspin_native.so
+    SchedModel::default_conf(conf->sched_model);
 
     return SPIN_SUCCESS;
 }
 
 int pspinsim_init(int argc, char **argv, pspin_conf_t *conf) 
 {
-    Verilated::commandArgs(argc, argv);
-    Vpspin_verilator *tb = new Vpspin_verilator();
-    sim = new SimControl<Vpspin_verilator>(tb, VCD_FILE);
-
     pspin_conf_t default_conf;
     if (conf==NULL) {
         pspinsim_default_conf(&default_conf);
         conf = &default_conf;
     }
 
+    Verilated::commandArgs(argc, argv);
+    Vpspin_verilator *tb = new Vpspin_verilator();
+    trace_conf_t *tconf = &(conf->trace_conf);
+    const char *trace_file = (tconf->file != NULL) ? tconf->file : DEFAULT_TRACE_FILE;
+    sim = new SimControl<Vpspin_verilator>(tb, trace_file, tconf->scope, tconf->levels);
+
     // Define ports
     AXI_MASTER_PORT_ASSIGN(tb, ni_slave, &ni_mst);
     NI_CTRL_PORT_ASSIGN(tb, her, &ni_control)    
@@ -130,18 +240,114 @@ int pspinsim_init(int argc, char **argv, pspin_conf_t *conf)
     NO_CMD_PORT_ASSIGN(tb, nic_cmd, &no_cmd);
     AXI_SLAVE_PORT_ASSIGN(tb, host_master, &pcie_slv_port);
     AXI_MASTER_PORT_ASSIGN(tb, host_slave, &pcie_mst_port);
+    HPU_MON_PORT_ASSIGN(tb, &hpu_monitor_port);
+    MPQ_MON_PORT_ASSIGN(tb, &mpq_monitor_port);
 
     // Instantiate simulation-only modules
     ni = new NICInbound<AXIPort<uint32_t, uint64_t>>(ni_mst, ni_control, L2_PKT_BUFF_START, L2_PKT_BUFF_SIZE);
     no = new NICOutbound<AXIPort<uint32_t, uint64_t>>(no_mst, no_cmd, conf->no_conf.network_G, conf->no_conf.max_pkt_size, conf->no_conf.max_network_queue_len);
+    no->set_egress_ports(conf->no_conf);
+    no->set_packet_format(conf->no_conf.pkt_format, conf->no_conf.icrc, conf->no_conf.src_nid);
     pcie_slv = new PCIeSlave<AXIPort<uint64_t, uint64_t>>(pcie_slv_port, conf->pcie_slv_conf.axi_aw_buffer, conf->pcie_slv_conf.axi_w_buffer, conf->pcie_slv_conf.axi_ar_buffer, conf->pcie_slv_conf.axi_r_buffer, conf->pcie_slv_conf.axi_b_buffer, conf->pcie_slv_conf.pcie_L, conf->pcie_slv_conf.pcie_G);
     pcie_mst = new PCIeMaster<AXIPort<uint32_t, uint64_t>>(pcie_mst_port);
+    hpu_mon = new HPUMonitor(hpu_monitor_port);
+    mpq_mon = new MPQMonitor(mpq_monitor_port);
+
+    ni->set_impairment(conf->ni_conf.impair);
+    ni->set_ingress_buffer(conf->ni_conf.ingress, conf->ni_conf.impair.seed);
+
+    if (conf->pcie_slv_conf.model == PCIE_MODEL_TLP) {
+        pcie_tlp_conf_t *tlp_conf = &(conf->pcie_slv_conf.tlp);
+        if (tlp_conf->mps == 0 || tlp_conf->mrrs == 0 || tlp_conf->max_read_tags == 0 ||
+            tlp_conf->cpld_credits < (tlp_conf->mrrs + PCIE_CREDIT_BYTES - 1) / PCIE_CREDIT_BYTES ||
+            tlp_conf->cplh_credits < (tlp_conf->mrrs + tlp_conf->mps - 1) / tlp_conf->mps + 1 ||
+            tlp_conf->ph_credits == 0 || tlp_conf->nph_credits == 0 ||
+            tlp_conf->pd_credits < AXI_SW / PCIE_CREDIT_BYTES) {
+            printf("Error: invalid PCIe TLP configuration!\n");
+            return SPIN_ERR;
+        }
+        pcie_slv->set_tlp_model(*tlp_conf);
+    }
 
     // Add simulation only modules
     sim->add_module(*ni);
     sim->add_module(*no);
     sim->add_module(*pcie_slv);
     sim->add_module(*pcie_mst);
+    sim->add_module(*hpu_mon);
+    sim->add_module(*mpq_mon);
+
+    for (auto it = sim->get_modules().begin(); it != sim->get_modules().end(); ++it){
+        it->get().register_stats(sim_stats);
+    }
+
+    // Chrome trace-event export
+    ctrace = NULL;
+    if (conf->chrome_trace_file != NULL) {
+        ctrace = new ChromeTrace(conf->chrome_trace_file);
+        if (!ctrace->is_open()) return SPIN_ERR;
+
+        ni->set_chrome_trace(ctrace);
+        no->set_chrome_trace(ctrace);
+        pcie_slv->set_chrome_trace(ctrace);
+        hpu_mon->set_chrome_trace(ctrace);
+    }
+
+    // HPU utilization time series
+    if (conf->hpu_util_interval > 0) {
+        const char *util_file = (conf->hpu_util_file != NULL) ? conf->hpu_util_file : DEFAULT_HPU_UTIL_FILE;
+        if (hpu_mon->set_util_sampling(util_file, conf->hpu_util_interval) != SPIN_SUCCESS) return SPIN_ERR;
+    }
+
+    // Handler perf windows
+    if (conf->perf_samples_file != NULL) {
+        if (hpu_mon->set_perf_samples(conf->perf_samples_file) != SPIN_SUCCESS) return SPIN_ERR;
+    }
+
+    // Handler durations (input of the scheduler model of libpspin_native.so)
+    if (conf->handler_profile_file != NULL) {
+        if (hpu_mon->set_handler_profile(conf->handler_profile_file) != SPIN_SUCCESS) return SPIN_ERR;
+    }
+
+    // Per-message statistics are exported at pspinsim_fini
+    msg_stats_path[0] = '\0';
+    if (conf->msg_stats_file != NULL) {
+        snprintf(msg_stats_path, PATH_MAX, "%s", conf->msg_stats_file);
+        ni->set_keep_pkt_latencies(true);
+    }
+
+    // Trace window and triggers
+    sim->set_trace_enabled(tconf->enabled != 0);
+    sim->set_trace_window(tconf->start_cycle, tconf->stop_cycle);
+    sim->set_trace_flush_interval(tconf->flush_interval);
+
+    if (tconf->trigger_msgid >= 0 || tconf->trigger_feedback >= 0 || tconf->trigger_pc >= 0) {
+        sim->arm_trace_trigger();
+    }
+
+    if (tconf->trigger_msgid >= 0) {
+        uint32_t msgid = (uint32_t) tconf->trigger_msgid;
+        ni->set_her_sent_listener([msgid](her_descr_t &her) {
+            if (her.msgid == msgid) sim->trace_trigger();
+        });
+    }
+
+    if (tconf->trigger_feedback >= 0) {
+        uint32_t pkt_idx = (uint32_t) tconf->trigger_feedback;
+        ni->set_feedback_listener([pkt_idx](uint32_t feedback_idx) {
+            if (feedback_idx == pkt_idx) sim->trace_trigger();
+        });
+    }
+
+    if (tconf->trigger_pc >= 0) {
+        uint32_t pc = (uint32_t) tconf->trigger_pc;
+        sim->set_trace_trigger_cond([pc]() {
+            for (int i = 0; i < NUM_HPUS; i++) {
+                if (hpu_monitor_port.pc_i[i] == pc) return true;
+            }
+            return false;
+        });
+    }
 
     //before the reset!    
     const char *slm_files_path = conf->slm_files_path;
@@ -182,16 +388,58 @@ int pspinsim_run_tick(uint8_t* done_flag)
 
 int pspinsim_fini() 
 {
+    int ret = SPIN_SUCCESS;
+    if (msg_stats_path[0] != '\0') {
+        ret = ni->export_msg_stats(msg_stats_path);
+    }
+
     printf("\n###### Statistics ######\n");
     for (auto it = sim->get_modules().begin(); it != sim->get_modules().end(); ++it){
         it->get().print_stats();
         printf("----------------------------------\n");
     }
     delete sim;
+
+    if (ctrace != NULL) {
+        delete ctrace;
+        ctrace = NULL;
+    }
     
+    return ret;
+}
+
+int pspinsim_trace_enable(uint8_t enable)
+{
+    if (!sim->has_trace()) {
+        printf("Error: tracing is available only with libpspin_debug.so!\n");
+        return SPIN_ERR;
+    }
+
+    sim->set_trace_enabled(enable != 0);
     return SPIN_SUCCESS;
 }
 
+int pspinsim_stats_count(uint32_t *count)
+{
+    *count = sim_stats.size();
+    return SPIN_SUCCESS;
+}
+
+int pspinsim_stats_get(uint32_t idx, pspinsim_stat_t *stat)
+{
+    return sim_stats.get(idx, stat);
+}
+
+int pspinsim_stats_find(const char *module, const char *name, pspinsim_stat_t *stat)
+{
+    return sim_stats.find(module, name, stat);
+}
+
+int pspinsim_stats_dump(const char *path, pspinsim_stats_format_t format)
+{
+    return sim_stats.dump(path, format);
+}
+
 int pspinsim_packet_trace_read(const char* pkt_file_path, const char* data_file_path)
 {
     return ni->read_trace(pkt_file_path, data_file_path);
@@ -225,6 +473,12 @@ int pspinsim_cb_set_pkt_out(pkt_out_cb_t cb)
     return SPIN_SUCCESS;
 }
 
+int pspinsim_cb_set_port_pkt_out(uint32_t port, pkt_out_cb_t cb)
+{
+    NICOutbound<AXIPort<uint32_t, uint64_t>>::out_packet_cb_t f(cb);
+    return no->set_port_packet_out_cb(port, f);
+}
+
 
 int pspinsim_cb_set_pcie_slv_write(pcie_slv_write_cb_t cb)
 {
@@ -322,6 +576,7 @@ int spin_find_handler_by_name(const char *binfile, const char* handler_name, spi
                 {
                     *handler_addr = symbol_table[j].st_value;
                     *handler_size = 4096;
+                    hpu_mon->set_handler_name(*handler_addr, handler_name);
                     break;
                 }
             }
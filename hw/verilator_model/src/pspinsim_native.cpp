@@ -0,0 +1,939 @@
+// Copyright 2020 ETH Zurich
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Native backend of the simulator API (libpspin_native.so). Handlers built
+// with -DHOST (handler_profiler.h) are loaded from <handlers file>.so and run
+// on host threads, one per HPU. The NIC is functional only: packets are
+// processed in arrival order, the header handler of a message runs before its
+// payload handlers, and the tail handler runs once all payload handlers of the
+// message are done. Handler durations are host nanoseconds.
+//
+// With sched_model.enabled, packets go through the scheduler model instead
+// (SchedModel.hpp): handlers run on a single thread when the model starts
+// them, and the model times the packets with their native durations (scaled
+// to cycles) or with durations sampled from a handler profile.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <dlfcn.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include <map>
+#include <random>
+#include <deque>
+#include <vector>
+#include <string>
+#include <mutex>
+#include <condition_variable>
+
+#include "SimStats.hpp"
+#include "SchedModel.hpp"
+
+#include "pspinsim.h"
+#include "spin.h"
+#include "handler_profiler.h"
+
+// NIC memories, mapped at their PsPIN addresses
+#define NATIVE_L1_BASE 0x10000000
+#define NATIVE_L1_STRIDE 0x00400000
+#define NATIVE_L2_BASE 0x1c000000
+#define NATIVE_L2_SIZE 0x00200000
+
+#define NATIVE_HPUS (NUM_CLUSTERS * NUM_CORES)
+#define NATIVE_L1_PKT_SLOT (L1_PKT_BUFF_SIZE / NUM_CORES)
+#define NATIVE_L2_PKT_SLOT ((L2_PKT_BUFF_SIZE) / NATIVE_HPUS)
+#define NATIVE_HPU_STACK_SIZE (1 << 20)
+#define NATIVE_HOST_PAGE_SIZE 4096
+
+#ifndef MAP_FIXED_NOREPLACE
+#define MAP_FIXED_NOREPLACE 0x100000
+#endif
+
+#ifndef MAP_32BIT
+#define MAP_32BIT 0
+#endif
+
+#define HANDLER_HH 0
+#define HANDLER_PH 1
+#define HANDLER_TH 2
+#define NUM_HANDLER_TYPES 3
+
+extern "C" {
+volatile struct host_data __host_data;
+}
+
+namespace PsPIN
+{
+    class NativeBackend
+    {
+    private:
+        typedef struct native_pkt
+        {
+            spin_ec_t ec;
+            uint32_t msgid;
+            std::vector<uint8_t> data;
+            size_t l1_len;
+            bool eom;
+            uint64_t user_ptr;
+            uint64_t arrival;
+        } native_pkt_t;
+
+        typedef struct native_msg
+        {
+            bool hh_started;
+            bool hh_done;
+            bool eom_seen;
+            uint32_t received;
+            uint32_t completed;
+            std::deque<native_pkt_t*> waiting; // arrived while the HH was running
+        } native_msg_t;
+
+        typedef std::pair<uint32_t, uint32_t> msg_key_t; // (HH/PH/TH of the EC, msgid)
+
+        typedef struct hpu_state
+        {
+            uint32_t id;
+            pthread_t thread;
+            void *stack;
+            uint64_t busy_ns;
+            uint64_t handlers;
+        } hpu_state_t;
+
+        std::mutex mtx;
+        std::condition_variable cv;
+        std::deque<native_pkt_t*> ingress;
+        std::deque<native_pkt_t*> ready;
+        std::map<msg_key_t, native_msg_t> messages;
+        uint32_t in_flight;
+        bool eos;
+
+        std::vector<hpu_state_t> hpus;
+        std::vector<handler_fn> handlers;
+        std::vector<std::string> handler_names;
+        std::map<std::string, void*> libs;
+
+        // scheduler model (NULL: functional execution only)
+        SchedModel *model;
+        sched_model_conf_t model_conf;
+        std::map<std::string, std::vector<uint64_t>> profile;
+        std::mt19937_64 profile_rng;
+
+        std::mutex host_mtx;
+        std::map<uint64_t, std::vector<uint8_t>> host_pages;
+
+        struct timespec start_time;
+
+        pkt_out_cb_t pkt_out_cb;
+        pcie_slv_write_cb_t pcie_slv_write_cb;
+        pcie_slv_read_cb_t pcie_slv_read_cb;
+        pcie_mst_write_cb_t pcie_mst_write_cb;
+        pcie_mst_read_cb_t pcie_mst_read_cb;
+        pkt_feedback_cb_t feedback_cb;
+
+        //statistics
+        std::mutex stats_mtx;
+        uint64_t packets;
+        uint64_t msgs;
+        uint64_t run_ns;
+        uint64_t handler_count[NUM_HANDLER_TYPES];
+        StatsHistogram handler_ns[NUM_HANDLER_TYPES];
+        uint64_t pkts_out;
+        uint64_t bytes_out;
+        uint64_t host_write_bytes;
+        uint64_t host_read_bytes;
+
+    public:
+        NativeBackend()
+            : hpus(NATIVE_HPUS)
+        {
+            in_flight = 0;
+            eos = false;
+
+            pkt_out_cb = NULL;
+            pcie_slv_write_cb = NULL;
+            pcie_slv_read_cb = NULL;
+            pcie_mst_write_cb = NULL;
+            pcie_mst_read_cb = NULL;
+            feedback_cb = NULL;
+
+            model = NULL;
+
+            packets = 0;
+            msgs = 0;
+            run_ns = 0;
+            pkts_out = 0;
+            bytes_out = 0;
+            host_write_bytes = 0;
+            host_read_bytes = 0;
+            for (int i = 0; i < NUM_HANDLER_TYPES; i++) handler_count[i] = 0;
+
+            for (uint32_t i = 0; i < NATIVE_HPUS; i++)
+            {
+                hpus[i].id = i;
+                hpus[i].stack = NULL;
+                hpus[i].busy_ns = 0;
+                hpus[i].handlers = 0;
+            }
+
+            clock_gettime(CLOCK_MONOTONIC, &start_time);
+        }
+
+        int map_nic_memories()
+        {
+            for (uint32_t i = 0; i < NUM_CLUSTERS; i++)
+            {
+                if (map_fixed(NATIVE_L1_BASE + i * NATIVE_L1_STRIDE, NATIVE_L1_STRIDE) != SPIN_SUCCESS) return SPIN_ERR;
+            }
+
+            return map_fixed(NATIVE_L2_BASE, NATIVE_L2_SIZE);
+        }
+
+        uint64_t now_ns()
+        {
+            struct timespec t;
+            clock_gettime(CLOCK_MONOTONIC, &t);
+            return (t.tv_sec - start_time.tv_sec) * 1000000000ull + t.tv_nsec - start_time.tv_nsec;
+        }
+
+        int find_handler(const char *binfile, const char *name, spin_nic_addr_t *addr, size_t *size)
+        {
+            std::string path = std::string(binfile) + ".so";
+
+            auto it = libs.find(path);
+            if (it == libs.end())
+            {
+                void *lib = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+                if (lib == NULL)
+                {
+                    printf("Error: cannot load %s: %s (build the handlers with make native)\n", path.c_str(), dlerror());
+                    return SPIN_ERR;
+                }
+                it = libs.insert(std::make_pair(path, lib)).first;
+            }
+
+            handler_fn fn = (handler_fn) dlsym(it->second, name);
+            if (fn == NULL)
+            {
+                printf("Error: handler %s not found in %s\n", name, path.c_str());
+                return SPIN_ERR;
+            }
+
+            // addresses are indices in the handler table (0: no handler)
+            handlers.push_back(fn);
+            handler_names.push_back(name);
+            *addr = handlers.size();
+            *size = 1;
+
+            return SPIN_SUCCESS;
+        }
+
+        int nic_mem_access(spin_nic_addr_t addr, void *data, size_t size, bool write)
+        {
+            if (!is_nic_mem(addr, size))
+            {
+                printf("Error: NIC memory access out of the mapped memories (addr: 0x%x; size: %lu)\n", addr, size);
+                return SPIN_ERR;
+            }
+
+            if (write) memcpy((void*) (uintptr_t) addr, data, size);
+            else memcpy(data, (void*) (uintptr_t) addr, size);
+
+            return SPIN_SUCCESS;
+        }
+
+        int set_sched_model(sched_model_conf_t &conf)
+        {
+            if (SchedModel::check_conf(conf) != SPIN_SUCCESS) return SPIN_ERR;
+
+            if (conf.handler_profile != NULL && load_profile(conf.handler_profile) != SPIN_SUCCESS) return SPIN_ERR;
+
+            model_conf = conf;
+            profile_rng.seed(conf.seed);
+            model = new SchedModel(model_conf,
+                [this](uint32_t handler, uint64_t pkt, uint32_t cluster, uint32_t core) { return model_exec(handler, pkt, cluster, core); },
+                [this](uint64_t pkt, uint64_t nic_arrival, uint64_t pspin_arrival, uint64_t now) { model_feedback(pkt, nic_arrival, pspin_arrival, now); });
+
+            return SPIN_SUCCESS;
+        }
+
+        void packet_add(spin_ec_t *ec, uint32_t msgid, uint8_t *pkt_data, size_t pkt_len, size_t pkt_l1_len, uint8_t eom, uint32_t wait_cycles, uint64_t user_ptr)
+        {
+            native_pkt_t *pkt = new native_pkt_t;
+            pkt->ec = *ec;
+            pkt->msgid = msgid;
+            pkt->data.assign(pkt_data, pkt_data + pkt_len);
+            // stateless tasks are dispatched without an L1 copy
+            if (ec->stateless)
+                pkt_l1_len = 0;
+            else if (ec->l1_copy_size != 0 && pkt_l1_len > ec->l1_copy_size)
+                pkt_l1_len = ec->l1_copy_size;
+            pkt->l1_len = pkt_l1_len;
+            pkt->eom = eom != 0;
+            pkt->user_ptr = user_ptr;
+            pkt->arrival = now_ns();
+
+            std::unique_lock<std::mutex> lock(mtx);
+            if (model != NULL)
+            {
+                model->add_packet((uint64_t) pkt, msgid, ec->hh_addr, ec->ph_addr, ec->th_addr, pkt_len, pkt_l1_len, eom != 0, wait_cycles, ec->stateless != 0);
+                return;
+            }
+            ingress.push_back(pkt);
+            cv.notify_one();
+        }
+
+        void packet_eos()
+        {
+            std::unique_lock<std::mutex> lock(mtx);
+            eos = true;
+            if (model != NULL) model->set_eos();
+            cv.notify_all();
+        }
+
+        int run()
+        {
+            uint64_t start = now_ns();
+            uint32_t threads = (model != NULL) ? 1 : NATIVE_HPUS;
+            int res = SPIN_SUCCESS;
+
+            for (uint32_t i = 0; i < threads; i++)
+            {
+                // in the low 4 GiB as well: handlers pass stack buffers as 32-bit NIC addresses
+                hpus[i].stack = mmap(NULL, NATIVE_HPU_STACK_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_32BIT | MAP_STACK, -1, 0);
+                if (hpus[i].stack == MAP_FAILED)
+                {
+                    printf("Error: cannot allocate the HPU stacks!\n");
+                    return SPIN_ERR;
+                }
+
+                pthread_attr_t attr;
+                pthread_attr_init(&attr);
+                pthread_attr_setstack(&attr, hpus[i].stack, NATIVE_HPU_STACK_SIZE);
+                void *(*entry)(void*) = (model != NULL) ? model_entry : hpu_entry;
+                int err = pthread_create(&hpus[i].thread, &attr, entry, new std::pair<NativeBackend*, uint32_t>(this, i));
+                pthread_attr_destroy(&attr);
+                if (err != 0)
+                {
+                    printf("Error: cannot start the HPU threads!\n");
+                    return SPIN_ERR;
+                }
+            }
+
+            for (uint32_t i = 0; i < threads; i++)
+            {
+                void *ret;
+                pthread_join(hpus[i].thread, &ret);
+                munmap(hpus[i].stack, NATIVE_HPU_STACK_SIZE);
+                if (ret != NULL) res = SPIN_ERR;
+            }
+
+            run_ns = now_ns() - start;
+
+            return res;
+        }
+
+        void host_write(uint64_t addr, const uint8_t *data, uint32_t len)
+        {
+            __atomic_fetch_add(&host_write_bytes, len, __ATOMIC_RELAXED);
+
+            if (pcie_slv_write_cb != NULL)
+            {
+                pcie_slv_write_cb(addr, (uint8_t*) data, len);
+                return;
+            }
+
+            std::unique_lock<std::mutex> lock(host_mtx);
+            host_copy(addr, (uint8_t*) data, len, true);
+        }
+
+        void host_read(uint64_t addr, uint8_t *data, uint32_t len)
+        {
+            __atomic_fetch_add(&host_read_bytes, len, __ATOMIC_RELAXED);
+
+            if (pcie_slv_read_cb != NULL)
+            {
+                pcie_slv_read_cb(addr, data, len);
+                return;
+            }
+
+            std::unique_lock<std::mutex> lock(host_mtx);
+            host_copy(addr, data, len, false);
+        }
+
+        void send_packet(const void *data, uint32_t len)
+        {
+            __atomic_fetch_add(&pkts_out, 1, __ATOMIC_RELAXED);
+            __atomic_fetch_add(&bytes_out, len, __ATOMIC_RELAXED);
+
+            if (pkt_out_cb != NULL) pkt_out_cb((uint8_t*) data, len);
+        }
+
+        void set_pkt_out_cb(pkt_out_cb_t cb) { pkt_out_cb = cb; }
+        void set_pcie_slv_write_cb(pcie_slv_write_cb_t cb) { pcie_slv_write_cb = cb; }
+        void set_pcie_slv_read_cb(pcie_slv_read_cb_t cb) { pcie_slv_read_cb = cb; }
+        void set_pcie_mst_write_cb(pcie_mst_write_cb_t cb) { pcie_mst_write_cb = cb; }
+        void set_pcie_mst_read_cb(pcie_mst_read_cb_t cb) { pcie_mst_read_cb = cb; }
+        void set_feedback_cb(pkt_feedback_cb_t cb) { feedback_cb = cb; }
+
+        void nic_mem_write_done(void *user_ptr) { if (pcie_mst_write_cb != NULL) pcie_mst_write_cb(user_ptr); }
+        void nic_mem_read_done(void *user_ptr) { if (pcie_mst_read_cb != NULL) pcie_mst_read_cb(user_ptr); }
+
+        void print_stats()
+        {
+            const char *names[NUM_HANDLER_TYPES] = {"HH", "PH", "TH"};
+
+            printf("\nNative backend\n");
+            printf("\tPackets: %lu; messages: %lu; run time: %.3lf ms\n", packets, msgs, run_ns / 1e6);
+            for (int i = 0; i < NUM_HANDLER_TYPES; i++)
+            {
+                if (handler_count[i] == 0) continue;
+                printf("\t%s: %lu runs; avg: %.0lf ns; min: %lu ns; max: %lu ns\n", names[i], handler_count[i],
+                    handler_ns[i].mean(), handler_ns[i].min, handler_ns[i].max);
+            }
+            for (uint32_t i = 0; i < NATIVE_HPUS; i++)
+            {
+                printf("\tCluster %u HPU %u: %lu handlers; busy: %.2lf%%\n", i / NUM_CORES, i % NUM_CORES, hpus[i].handlers,
+                    (run_ns > 0) ? 100.0 * hpus[i].busy_ns / run_ns : 0);
+            }
+            printf("\tPackets sent: %lu (%lu B); host writes: %lu B; host reads: %lu B\n", pkts_out, bytes_out, host_write_bytes, host_read_bytes);
+
+            if (model != NULL) model->print_stats();
+        }
+
+        void register_stats(SimStats &stats)
+        {
+            const char *names[NUM_HANDLER_TYPES] = {"hh", "ph", "th"};
+
+            stats.add_counter("native", "packets", &packets);
+            stats.add_counter("native", "messages", &msgs);
+            stats.add_counter("native", "run_ns", &run_ns);
+            for (int i = 0; i < NUM_HANDLER_TYPES; i++)
+            {
+                stats.add_counter("native", std::string(names[i]) + ".count", &handler_count[i]);
+                stats.add_histogram("native", std::string(names[i]) + ".ns", &handler_ns[i]);
+            }
+            for (uint32_t i = 0; i < NATIVE_HPUS; i++)
+            {
+                std::string p = "cluster" + std::to_string(i / NUM_CORES) + ".hpu" + std::to_string(i % NUM_CORES) + ".";
+                stats.add_counter("native", p + "handlers", &hpus[i].handlers);
+                stats.add_counter("native", p + "busy_ns", &hpus[i].busy_ns);
+            }
+            stats.add_counter("native", "pkts_out", &pkts_out);
+            stats.add_counter("native", "bytes_out", &bytes_out);
+            stats.add_counter("native", "host_write_bytes", &host_write_bytes);
+            stats.add_counter("native", "host_read_bytes", &host_read_bytes);
+
+            if (model != NULL) model->register_stats(stats);
+        }
+
+    private:
+        static int map_fixed(uint32_t addr, uint32_t size)
+        {
+            void *ptr = mmap((void*) (uintptr_t) addr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+            if (ptr != (void*) (uintptr_t) addr)
+            {
+                printf("Error: cannot map NIC memory at 0x%x (size: 0x%x)!\n", addr, size);
+                if (ptr != MAP_FAILED) munmap(ptr, size);
+                return SPIN_ERR;
+            }
+            return SPIN_SUCCESS;
+        }
+
+        static bool is_nic_mem(uint32_t addr, size_t size)
+        {
+            uint64_t end = (uint64_t) addr + size;
+            if (addr >= NATIVE_L2_BASE && end <= NATIVE_L2_BASE + NATIVE_L2_SIZE) return true;
+            return addr >= NATIVE_L1_BASE && end <= NATIVE_L1_BASE + (uint64_t) NUM_CLUSTERS * NATIVE_L1_STRIDE;
+        }
+
+        void host_copy(uint64_t addr, uint8_t *data, uint32_t len, bool write)
+        {
+            while (len > 0)
+            {
+                uint64_t page = addr / NATIVE_HOST_PAGE_SIZE;
+                uint32_t offset = addr % NATIVE_HOST_PAGE_SIZE;
+                uint32_t chunk = std::min(len, NATIVE_HOST_PAGE_SIZE - offset);
+
+                std::vector<uint8_t> &mem = host_pages[page];
+                if (mem.empty()) mem.resize(NATIVE_HOST_PAGE_SIZE, 0);
+
+                if (write) memcpy(&mem[offset], data, chunk);
+                else memcpy(data, &mem[offset], chunk);
+
+                addr += chunk;
+                data += chunk;
+                len -= chunk;
+            }
+        }
+
+        static msg_key_t msg_key(native_pkt_t *pkt)
+        {
+            return msg_key_t(pkt->ec.ph_addr ^ (pkt->ec.hh_addr << 10) ^ (pkt->ec.th_addr << 20), pkt->msgid);
+        }
+
+        // Called with mtx held. Returns the next packet that can run, or NULL.
+        native_pkt_t *next_packet(bool &run_hh)
+        {
+            run_hh = false;
+
+            if (!ready.empty())
+            {
+                native_pkt_t *pkt = ready.front();
+                ready.pop_front();
+                return pkt;
+            }
+
+            while (!ingress.empty())
+            {
+                native_pkt_t *pkt = ingress.front();
+                ingress.pop_front();
+
+                // stateless ECs: payload handler only, not ordered
+                if (pkt->ec.stateless) return pkt;
+
+                native_msg_t &msg = get_msg(pkt);
+                msg.received++;
+                if (pkt->eom) msg.eom_seen = true;
+
+                if (!msg.hh_started)
+                {
+                    msg.hh_started = true;
+                    run_hh = pkt->ec.hh_addr != 0;
+                    msg.hh_done = !run_hh;
+                    return pkt;
+                }
+
+                if (!msg.hh_done)
+                {
+                    msg.waiting.push_back(pkt);
+                    continue;
+                }
+
+                return pkt;
+            }
+
+            return NULL;
+        }
+
+        native_msg_t &get_msg(native_pkt_t *pkt)
+        {
+            msg_key_t key = msg_key(pkt);
+            auto it = messages.find(key);
+            if (it == messages.end())
+            {
+                native_msg_t msg;
+                msg.hh_started = false;
+                msg.hh_done = false;
+                msg.eom_seen = false;
+                msg.received = 0;
+                msg.completed = 0;
+                it = messages.insert(std::make_pair(key, msg)).first;
+            }
+            return it->second;
+        }
+
+        // handler,cycles CSV (e.g., written by libpspin.so with handler_profile_file)
+        int load_profile(const char *path)
+        {
+            FILE *f = fopen(path, "r");
+            if (f == NULL)
+            {
+                printf("Error: cannot open handler profile %s!\n", path);
+                return SPIN_ERR;
+            }
+
+            char name[256];
+            unsigned long cycles;
+            if (fscanf(f, "%*[^\n]\n") != 0) // header
+            {
+                fclose(f);
+                return SPIN_ERR;
+            }
+            while (fscanf(f, "%255[^,],%lu\n", name, &cycles) == 2)
+            {
+                profile[name].push_back(cycles);
+            }
+            fclose(f);
+
+            printf("Handler profile: %lu handlers from %s\n", profile.size(), path);
+            return SPIN_SUCCESS;
+        }
+
+        static void *model_entry(void *arg)
+        {
+            std::pair<NativeBackend*, uint32_t> *p = (std::pair<NativeBackend*, uint32_t>*) arg;
+            int res = p->first->model->run();
+            delete p;
+            return (res == SPIN_SUCCESS) ? NULL : (void*) 1;
+        }
+
+        // Runs a handler started by the model and returns its duration (cycles).
+        // Model HPUs beyond the PsPIN ones share the memories of a PsPIN HPU.
+        uint64_t model_exec(uint32_t handler, uint64_t id, uint32_t cluster, uint32_t core)
+        {
+            native_pkt_t *pkt = (native_pkt_t*) id;
+            hpu_state_t &hpu = hpus[(cluster % NUM_CLUSTERS) * NUM_CORES + core % NUM_CORES];
+
+            task_t task;
+            handler_args_t args;
+            setup_task(hpu, pkt, task, args);
+
+            int type = (handler == pkt->ec.hh_addr) ? HANDLER_HH : (handler == pkt->ec.th_addr) ? HANDLER_TH : HANDLER_PH;
+            uint64_t ns = run_handler(hpu, type, handler, args);
+
+            auto it = profile.find(handler_names[handler - 1]);
+            if (it != profile.end())
+            {
+                std::uniform_int_distribution<size_t> sample(0, it->second.size() - 1);
+                return it->second[sample(profile_rng)];
+            }
+
+            return std::max((uint64_t) (ns * model_conf.cycles_per_ns), (uint64_t) 1);
+        }
+
+        // Times are in ps, as for libpspin.so
+        void model_feedback(uint64_t id, uint64_t nic_arrival, uint64_t pspin_arrival, uint64_t now)
+        {
+            native_pkt_t *pkt = (native_pkt_t*) id;
+            {
+                std::unique_lock<std::mutex> slock(stats_mtx);
+                packets++;
+                if (pkt->eom) msgs++;
+            }
+
+            if (feedback_cb != NULL) feedback_cb(pkt->user_ptr, nic_arrival * 1000, pspin_arrival * 1000, now * 1000);
+            delete pkt;
+        }
+
+        static void *hpu_entry(void *arg)
+        {
+            std::pair<NativeBackend*, uint32_t> *p = (std::pair<NativeBackend*, uint32_t>*) arg;
+            p->first->hpu_loop(p->first->hpus[p->second]);
+            delete p;
+            return NULL;
+        }
+
+        void hpu_loop(hpu_state_t &hpu)
+        {
+            std::unique_lock<std::mutex> lock(mtx);
+
+            while (true)
+            {
+                bool run_hh;
+                native_pkt_t *pkt = next_packet(run_hh);
+
+                if (pkt == NULL)
+                {
+                    if (eos && in_flight == 0 && ingress.empty())
+                    {
+                        cv.notify_all();
+                        return;
+                    }
+                    cv.wait(lock);
+                    continue;
+                }
+
+                in_flight++;
+                lock.unlock();
+
+                task_t task;
+                handler_args_t args;
+                setup_task(hpu, pkt, task, args);
+                uint64_t start = now_ns();
+
+                if (run_hh)
+                {
+                    run_handler(hpu, HANDLER_HH, pkt->ec.hh_addr, args);
+
+                    lock.lock();
+                    native_msg_t &msg = get_msg(pkt);
+                    msg.hh_done = true;
+                    ready.insert(ready.end(), msg.waiting.begin(), msg.waiting.end());
+                    msg.waiting.clear();
+                    cv.notify_all();
+                    lock.unlock();
+                }
+
+                run_handler(hpu, HANDLER_PH, pkt->ec.ph_addr, args);
+
+                bool last = false;
+                if (!pkt->ec.stateless)
+                {
+                    lock.lock();
+                    native_msg_t &msg = get_msg(pkt);
+                    msg.completed++;
+                    last = msg.eom_seen && msg.completed == msg.received && msg.waiting.empty();
+                    if (last) messages.erase(msg_key(pkt));
+                    lock.unlock();
+                }
+
+                if (last)
+                {
+                    run_handler(hpu, HANDLER_TH, pkt->ec.th_addr, args);
+                }
+
+                {
+                    std::unique_lock<std::mutex> slock(stats_mtx);
+                    packets++;
+                    if (last || (pkt->ec.stateless && pkt->eom)) msgs++;
+                }
+
+                // feedback times are in ps, as in model mode and the verilated library
+                if (feedback_cb != NULL) feedback_cb(pkt->user_ptr, pkt->arrival * 1000, start * 1000, now_ns() * 1000);
+                delete pkt;
+
+                lock.lock();
+                in_flight--;
+                if (eos && in_flight == 0) cv.notify_all();
+            }
+        }
+
+        void setup_task(hpu_state_t &hpu, native_pkt_t *pkt, task_t &task, handler_args_t &args)
+        {
+            uint32_t cluster_id = hpu.id / NUM_CORES;
+            uint32_t core_id = hpu.id % NUM_CORES;
+            uint8_t *l1_pkt = (uint8_t*) (uintptr_t) (NATIVE_L1_BASE + cluster_id * NATIVE_L1_STRIDE + L1_PKT_BUFF_OFFSET + core_id * NATIVE_L1_PKT_SLOT);
+            uint8_t *l2_pkt = (uint8_t*) (uintptr_t) (L2_PKT_BUFF_START + hpu.id * NATIVE_L2_PKT_SLOT);
+
+            size_t l1_len = std::min(pkt->l1_len, (size_t) NATIVE_L1_PKT_SLOT);
+            size_t l2_len = std::min(pkt->data.size(), (size_t) NATIVE_L2_PKT_SLOT);
+            memcpy(l1_pkt, pkt->data.data(), std::min(l1_len, pkt->data.size()));
+            memcpy(l2_pkt, pkt->data.data(), l2_len);
+
+            memset(&task, 0, sizeof(task));
+            task.handler_mem = (void*) (uintptr_t) pkt->ec.handler_mem_addr;
+            task.handler_mem_size = pkt->ec.handler_mem_size;
+            task.pkt_mem = (pkt->ec.stateless) ? l2_pkt : l1_pkt;
+            task.pkt_mem_size = (pkt->ec.stateless) ? l2_len : l1_len;
+            for (uint32_t i = 0; i < NUM_CLUSTERS && i < TASK_SCRATCHPAD_SLOTS; i++)
+            {
+                task.scratchpad[i] = (void*) (uintptr_t) (NATIVE_L1_BASE + i * NATIVE_L1_STRIDE + L1_SCRATCHPAD_OFFSET + pkt->ec.scratchpad_addr[i]);
+                task.scratchpad_size[i] = pkt->ec.scratchpad_size[i];
+            }
+            task.host_mem_high = (uint32_t) (pkt->ec.host_mem_addr >> 32);
+            task.host_mem_low = (uint32_t) pkt->ec.host_mem_addr;
+            task.host_mem_size = pkt->ec.host_mem_size;
+            task.l2_pkt_mem = l2_pkt;
+            task.pkt_l2_size = l2_len;
+            task.home_cluster_id = pkt->msgid % NUM_CLUSTERS;
+            task.flow_id = pkt->msgid;
+
+            args.task = &task;
+            args.hpu_gid = hpu.id;
+            args.cluster_id = cluster_id;
+            args.hpu_id = core_id;
+        }
+
+        // Returns the duration of the handler (ns)
+        uint64_t run_handler(hpu_state_t &hpu, int type, uint32_t addr, handler_args_t &args)
+        {
+            if (addr == 0) return 0;
+
+            uint64_t start = now_ns();
+            handlers[addr - 1](&args);
+            uint64_t duration = now_ns() - start;
+
+            hpu.busy_ns += duration;
+            hpu.handlers++;
+
+            std::unique_lock<std::mutex> lock(stats_mtx);
+            handler_count[type]++;
+            handler_ns[type].add(duration);
+
+            return duration;
+        }
+    };
+}
+
+using namespace PsPIN;
+
+static NativeBackend *native = NULL;
+static SimStats sim_stats;
+
+/* Handler side (handler_profiler.h) */
+extern "C" {
+
+uint64_t pspin_native_cycles()
+{
+    return native->now_ns();
+}
+
+void pspin_native_dma_to_host(uint64_t host_addr, const void *src, uint32_t length)
+{
+    native->host_write(host_addr, (const uint8_t*) src, length);
+}
+
+void pspin_native_dma_from_host(uint64_t host_addr, void *dst, uint32_t length)
+{
+    native->host_read(host_addr, (uint8_t*) dst, length);
+}
+
+void pspin_native_send_packet(const void *data, uint32_t length)
+{
+    native->send_packet(data, length);
+}
+
+}
+
+/* Simulator API (pspinsim.h) */
+int pspinsim_default_conf(pspin_conf_t *conf)
+{
+    memset(conf, 0, sizeof(pspin_conf_t));
+    SchedModel::default_conf(conf->sched_model);
+    return SPIN_SUCCESS;
+}
+
+// Only sched_model is used from the configuration
+int pspinsim_init(int argc, char **argv, pspin_conf_t *conf)
+{
+    native = new NativeBackend();
+    if (native->map_nic_memories() != SPIN_SUCCESS) return SPIN_ERR;
+    if (conf->sched_model.enabled && native->set_sched_model(conf->sched_model) != SPIN_SUCCESS) return SPIN_ERR;
+
+    memset((void*) &__host_data, 0, sizeof(__host_data));
+
+    native->register_stats(sim_stats);
+
+    return SPIN_SUCCESS;
+}
+
+int pspinsim_run()
+{
+    return native->run();
+}
+
+int pspinsim_run_tick(uint8_t *done_flag)
+{
+    int res = native->run();
+    *done_flag = 1;
+    return res;
+}
+
+int pspinsim_fini()
+{
+    native->print_stats();
+    return SPIN_SUCCESS;
+}
+
+int pspinsim_trace_enable(uint8_t enable)
+{
+    printf("Error: tracing is not available with libpspin_native.so!\n");
+    return SPIN_ERR;
+}
+
+int pspinsim_stats_count(uint32_t *count)
+{
+    *count = sim_stats.size();
+    return SPIN_SUCCESS;
+}
+
+int pspinsim_stats_get(uint32_t idx, pspinsim_stat_t *stat)
+{
+    return sim_stats.get(idx, stat);
+}
+
+int pspinsim_stats_find(const char *module, const char *name, pspinsim_stat_t *stat)
+{
+    return sim_stats.find(module, name, stat);
+}
+
+int pspinsim_stats_dump(const char *path, pspinsim_stats_format_t format)
+{
+    return sim_stats.dump(path, format);
+}
+
+int pspinsim_packet_trace_read(const char* pkt_file_path, const char* data_file_path)
+{
+    printf("Error: packet trace files are not supported by libpspin_native.so!\n");
+    return SPIN_ERR;
+}
+
+int pspinsim_packet_add(spin_ec_t* ec, uint32_t msgid, uint8_t* pkt_data, size_t pkt_len, size_t pkt_l1_len, uint8_t eom, uint32_t wait_cycles, uint64_t user_ptr)
+{
+    native->packet_add(ec, msgid, pkt_data, pkt_len, pkt_l1_len, eom, wait_cycles, user_ptr);
+    return SPIN_SUCCESS;
+}
+
+int pspinsim_packet_eos()
+{
+    native->packet_eos();
+    return SPIN_SUCCESS;
+}
+
+int pspinsim_cb_set_pkt_out(pkt_out_cb_t cb)
+{
+    native->set_pkt_out_cb(cb);
+    return SPIN_SUCCESS;
+}
+
+// a single egress port
+int pspinsim_cb_set_port_pkt_out(uint32_t port, pkt_out_cb_t cb)
+{
+    if (port != 0) return SPIN_ERR;
+    native->set_pkt_out_cb(cb);
+    return SPIN_SUCCESS;
+}
+
+int pspinsim_cb_set_pcie_slv_write(pcie_slv_write_cb_t cb)
+{
+    native->set_pcie_slv_write_cb(cb);
+    return SPIN_SUCCESS;
+}
+
+int pspinsim_cb_set_pcie_slv_read(pcie_slv_read_cb_t cb)
+{
+    native->set_pcie_slv_read_cb(cb);
+    return SPIN_SUCCESS;
+}
+
+int pspinsim_cb_set_pcie_mst_write_completion(pcie_mst_write_cb_t cb)
+{
+    native->set_pcie_mst_write_cb(cb);
+    return SPIN_SUCCESS;
+}
+
+int pspinsim_cb_set_pcie_mst_read_completion(pcie_mst_read_cb_t cb)
+{
+    native->set_pcie_mst_read_cb(cb);
+    return SPIN_SUCCESS;
+}
+
+int pspinsim_cb_set_pkt_feedback(pkt_feedback_cb_t cb)
+{
+    native->set_feedback_cb(cb);
+    return SPIN_SUCCESS;
+}
+
+/* sPIN API functions */
+int spin_nicmem_write(spin_nic_addr_t addr, void *data, size_t size, void* user_ptr)
+{
+    if (native->nic_mem_access(addr, data, size, true) != SPIN_SUCCESS) return SPIN_ERR;
+    native->nic_mem_write_done(user_ptr);
+    return SPIN_SUCCESS;
+}
+
+int spin_nicmem_read(spin_nic_addr_t addr, void *data, size_t size, void* user_ptr)
+{
+    if (native->nic_mem_access(addr, data, size, false) != SPIN_SUCCESS) return SPIN_ERR;
+    native->nic_mem_read_done(user_ptr);
+    return SPIN_SUCCESS;
+}
+
+int spin_find_handler_by_name(const char *binfile, const char* handler_name, spin_nic_addr_t *handler_addr, size_t *handler_size)
+{
+    return native->find_handler(binfile, handler_name, handler_addr, handler_size);
+}
@@ -4,19 +4,27 @@ OBJCOPY=${RISCV_GCC}/riscv32-unknown-elf-objcopy
 OBJDUMP=${RISCV_GCC}/riscv32-unknown-elf-objdump
 PULP_SDK=${PSPIN_RT}/pulp-sdk/
 
+# CLUSTERS and CORES
+include ${PSPIN_HW}/pspin_conf.mk
+
 TARGET_BIN=build/$(SPIN_APP_NAME)
 
 .PHONY: install deploy
 
-CFLAGS=-DPULP_CHIP_STR=bigpulp -DPULP_CHIP_FAMILY_STR=bigpulp -DPULP_CHIP=40 -DPULP_CHIP_FAMILY=7 -march=rv32imacxpulpv2 -D__riscv__ -MMD -MP $(SPIN_CFLAGS)
-LDFLAGS=-nostartfiles -nostdlib -Wl,--gc-sections -T $(PULP_SDK)/linker/config.ld -T $(PULP_SDK)/linker/link.ld $(SPIN_LDFLAGS)
+CFLAGS=-DPULP_CHIP_STR=bigpulp -DPULP_CHIP_FAMILY_STR=bigpulp -DPULP_CHIP=40 -DPULP_CHIP_FAMILY=7 -march=rv32imacxpulpv2 -D__riscv__ -MMD -MP $(PSPIN_CONF_RT_CFLAGS) $(SPIN_CFLAGS)
+LDFLAGS=-nostartfiles -nostdlib -Wl,--gc-sections -T $(PULP_SDK)/linker/config.ld -T $(PULP_SDK)/linker/link.ld $(PSPIN_CONF_RT_LDFLAGS) $(SPIN_LDFLAGS)
 INCLUDE_FILES=-I$(PULP_SDK)/archi/include -I$(PULP_SDK)/hal/include -I${PSPIN_HW}/deps/axi/src/dma/frontends/pulp_cluster_frontend/lib/ -I${PSPIN_RT}/runtime/include/
 
 PULP_SRCS=$(PULP_SDK)/runtime/libs/io/io.c $(PULP_SDK)/runtime/libs/io/tinyprintf.c
 PULP_INC=-I$(PULP_SDK)/runtime/libs/io/
 
 #SRC_FILES=$(PSPIN_RT)/src/hpu.c $(PSPIN_RT)/src/handler.c ${SPIN_APP_SRCS}
-SRC_FILES=$(PSPIN_RT)/runtime/src/hpu.c $(PSPIN_RT)/runtime/src/mtvec.S ${SPIN_APP_SRCS}
+SRC_FILES=$(PSPIN_RT)/runtime/src/hpu.c $(PSPIN_RT)/runtime/src/l1_alloc.c $(PSPIN_RT)/runtime/src/reasm.c $(PSPIN_RT)/runtime/src/mtvec.S ${SPIN_APP_SRCS}
+
+# size of the per-cluster L1 arena for l1_malloc [B] (link.ld default: 6 KiB)
+ifdef L1_ARENA_SIZE
+LDFLAGS += -Wl,--defsym=__l1_arena_size=$(L1_ARENA_SIZE)
+endif
 
 runtime-debug:
 	mkdir -p build/
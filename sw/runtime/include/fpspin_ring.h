@@ -0,0 +1,118 @@
+// Copyright 2020 ETH Zurich
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef FPSPIN_RING_H
+#define FPSPIN_RING_H
+
+#include <stdint.h>
+
+// Shared completion ring for HPU -> host requests.
+//
+// The ring lives in host memory, right after the per-HPU pages. An HPU takes
+// a slot by incrementing the producer index (__host_data.ring_prod, NIC
+// memory) and writes an 8-byte descriptor into it with a single DMA write.
+// The descriptor carries a sequence number, so the host finds new requests by
+// reading its own memory instead of polling every HPU. The host returns the
+// consumer index (__host_data.ring_cons) with one doorbell write per batch;
+// HPUs wait while the ring is full. Responses still go to the requesting
+// HPU's flag (__host_data.flag).
+
+#define FPSPIN_RING_SLOTS 256 // power of two
+#define FPSPIN_RING_SLOT(idx) ((idx) & (FPSPIN_RING_SLOTS - 1))
+#define FPSPIN_RING_SEQ(idx) ((uint16_t)((idx) + 1)) // 0: slot never written
+#define FPSPIN_RING_BYTES (FPSPIN_RING_SLOTS * sizeof(fpspin_ring_desc_t))
+
+// per-HPU host pages (PAGE_SIZE) and payload offset in them (DMA_ALIGN)
+#define FPSPIN_RING_HPU_PAGE 4096
+#define FPSPIN_RING_PLD_OFFSET 64
+
+typedef struct {
+  union {
+    struct {
+      uint16_t seq;
+      uint8_t dma_id;
+      uint8_t hpu_id;
+      uint32_t len;
+    } __attribute__((packed));
+    uint64_t data;
+  };
+} fpspin_ring_desc_t;
+
+#ifdef __FPSPIN_HOST__
+
+typedef struct {
+  volatile uint8_t *host_mem;         // host DMA region
+  volatile fpspin_ring_desc_t *descs; // ring, after the per-HPU pages
+  volatile uint64_t *flags;           // __host_data.flag (NIC memory)
+  volatile uint32_t *doorbell;        // __host_data.ring_cons (NIC memory)
+  uint32_t cons;
+} fpspin_ring_t;
+
+static inline void fpspin_ring_init(fpspin_ring_t *ring,
+                                    volatile uint8_t *host_mem, int num_hpus,
+                                    volatile uint64_t *flags,
+                                    volatile uint32_t *doorbell) {
+  ring->host_mem = host_mem;
+  ring->descs = (volatile fpspin_ring_desc_t *)(host_mem +
+                                                num_hpus * FPSPIN_RING_HPU_PAGE);
+  ring->flags = flags;
+  ring->doorbell = doorbell;
+  ring->cons = 0;
+
+  for (int i = 0; i < FPSPIN_RING_SLOTS; ++i)
+    ring->descs[i].data = 0;
+  *ring->doorbell = 0;
+}
+
+// Copies up to max new descriptors (in request order) and consumes them.
+// The slots are returned to the HPUs by the next doorbell.
+static inline int fpspin_ring_poll(fpspin_ring_t *ring,
+                                   fpspin_ring_desc_t *descs, int max) {
+  int n = 0;
+  while (n < max) {
+    fpspin_ring_desc_t desc;
+    desc.data = ring->descs[FPSPIN_RING_SLOT(ring->cons)].data;
+    if (desc.seq != FPSPIN_RING_SEQ(ring->cons))
+      break;
+    descs[n++] = desc;
+    ring->cons++;
+  }
+
+  // payloads were written before the descriptors
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  return n;
+}
+
+static inline void fpspin_ring_doorbell(fpspin_ring_t *ring) {
+  *ring->doorbell = ring->cons;
+}
+
+static inline volatile uint8_t *
+fpspin_ring_payload(fpspin_ring_t *ring, const fpspin_ring_desc_t *desc) {
+  return ring->host_mem + desc->hpu_id * FPSPIN_RING_HPU_PAGE +
+         FPSPIN_RING_PLD_OFFSET;
+}
+
+// Wakes up the HPU with a response of len bytes (same layout as
+// fpspin_flag_t: dma_id, len, hpu_id)
+static inline void fpspin_ring_respond(fpspin_ring_t *ring,
+                                       const fpspin_ring_desc_t *desc,
+                                       uint32_t len) {
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  ring->flags[desc->hpu_id] = (uint64_t)desc->dma_id | ((uint64_t)len << 8) |
+                              ((uint64_t)desc->hpu_id << 40);
+}
+
+#endif /* __FPSPIN_HOST__ */
+
+#endif /* FPSPIN_RING_H */
@@ -20,6 +20,8 @@
 #include "spin_conf.h"
 #include "spin_dma.h"
 #include "hwsched.h"
+#include "l1_alloc.h"
+#include "reasm.h"
 
 #define __handler__ __attribute__((used))
 
@@ -44,16 +46,14 @@ typedef struct task
     void* handler_mem;
     size_t handler_mem_size;
 
-    //packet memory (L1)
+    //packet memory (L1; the packet in L2 for stateless ECs)
     void* pkt_mem;
     size_t pkt_mem_size;
     
-    //per-message scratchpad (L1)
-    void* scratchpad[NB_CLUSTERS];
-    // FIXME: remove this padding in hpu_driver
-    uint32_t unused_0[2];
-    size_t scratchpad_size[NB_CLUSTERS];
-    uint32_t unused_1[2];
+    //per-message scratchpad (L1) in the first TASK_SCRATCHPAD_SLOTS clusters;
+    //the slots of missing clusters are NULL
+    void* scratchpad[TASK_SCRATCHPAD_SLOTS];
+    size_t scratchpad_size[TASK_SCRATCHPAD_SLOTS];
 
     //host memory region
     uint32_t host_mem_high;
@@ -83,6 +83,14 @@ typedef void (*handler_fn)(handler_args_t*);
 
 typedef dma_t spin_dma_t;
 
+// Size of the whole packet (task->l2_pkt_mem). Only the first
+// task->pkt_mem_size bytes are in L1 if the execution context sets
+// an L1 copy size (l1_copy_size in spin_ec_t).
+static inline size_t spin_pkt_l2_size(task_t *task)
+{
+    return MMIO_READ(HWSCHED_PKT_L2_SIZE);
+}
+
 typedef struct spin_rw_lock {
     spin_lock_t glock;
     volatile int32_t num_readers;
@@ -186,6 +194,32 @@ static inline int spin_cmd_test(spin_cmd_t handle, bool *completed)
     return SPIN_OK;
 } 
 
+// Set of commands of this HPU: bit i is the command with handle i. The HPU
+// keeps up to HPU_CMDS commands in flight (4 by default; see the verilator
+// model Makefile) and stalls on the next issue until one completes.
+typedef uint32_t spin_cmd_set_t;
+#define SPIN_CMD_SET(handle) (((spin_cmd_set_t) 1) << (handle))
+#define SPIN_CMD_SET_ALL ((spin_cmd_set_t) 0xffffffff)
+
+// Waits until none of the commands in the set is in flight (one MMIO write)
+static inline int spin_cmd_wait_set(spin_cmd_set_t set)
+{
+    MMIO_WRITE(CMD_WAIT_SET, set);
+    return SPIN_OK;
+}
+
+// Completed if none of the commands in the set is in flight (one MMIO read)
+static inline int spin_cmd_test_set(spin_cmd_set_t set, bool *completed)
+{
+    *completed = (MMIO_READ(CMD_PENDING) & set) == 0;
+    return SPIN_OK;
+}
+
+static inline int spin_cmd_wait_all()
+{
+    return spin_cmd_wait_set(SPIN_CMD_SET_ALL);
+}
+
 static inline int spin_rdma_put(uint32_t dest, void *data, uint32_t length, spin_cmd_t *handle)
 {
     uint32_t fid = 1 /* >1 is RDMA */;
@@ -0,0 +1,348 @@
+// Copyright 2020 ETH Zurich
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#pragma once
+
+// Handler API for native (host) execution, selected with -DHOST (see the
+// `native` target of gdriver.mk). Handlers are built as a shared object and
+// run by the native backend (hw/verilator_model/src/pspinsim_native.cpp) on
+// host threads, one per HPU. NIC memories (L1 of each cluster, L2) are mapped
+// at their PsPIN addresses, so 32-bit NIC addresses passed to the DMA
+// functions stay valid. Commands complete synchronously.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sched.h>
+
+#include "spin_conf.h"
+#include "packets.h"
+#include "host_data.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define __handler__ __attribute__((used, visibility("default")))
+
+#define SPIN_OK 0x0
+#define SPIN_FAIL 0x1
+
+#define GET_IP_UDP_PLD(pkt_ptr, pkt_pld_ptr, pkt_pld_len)                           \
+{                                                                                   \
+    ip_hdr_t *ip_hdr = (ip_hdr_t*) (pkt_ptr);                                       \
+    pkt_pld_len = ip_hdr->length - sizeof(ip_hdr_t) - sizeof(udp_hdr_t);            \
+    pkt_pld_ptr = ((uint8_t *) pkt_ptr) + (ip_hdr->ihl * 4) + sizeof(udp_hdr_t);    \
+}
+
+typedef uint32_t dma_t;
+typedef volatile uint32_t futex_t;
+typedef futex_t spin_lock_t;
+typedef dma_t spin_dma_t;
+typedef uint32_t spin_cmd_t;
+
+typedef struct task
+{
+    //handler memory (L2)
+    void* handler_mem;
+    size_t handler_mem_size;
+
+    //packet memory (L1; the packet in L2 for stateless ECs)
+    void* pkt_mem;
+    size_t pkt_mem_size;
+
+    //per-message scratchpad (L1) in the first TASK_SCRATCHPAD_SLOTS clusters;
+    //the slots of missing clusters are NULL
+    void* scratchpad[TASK_SCRATCHPAD_SLOTS];
+    size_t scratchpad_size[TASK_SCRATCHPAD_SLOTS];
+
+    //host memory region
+    uint32_t host_mem_high;
+    uint32_t host_mem_low;
+    size_t host_mem_size;
+
+    //l2 pkt addr
+    void* l2_pkt_mem;
+
+    //home cluster id
+    uint32_t home_cluster_id;
+
+    //flow id
+    uint32_t flow_id;
+
+    //whole packet size (a register on PsPIN, see spin_pkt_l2_size())
+    size_t pkt_l2_size;
+} task_t;
+
+typedef struct handler_args
+{
+    task_t *task;
+    uint32_t hpu_gid;
+    uint32_t cluster_id;
+    uint32_t hpu_id;
+} handler_args_t;
+
+typedef void (*handler_fn)(handler_args_t*);
+
+static inline size_t spin_pkt_l2_size(task_t *task)
+{
+    return task->pkt_l2_size;
+}
+
+typedef struct spin_rw_lock {
+    spin_lock_t glock;
+    volatile int32_t num_readers;
+} spin_rw_lock_t;
+
+/* implemented by the native backend */
+uint64_t pspin_native_cycles();
+void pspin_native_dma_to_host(uint64_t host_addr, const void *src, uint32_t length);
+void pspin_native_dma_from_host(uint64_t host_addr, void *dst, uint32_t length);
+void pspin_native_send_packet(const void *data, uint32_t length);
+
+#define NIC_PTR(addr) ((void *) (uintptr_t) (addr))
+
+/** Atomics **/
+
+static inline uint32_t amo_swap(volatile uint32_t *const addr, const uint32_t val)
+{
+    return __atomic_exchange_n(addr, val, __ATOMIC_SEQ_CST);
+}
+
+static inline void amo_store(volatile uint32_t *const addr, const uint32_t val)
+{
+    __atomic_store_n(addr, val, __ATOMIC_SEQ_CST);
+}
+
+static inline int32_t amo_add(volatile int32_t *const addr, const int32_t val)
+{
+    return __atomic_fetch_add(addr, val, __ATOMIC_SEQ_CST);
+}
+
+static inline uint32_t amo_and(volatile uint32_t *const addr, const uint32_t val)
+{
+    return __atomic_fetch_and(addr, val, __ATOMIC_SEQ_CST);
+}
+
+static inline uint32_t amo_or(volatile uint32_t *const addr, const uint32_t val)
+{
+    return __atomic_fetch_or(addr, val, __ATOMIC_SEQ_CST);
+}
+
+static inline uint32_t amo_xor(volatile uint32_t *const addr, const uint32_t val)
+{
+    return __atomic_fetch_xor(addr, val, __ATOMIC_SEQ_CST);
+}
+
+#define AMO_MINMAX(name, type, cmp)                                             \
+static inline type name(volatile type *const addr, const type val)              \
+{                                                                               \
+    type old = __atomic_load_n(addr, __ATOMIC_SEQ_CST);                         \
+    while ((val cmp old) && !__atomic_compare_exchange_n(addr, &old, val, false, \
+        __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST));                                   \
+    return old;                                                                 \
+}
+
+AMO_MINMAX(amo_maxu, uint32_t, >)
+AMO_MINMAX(amo_max, int32_t, >)
+AMO_MINMAX(amo_minu, uint32_t, <)
+AMO_MINMAX(amo_min, int32_t, <)
+
+static inline int compare_and_swap(volatile uint32_t *const addr, const uint32_t old, const uint32_t new_val)
+{
+    uint32_t expected = old;
+    return __atomic_compare_exchange_n(addr, &expected, new_val, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST) ? 0 : -1;
+}
+
+/** Locks **/
+
+static inline void futex_init(futex_t *futex) { amo_store(futex, 0); }
+
+static inline int futex_try_lock(futex_t *futex) { return amo_or(futex, 1) == 0; }
+
+// HPUs are threads that may share a host CPU: yield instead of spinning
+static inline int futex_lock_s(futex_t *futex)
+{
+    while (amo_or(futex, 1)) {
+        sched_yield();
+    }
+    return 1;
+}
+
+static inline int futex_lock(futex_t *futex) { return futex_lock_s(futex); }
+
+static inline void futex_unlock(futex_t *futex) { futex_init(futex); }
+
+static inline int spin_lock_init(spin_lock_t* lock)
+{
+    futex_init(lock);
+    return SPIN_OK;
+}
+
+static inline int spin_lock_try_lock(spin_lock_t* lock)
+{
+    return futex_try_lock(lock);
+}
+
+static inline int spin_lock_lock(spin_lock_t* lock)
+{
+    futex_lock_s(lock);
+    return SPIN_OK;
+}
+
+static inline int spin_lock_unlock(spin_lock_t* lock)
+{
+    futex_unlock(lock);
+    return SPIN_OK;
+}
+
+static inline int spin_rw_lock_r_lock(spin_rw_lock_t *rwlock)
+{
+    int32_t num_readers = amo_add(&(rwlock->num_readers), 1) + 1;
+    if (num_readers == 1)
+    {
+        spin_lock_lock(&(rwlock->glock));
+    }
+    return SPIN_OK;
+}
+
+static inline int spin_rw_lock_r_unlock(spin_rw_lock_t *rwlock)
+{
+    int32_t num_readers = amo_add(&(rwlock->num_readers), -1) - 1;
+    if (num_readers == 0)
+    {
+        spin_lock_unlock(&(rwlock->glock));
+    }
+    return SPIN_OK;
+}
+
+static inline int spin_rw_lock_w_lock(spin_rw_lock_t *rwlock)
+{
+    spin_lock_lock(&(rwlock->glock));
+    return SPIN_OK;
+}
+
+static inline int spin_rw_lock_w_unlock(spin_rw_lock_t *rwlock)
+{
+    spin_lock_unlock(&(rwlock->glock));
+    return SPIN_OK;
+}
+
+/** Timing **/
+
+// host nanoseconds (not PsPIN cycles)
+static inline uint32_t cycles() { return (uint32_t) pspin_native_cycles(); }
+
+static inline void perf_start() {}
+
+static inline void perf_stop(uint32_t tag) {}
+
+static inline void push_counter(volatile struct perf_counter *c, uint32_t dur)
+{
+    amo_add((volatile int32_t *) &c->count, 1);
+    amo_add((volatile int32_t *) &c->sum, dur);
+}
+
+/** DMA and NIC commands **/
+
+static inline int spin_dma(void* source, void* dest, size_t size, int direction, int options, spin_dma_t* xfer)
+{
+    if (__builtin_expect(size>0, 1))
+    {
+        memcpy(dest, source, size);
+        *xfer = 0;
+        return SPIN_OK;
+    } else
+    {
+        return SPIN_FAIL;
+    }
+}
+
+static inline int spin_dma_wait(spin_dma_t xfer) { return SPIN_OK; }
+
+static inline int spin_dma_test(spin_dma_t xfer, uint32_t *completed)
+{
+    *completed = 1;
+    return SPIN_OK;
+}
+
+static inline int spin_cmd_wait(spin_cmd_t handle) { return SPIN_OK; }
+
+static inline int spin_cmd_test(spin_cmd_t handle, bool *completed)
+{
+    *completed = true;
+    return SPIN_OK;
+}
+
+typedef uint32_t spin_cmd_set_t;
+#define SPIN_CMD_SET(handle) (((spin_cmd_set_t) 1) << (handle))
+#define SPIN_CMD_SET_ALL ((spin_cmd_set_t) 0xffffffff)
+
+static inline int spin_cmd_wait_set(spin_cmd_set_t set) { return SPIN_OK; }
+
+static inline int spin_cmd_test_set(spin_cmd_set_t set, bool *completed)
+{
+    *completed = true;
+    return SPIN_OK;
+}
+
+static inline int spin_cmd_wait_all() { return SPIN_OK; }
+
+static inline int spin_rdma_put(uint32_t dest, void *data, uint32_t length, spin_cmd_t *handle)
+{
+    pspin_native_send_packet(data, length);
+    *handle = 0;
+    return SPIN_OK;
+}
+
+static inline int spin_send_packet(void *data, uint32_t length, spin_cmd_t *handle)
+{
+    pspin_native_send_packet(data, length);
+    *handle = 0;
+    return SPIN_OK;
+}
+
+static inline int spin_dma_to_host(uint64_t host_addr, uint32_t nic_addr, uint32_t length, bool generate_event, spin_cmd_t *xfer)
+{
+    pspin_native_dma_to_host(host_addr, NIC_PTR(nic_addr), length);
+    *xfer = 0;
+    return SPIN_OK;
+}
+
+static inline int spin_dma_from_host(uint64_t host_addr, uint32_t nic_addr, uint32_t length, bool generate_event, spin_cmd_t *xfer)
+{
+    pspin_native_dma_from_host(host_addr, NIC_PTR(nic_addr), length);
+    *xfer = 0;
+    return SPIN_OK;
+}
+
+// spin_host_write is deprecated. Use spin_write_to_host instead!
+#define spin_host_write spin_write_to_host
+
+static inline int spin_write_to_host(uint64_t host_addr, uint64_t user_data, spin_cmd_t *xfer)
+{
+    pspin_native_dma_to_host(host_addr, &user_data, sizeof(user_data));
+    if (xfer != NULL) *xfer = 0;
+    return SPIN_OK;
+}
+
+// used to implement handler initialisation
+void init_handlers(handler_fn * hh, handler_fn *ph, handler_fn *th, void **handler_mem_ptr);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
@@ -0,0 +1,45 @@
+// Copyright 2020 ETH Zurich
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <stdint.h>
+
+#include "spin_conf.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Layout of the host-visible data block, shared by the PULP runtime and the
+// native backend. Space for it is reserved in link.ld.
+#define MAX_COUNTERS 16
+
+struct perf_counter {
+  uint32_t sum;
+  uint32_t count;
+};
+
+struct host_data {
+  uint64_t flag[CORE_COUNT];
+  struct perf_counter counters[MAX_COUNTERS];
+  // completion ring (see fpspin_ring.h)
+  uint32_t ring_prod;
+  uint32_t ring_cons; // doorbell, written by the host
+};
+extern volatile struct host_data __host_data;
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
@@ -35,6 +35,7 @@
 #define HWSCHED_FLOW_ID              0x1B20504c
 #define HWSCHED_DOORBELL             0x1B205050
 #define HWSCHED_ERROR                0x1B205054
+#define HWSCHED_PKT_L2_SIZE          0x1B205058
 
 #define CMD_ISSUE   0x1B205080
 #define CMD_WAIT    0x1B205084
@@ -47,6 +48,8 @@
 #define CMD_WORD4   0x1B2050A0
 #define CMD_WORD5   0x1B2050A4
 #define CMD_WORD6   0x1B2050A8
+#define CMD_PENDING 0x1B2050AC
+#define CMD_WAIT_SET 0x1B2050B0
 
 #define MMIO_READ(X) (*((uint32_t volatile*) (X)))
 #define MMIO_WRITE(X, V) (*((uint32_t volatile*) (X)) = V)
\ No newline at end of file
@@ -0,0 +1,74 @@
+// Copyright 2020 ETH Zurich
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef L1_ALLOC_H
+#define L1_ALLOC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "spin_conf.h"
+
+// Lock-free allocator for the per-cluster L1 arena reserved by the linker
+// script (__l1_arena_size, set with L1_ARENA_SIZE in the handler Makefile).
+//
+// The arena is split in equal regions, one per size class (16 B to 512 B).
+// Each region has a free bitmap that all HPUs of the cluster share: blocks
+// are claimed with amo_and and returned with amo_or (the L1 AMO unit has no
+// LR/SC). On top of it every HPU keeps a small cache per class, so most
+// allocations and frees touch no shared state. Blocks must be freed on the
+// cluster they were allocated from, by any of its HPUs.
+
+#define L1_ALLOC_MIN_SHIFT 4 // 16 B
+#define L1_ALLOC_NUM_CLASSES 6
+#define L1_ALLOC_MAX_SIZE (1 << (L1_ALLOC_MIN_SHIFT + L1_ALLOC_NUM_CLASSES - 1))
+
+#define L1_ALLOC_MAP_WORDS 4 // at most 128 blocks per class
+#define L1_ALLOC_CACHE_SLOTS 7
+#define L1_ALLOC_BATCH 4 // blocks moved between a cache and the bitmap
+
+typedef struct l1_alloc_cache {
+  uint8_t count;
+  uint8_t idx[L1_ALLOC_CACHE_SLOTS];
+} l1_alloc_cache_t;
+
+typedef struct l1_alloc_class {
+  uint8_t *base;
+  uint32_t num_blocks;
+  uint32_t num_words;
+  volatile uint32_t hint; // bitmap word where the last refill found blocks
+  volatile uint32_t free_map[L1_ALLOC_MAP_WORDS];
+} l1_alloc_class_t;
+
+// Kept at the beginning of the arena
+typedef struct l1_arena {
+  uint8_t *data;
+  uint8_t *end;
+  uint32_t region_size;
+  l1_alloc_class_t classes[L1_ALLOC_NUM_CLASSES];
+  l1_alloc_cache_t caches[NUM_CLUSTER_HPUS][L1_ALLOC_NUM_CLASSES];
+} l1_arena_t;
+
+// Called by the runtime on core 0 of each cluster, before any handler runs
+void l1_alloc_init();
+
+// Returns NULL if size exceeds L1_ALLOC_MAX_SIZE or its class is exhausted
+void *l1_malloc(size_t size);
+
+void l1_free(void *ptr);
+
+// Free blocks of a class in the bitmap (not counting HPU caches)
+uint32_t l1_alloc_free_blocks(uint32_t size_class);
+
+#endif /* L1_ALLOC_H */
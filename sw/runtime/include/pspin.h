@@ -22,6 +22,7 @@
 #include <stdlib.h>
 
 #include "spin_conf.h"
+#include "host_data.h"
 
 #include "pspin_rt.h"
 
@@ -33,19 +34,25 @@
 typedef uint32_t dma_t;
 typedef volatile uint32_t futex_t;
 
-// definition in link.ld
-#define MAX_COUNTERS 16
-
-struct perf_counter {
-  uint32_t sum;
-  uint32_t count;
+// Samples of perf_start()/perf_stop(), one lossy ring per HPU (in L2). A
+// sample is valid if its seq is the index it was read at plus one.
+#define HPU_PERF_SLOTS 32
+
+struct hpu_perf_sample {
+  uint32_t seq;
+  uint32_t tag;
+  uint32_t cycles;
+  uint32_t instret;
+  uint32_t ld_stall; // load-use hazard cycles
+  uint32_t reserved[3];
 };
 
-struct host_data {
-  uint64_t flag[CORE_COUNT];
-  struct perf_counter counters[MAX_COUNTERS];
+struct hpu_perf_ring {
+  uint32_t prod; // samples written so far
+  uint32_t reserved[7];
+  struct hpu_perf_sample samples[HPU_PERF_SLOTS];
 };
-extern volatile struct host_data __host_data;
+extern volatile struct hpu_perf_ring __hpu_perf[CORE_COUNT];
 
 #ifndef NO_PULP
 
@@ -247,6 +254,20 @@ static inline uint32_t cycles() {
   return c;
 }
 
+// Counts cycles, instructions and load-use stalls of the calling HPU until
+// perf_stop(), which appends them to its __hpu_perf ring with the given tag.
+// In the simulator, the same window also gets the TCDM contention and command
+// (DMA) wait cycles, which the core cannot count (see the HPU monitor).
+static inline void perf_start() {
+  uint32_t r;
+  ecall_0(PSPIN_ECALL_PERF_START, r);
+}
+
+static inline void perf_stop(uint32_t tag) {
+  uint32_t r;
+  ecall_1(PSPIN_ECALL_PERF_STOP, tag, r);
+}
+
 static inline void push_counter(volatile struct perf_counter *c, uint32_t dur) {
   amo_add(&c->count, 1);
   amo_add(&c->sum, dur);
@@ -0,0 +1,21 @@
+// Copyright 2020 ETH Zurich
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+// ecall numbers (a7), shared with the trap vector in mtvec.S
+#define PSPIN_ECALL_CYCLES 0x1
+#define PSPIN_ECALL_PERF_START 0x2
+#define PSPIN_ECALL_PERF_STOP 0x3
+#define PSPIN_ECALL_LAST PSPIN_ECALL_PERF_STOP
@@ -20,6 +20,8 @@
 #include <stdint.h>
 #include <stdlib.h>
 
+#include "pspin_ecall.h"
+
 #define PAGE_SIZE 4096
 
 #if RISCV_VERSION >= 4 && !defined(RISCV_1_7)
@@ -35,6 +37,8 @@
 #define PULP_CSR_MSTATUS 0x300
 #define PULP_CSR_MTVEC   0x305
 #define PULP_CSR_MCOUNTINHIBIT 0x320
+#define PULP_CSR_MHPMEVENT3 0x323
+#define PULP_CSR_MHPMCOUNTER3 0xb03
 #define PULP_CSR_MEPC    0x341
 #define PULP_CSR_MCAUSE  0x342
 #define PULP_CSR_MTVAL   0x343
@@ -62,7 +66,6 @@
 #define PULP_CSR_PMPADDR15 0x3bf
 
 // ecalls
-#define PSPIN_ECALL_CYCLES 0x1
 #define ecall(num, a0, a1, a2, a3, a4, a5, a6, ret)                            \
   asm volatile("mv a0,%1; mv a1,%2; mv a2,%3; mv a3,%4; mv a4,%5; mv a5,%6; "  \
                "mv a6,%7; mv a7,%8; ecall; mv %0, a0"                          \
@@ -71,7 +74,12 @@
                  "r"(a6), "r"(num)                                             \
                : "a0", "a1", "a2", "a3", "a4", "a5", "a6", "a7");
 #define ecall_1(num, a0, ret) ecall(num, a0, 0, 0, 0, 0, 0, 0, ret)
-#define ecall_0(num, ret) ecall_1(num, 0, ret)
+// no arguments: only a7 is set (cycles() is served in a few cycles, see mtvec.S)
+#define ecall_0(num, ret)                                                      \
+  asm volatile("li a7,%1; ecall; mv %0, a0"                                    \
+               : "=r"(ret)                                                     \
+               : "i"(num)                                                      \
+               : "a0", "a7");
 
 #ifndef NO_PULP
 static inline uint32_t rt_core_id() { return hal_core_id(); }
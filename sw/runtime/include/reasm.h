@@ -0,0 +1,61 @@
+// Copyright 2020 ETH Zurich
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef REASM_H
+#define REASM_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Out-of-order reassembly of a message from byte ranges. Received data is
+// tracked in a bitmap with one bit per unit of (1 << unit_shift) bytes: a
+// range is marked with amo_or and the newly set bits are added to a
+// completion counter with amo_add, so any number of HPUs can insert
+// concurrently without locks, and exactly one insertion completes the
+// message. Ranges must start at a unit boundary; only the last unit of the
+// message may be partial. Duplicate and overlapping ranges are counted once.
+//
+// The state needs REASM_SIZE(msg_len, unit_shift) bytes, e.g., in the
+// message scratchpad, and is set up by reasm_init() (e.g., in the header
+// handler).
+
+typedef struct reasm {
+  uint32_t msg_len;
+  uint32_t unit_shift;
+  uint32_t num_units;
+  uint32_t num_words;
+  volatile uint32_t received;    // units
+  volatile uint32_t prefix_word; // bitmap words before it are full
+  volatile uint32_t map[];
+} reasm_t;
+
+#define REASM_MAP_WORDS(msg_len, unit_shift)                                   \
+  (((((msg_len) + (1 << (unit_shift)) - 1) >> (unit_shift)) + 31) / 32)
+#define REASM_SIZE(msg_len, unit_shift)                                        \
+  (sizeof(reasm_t) + REASM_MAP_WORDS(msg_len, unit_shift) * sizeof(uint32_t))
+
+void reasm_init(reasm_t *r, uint32_t msg_len, uint32_t unit_shift);
+
+// Marks [offset, offset + len) as received. Returns true if this range
+// completed the message.
+bool reasm_insert(reasm_t *r, uint32_t offset, uint32_t len);
+
+// Bytes received contiguously from the beginning of the message
+uint32_t reasm_prefix(reasm_t *r);
+
+static inline bool reasm_complete(reasm_t *r) {
+  return r->received == r->num_units;
+}
+
+#endif /* REASM_H */
@@ -15,19 +15,21 @@
 #pragma once
 
 /* PULP settings */
+// set by hw/pspin_conf.mk (CORES, CLUSTERS), they have to match the simulation library
 // number of cores per cluster
 #ifndef NB_CORES
 #define NB_CORES 8
 #endif
 
 // number of clusters
-// FIXME: we need to change hpu_driver.sv together with this
-// we only have 2 clusters atm but keeping it as 4
 #ifndef NB_CLUSTERS
 #define NB_CLUSTERS 2
 #endif
 #define CORE_COUNT (NB_CORES * NB_CLUSTERS)
 
+// scratchpads in the task of a handler (hpu_driver.sv)
+#define TASK_SCRATCHPAD_SLOTS 4
+
 /* Packet settings */
 // length of the input packet queue [B]
 // Warning: modify spin_types.h if you increase this size!
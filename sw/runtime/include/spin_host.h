@@ -1,5 +1,6 @@
 #pragma once
 
+#include "fpspin_ring.h"
 #include "spin_conf.h"
 #include <stdint.h>
 typedef struct {
@@ -20,6 +21,7 @@ static_assert(sizeof(fpspin_flag_t) == sizeof(uint64_t),
   (((uint64_t)args->task->host_mem_high << 32) | args->task->host_mem_low)
 #define HOST_ADDR_HPU(args) (HOST_ADDR(args) + HPU_ID(args) * PAGE_SIZE)
 #define HOST_PLD_ADDR(args) (HOST_ADDR_HPU(args) + DMA_ALIGN)
+#define HOST_RING_ADDR(args) (HOST_ADDR(args) + CORE_COUNT * PAGE_SIZE)
 
 #define DMA_BUS_WIDTH 512
 #define DMA_ALIGN (DMA_BUS_WIDTH / 8)
@@ -30,6 +32,26 @@ static inline bool fpspin_check_host_mem(handler_args_t *args) {
   return HOST_ADDR(args) && args->task->host_mem_size >= CORE_COUNT * PAGE_SIZE;
 }
 
+static inline bool fpspin_check_host_ring(handler_args_t *args) {
+  return HOST_ADDR(args) &&
+         args->task->host_mem_size >= CORE_COUNT * PAGE_SIZE + FPSPIN_RING_BYTES;
+}
+
+static inline fpspin_flag_t fpspin_wait_host(handler_args_t *args,
+                                             uint8_t dma_id) {
+  // poll for host finish
+  fpspin_flag_t flag_from_host;
+  do {
+    flag_from_host.data = __host_data.flag[HPU_ID(args)];
+  } while (dma_id != flag_from_host.dma_id);
+
+  if (flag_from_host.hpu_id != HPU_ID(args)) {
+    printf("HPU ID mismatch in response flag!  Got: %lld\n",
+           flag_from_host.hpu_id);
+  }
+  return flag_from_host;
+}
+
 static inline fpspin_flag_t fpspin_host_req(handler_args_t *args, uint32_t len) {
   uint64_t flag_haddr = HOST_ADDR_HPU(args);
   spin_cmd_t dma;
@@ -45,15 +67,32 @@ static inline fpspin_flag_t fpspin_host_req(handler_args_t *args, uint32_t len)
   spin_write_to_host(flag_haddr, flag_to_host.data, &dma);
   spin_cmd_wait(dma);
 
-  // poll for host finish
-  fpspin_flag_t flag_from_host;
-  do {
-    flag_from_host.data = __host_data.flag[HPU_ID(args)];
-  } while (flag_to_host.dma_id != flag_from_host.dma_id);
+  return fpspin_wait_host(args, flag_to_host.dma_id);
+}
 
-  if (flag_from_host.hpu_id != HPU_ID(args)) {
-    printf("HPU ID mismatch in response flag!  Got: %lld\n",
-           flag_from_host.hpu_id);
-  }
-  return flag_from_host;
+// Same as fpspin_host_req, but the request is appended to the shared
+// completion ring instead of the HPU's own page (the payload is still
+// expected at HOST_PLD_ADDR).
+static inline fpspin_flag_t fpspin_ring_host_req(handler_args_t *args,
+                                                 uint32_t len) {
+  spin_cmd_t dma;
+
+  // take a slot and wait for the host to have consumed it
+  uint32_t idx = amo_add((volatile int32_t *)&__host_data.ring_prod, 1);
+  while (idx - __host_data.ring_cons >= FPSPIN_RING_SLOTS)
+    ;
+
+  fpspin_ring_desc_t desc = {
+      .seq = FPSPIN_RING_SEQ(idx),
+      .dma_id = ++dma_idx[args->hpu_id],
+      .hpu_id = HPU_ID(args),
+      .len = len,
+  };
+
+  uint64_t desc_haddr =
+      HOST_RING_ADDR(args) + FPSPIN_RING_SLOT(idx) * sizeof(fpspin_ring_desc_t);
+  spin_write_to_host(desc_haddr, desc.data, &dma);
+  spin_cmd_wait(dma);
+
+  return fpspin_wait_host(args, desc.dma_id);
 }
\ No newline at end of file
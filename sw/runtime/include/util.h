@@ -29,6 +29,7 @@
 #define read_csr(reg, val) asm volatile ("csrr %0, " STRINGIFY(reg) : "=r"(val));
 #define write_csr(reg, val) asm volatile ("csrw " STRINGIFY(reg) ", %0" : : "rK" (val) : "memory");
 #define clear_csr(reg, mask) asm volatile ("csrc " STRINGIFY(reg) ", %0" : : "rK" (mask) : "memory");
+#define set_csr(reg, mask) asm volatile ("csrs " STRINGIFY(reg) ", %0" : : "rK" (mask) : "memory");
 #define read_register(reg, val) asm volatile ("addi %0, " STRINGIFY(reg) ", 0" : "=r"(val));
 #define write_register(reg, val) asm volatile ("addi " STRINGIFY(reg) ", %0, 0" : : "r"(val) : "memory");
 
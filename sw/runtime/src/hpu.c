@@ -14,14 +14,32 @@
 
 #include "hpu.h"
 #include "hwsched.h"
+#include "l1_alloc.h"
 #include "pspin_rt.h"
 #include "spin_conf.h"
 #include "util.h"
 
 #define MSTATUS_USER (3 << 11)
 
+// mhpmcounter3 counts load-use hazards, only between perf_start/perf_stop
+#define HPM_EVENT_LD_STALL (1 << 2)
+#define PERF_COUNTER_MASK (1 << 3)
+
 extern void rt_vec();
 
+// per-HPU exception stacks (L1, cluster alias), defined in link.ld
+extern uint8_t __rt_exc_stack_start, __rt_exc_stack_size;
+
+static inline uint32_t exc_stack_top(uint32_t core_id) {
+  return (uint32_t)&__rt_exc_stack_start +
+         (core_id + 1) * (uint32_t)&__rt_exc_stack_size;
+}
+
+// not loaded: only gives link.ld the size of struct host_data, to check it
+// against the space reserved by __rt_host_data_size
+static const struct host_data __host_data_layout
+    __attribute__((section(".host_data_layout"), used));
+
 typedef struct hpu_descr {
   uint8_t *runtime_sp;
 } hpu_descr_t;
@@ -33,6 +51,16 @@ hpu_descr_t *volatile hpu_descr[NUM_CLUSTER_HPUS];
 volatile __attribute__((section(".data_tiny_l1")))
 uint8_t dma_idx[NUM_CLUSTER_HPUS];
 
+typedef struct perf_window {
+  uint32_t cycles;
+  uint32_t instret;
+} perf_window_t;
+
+volatile __attribute__((section(".data_tiny_l1")))
+perf_window_t perf_window[NUM_CLUSTER_HPUS];
+
+volatile struct hpu_perf_ring __hpu_perf[CORE_COUNT];
+
 void hpu_run() {
   handler_args_t handler_args;
 
@@ -88,11 +116,16 @@ void hpu_entry() {
   uint32_t counter_mask;
   read_csr(PULP_CSR_MCOUNTINHIBIT, counter_mask);
   counter_mask &= ~0b101; // MCYCLE & MINSTRET
+  counter_mask |= PERF_COUNTER_MASK;
   write_csr(PULP_CSR_MCOUNTINHIBIT, counter_mask);
 
+  uint32_t perf_event = HPM_EVENT_LD_STALL;
+  write_csr(PULP_CSR_MHPMEVENT3, perf_event);
+
   clear_csr(PULP_CSR_MSTATUS, MSTATUS_USER);
   write_csr(PULP_CSR_MEPC, hpu_run);
 
+  write_csr(mscratch, exc_stack_top(core_id));
   write_csr(PULP_CSR_MTVEC, rt_vec);
 
   // after exception handler so we can catch errors in user init
@@ -106,6 +139,15 @@ void hpu_entry() {
       __host_data.counters[i].count = 0;
       __host_data.counters[i].sum = 0;
     }
+
+    __host_data.ring_prod = 0;
+    __host_data.ring_cons = 0;
+  }
+
+  __hpu_perf[cluster_id * NB_CORES + core_id].prod = 0;
+
+  if (core_id == 0) {
+    l1_alloc_init();
   }
 
   /*
@@ -133,6 +175,39 @@ void hpu_entry() {
 
 #define handler_error(msg) printf("TRAP @ %#x: " msg "\n", mepc)
 
+static void perf_window_start() {
+  volatile perf_window_t *w = &perf_window[rt_core_id()];
+  uint32_t zero = 0;
+
+  write_csr(PULP_CSR_MHPMCOUNTER3, zero);
+  read_csr(minstret, w->instret);
+  read_csr(mcycle, w->cycles);
+  clear_csr(PULP_CSR_MCOUNTINHIBIT, PERF_COUNTER_MASK);
+}
+
+static void perf_window_stop(uint32_t tag) {
+  uint32_t cycles, instret, ld_stall;
+
+  set_csr(PULP_CSR_MCOUNTINHIBIT, PERF_COUNTER_MASK);
+  read_csr(mcycle, cycles);
+  read_csr(minstret, instret);
+  read_csr(PULP_CSR_MHPMCOUNTER3, ld_stall);
+
+  uint32_t core_id = rt_core_id();
+  volatile perf_window_t *w = &perf_window[core_id];
+  volatile struct hpu_perf_ring *ring =
+      &__hpu_perf[rt_cluster_id() * NB_CORES + core_id];
+  uint32_t idx = ring->prod;
+  volatile struct hpu_perf_sample *s = &ring->samples[idx % HPU_PERF_SLOTS];
+
+  s->tag = tag;
+  s->cycles = cycles - w->cycles;
+  s->instret = instret - w->instret;
+  s->ld_stall = ld_stall;
+  s->seq = idx + 1;
+  ring->prod = idx + 1;
+}
+
 typedef struct {
   uint32_t ra;
   // not saving: sp, gp, tp
@@ -172,7 +247,8 @@ void dump_regs(volatile saved_regs_t *a) {
   printf("s11=0x%08x\n", a->s11);
 }
 
-void int0_handler() {
+// saved_regs: save area of rt_vec (only caller-saved registers for ecalls)
+void int0_handler(volatile saved_regs_t *saved_regs) {
   uint32_t mcause, mepc;
   read_csr(PULP_CSR_MCAUSE, mcause);
   read_csr(PULP_CSR_MEPC, mepc);
@@ -180,19 +256,23 @@ void int0_handler() {
 
   // force earlier check of syscall (fastpath)
   if (__builtin_expect(mcause, 8) == 8) {
-    // get saved area
-    uint32_t saved;
-    read_csr(mscratch, saved);
-    volatile saved_regs_t *saved_regs = (saved_regs_t *)saved;
     bool handled = false;
 
     // printf("Ecall: %d @ %#x\n", saved_regs->a7, mepc);
     // dump_regs(saved_regs);
     switch (saved_regs->a7) {
-    case PSPIN_ECALL_CYCLES:
+    case PSPIN_ECALL_CYCLES: // normally served by rt_vec
       read_csr(mcycle, saved_regs->a0);
       handled = true;
       break;
+    case PSPIN_ECALL_PERF_START:
+      perf_window_start();
+      handled = true;
+      break;
+    case PSPIN_ECALL_PERF_STOP:
+      perf_window_stop(saved_regs->a0);
+      handled = true;
+      break;
     default:
       handler_error("Unknown ecall number");
     }
@@ -226,9 +306,6 @@ void int0_handler() {
     }
 
   // diagnostics
-  uint32_t saved;
-  read_csr(mscratch, saved);
-  volatile saved_regs_t *saved_regs = (saved_regs_t *)saved;
   dump_regs(saved_regs);
   for (;;)
     ;
@@ -236,8 +313,10 @@ void int0_handler() {
   MMIO_WRITE(HWSCHED_ERROR, mcause);
   MMIO_READ(HWSCHED_DOORBELL);
 
-  // restore the stack pointer
+  // restore the stack pointer (and the exception stack, as rt_vec does not
+  // swap it back)
   write_register(x2, hpu_descr[rt_core_id()]);
+  write_csr(mscratch, exc_stack_top(rt_core_id()));
 
   // we want to resume the runtime and get ready
   // for the next handler
@@ -0,0 +1,155 @@
+// Copyright 2020 ETH Zurich
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "l1_alloc.h"
+#include "pspin.h"
+#include "util.h"
+
+// defined in link.ld (cluster alias, so every cluster has its own arena)
+extern uint8_t __l1_arena_start, __l1_arena_end;
+
+#define ARENA ((l1_arena_t *)&__l1_arena_start)
+
+static inline uint32_t class_of(size_t size) {
+  if (size <= (1 << L1_ALLOC_MIN_SHIFT))
+    return 0;
+  return 32 - __builtin_clz(size - 1) - L1_ALLOC_MIN_SHIFT;
+}
+
+void l1_alloc_init() {
+  l1_arena_t *arena = ARENA;
+  arena->data = (uint8_t *)ALIGN_UP(&__l1_arena_start + sizeof(l1_arena_t),
+                                    1 << L1_ALLOC_MIN_SHIFT);
+  arena->end = &__l1_arena_end;
+  arena->region_size = 0;
+  if (arena->end > arena->data) {
+    arena->region_size = ((arena->end - arena->data) / L1_ALLOC_NUM_CLASSES) &
+                         ~((1 << L1_ALLOC_MIN_SHIFT) - 1);
+  }
+
+  for (int c = 0; c < L1_ALLOC_NUM_CLASSES; ++c) {
+    l1_alloc_class_t *cls = &arena->classes[c];
+    uint32_t blocks = arena->region_size >> (L1_ALLOC_MIN_SHIFT + c);
+
+    cls->base = arena->data + c * arena->region_size;
+    cls->num_blocks = MIN(blocks, L1_ALLOC_MAP_WORDS * 32);
+    cls->num_words = DIV_CEIL(cls->num_blocks, 32);
+    cls->hint = 0;
+
+    for (int w = 0; w < L1_ALLOC_MAP_WORDS; ++w) {
+      uint32_t first = w * 32;
+      if (first >= cls->num_blocks)
+        cls->free_map[w] = 0;
+      else if (cls->num_blocks - first >= 32)
+        cls->free_map[w] = 0xffffffff;
+      else
+        cls->free_map[w] = (1u << (cls->num_blocks - first)) - 1;
+    }
+  }
+
+  for (int h = 0; h < NUM_CLUSTER_HPUS; ++h)
+    for (int c = 0; c < L1_ALLOC_NUM_CLASSES; ++c)
+      arena->caches[h][c].count = 0;
+}
+
+// Claims up to L1_ALLOC_BATCH blocks from the bitmap. A claim only takes the
+// bits that were still set, so a failed race costs one more amo_and.
+static void refill(l1_alloc_class_t *cls, l1_alloc_cache_t *cache) {
+  uint32_t hint = cls->hint;
+
+  for (uint32_t i = 0; i < cls->num_words; ++i) {
+    uint32_t w = (hint + i) % cls->num_words;
+    uint32_t avail = cls->free_map[w];
+
+    while (avail != 0 && cache->count < L1_ALLOC_BATCH) {
+      uint32_t mask = 0;
+      for (uint32_t n = cache->count; n < L1_ALLOC_BATCH && avail != 0; ++n) {
+        mask |= avail & -avail;
+        avail &= avail - 1;
+      }
+
+      uint32_t old = amo_and(&cls->free_map[w], ~mask);
+      uint32_t mine = old & mask;
+      avail = old & ~mask;
+
+      while (mine != 0) {
+        cache->idx[cache->count++] = w * 32 + __builtin_ctz(mine);
+        mine &= mine - 1;
+      }
+    }
+
+    if (cache->count > 0) {
+      cls->hint = w;
+      return;
+    }
+  }
+}
+
+// Returns the L1_ALLOC_BATCH least recently freed blocks to the bitmap
+static void flush(l1_alloc_class_t *cls, l1_alloc_cache_t *cache) {
+  for (int i = 0; i < L1_ALLOC_BATCH; ++i) {
+    uint32_t idx = cache->idx[i];
+    amo_or(&cls->free_map[idx / 32], 1u << (idx % 32));
+  }
+
+  for (int i = L1_ALLOC_BATCH; i < cache->count; ++i)
+    cache->idx[i - L1_ALLOC_BATCH] = cache->idx[i];
+  cache->count -= L1_ALLOC_BATCH;
+}
+
+void *l1_malloc(size_t size) {
+  if (size > L1_ALLOC_MAX_SIZE)
+    return NULL;
+
+  l1_arena_t *arena = ARENA;
+  uint32_t c = class_of(size);
+  l1_alloc_class_t *cls = &arena->classes[c];
+  l1_alloc_cache_t *cache = &arena->caches[user_core_id()][c];
+
+  if (cache->count == 0) {
+    refill(cls, cache);
+    if (cache->count == 0)
+      return NULL;
+  }
+
+  uint32_t idx = cache->idx[--cache->count];
+  return cls->base + (idx << (L1_ALLOC_MIN_SHIFT + c));
+}
+
+void l1_free(void *ptr) {
+  if (ptr == NULL)
+    return;
+
+  l1_arena_t *arena = ARENA;
+  ASSERT((uint8_t *)ptr >= arena->data && (uint8_t *)ptr < arena->end);
+
+  uint32_t offset = (uint8_t *)ptr - arena->data;
+  uint32_t c = offset / arena->region_size;
+  l1_alloc_class_t *cls = &arena->classes[c];
+  l1_alloc_cache_t *cache = &arena->caches[user_core_id()][c];
+
+  if (cache->count == L1_ALLOC_CACHE_SLOTS)
+    flush(cls, cache);
+
+  cache->idx[cache->count++] =
+      (offset - c * arena->region_size) >> (L1_ALLOC_MIN_SHIFT + c);
+}
+
+uint32_t l1_alloc_free_blocks(uint32_t size_class) {
+  l1_alloc_class_t *cls = &ARENA->classes[size_class];
+  uint32_t free = 0;
+  for (uint32_t w = 0; w < cls->num_words; ++w)
+    free += __builtin_popcount(cls->free_map[w]);
+  return free;
+}
@@ -0,0 +1,77 @@
+// Copyright 2020 ETH Zurich
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "reasm.h"
+#include "pspin.h"
+#include "util.h"
+
+void reasm_init(reasm_t *r, uint32_t msg_len, uint32_t unit_shift) {
+  r->msg_len = msg_len;
+  r->unit_shift = unit_shift;
+  r->num_units = DIV_CEIL(msg_len, 1 << unit_shift);
+  r->num_words = REASM_MAP_WORDS(msg_len, unit_shift);
+  r->received = 0;
+  r->prefix_word = 0;
+
+  for (uint32_t w = 0; w < r->num_words; ++w)
+    r->map[w] = 0;
+
+  // bits past the end are set, so that the prefix search stops at the end
+  if (r->num_units % 32 != 0)
+    r->map[r->num_words - 1] = ~((1u << (r->num_units % 32)) - 1);
+}
+
+bool reasm_insert(reasm_t *r, uint32_t offset, uint32_t len) {
+  if (len == 0 || offset >= r->msg_len)
+    return false;
+
+  uint32_t end = MIN(offset + len, r->msg_len);
+  uint32_t first = offset >> r->unit_shift;
+  uint32_t last = (end - 1) >> r->unit_shift;
+  uint32_t added = 0;
+
+  for (uint32_t w = first / 32; w <= last / 32; ++w) {
+    uint32_t lo = (w == first / 32) ? first % 32 : 0;
+    uint32_t hi = (w == last / 32) ? last % 32 : 31;
+    uint32_t mask = (0xffffffff >> (31 - hi)) & (0xffffffff << lo);
+
+    uint32_t old = amo_or(&r->map[w], mask);
+    added += __builtin_popcount(mask & ~old);
+  }
+
+  if (added == 0)
+    return false;
+
+  return amo_add((volatile int32_t *)&r->received, added) + added ==
+         r->num_units;
+}
+
+uint32_t reasm_prefix(reasm_t *r) {
+  uint32_t start = r->prefix_word;
+  uint32_t w = start;
+
+  while (w < r->num_words && r->map[w] == 0xffffffff)
+    w++;
+
+  // other HPUs may have moved it further already
+  if (w > start)
+    amo_maxu(&r->prefix_word, w);
+
+  if (w == r->num_words)
+    return r->msg_len;
+
+  uint32_t units = w * 32 + __builtin_ctz(~r->map[w]);
+  return MIN(units << r->unit_shift, r->msg_len);
+}